@@ -50,6 +50,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "clientmap.h"
 #include "clientmedia.h"
 #include "version.h"
+#include "database/database-files.h"
 #include "database/database-sqlite3.h"
 #include "serialization.h"
 #include "guiscalingfilter.h"
@@ -151,6 +152,9 @@ void Client::loadMods()
 		return;
 	}
 
+	m_mod_storage_database.reset(new ModMetadataDatabaseFiles(
+		porting::path_user + DIR_DELIM + "client" + DIR_DELIM + "mod_storage"));
+
 	m_script = new ClientScripting(this);
 	m_env.setScript(m_script);
 	m_script->setEnv(&m_env);
@@ -649,12 +653,15 @@ void Client::step(float dtime)
 		for (std::unordered_map<std::string, ModMetadata *>::const_iterator
 				it = m_mod_storages.begin(); it != m_mod_storages.end(); ++it) {
 			if (it->second->isModified()) {
-				it->second->save(getModStoragePath());
-				n++;
+				if (n++ == 0)
+					m_mod_storage_database->beginSave();
+				it->second->save();
 			}
 		}
-		if (n > 0)
+		if (n > 0) {
+			m_mod_storage_database->endSave();
 			infostream << "Saved " << n << " modified mod storages." << std::endl;
+		}
 	}
 
 	// Write server map
@@ -1982,16 +1989,15 @@ void Client::unregisterModStorage(const std::string &name)
 	std::unordered_map<std::string, ModMetadata *>::const_iterator it =
 		m_mod_storages.find(name);
 	if (it != m_mod_storages.end()) {
-		// Save unconditionaly on unregistration
-		it->second->save(getModStoragePath());
+		if (it->second->isModified()) {
+			m_mod_storage_database->beginSave();
+			it->second->save();
+			m_mod_storage_database->endSave();
+		}
 		m_mod_storages.erase(name);
 	}
 }
 
-std::string Client::getModStoragePath() const
-{
-	return porting::path_user + DIR_DELIM + "client" + DIR_DELIM + "mod_storage";
-}
 
 /*
  * Mod channels
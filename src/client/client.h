@@ -371,7 +371,8 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	virtual scene::IAnimatedMesh* getMesh(const std::string &filename, bool cache = false);
 	const std::string* getModFile(std::string filename);
 
-	std::string getModStoragePath() const override;
+	ModMetadataDatabase *getModStorageDatabase() override
+	{ return m_mod_storage_database.get(); }
 	bool registerModStorage(ModMetadata *meta) override;
 	void unregisterModStorage(const std::string &name) override;
 
@@ -588,6 +589,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	// Client modding
 	ClientScripting *m_script = nullptr;
 	bool m_modding_enabled;
+	std::unique_ptr<ModMetadataDatabase> m_mod_storage_database;
 	std::unordered_map<std::string, ModMetadata *> m_mod_storages;
 	float m_mod_storage_save_timer = 10.0f;
 	std::vector<ModSpec> m_mods;
@@ -63,6 +63,8 @@ Clouds::Clouds(scene::ISceneManager* mgr,
 	m_params.color_ambient = video::SColor(255, 0, 0, 0);
 	m_params.speed         = v2f(0.0f, -2.0f);
 
+	m_mesh = new scene::SMesh();
+
 	readSettings();
 	g_settings->registerChangedCallback("enable_3d_clouds",
 		&cloud_3d_setting_changed, this);
@@ -74,6 +76,10 @@ Clouds::~Clouds()
 {
 	g_settings->deregisterChangedCallback("enable_3d_clouds",
 		&cloud_3d_setting_changed, this);
+
+	// The scene manager may already be gone, the video driver frees the
+	// hardware buffers that are no longer used by itself
+	m_mesh->drop();
 }
 
 void Clouds::OnRegisterSceneNode()
@@ -101,13 +107,8 @@ void Clouds::render()
 
 	ScopeProfiler sp(g_profiler, "Clouds::render()", SPT_AVG);
 
-	int num_faces_to_draw = m_enable_3d ? 6 : 1;
-
 	m_material.setFlag(video::EMF_BACK_FACE_CULLING, m_enable_3d);
 
-	driver->setTransform(video::ETS_WORLD, AbsoluteTransformation);
-	driver->setMaterial(m_material);
-
 	/*
 		Clouds move from Z+ towards Z-
 	*/
@@ -131,6 +132,49 @@ void Clouds::render()
 		center_of_drawing_in_noise_i.Y * cloud_size
 	) + m_origin;
 
+	// The mesh only changes when the clouds scroll by a whole cell
+	if (!m_mesh_valid || center_of_drawing_in_noise_i != m_mesh_center)
+		updateMesh(center_of_drawing_in_noise_i);
+	else if (m_color.toSColor() != m_mesh_color)
+		updateMeshColors();
+
+	// The mesh is built around the center cell, move it there
+	core::matrix4 translation;
+	translation.setTranslation(v3f(world_center_of_drawing_in_noise_f.X,
+		m_params.height * BS, world_center_of_drawing_in_noise_f.Y) -
+		intToFloat(m_camera_offset, BS));
+	driver->setTransform(video::ETS_WORLD, translation);
+	driver->setMaterial(m_material);
+
+	// Get fog parameters for setting them back later
+	video::SColor fog_color(0,0,0,0);
+	video::E_FOG_TYPE fog_type = video::EFT_FOG_LINEAR;
+	f32 fog_start = 0;
+	f32 fog_end = 0;
+	f32 fog_density = 0;
+	bool fog_pixelfog = false;
+	bool fog_rangefog = false;
+	driver->getFog(fog_color, fog_type, fog_start, fog_end, fog_density,
+			fog_pixelfog, fog_rangefog);
+
+	// Set our own fog
+	driver->setFog(fog_color, fog_type, cloud_full_radius * 0.5,
+			cloud_full_radius*1.2, fog_density, fog_pixelfog, fog_rangefog);
+
+	for (u32 i = 0; i < m_mesh->getMeshBufferCount(); i++)
+		driver->drawMeshBuffer(m_mesh->getMeshBuffer(i));
+
+	// Restore fog settings
+	driver->setFog(fog_color, fog_type, fog_start, fog_end, fog_density,
+			fog_pixelfog, fog_rangefog);
+}
+
+// The most faces whose vertices can be indexed with 16 bits
+#define CLOUD_MAX_FACES_PER_BUFFER 0x4000
+
+void Clouds::getFaceColors(video::SColor *c_top, video::SColor *c_side_1,
+		video::SColor *c_side_2, video::SColor *c_bottom) const
+{
 	/*video::SColor c_top(128,b*240,b*240,b*255);
 	video::SColor c_side_1(128,b*230,b*230,b*255);
 	video::SColor c_side_2(128,b*220,b*220,b*245);
@@ -148,25 +192,31 @@ void Clouds::render()
 	c_bottom_f.r *= 0.80;
 	c_bottom_f.g *= 0.80;
 	c_bottom_f.b *= 0.80;
-	video::SColor c_top = c_top_f.toSColor();
-	video::SColor c_side_1 = c_side_1_f.toSColor();
-	video::SColor c_side_2 = c_side_2_f.toSColor();
-	video::SColor c_bottom = c_bottom_f.toSColor();
+	*c_top = c_top_f.toSColor();
+	*c_side_1 = c_side_1_f.toSColor();
+	*c_side_2 = c_side_2_f.toSColor();
+	*c_bottom = c_bottom_f.toSColor();
+}
 
-	// Get fog parameters for setting them back later
-	video::SColor fog_color(0,0,0,0);
-	video::E_FOG_TYPE fog_type = video::EFT_FOG_LINEAR;
-	f32 fog_start = 0;
-	f32 fog_end = 0;
-	f32 fog_density = 0;
-	bool fog_pixelfog = false;
-	bool fog_rangefog = false;
-	driver->getFog(fog_color, fog_type, fog_start, fog_end, fog_density,
-			fog_pixelfog, fog_rangefog);
+void Clouds::clearMesh()
+{
+	video::IVideoDriver *driver = SceneManager->getVideoDriver();
+	for (u32 i = 0; i < m_mesh->getMeshBufferCount(); i++)
+		driver->removeHardwareBuffer(m_mesh->getMeshBuffer(i));
+	m_mesh->clear();
+	m_mesh_valid = false;
+}
 
-	// Set our own fog
-	driver->setFog(fog_color, fog_type, cloud_full_radius * 0.5,
-			cloud_full_radius*1.2, fog_density, fog_pixelfog, fog_rangefog);
+void Clouds::updateMesh(v2s16 center_of_drawing_in_noise_i)
+{
+	ScopeProfiler sp(g_profiler, "Clouds::updateMesh()", SPT_AVG);
+
+	clearMesh();
+
+	int num_faces_to_draw = m_enable_3d ? 6 : 1;
+
+	video::SColor c_top, c_side_1, c_side_2, c_bottom;
+	getFaceColors(&c_top, &c_side_1, &c_side_2, &c_bottom);
 
 	// Read noise
 
@@ -190,6 +240,8 @@ void Clouds::render()
 #define INAREA(x, z, radius) \
 	((x) >= -(radius) && (x) < (radius) && (z) >= -(radius) && (z) < (radius))
 
+	std::vector<video::S3DVertex> vertices;
+
 	for (s16 zi0= -m_cloud_radius_i; zi0 < m_cloud_radius_i; zi0++)
 	for (s16 xi0= -m_cloud_radius_i; xi0 < m_cloud_radius_i; xi0++)
 	{
@@ -211,7 +263,8 @@ void Clouds::render()
 		if (!grid[i])
 			continue;
 
-		v2f p0 = v2f(xi,zi)*cloud_size + world_center_of_drawing_in_noise_f;
+		// Relative to the center cell, see render()
+		v2f p0 = v2f(xi,zi)*cloud_size;
 
 		video::S3DVertex v[4] = {
 			video::S3DVertex(0,0,0, 0,0,0, c_top, 0, 1),
@@ -317,22 +370,65 @@ void Clouds::render()
 				break;
 			}
 
-			v3f pos(p0.X, m_params.height * BS, p0.Y);
-			pos -= intToFloat(m_camera_offset, BS);
+			v3f pos(p0.X, 0.0f, p0.Y);
 
-			for (video::S3DVertex &vertex : v)
+			for (video::S3DVertex vertex : v) {
 				vertex.Pos += pos;
-			u16 indices[] = {0,1,2,2,3,0};
-			driver->drawVertexPrimitiveList(v, 4, indices, 2,
-					video::EVT_STANDARD, scene::EPT_TRIANGLES, video::EIT_16BIT);
+				vertices.push_back(vertex);
+			}
 		}
 	}
 
 	delete[] grid;
 
-	// Restore fog settings
-	driver->setFog(fog_color, fog_type, fog_start, fog_end, fog_density,
-			fog_pixelfog, fog_rangefog);
+	// Split into buffers that can be indexed with 16 bits, keeping the order
+	u32 face_count = vertices.size() / 4;
+	std::vector<u16> indices;
+	for (u32 first = 0; first < face_count; first += CLOUD_MAX_FACES_PER_BUFFER) {
+		u32 count = MYMIN(face_count - first, CLOUD_MAX_FACES_PER_BUFFER);
+		indices.clear();
+		for (u32 i = 0; i < count; i++) {
+			u16 k = i * 4;
+			for (u16 index : {0, 1, 2, 2, 3, 0})
+				indices.push_back(k + index);
+		}
+
+		scene::SMeshBuffer *buf = new scene::SMeshBuffer();
+		buf->append(&vertices[first * 4], count * 4, &indices[0], count * 6);
+		m_mesh->addMeshBuffer(buf);
+		buf->drop();
+	}
+	m_mesh->setHardwareMappingHint(scene::EHM_STATIC);
+
+	m_mesh_center = center_of_drawing_in_noise_i;
+	m_mesh_color = c_top;
+	m_mesh_valid = true;
+}
+
+void Clouds::updateMeshColors()
+{
+	video::SColor c_top, c_side_1, c_side_2, c_bottom;
+	getFaceColors(&c_top, &c_side_1, &c_side_2, &c_bottom);
+
+	// The faces are told apart by their normals
+	for (u32 i = 0; i < m_mesh->getMeshBufferCount(); i++) {
+		scene::IMeshBuffer *buf = m_mesh->getMeshBuffer(i);
+		video::S3DVertex *vertices = (video::S3DVertex *)buf->getVertices();
+		for (u32 j = 0; j < buf->getVertexCount(); j++) {
+			video::S3DVertex &vertex = vertices[j];
+			if (vertex.Normal.Y > 0.0f)
+				vertex.Color = c_top;
+			else if (vertex.Normal.Y < 0.0f)
+				vertex.Color = c_bottom;
+			else if (vertex.Normal.Z != 0.0f)
+				vertex.Color = c_side_1;
+			else
+				vertex.Color = c_side_2;
+		}
+		buf->setDirty(scene::EBT_VERTEX);
+	}
+
+	m_mesh_color = c_top;
 }
 
 void Clouds::step(float dtime)
@@ -370,6 +466,7 @@ void Clouds::readSettings()
 {
 	m_cloud_radius_i = g_settings->getU16("cloud_radius");
 	m_enable_3d = g_settings->getBool("enable_3d_clouds");
+	m_mesh_valid = false;
 }
 
 bool Clouds::gridFilled(int x, int y) const
@@ -83,8 +83,11 @@ class Clouds : public scene::ISceneNode
 
 	void setDensity(float density)
 	{
+		if (m_params.density == density)
+			return;
 		m_params.density = density;
 		// currently does not need bounding
+		m_mesh_valid = false;
 	}
 
 	void setColorBright(const video::SColor &color_bright)
@@ -110,8 +113,11 @@ class Clouds : public scene::ISceneNode
 
 	void setThickness(float thickness)
 	{
+		if (m_params.thickness == thickness)
+			return;
 		m_params.thickness = thickness;
 		updateBox();
+		m_mesh_valid = false;
 	}
 
 	bool isCameraInsideCloud() const { return m_camera_inside_cloud; }
@@ -129,7 +135,20 @@ class Clouds : public scene::ISceneNode
 
 	bool gridFilled(int x, int y) const;
 
+	void getFaceColors(video::SColor *c_top, video::SColor *c_side_1,
+			video::SColor *c_side_2, video::SColor *c_bottom) const;
+	void clearMesh();
+	// Builds the faces of the cells around the center, relative to it
+	void updateMesh(v2s16 center_of_drawing_in_noise_i);
+	void updateMeshColors();
+
 	video::SMaterial m_material;
+	scene::SMesh *m_mesh;
+	// The cloud grid cell at the center of m_mesh
+	v2s16 m_mesh_center;
+	// Color of the top faces in m_mesh
+	video::SColor m_mesh_color;
+	bool m_mesh_valid = false;
 	aabb3f m_box;
 	u16 m_cloud_radius_i;
 	bool m_enable_3d;
@@ -0,0 +1,497 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "imagekernels.h"
+#include <cassert>
+#include <cstring>
+
+/*
+	Calculate the color of a single pixel drawn on top of another pixel.
+
+	This is a little more complicated than just video::SColor::getInterpolated
+	because getInterpolated does not handle alpha correctly.  For example, a
+	pixel with alpha=64 drawn atop a pixel with alpha=128 should yield a
+	pixel with alpha=160, while getInterpolated would yield alpha=96.
+*/
+static inline video::SColor blitPixel(const video::SColor &src_c, const video::SColor &dst_c, u32 ratio)
+{
+	if (dst_c.getAlpha() == 0)
+		return src_c;
+	video::SColor out_c = src_c.getInterpolated(dst_c, (float)ratio / 255.0f);
+	out_c.setAlpha(dst_c.getAlpha() + (255 - dst_c.getAlpha()) *
+		src_c.getAlpha() * ratio / (255 * 255));
+	return out_c;
+}
+
+/*
+	Draw an image on top of an another one, using the alpha channel of the
+	source image
+
+	This exists because IImage::copyToWithAlpha() doesn't seem to always
+	work.
+*/
+void blit_with_alpha_generic(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size)
+{
+	for (u32 y0=0; y0<size.Y; y0++)
+	for (u32 x0=0; x0<size.X; x0++)
+	{
+		s32 src_x = src_pos.X + x0;
+		s32 src_y = src_pos.Y + y0;
+		s32 dst_x = dst_pos.X + x0;
+		s32 dst_y = dst_pos.Y + y0;
+		video::SColor src_c = src->getPixel(src_x, src_y);
+		video::SColor dst_c = dst->getPixel(dst_x, dst_y);
+		dst_c = blitPixel(src_c, dst_c, src_c.getAlpha());
+		dst->setPixel(dst_x, dst_y, dst_c);
+	}
+}
+
+/*
+	Draw an image on top of an another one, using the alpha channel of the
+	source image; only modify fully opaque pixels in destinaion
+*/
+void blit_with_alpha_overlay_generic(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size)
+{
+	for (u32 y0=0; y0<size.Y; y0++)
+	for (u32 x0=0; x0<size.X; x0++)
+	{
+		s32 src_x = src_pos.X + x0;
+		s32 src_y = src_pos.Y + y0;
+		s32 dst_x = dst_pos.X + x0;
+		s32 dst_y = dst_pos.Y + y0;
+		video::SColor src_c = src->getPixel(src_x, src_y);
+		video::SColor dst_c = dst->getPixel(dst_x, dst_y);
+		if (dst_c.getAlpha() == 255 && src_c.getAlpha() != 0)
+		{
+			dst_c = blitPixel(src_c, dst_c, src_c.getAlpha());
+			dst->setPixel(dst_x, dst_y, dst_c);
+		}
+	}
+}
+
+// This function has been disabled because it is currently unused.
+// Feel free to re-enable if you find it handy.
+#if 0
+/*
+	Draw an image on top of an another one, using the specified ratio
+	modify all partially-opaque pixels in the destination.
+*/
+static void blit_with_interpolate_overlay(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size, int ratio)
+{
+	for (u32 y0 = 0; y0 < size.Y; y0++)
+	for (u32 x0 = 0; x0 < size.X; x0++)
+	{
+		s32 src_x = src_pos.X + x0;
+		s32 src_y = src_pos.Y + y0;
+		s32 dst_x = dst_pos.X + x0;
+		s32 dst_y = dst_pos.Y + y0;
+		video::SColor src_c = src->getPixel(src_x, src_y);
+		video::SColor dst_c = dst->getPixel(dst_x, dst_y);
+		if (dst_c.getAlpha() > 0 && src_c.getAlpha() != 0)
+		{
+			if (ratio == -1)
+				dst_c = src_c.getInterpolated(dst_c, (float)src_c.getAlpha()/255.0f);
+			else
+				dst_c = src_c.getInterpolated(dst_c, (float)ratio/255.0f);
+			dst->setPixel(dst_x, dst_y, dst_c);
+		}
+	}
+}
+#endif
+
+/*
+	Apply color to destination
+*/
+void apply_colorize_generic(video::IImage *dst, v2u32 dst_pos, v2u32 size,
+		const video::SColor &color, int ratio, bool keep_alpha)
+{
+	u32 alpha = color.getAlpha();
+	video::SColor dst_c;
+	if ((ratio == -1 && alpha == 255) || ratio == 255) { // full replacement of color
+		if (keep_alpha) { // replace the color with alpha = dest alpha * color alpha
+			dst_c = color;
+			for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
+			for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++) {
+				u32 dst_alpha = dst->getPixel(x, y).getAlpha();
+				if (dst_alpha > 0) {
+					dst_c.setAlpha(dst_alpha * alpha / 255);
+					dst->setPixel(x, y, dst_c);
+				}
+			}
+		} else { // replace the color including the alpha
+			for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
+			for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++)
+				if (dst->getPixel(x, y).getAlpha() > 0)
+					dst->setPixel(x, y, color);
+		}
+	} else {  // interpolate between the color and destination
+		float interp = (ratio == -1 ? color.getAlpha() / 255.0f : ratio / 255.0f);
+		for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
+		for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++) {
+			dst_c = dst->getPixel(x, y);
+			if (dst_c.getAlpha() > 0) {
+				dst_c = color.getInterpolated(dst_c, interp);
+				dst->setPixel(x, y, dst_c);
+			}
+		}
+	}
+}
+
+/*
+	Apply color to destination
+*/
+void apply_multiplication_generic(video::IImage *dst, v2u32 dst_pos, v2u32 size,
+		const video::SColor &color)
+{
+	video::SColor dst_c;
+
+	for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
+	for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++) {
+		dst_c = dst->getPixel(x, y);
+		dst_c.set(
+				dst_c.getAlpha(),
+				(dst_c.getRed() * color.getRed()) / 255,
+				(dst_c.getGreen() * color.getGreen()) / 255,
+				(dst_c.getBlue() * color.getBlue()) / 255
+				);
+		dst->setPixel(x, y, dst_c);
+	}
+}
+
+/*
+	Apply mask to destination
+*/
+void apply_mask_generic(video::IImage *mask, video::IImage *dst,
+		v2s32 mask_pos, v2s32 dst_pos, v2u32 size)
+{
+	for (u32 y0 = 0; y0 < size.Y; y0++) {
+		for (u32 x0 = 0; x0 < size.X; x0++) {
+			s32 mask_x = x0 + mask_pos.X;
+			s32 mask_y = y0 + mask_pos.Y;
+			s32 dst_x = x0 + dst_pos.X;
+			s32 dst_y = y0 + dst_pos.Y;
+			video::SColor mask_c = mask->getPixel(mask_x, mask_y);
+			video::SColor dst_c = dst->getPixel(dst_x, dst_y);
+			dst_c.color &= mask_c.color;
+			dst->setPixel(dst_x, dst_y, dst_c);
+		}
+	}
+}
+
+void brighten_generic(video::IImage *image)
+{
+	if (image == NULL)
+		return;
+
+	core::dimension2d<u32> dim = image->getDimension();
+
+	for (u32 y=0; y<dim.Height; y++)
+	for (u32 x=0; x<dim.Width; x++)
+	{
+		video::SColor c = image->getPixel(x,y);
+		c.setRed(0.5 * 255 + 0.5 * (float)c.getRed());
+		c.setGreen(0.5 * 255 + 0.5 * (float)c.getGreen());
+		c.setBlue(0.5 * 255 + 0.5 * (float)c.getBlue());
+		image->setPixel(x,y,c);
+	}
+}
+
+core::dimension2d<u32> imageTransformDimension(u32 transform, core::dimension2d<u32> dim)
+{
+	if (transform % 2 == 0)
+		return dim;
+
+	return core::dimension2d<u32>(dim.Height, dim.Width);
+}
+
+void imageTransform_generic(u32 transform, video::IImage *src, video::IImage *dst)
+{
+	if (src == NULL || dst == NULL)
+		return;
+
+	core::dimension2d<u32> dstdim = dst->getDimension();
+
+	// Pre-conditions
+	assert(dstdim == imageTransformDimension(transform, src->getDimension()));
+	assert(transform <= 7);
+
+	/*
+		Compute the transformation from source coordinates (sx,sy)
+		to destination coordinates (dx,dy).
+	*/
+	int sxn = 0;
+	int syn = 2;
+	if (transform == 0)         // identity
+		sxn = 0, syn = 2;  //   sx = dx, sy = dy
+	else if (transform == 1)    // rotate by 90 degrees ccw
+		sxn = 3, syn = 0;  //   sx = (H-1) - dy, sy = dx
+	else if (transform == 2)    // rotate by 180 degrees
+		sxn = 1, syn = 3;  //   sx = (W-1) - dx, sy = (H-1) - dy
+	else if (transform == 3)    // rotate by 270 degrees ccw
+		sxn = 2, syn = 1;  //   sx = dy, sy = (W-1) - dx
+	else if (transform == 4)    // flip x
+		sxn = 1, syn = 2;  //   sx = (W-1) - dx, sy = dy
+	else if (transform == 5)    // flip x then rotate by 90 degrees ccw
+		sxn = 2, syn = 0;  //   sx = dy, sy = dx
+	else if (transform == 6)    // flip y
+		sxn = 0, syn = 3;  //   sx = dx, sy = (H-1) - dy
+	else if (transform == 7)    // flip y then rotate by 90 degrees ccw
+		sxn = 3, syn = 1;  //   sx = (H-1) - dy, sy = (W-1) - dx
+
+	for (u32 dy=0; dy<dstdim.Height; dy++)
+	for (u32 dx=0; dx<dstdim.Width; dx++)
+	{
+		u32 entries[4] = {dx, dstdim.Width-1-dx, dy, dstdim.Height-1-dy};
+		u32 sx = entries[sxn];
+		u32 sy = entries[syn];
+		video::SColor c = src->getPixel(sx,sy);
+		dst->setPixel(dx,dy,c);
+	}
+}
+
+/*
+	Direct access to the pixels of an A8R8G8B8 image.  Every pixel is a
+	video::SColor, so the kernels below work on whole u32 values and the
+	compiler is free to vectorize the simple ones.
+*/
+class PixelBuffer
+{
+public:
+	PixelBuffer(video::IImage *image) :
+		m_image(image),
+		m_data((u8 *)image->lock()),
+		m_pitch(image->getPitch())
+	{
+	}
+
+	~PixelBuffer() { m_image->unlock(); }
+
+	u32 *row(u32 y, u32 x = 0) const { return (u32 *)(m_data + y * m_pitch) + x; }
+
+	// Distance between two rows, in pixels
+	u32 pitch() const { return m_pitch / 4; }
+
+private:
+	video::IImage *m_image;
+	u8 *m_data;
+	u32 m_pitch;
+};
+
+static inline bool is_argb(video::IImage *image)
+{
+	return image->getColorFormat() == video::ECF_A8R8G8B8;
+}
+
+void blit_with_alpha(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size)
+{
+	if (!is_argb(src) || !is_argb(dst)) {
+		blit_with_alpha_generic(src, dst, src_pos, dst_pos, size);
+		return;
+	}
+
+	PixelBuffer src_buf(src), dst_buf(dst);
+	for (u32 y = 0; y < size.Y; y++) {
+		const u32 *s = src_buf.row(src_pos.Y + y, src_pos.X);
+		u32 *d = dst_buf.row(dst_pos.Y + y, dst_pos.X);
+		for (u32 x = 0; x < size.X; x++) {
+			// Opaque source pixels replace the destination and transparent
+			// ones keep it, which blitPixel() would compute as well
+			u32 src_alpha = s[x] >> 24;
+			if (src_alpha == 255)
+				d[x] = s[x];
+			else if (src_alpha != 0 || (d[x] >> 24) == 0)
+				d[x] = blitPixel(s[x], d[x], src_alpha).color;
+		}
+	}
+}
+
+void blit_with_alpha_overlay(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size)
+{
+	if (!is_argb(src) || !is_argb(dst)) {
+		blit_with_alpha_overlay_generic(src, dst, src_pos, dst_pos, size);
+		return;
+	}
+
+	PixelBuffer src_buf(src), dst_buf(dst);
+	for (u32 y = 0; y < size.Y; y++) {
+		const u32 *s = src_buf.row(src_pos.Y + y, src_pos.X);
+		u32 *d = dst_buf.row(dst_pos.Y + y, dst_pos.X);
+		for (u32 x = 0; x < size.X; x++) {
+			u32 src_alpha = s[x] >> 24;
+			if ((d[x] >> 24) != 255 || src_alpha == 0)
+				continue;
+			d[x] = src_alpha == 255 ? s[x] : blitPixel(s[x], d[x], src_alpha).color;
+		}
+	}
+}
+
+void apply_colorize(video::IImage *dst, v2u32 dst_pos, v2u32 size,
+		const video::SColor &color, int ratio, bool keep_alpha)
+{
+	if (!is_argb(dst)) {
+		apply_colorize_generic(dst, dst_pos, size, color, ratio, keep_alpha);
+		return;
+	}
+
+	PixelBuffer buf(dst);
+	u32 alpha = color.getAlpha();
+	if ((ratio == -1 && alpha == 255) || ratio == 255) { // full replacement of color
+		u32 rgb = color.color & 0x00ffffff;
+		for (u32 y = 0; y < size.Y; y++) {
+			u32 *d = buf.row(dst_pos.Y + y, dst_pos.X);
+			if (keep_alpha) {
+				for (u32 x = 0; x < size.X; x++) {
+					u32 dst_alpha = d[x] >> 24;
+					if (dst_alpha > 0)
+						d[x] = (dst_alpha * alpha / 255) << 24 | rgb;
+				}
+			} else {
+				for (u32 x = 0; x < size.X; x++)
+					d[x] = (d[x] >> 24) > 0 ? color.color : d[x];
+			}
+		}
+	} else {  // interpolate between the color and destination
+		float interp = (ratio == -1 ? color.getAlpha() / 255.0f : ratio / 255.0f);
+		for (u32 y = 0; y < size.Y; y++) {
+			u32 *d = buf.row(dst_pos.Y + y, dst_pos.X);
+			for (u32 x = 0; x < size.X; x++) {
+				if ((d[x] >> 24) > 0)
+					d[x] = color.getInterpolated(d[x], interp).color;
+			}
+		}
+	}
+}
+
+void apply_multiplication(video::IImage *dst, v2u32 dst_pos, v2u32 size,
+		const video::SColor &color)
+{
+	if (!is_argb(dst)) {
+		apply_multiplication_generic(dst, dst_pos, size, color);
+		return;
+	}
+
+	PixelBuffer buf(dst);
+	u32 r = color.getRed(), g = color.getGreen(), b = color.getBlue();
+	for (u32 y = 0; y < size.Y; y++) {
+		u32 *d = buf.row(dst_pos.Y + y, dst_pos.X);
+		for (u32 x = 0; x < size.X; x++) {
+			u32 c = d[x];
+			d[x] = (c & 0xff000000) |
+				((c >> 16 & 0xff) * r / 255) << 16 |
+				((c >> 8 & 0xff) * g / 255) << 8 |
+				(c & 0xff) * b / 255;
+		}
+	}
+}
+
+void apply_mask(video::IImage *mask, video::IImage *dst,
+		v2s32 mask_pos, v2s32 dst_pos, v2u32 size)
+{
+	if (!is_argb(mask) || !is_argb(dst)) {
+		apply_mask_generic(mask, dst, mask_pos, dst_pos, size);
+		return;
+	}
+
+	PixelBuffer mask_buf(mask), dst_buf(dst);
+	for (u32 y = 0; y < size.Y; y++) {
+		const u32 *m = mask_buf.row(mask_pos.Y + y, mask_pos.X);
+		u32 *d = dst_buf.row(dst_pos.Y + y, dst_pos.X);
+		for (u32 x = 0; x < size.X; x++)
+			d[x] &= m[x];
+	}
+}
+
+void brighten(video::IImage *image)
+{
+	if (image == NULL)
+		return;
+
+	if (!is_argb(image)) {
+		brighten_generic(image);
+		return;
+	}
+
+	// (255 + c) / 2 == 127 + c / 2 + c % 2, for the three color channels at once
+	PixelBuffer buf(image);
+	core::dimension2d<u32> dim = image->getDimension();
+	for (u32 y = 0; y < dim.Height; y++) {
+		u32 *p = buf.row(y);
+		for (u32 x = 0; x < dim.Width; x++) {
+			u32 c = p[x];
+			p[x] = (c & 0xff000000) + ((c >> 1) & 0x7f7f7f) +
+				(c & 0x010101) + 0x7f7f7f;
+		}
+	}
+}
+
+void imageTransform(u32 transform, video::IImage *src, video::IImage *dst)
+{
+	if (src == NULL || dst == NULL)
+		return;
+
+	if (!is_argb(src) || !is_argb(dst) || src == dst) {
+		imageTransform_generic(transform, src, dst);
+		return;
+	}
+
+	core::dimension2d<u32> srcdim = src->getDimension();
+	core::dimension2d<u32> dstdim = dst->getDimension();
+
+	// Pre-conditions
+	assert(dstdim == imageTransformDimension(transform, srcdim));
+	assert(transform <= 7);
+
+	PixelBuffer src_buf(src), dst_buf(dst);
+	if (transform == 0) {
+		for (u32 y = 0; y < dstdim.Height; y++)
+			memcpy(dst_buf.row(y), src_buf.row(y), dstdim.Width * 4);
+		return;
+	}
+
+	/*
+		The source pixel moves by a fixed step for every destination pixel
+		of a row: along the source row for the flips and the 180 degree
+		rotation, along a source column for the other transforms.
+	*/
+	bool swap = transform % 2 == 1;
+	bool flip_x = transform == 1 || transform == 2 || transform == 4 || transform == 7;
+	bool flip_y = transform == 2 || transform == 3 || transform == 6 || transform == 7;
+	s32 pitch = src_buf.pitch();
+	s32 step_x = flip_x ? -1 : 1;
+	s32 step_y = flip_y ? -pitch : pitch;
+	s32 step = swap ? step_y : step_x;
+	for (u32 dy = 0; dy < dstdim.Height; dy++) {
+		// Source coordinates of the first pixel of the row
+		u32 sx = swap ? dy : 0;
+		u32 sy = swap ? 0 : dy;
+		if (flip_x)
+			sx = srcdim.Width - 1 - sx;
+		if (flip_y)
+			sy = srcdim.Height - 1 - sy;
+		const u32 *s = src_buf.row(sy, sx);
+		u32 *d = dst_buf.row(dy);
+		for (u32 dx = 0; dx < dstdim.Width; dx++)
+			d[dx] = s[(s32)dx * step];
+	}
+}
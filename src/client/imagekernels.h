@@ -0,0 +1,77 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "irrlichttypes_extrabloated.h"
+
+/*
+	Pixel kernels of the texture modifiers.
+
+	Images created by the texture source are A8R8G8B8, so every kernel works
+	directly on the pixel buffer of such images and falls back to
+	IImage::getPixel()/setPixel() for other formats.  The *_generic variants
+	are the fallbacks; the unit tests use them as reference.
+*/
+
+// Draw an image on top of an another one, using the alpha channel of the
+// source image
+void blit_with_alpha(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size);
+
+// Like blit_with_alpha, but only modifies destination pixels that
+// are fully opaque
+void blit_with_alpha_overlay(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size);
+
+// Apply a color to an image.  Uses an int (0-255) to calculate the ratio.
+// If the ratio is 255 or -1 and keep_alpha is true, then it multiples the
+// color alpha with the destination alpha.
+// Otherwise, any pixels that are not fully transparent get the color alpha.
+void apply_colorize(video::IImage *dst, v2u32 dst_pos, v2u32 size,
+		const video::SColor &color, int ratio, bool keep_alpha);
+
+// paint a texture using the given color
+void apply_multiplication(video::IImage *dst, v2u32 dst_pos, v2u32 size,
+		const video::SColor &color);
+
+// Apply a mask to an image
+void apply_mask(video::IImage *mask, video::IImage *dst,
+		v2s32 mask_pos, v2s32 dst_pos, v2u32 size);
+
+// Brighten image
+void brighten(video::IImage *image);
+
+// Apply transform to image dimension
+core::dimension2d<u32> imageTransformDimension(u32 transform, core::dimension2d<u32> dim);
+// Apply transform to image data
+void imageTransform(u32 transform, video::IImage *src, video::IImage *dst);
+
+void blit_with_alpha_generic(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size);
+void blit_with_alpha_overlay_generic(video::IImage *src, video::IImage *dst,
+		v2s32 src_pos, v2s32 dst_pos, v2u32 size);
+void apply_colorize_generic(video::IImage *dst, v2u32 dst_pos, v2u32 size,
+		const video::SColor &color, int ratio, bool keep_alpha);
+void apply_multiplication_generic(video::IImage *dst, v2u32 dst_pos, v2u32 size,
+		const video::SColor &color);
+void apply_mask_generic(video::IImage *mask, video::IImage *dst,
+		v2s32 mask_pos, v2s32 dst_pos, v2u32 size);
+void brighten_generic(video::IImage *image);
+void imageTransform_generic(u32 transform, video::IImage *src, video::IImage *dst);
@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "minimap.h"
 #include "content_mapblock.h"
 #include "util/directiontables.h"
+#include "util/rectmerge.h"
 #include "client/meshgen/collector.h"
 #include "client/renderingengine.h"
 #include <array>
@@ -66,7 +67,7 @@ void MeshMakeData::fill(MapBlock *block)
 {
 	fillBlockDataBegin(block->getPos());
 
-	fillBlockData(v3s16(0,0,0), block->getData());
+	block->copyTo(m_vmanip);
 
 	// Get map for reading neighbor blocks
 	Map *map = block->getParent();
@@ -75,7 +76,7 @@ void MeshMakeData::fill(MapBlock *block)
 		v3s16 bp = m_blockpos + dir;
 		MapBlock *b = map->getBlockNoCreateNoEx(bp);
 		if(b)
-			fillBlockData(dir, b->getData());
+			b->copyTo(m_vmanip);
 	}
 }
 
@@ -628,6 +629,40 @@ static void makeFastFace(const TileSpec &tile, u16 li0, u16 li1, u16 li2, u16 li
 	face.tile = tile;
 }
 
+/*
+	Grows a face made by makeFastFace() for the node at p by extent nodes in
+	the positive directions of the face plane. The texture coordinates go on
+	across the added nodes, like the ones of the faces of those nodes would:
+	tileable textures repeat, world-aligned ones continue.
+*/
+static void stretchFastFace(FastFace &face, const v3f &p, const v3s16 &extent)
+{
+	v3f center = p * BS;
+
+	// Texture coordinates along the edges from vertex 1 to 0 and 1 to 2
+	const v3f origin = face.vertices[1].Pos;
+	const v3f edge_u = face.vertices[0].Pos - origin;
+	const v3f edge_v = face.vertices[2].Pos - origin;
+	const v2f tc_origin = face.vertices[1].TCoords;
+	const v2f tc_u = face.vertices[0].TCoords - tc_origin;
+	const v2f tc_v = face.vertices[2].TCoords - tc_origin;
+
+	for (video::S3DVertex &vertex : face.vertices) {
+		v3f &pos = vertex.Pos;
+		if (pos.X > center.X)
+			pos.X += extent.X * BS;
+		if (pos.Y > center.Y)
+			pos.Y += extent.Y * BS;
+		if (pos.Z > center.Z)
+			pos.Z += extent.Z * BS;
+
+		v3f rel = pos - origin;
+		vertex.TCoords = tc_origin
+			+ tc_u * (rel.dotProduct(edge_u) / edge_u.getLengthSQ())
+			+ tc_v * (rel.dotProduct(edge_v) / edge_v.getLengthSQ());
+	}
+}
+
 /*
 	Nodes make a face if contents differ and solidness differs.
 	Return value:
@@ -945,9 +980,94 @@ static void updateFastFaceRow(
 	}
 }
 
+// The face between a node and its neighbour, as found by getTileInfo()
+struct FastFaceCell
+{
+	bool makes_face = false;
+	v3s16 p_corrected;
+	v3s16 face_dir_corrected;
+	u16 lights[4] = {0, 0, 0, 0};
+	u8 waving = 0;
+	TileSpec tile;
+};
+
+/*
+	Greedy meshing: merges the faces of a whole slice of the block into
+	rectangles, instead of only along rows like updateFastFaceRow().
+
+	startpos: first node of the slice
+	u_dir, v_dir: the axes of the slice, unit vectors with only one of x, y or z
+	face_dir: unit vector with only one of x, y or z
+	cells: scratch space for MAP_BLOCKSIZE^2 cells
+*/
+static void updateFastFaceSlice(
+		MeshMakeData *data,
+		const v3s16 &startpos,
+		const v3s16 &u_dir,
+		const v3s16 &v_dir,
+		const v3s16 &face_dir,
+		std::vector<FastFaceCell> &cells,
+		std::vector<FastFace> &dest)
+{
+	for (u16 v = 0; v < MAP_BLOCKSIZE; v++)
+	for (u16 u = 0; u < MAP_BLOCKSIZE; u++) {
+		FastFaceCell &cell = cells[v * MAP_BLOCKSIZE + u];
+		cell.waving = 0;
+		getTileInfo(data, startpos + u_dir * u + v_dir * v, face_dir,
+				cell.makes_face, cell.p_corrected, cell.face_dir_corrected,
+				cell.lights, cell.waving, cell.tile);
+	}
+
+	auto mergeable = [&cells] (u32 first, u32 other) {
+		const FastFaceCell &a = cells[first];
+		const FastFaceCell &b = cells[other];
+		if (!b.makes_face)
+			return false;
+		if (first == other)
+			return true;
+		// Waving moves the vertices, so merged faces would wave differently
+		return a.waving == 0 && b.waving == 0
+			&& b.face_dir_corrected == a.face_dir_corrected
+			&& memcmp(b.lights, a.lights, sizeof(a.lights)) == 0
+			&& b.tile.isTileable(a.tile);
+	};
+
+	mergeRectangles(MAP_BLOCKSIZE, MAP_BLOCKSIZE, mergeable,
+		[&] (u16 u, u16 v, u16 w, u16 h) {
+			const FastFaceCell &cell = cells[v * MAP_BLOCKSIZE + u];
+			v3f pf(cell.p_corrected.X, cell.p_corrected.Y, cell.p_corrected.Z);
+			makeFastFace(cell.tile, cell.lights[0], cell.lights[1],
+					cell.lights[2], cell.lights[3], pf, pf,
+					cell.face_dir_corrected, v3f(1, 1, 1), dest);
+			if (w > 1 || h > 1)
+				stretchFastFace(dest.back(), pf,
+						u_dir * (w - 1) + v_dir * (h - 1));
+			g_profiler->avg("Meshgen: Tiles per face [#]", w * h);
+		});
+}
+
 static void updateAllFastFaceRows(MeshMakeData *data,
 		std::vector<FastFace> &dest)
 {
+	static thread_local const bool greedy_meshing =
+		g_settings->getBool("greedy_meshing");
+
+	if (greedy_meshing) {
+		std::vector<FastFaceCell> cells(MAP_BLOCKSIZE * MAP_BLOCKSIZE);
+
+		// top(y+) faces, right(x+) faces and back(z+) faces
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+			updateFastFaceSlice(data, v3s16(0, y, 0), v3s16(1, 0, 0),
+					v3s16(0, 0, 1), v3s16(0, 1, 0), cells, dest);
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+			updateFastFaceSlice(data, v3s16(x, 0, 0), v3s16(0, 0, 1),
+					v3s16(0, 1, 0), v3s16(1, 0, 0), cells, dest);
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+			updateFastFaceSlice(data, v3s16(0, 0, z), v3s16(1, 0, 0),
+					v3s16(0, 1, 0), v3s16(0, 0, 1), cells, dest);
+		return;
+	}
+
 	/*
 		Go through every y,z and get top(y+) faces in rows of x+
 	*/
@@ -1042,6 +1162,7 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 		updateAllFastFaceRows(data, fastfaces_new);
 	}
 	// End of slow part
+	g_profiler->avg("Meshgen: Fast faces per block [#]", fastfaces_new.size());
 
 	/*
 		Convert FastFaces to MeshCollector
@@ -1127,7 +1248,9 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 			}
 
 			if (!m_enable_shaders) {
-				// Extract colors for day-night animation
+				// Extract colors for day-night animation. With shaders the
+				// vertex colors keep the sunlight ratio in the alpha and the
+				// node shader blends them with the dayLight uniform instead.
 				// Dummy sunlight to handle non-sunlit areas
 				video::SColorf sunlight;
 				get_sunlight_color(&sunlight, 0);
@@ -1138,7 +1261,8 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 					if (vc->getAlpha() == 0) // No sunlight - no need to animate
 						final_color_blend(vc, copy, sunlight); // Finalize color
 					else // Record color to animate
-						m_daynight_diffs[std::pair<u8, u32>(layer, i)][j] = copy;
+						m_daynight_diffs[std::pair<u8, u32>(layer, i)]
+							.emplace_back(j, copy);
 
 					// The sunlight ratio has been stored,
 					// delete alpha (for the final rendering).
@@ -1285,12 +1409,8 @@ bool MapBlockMesh::animate(bool faraway, float time, int crack,
 		}
 	}
 
-	// Day-night transition
+	// Day-night transition, only without shaders
 	if (!m_enable_shaders && (daynight_ratio != m_last_daynight_ratio)) {
-		// Force reload mesh to VBO
-		if (m_enable_vbo)
-			for (scene::IMesh *m : m_mesh)
-				m->setDirty();
 		video::SColorf day_color;
 		get_sunlight_color(&day_color, daynight_ratio);
 
@@ -1298,9 +1418,17 @@ bool MapBlockMesh::animate(bool faraway, float time, int crack,
 			scene::IMeshBuffer *buf = m_mesh[daynight_diff.first.first]->
 				getMeshBuffer(daynight_diff.first.second);
 			video::S3DVertex *vertices = (video::S3DVertex *)buf->getVertices();
-			for (const auto &j : daynight_diff.second)
-				final_color_blend(&(vertices[j.first].Color), j.second,
-						day_color);
+			bool changed = false;
+			for (const auto &j : daynight_diff.second) {
+				video::SColor *color = &vertices[j.first].Color;
+				const video::SColor old_color = *color;
+				final_color_blend(color, j.second, day_color);
+				changed |= *color != old_color;
+			}
+			// Small ratio steps often leave the 8-bit colors unchanged.
+			// Only the vertices of this buffer need to be reloaded to the VBO.
+			if (changed && m_enable_vbo)
+				buf->setDirty(scene::EBT_VERTEX);
 		}
 		m_last_daynight_ratio = daynight_ratio;
 	}
@@ -156,10 +156,11 @@ class MapBlockMesh
 	// Animation info: day/night transitions
 	// Last daynight_ratio value passed to animate()
 	u32 m_last_daynight_ratio;
-	// For each mesh and mesh buffer, stores pre-baked colors
-	// of sunlit vertices
+	// For each mesh and mesh buffer, stores the indices and pre-baked colors
+	// of sunlit vertices. Only used without shaders.
 	// Keys are pairs of (mesh index, buffer index in the mesh)
-	std::map<std::pair<u8, u32>, std::map<u32, video::SColor > > m_daynight_diffs;
+	std::map<std::pair<u8, u32>, std::vector<std::pair<u32, video::SColor>>>
+		m_daynight_diffs;
 
 	// Camera offset info -> do we have to translate the mesh?
 	v3s16 m_camera_offset;
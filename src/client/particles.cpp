@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "particles.h"
+#include <algorithm>
 #include <cmath>
 #include "client.h"
 #include "collision.h"
@@ -31,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapnode.h"
 #include "nodedef.h"
 #include "client.h"
+#include "profiler.h"
 #include "settings.h"
 
 /*
@@ -51,67 +53,107 @@ static v3f random_v3f(v3f min, v3f max)
 }
 
 /*
-	Particle
+	ParticlePool
 */
 
-Particle::Particle(
-	IGameDef *gamedef,
-	LocalPlayer *player,
-	ClientEnvironment *env,
-	const ParticleParameters &p,
-	video::ITexture *texture,
-	v2f texpos,
-	v2f texsize,
-	video::SColor color
-):
-	scene::ISceneNode(RenderingEngine::get_scene_manager()->getRootSceneNode(),
-		RenderingEngine::get_scene_manager())
+void ParticlePool::add(const ParticleParameters &p, u32 batch_index,
+	v2f texpos_, v2f texsize_, video::SColor color)
 {
-	// Misc
-	m_gamedef = gamedef;
-	m_env = env;
+	pos.push_back(p.pos);
+	vel.push_back(p.vel);
+	acc.push_back(p.acc);
+	time.push_back(0.0f);
+	expiration.push_back(p.expirationtime);
+
+	quad_size.push_back(p.size);
+	batch.push_back(batch_index);
+	texpos.push_back(texpos_);
+	texsize.push_back(texsize_);
+	base_color.push_back(color);
+	glow.push_back(p.glow);
+	flags.push_back((p.collisiondetection ? COLLISION_DETECTION : 0) |
+		(p.collision_removal ? COLLISION_REMOVAL : 0) |
+		(p.object_collision ? OBJECT_COLLISION : 0) |
+		(p.vertical ? VERTICAL : 0));
+
+	animation.push_back(p.animation);
+	animation_time.push_back(0.0f);
+	animation_frame.push_back(0);
+}
 
-	// Texture
-	m_material.setFlag(video::EMF_LIGHTING, false);
-	m_material.setFlag(video::EMF_BACK_FACE_CULLING, false);
-	m_material.setFlag(video::EMF_BILINEAR_FILTER, false);
-	m_material.setFlag(video::EMF_FOG_ENABLE, true);
-	m_material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL;
-	m_material.setTexture(0, texture);
-	m_texpos = texpos;
-	m_texsize = texsize;
-	m_animation = p.animation;
-
-	// Color
-	m_base_color = color;
-	m_color = color;
-
-	// Particle related
-	m_pos = p.pos;
-	m_velocity = p.vel;
-	m_acceleration = p.acc;
-	m_expiration = p.expirationtime;
-	m_player = player;
-	m_size = p.size;
-	m_collisiondetection = p.collisiondetection;
-	m_collision_removal = p.collision_removal;
-	m_object_collision = p.object_collision;
-	m_vertical = p.vertical;
-	m_glow = p.glow;
-
-	// Irrlicht stuff
-	const float c = p.size / 2;
-	m_collisionbox = aabb3f(-c, -c, -c, c, c, c);
-	this->setAutomaticCulling(scene::EAC_OFF);
-
-	// Init lighting
-	updateLight();
-
-	// Init model
-	updateVertices();
+template <typename T>
+static void swap_remove(std::vector<T> &v, u32 i)
+{
+	v[i] = v.back();
+	v.pop_back();
+}
+
+void ParticlePool::remove(u32 i)
+{
+	swap_remove(pos, i);
+	swap_remove(vel, i);
+	swap_remove(acc, i);
+	swap_remove(time, i);
+	swap_remove(expiration, i);
+
+	swap_remove(quad_size, i);
+	swap_remove(batch, i);
+	swap_remove(texpos, i);
+	swap_remove(texsize, i);
+	swap_remove(base_color, i);
+	swap_remove(glow, i);
+	swap_remove(flags, i);
+
+	swap_remove(animation, i);
+	swap_remove(animation_time, i);
+	swap_remove(animation_frame, i);
 }
 
-void Particle::OnRegisterSceneNode()
+void ParticlePool::clear()
+{
+	pos.clear();
+	vel.clear();
+	acc.clear();
+	time.clear();
+	expiration.clear();
+
+	quad_size.clear();
+	batch.clear();
+	texpos.clear();
+	texsize.clear();
+	base_color.clear();
+	glow.clear();
+	flags.clear();
+
+	animation.clear();
+	animation_time.clear();
+	animation_frame.clear();
+}
+
+/*
+	ParticleRenderer
+*/
+
+// The most quads whose vertices can be indexed with 16 bits
+#define PARTICLE_MAX_QUADS 0x4000
+
+ParticleRenderer::ParticleRenderer(scene::ISceneNode *parent,
+		scene::ISceneManager *mgr) :
+	scene::ISceneNode(parent, mgr)
+{
+	m_box = aabb3f(-BS*1000000,-BS*1000000,-BS*1000000,
+			BS*1000000,BS*1000000,BS*1000000);
+	setAutomaticCulling(scene::EAC_OFF);
+
+	m_indices.reserve(PARTICLE_MAX_QUADS * 6);
+	for (u32 i = 0; i < PARTICLE_MAX_QUADS; i++) {
+		u16 first = i * 4;
+		for (u16 index : {0, 1, 2, 2, 3, 0})
+			m_indices.push_back(first + index);
+	}
+}
+
+void ParticleRenderer::OnRegisterSceneNode()
 {
 	if (IsVisible)
 		SceneManager->registerNodeForRendering(this, scene::ESNRP_TRANSPARENT_EFFECT);
@@ -119,127 +161,54 @@ void Particle::OnRegisterSceneNode()
 	ISceneNode::OnRegisterSceneNode();
 }
 
-void Particle::render()
+void ParticleRenderer::render()
 {
 	video::IVideoDriver *driver = SceneManager->getVideoDriver();
-	driver->setMaterial(m_material);
 	driver->setTransform(video::ETS_WORLD, AbsoluteTransformation);
 
-	u16 indices[] = {0,1,2, 2,3,0};
-	driver->drawVertexPrimitiveList(m_vertices, 4,
-			indices, 2, video::EVT_STANDARD,
-			scene::EPT_TRIANGLES, video::EIT_16BIT);
+	for (const Run &run : m_runs) {
+		driver->setMaterial(m_batches[run.batch].material);
+		driver->drawVertexPrimitiveList(&m_vertices[run.first_quad * 4],
+				run.quad_count * 4, &m_indices[0], run.quad_count * 2,
+				video::EVT_STANDARD, scene::EPT_TRIANGLES, video::EIT_16BIT);
+	}
 }
 
-void Particle::step(float dtime)
+void ParticleRenderer::clearQuads()
 {
-	m_time += dtime;
-	if (m_collisiondetection) {
-		aabb3f box = m_collisionbox;
-		v3f p_pos = m_pos * BS;
-		v3f p_velocity = m_velocity * BS;
-		collisionMoveResult r = collisionMoveSimple(m_env, m_gamedef, BS * 0.5f,
-			box, 0.0f, dtime, &p_pos, &p_velocity, m_acceleration * BS, nullptr,
-			m_object_collision);
-		if (m_collision_removal && r.collides) {
-			// force expiration of the particle
-			m_expiration = -1.0;
-		} else {
-			m_pos = p_pos / BS;
-			m_velocity = p_velocity / BS;
-		}
-	} else {
-		m_velocity += m_acceleration * dtime;
-		m_pos += m_velocity * dtime;
-	}
-	if (m_animation.type != TAT_NONE) {
-		m_animation_time += dtime;
-		int frame_length_i, frame_count;
-		m_animation.determineParams(
-				m_material.getTexture(0)->getSize(),
-				&frame_count, &frame_length_i, NULL);
-		float frame_length = frame_length_i / 1000.0;
-		while (m_animation_time > frame_length) {
-			m_animation_frame++;
-			m_animation_time -= frame_length;
-		}
-	}
-
-	// Update lighting
-	updateLight();
-
-	// Update model
-	updateVertices();
+	m_vertices.clear();
+	m_runs.clear();
 }
 
-void Particle::updateLight()
+void ParticleRenderer::addQuad(u32 batch, const video::S3DVertex *vertices)
 {
-	u8 light = 0;
-	bool pos_ok;
+	u32 quad = m_vertices.size() / 4;
+	if (m_runs.empty() || m_runs.back().batch != batch ||
+			m_runs.back().quad_count == PARTICLE_MAX_QUADS)
+		m_runs.push_back({batch, quad, 0});
+	m_runs.back().quad_count++;
 
-	v3s16 p = v3s16(
-		floor(m_pos.X+0.5),
-		floor(m_pos.Y+0.5),
-		floor(m_pos.Z+0.5)
-	);
-	MapNode n = m_env->getClientMap().getNode(p, &pos_ok);
-	if (pos_ok)
-		light = n.getLightBlend(m_env->getDayNightRatio(), m_gamedef->ndef());
-	else
-		light = blend_light(m_env->getDayNightRatio(), LIGHT_SUN, 0);
-
-	u8 m_light = decode_light(light + m_glow);
-	m_color.set(255,
-		m_light * m_base_color.getRed() / 255,
-		m_light * m_base_color.getGreen() / 255,
-		m_light * m_base_color.getBlue() / 255);
+	m_vertices.insert(m_vertices.end(), vertices, vertices + 4);
 }
 
-void Particle::updateVertices()
+u32 ParticleRenderer::getBatch(video::ITexture *texture)
 {
-	f32 tx0, tx1, ty0, ty1;
-
-	if (m_animation.type != TAT_NONE) {
-		const v2u32 texsize = m_material.getTexture(0)->getSize();
-		v2f texcoord, framesize_f;
-		v2u32 framesize;
-		texcoord = m_animation.getTextureCoords(texsize, m_animation_frame);
-		m_animation.determineParams(texsize, NULL, NULL, &framesize);
-		framesize_f = v2f(framesize.X / (float) texsize.X, framesize.Y / (float) texsize.Y);
-
-		tx0 = m_texpos.X + texcoord.X;
-		tx1 = m_texpos.X + texcoord.X + framesize_f.X * m_texsize.X;
-		ty0 = m_texpos.Y + texcoord.Y;
-		ty1 = m_texpos.Y + texcoord.Y + framesize_f.Y * m_texsize.Y;
-	} else {
-		tx0 = m_texpos.X;
-		tx1 = m_texpos.X + m_texsize.X;
-		ty0 = m_texpos.Y;
-		ty1 = m_texpos.Y + m_texsize.Y;
-	}
-
-	m_vertices[0] = video::S3DVertex(-m_size / 2, -m_size / 2,
-		0, 0, 0, 0, m_color, tx0, ty1);
-	m_vertices[1] = video::S3DVertex(m_size / 2, -m_size / 2,
-		0, 0, 0, 0, m_color, tx1, ty1);
-	m_vertices[2] = video::S3DVertex(m_size / 2, m_size / 2,
-		0, 0, 0, 0, m_color, tx1, ty0);
-	m_vertices[3] = video::S3DVertex(-m_size / 2, m_size / 2,
-		0, 0, 0, 0, m_color, tx0, ty0);
-
-	v3s16 camera_offset = m_env->getCameraOffset();
-	for (video::S3DVertex &vertex : m_vertices) {
-		if (m_vertical) {
-			v3f ppos = m_player->getPosition()/BS;
-			vertex.Pos.rotateXZBy(std::atan2(ppos.Z - m_pos.Z, ppos.X - m_pos.X) /
-				core::DEGTORAD + 90);
-		} else {
-			vertex.Pos.rotateYZBy(m_player->getPitch());
-			vertex.Pos.rotateXZBy(m_player->getYaw());
-		}
-		m_box.addInternalPoint(vertex.Pos);
-		vertex.Pos += m_pos*BS - intToFloat(camera_offset, BS);
-	}
+	auto it = m_batch_indices.find(texture);
+	if (it != m_batch_indices.end())
+		return it->second;
+
+	Batch batch;
+	batch.material.setFlag(video::EMF_LIGHTING, false);
+	batch.material.setFlag(video::EMF_BACK_FACE_CULLING, false);
+	batch.material.setFlag(video::EMF_BILINEAR_FILTER, false);
+	batch.material.setFlag(video::EMF_FOG_ENABLE, true);
+	batch.material.MaterialType = video::EMT_TRANSPARENT_ALPHA_CHANNEL;
+	batch.material.setTexture(0, texture);
+	m_batches.push_back(batch);
+
+	u32 index = m_batches.size() - 1;
+	m_batch_indices[texture] = index;
+	return index;
 }
 
 /*
@@ -326,16 +295,7 @@ void ParticleSpawner::spawnParticle(ClientEnvironment *env, float radius,
 	if (p.maxsize > 0.0f)
 		pp.size = random_f32(p.minsize, p.maxsize);
 
-	m_particlemanager->addParticle(new Particle(
-		m_gamedef,
-		m_player,
-		env,
-		pp,
-		texture,
-		texpos,
-		texsize,
-		color
-	));
+	m_particlemanager->addParticle(pp, texture, texpos, texsize, color);
 }
 
 void ParticleSpawner::step(float dtime, ClientEnvironment *env)
@@ -391,17 +351,26 @@ void ParticleSpawner::step(float dtime, ClientEnvironment *env)
 
 ParticleManager::ParticleManager(ClientEnvironment *env) :
 	m_env(env)
-{}
+{
+	m_renderer = new ParticleRenderer(
+		RenderingEngine::get_scene_manager()->getRootSceneNode(),
+		RenderingEngine::get_scene_manager());
+}
 
 ParticleManager::~ParticleManager()
 {
 	clearAll();
+	m_renderer->remove();
+	m_renderer->drop();
 }
 
 void ParticleManager::step(float dtime)
 {
-	stepParticles (dtime);
-	stepSpawners (dtime);
+	ScopeProfiler sp(g_profiler, "ParticleManager::step()", SPT_AVG);
+
+	stepParticles(dtime);
+	stepSpawners(dtime);
+	updateVertices();
 }
 
 void ParticleManager::stepSpawners(float dtime)
@@ -421,16 +390,184 @@ void ParticleManager::stepSpawners(float dtime)
 void ParticleManager::stepParticles(float dtime)
 {
 	MutexAutoLock lock(m_particle_list_lock);
-	for (auto i = m_particles.begin(); i != m_particles.end();) {
-		if ((*i)->get_expired()) {
-			(*i)->remove();
-			delete *i;
-			i = m_particles.erase(i);
+	ParticlePool &ps = m_particles;
+	const u32 count = ps.size();
+
+	// Particles without collision detection only need the simple motion
+	for (u32 i = 0; i < count; i++) {
+		ps.time[i] += dtime;
+		if (ps.flags[i] & ParticlePool::COLLISION_DETECTION)
+			continue;
+		ps.vel[i] += ps.acc[i] * dtime;
+		ps.pos[i] += ps.vel[i] * dtime;
+	}
+
+	IGameDef *gamedef = m_env->getGameDef();
+	for (u32 i = 0; i < count; i++) {
+		const u8 flags = ps.flags[i];
+		if (!(flags & ParticlePool::COLLISION_DETECTION))
+			continue;
+
+		const float c = ps.quad_size[i] / 2;
+		aabb3f box(-c, -c, -c, c, c, c);
+		v3f p_pos = ps.pos[i] * BS;
+		v3f p_velocity = ps.vel[i] * BS;
+		collisionMoveResult r = collisionMoveSimple(m_env, gamedef, BS * 0.5f,
+			box, 0.0f, dtime, &p_pos, &p_velocity, ps.acc[i] * BS, nullptr,
+			flags & ParticlePool::OBJECT_COLLISION);
+		if ((flags & ParticlePool::COLLISION_REMOVAL) && r.collides) {
+			// force expiration of the particle
+			ps.expiration[i] = -1.0f;
 		} else {
-			(*i)->step(dtime);
-			++i;
+			ps.pos[i] = p_pos / BS;
+			ps.vel[i] = p_velocity / BS;
 		}
 	}
+
+	const std::vector<ParticleRenderer::Batch> &batches = m_renderer->getBatches();
+	for (u32 i = 0; i < count; i++) {
+		const TileAnimationParams &animation = ps.animation[i];
+		if (animation.type == TAT_NONE)
+			continue;
+
+		ps.animation_time[i] += dtime;
+		int frame_length_i, frame_count;
+		animation.determineParams(
+				batches[ps.batch[i]].material.getTexture(0)->getSize(),
+				&frame_count, &frame_length_i, NULL);
+		float frame_length = frame_length_i / 1000.0;
+		while (ps.animation_time[i] > frame_length) {
+			ps.animation_frame[i]++;
+			ps.animation_time[i] -= frame_length;
+		}
+	}
+
+	// Going backwards, the particle moved into the place of a removed one
+	// has already been checked
+	for (u32 i = count; i-- > 0;) {
+		if (ps.expiration[i] < ps.time[i])
+			ps.remove(i);
+	}
+
+	g_profiler->avg("Particles: count [#]", ps.size());
+}
+
+void ParticleManager::updateVertices()
+{
+	MutexAutoLock lock(m_particle_list_lock);
+	const ParticlePool &ps = m_particles;
+
+	const std::vector<ParticleRenderer::Batch> &batches = m_renderer->getBatches();
+	m_renderer->clearQuads();
+
+	if (ps.size() == 0)
+		return;
+
+	v3f camera_offset = intToFloat(m_env->getCameraOffset(), BS);
+	scene::ICameraSceneNode *camera =
+		RenderingEngine::get_scene_manager()->getActiveCamera();
+	v3f camera_pos = camera ? camera->getAbsolutePosition() :
+		m_env->getLocalPlayer()->getEyePosition() - camera_offset;
+
+	m_draw_order.clear();
+	for (u32 i = 0; i < ps.size(); i++) {
+		v3f center = ps.pos[i] * BS - camera_offset;
+		m_draw_order.emplace_back(center.getDistanceFromSQ(camera_pos), i);
+	}
+	std::sort(m_draw_order.begin(), m_draw_order.end(),
+		[] (const std::pair<f32, u32> &a, const std::pair<f32, u32> &b) {
+			return a.first > b.first;
+		});
+
+	// The rotation is linear, so the quads of all particles that aren't
+	// vertical are spanned by the same rotated axes
+	LocalPlayer *player = m_env->getLocalPlayer();
+	v3f ppos = player->getPosition() / BS;
+	v3f camera_right(1.0f, 0.0f, 0.0f);
+	v3f camera_up(0.0f, 1.0f, 0.0f);
+	camera_right.rotateYZBy(player->getPitch());
+	camera_right.rotateXZBy(player->getYaw());
+	camera_up.rotateYZBy(player->getPitch());
+	camera_up.rotateXZBy(player->getYaw());
+
+	u32 daynight_ratio = m_env->getDayNightRatio();
+	const NodeDefManager *ndef = m_env->getGameDef()->ndef();
+	ClientMap &map = m_env->getClientMap();
+
+	for (const std::pair<f32, u32> &order : m_draw_order) {
+		const u32 i = order.second;
+		const ParticleRenderer::Batch &batch = batches[ps.batch[i]];
+		const v3f &pos = ps.pos[i];
+
+		// Lighting
+		u8 light = 0;
+		bool pos_ok;
+		v3s16 p = v3s16(
+			floor(pos.X + 0.5),
+			floor(pos.Y + 0.5),
+			floor(pos.Z + 0.5)
+		);
+		MapNode n = map.getNode(p, &pos_ok);
+		if (pos_ok)
+			light = n.getLightBlend(daynight_ratio, ndef);
+		else
+			light = blend_light(daynight_ratio, LIGHT_SUN, 0);
+
+		u8 m_light = decode_light(light + ps.glow[i]);
+		const video::SColor &base_color = ps.base_color[i];
+		video::SColor color(255,
+			m_light * base_color.getRed() / 255,
+			m_light * base_color.getGreen() / 255,
+			m_light * base_color.getBlue() / 255);
+
+		// Texture coordinates
+		f32 tx0, tx1, ty0, ty1;
+		const v2f &texpos = ps.texpos[i];
+		const v2f &texsize = ps.texsize[i];
+		const TileAnimationParams &animation = ps.animation[i];
+		if (animation.type != TAT_NONE) {
+			const v2u32 texsize_px = batch.material.getTexture(0)->getSize();
+			v2f texcoord, framesize_f;
+			v2u32 framesize;
+			texcoord = animation.getTextureCoords(texsize_px,
+				ps.animation_frame[i]);
+			animation.determineParams(texsize_px, NULL, NULL, &framesize);
+			framesize_f = v2f(framesize.X / (float) texsize_px.X,
+				framesize.Y / (float) texsize_px.Y);
+
+			tx0 = texpos.X + texcoord.X;
+			tx1 = texpos.X + texcoord.X + framesize_f.X * texsize.X;
+			ty0 = texpos.Y + texcoord.Y;
+			ty1 = texpos.Y + texcoord.Y + framesize_f.Y * texsize.Y;
+		} else {
+			tx0 = texpos.X;
+			tx1 = texpos.X + texsize.X;
+			ty0 = texpos.Y;
+			ty1 = texpos.Y + texsize.Y;
+		}
+
+		// Quad
+		v3f right = camera_right;
+		v3f up = camera_up;
+		if (ps.flags[i] & ParticlePool::VERTICAL) {
+			right = v3f(1.0f, 0.0f, 0.0f);
+			right.rotateXZBy(std::atan2(ppos.Z - pos.Z, ppos.X - pos.X) /
+				core::DEGTORAD + 90);
+			up = v3f(0.0f, 1.0f, 0.0f);
+		}
+		right *= ps.quad_size[i] / 2;
+		up *= ps.quad_size[i] / 2;
+		v3f center = pos * BS - camera_offset;
+		const v3f normal(0.0f, 0.0f, 0.0f);
+
+		const video::S3DVertex vertices[4] = {
+			video::S3DVertex(center - right - up, normal, color, v2f(tx0, ty1)),
+			video::S3DVertex(center + right - up, normal, color, v2f(tx1, ty1)),
+			video::S3DVertex(center + right + up, normal, color, v2f(tx1, ty0)),
+			video::S3DVertex(center - right + up, normal, color, v2f(tx0, ty0)),
+		};
+		m_renderer->addQuad(ps.batch[i], vertices);
+	}
 }
 
 void ParticleManager::clearAll()
@@ -442,12 +579,8 @@ void ParticleManager::clearAll()
 		m_particle_spawners.erase(i++);
 	}
 
-	for(auto i = m_particles.begin(); i != m_particles.end();)
-	{
-		(*i)->remove();
-		delete *i;
-		i = m_particles.erase(i);
-	}
+	m_particles.clear();
+	m_renderer->clear();
 }
 
 void ParticleManager::handleParticleEvent(ClientEvent *event, Client *client,
@@ -502,12 +635,8 @@ void ParticleManager::handleParticleEvent(ClientEvent *event, Client *client,
 			if (oldsize > 0.0f)
 				p.size = oldsize;
 
-			if (texture) {
-				Particle *toadd = new Particle(client, player, m_env,
-						p, texture, texpos, texsize, color);
-
-				addParticle(toadd);
-			}
+			if (texture)
+				addParticle(p, texture, texpos, texsize, color);
 
 			delete event->spawn_particle;
 			break;
@@ -603,23 +732,14 @@ void ParticleManager::addNodeParticle(IGameDef *gamedef,
 		(f32)pos.Z + (rand() % 100) / 200.0f - 0.25f
 	);
 
-	Particle *toadd = new Particle(
-		gamedef,
-		player,
-		m_env,
-		p,
-		texture,
-		texpos,
-		texsize,
-		color);
-
-	addParticle(toadd);
+	addParticle(p, texture, texpos, texsize, color);
 }
 
-void ParticleManager::addParticle(Particle *toadd)
+void ParticleManager::addParticle(const ParticleParameters &p,
+	video::ITexture *texture, v2f texpos, v2f texsize, video::SColor color)
 {
 	MutexAutoLock lock(m_particle_list_lock);
-	m_particles.push_back(toadd);
+	m_particles.add(p, m_renderer->getBatch(texture), texpos, texsize, color);
 }
 
 
@@ -20,6 +20,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 #include "irrlichttypes_extrabloated.h"
 #include "client/tile.h"
 #include "localplayer.h"
@@ -31,77 +33,109 @@ class ClientEnvironment;
 struct MapNode;
 struct ContentFeatures;
 
-class Particle : public scene::ISceneNode
+/*
+	The particles of a ParticleManager, stored as a structure of arrays so
+	that the motion of all particles can be updated in one pass.
+	Particles are removed by moving the last particle into their place, so
+	the index of a particle changes when another one is removed.
+*/
+struct ParticlePool
 {
-	public:
-	Particle(
-		IGameDef* gamedef,
-		LocalPlayer *player,
-		ClientEnvironment *env,
-		const ParticleParameters &p,
-		video::ITexture *texture,
-		v2f texpos,
-		v2f texsize,
-		video::SColor color
-	);
-	~Particle() = default;
+	enum ParticleFlags : u8 {
+		COLLISION_DETECTION = 0x01,
+		COLLISION_REMOVAL = 0x02,
+		OBJECT_COLLISION = 0x04,
+		VERTICAL = 0x08,
+	};
+
+	u32 size() const { return pos.size(); }
+
+	void add(const ParticleParameters &p, u32 batch, v2f texpos, v2f texsize,
+		video::SColor color);
+	void remove(u32 i);
+	void clear();
+
+	// Motion
+	std::vector<v3f> pos;
+	std::vector<v3f> vel;
+	std::vector<v3f> acc;
+	std::vector<f32> time;
+	std::vector<f32> expiration;
+
+	// Appearance
+	std::vector<f32> quad_size;
+	std::vector<u32> batch;
+	std::vector<v2f> texpos;
+	std::vector<v2f> texsize;
+	//! Color without lighting
+	std::vector<video::SColor> base_color;
+	std::vector<u8> glow;
+	std::vector<u8> flags;
+
+	// Texture animation
+	std::vector<TileAnimationParams> animation;
+	std::vector<f32> animation_time;
+	std::vector<s32> animation_frame;
+};
 
-	virtual const aabb3f &getBoundingBox() const
+/*
+	Draws the particles in the transparent effect pass.
+	Alpha blended quads don't write depth, so they are drawn back to front.
+	Quads of consecutive particles with the same texture form a run, which
+	is drawn with as few draw calls as the 16-bit indices allow. Particles
+	with many textures mixed at the same distance need more draw calls,
+	but an alpha test material that writes depth would lose the
+	translucent edges of smoke and similar particles.
+*/
+class ParticleRenderer : public scene::ISceneNode
+{
+public:
+	// The material of the particles with one texture
+	struct Batch
 	{
-		return m_box;
-	}
+		video::SMaterial material;
+	};
 
-	virtual u32 getMaterialCount() const
+	struct Run
 	{
-		return 1;
-	}
+		u32 batch;
+		u32 first_quad;
+		u32 quad_count;
+	};
 
-	virtual video::SMaterial& getMaterial(u32 i)
+	ParticleRenderer(scene::ISceneNode *parent, scene::ISceneManager *mgr);
+
+	virtual const aabb3f &getBoundingBox() const
 	{
-		return m_material;
+		return m_box;
 	}
 
 	virtual void OnRegisterSceneNode();
 	virtual void render();
 
-	void step(float dtime);
-
-	bool get_expired ()
-	{ return m_expiration < m_time; }
+	// Returns the index of the batch for a texture, adding it if needed
+	u32 getBatch(video::ITexture *texture);
+	void clear()
+	{
+		m_batches.clear();
+		m_batch_indices.clear();
+		clearQuads();
+	}
 
-private:
-	void updateLight();
-	void updateVertices();
+	const std::vector<Batch> &getBatches() const { return m_batches; }
 
-	video::S3DVertex m_vertices[4];
-	float m_time = 0.0f;
-	float m_expiration;
+	// Quads are drawn in the order they are added
+	void clearQuads();
+	void addQuad(u32 batch, const video::S3DVertex *vertices);
 
-	ClientEnvironment *m_env;
-	IGameDef *m_gamedef;
+private:
 	aabb3f m_box;
-	aabb3f m_collisionbox;
-	video::SMaterial m_material;
-	v2f m_texpos;
-	v2f m_texsize;
-	v3f m_pos;
-	v3f m_velocity;
-	v3f m_acceleration;
-	LocalPlayer *m_player;
-	float m_size;
-	//! Color without lighting
-	video::SColor m_base_color;
-	//! Final rendered color
-	video::SColor m_color;
-	bool m_collisiondetection;
-	bool m_collision_removal;
-	bool m_object_collision;
-	bool m_vertical;
-	v3s16 m_camera_offset;
-	struct TileAnimationParams m_animation;
-	float m_animation_time = 0.0f;
-	int m_animation_frame = 0;
-	u8 m_glow;
+	std::vector<Batch> m_batches;
+	std::unordered_map<video::ITexture *, u32> m_batch_indices;
+	std::vector<video::S3DVertex> m_vertices;
+	std::vector<Run> m_runs;
+	// Indices of the quads of one draw call
+	std::vector<u16> m_indices;
 };
 
 class ParticleSpawner
@@ -173,7 +207,8 @@ friend class ParticleSpawner;
 		ParticleParameters &p, video::ITexture **texture, v2f &texpos,
 		v2f &texsize, video::SColor *color, u8 tilenum = 0);
 
-	void addParticle(Particle* toadd);
+	void addParticle(const ParticleParameters &p, video::ITexture *texture,
+		v2f texpos, v2f texsize, video::SColor color);
 
 private:
 	void addParticleSpawner(u64 id, ParticleSpawner *toadd);
@@ -181,10 +216,15 @@ friend class ParticleSpawner;
 
 	void stepParticles(float dtime);
 	void stepSpawners(float dtime);
+	// Builds the quads of all particles, facing the camera
+	void updateVertices();
 
 	void clearAll();
 
-	std::vector<Particle*> m_particles;
+	ParticlePool m_particles;
+	ParticleRenderer *m_renderer;
+	// Squared camera distance and index of the particles, farthest first
+	std::vector<std::pair<f32, u32>> m_draw_order;
 	std::unordered_map<u64, ParticleSpawner*> m_particle_spawners;
 	// Start the particle spawner ids generated from here after u32_max. lower values are
 	// for server sent spawners.
@@ -20,17 +20,30 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "tile.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <unordered_set>
 #include <ICameraSceneNode.h>
 #include <IrrCompileConfig.h>
 #include "util/string.h"
 #include "util/container.h"
+#include "util/hex.h"
+#include "util/serialize.h"
+#include "util/sha1.h"
 #include "util/thread.h"
+#include "util/timetaker.h"
+#include "util/workerpool.h"
 #include "filesys.h"
+#include "porting.h"
+#include "serialization.h"
 #include "settings.h"
+#include "version.h"
 #include "mesh.h"
 #include "gamedef.h"
 #include "util/strfnd.h"
 #include "imagefilters.h"
+#include "imagekernels.h"
 #include "guiscalingfilter.h"
 #include "renderingengine.h"
 
@@ -196,6 +209,11 @@ struct TextureInfo
 
 /*
 	SourceImageCache: A cache used for storing source images.
+
+	Images are only inserted by the main thread, but may be loaded and used
+	by the threads generating textures in parallel. The reference counts of
+	images aren't atomic, so images returned by getOrLoad() must be given
+	back with release().
 */
 
 class SourceImageCache
@@ -210,6 +228,8 @@ class SourceImageCache
 	void insert(const std::string &name, video::IImage *img, bool prefer_local)
 	{
 		assert(img); // Pre-condition
+		MutexAutoLock lock(m_mutex);
+		m_hashes.erase(name);
 		// Remove old image
 		std::map<std::string, video::IImage*>::iterator n;
 		n = m_images.find(name);
@@ -242,6 +262,7 @@ class SourceImageCache
 	}
 	video::IImage* get(const std::string &name)
 	{
+		MutexAutoLock lock(m_mutex);
 		std::map<std::string, video::IImage*>::iterator n;
 		n = m_images.find(name);
 		if (n != m_images.end())
@@ -250,13 +271,57 @@ class SourceImageCache
 	}
 	// Primarily fetches from cache, secondarily tries to read from filesystem
 	video::IImage *getOrLoad(const std::string &name)
+	{
+		MutexAutoLock lock(m_mutex);
+		video::IImage *img = load(name);
+		if (img)
+			img->grab(); // Grab for caller
+		return img;
+	}
+	// Drops an image returned by getOrLoad()
+	void release(video::IImage *img)
+	{
+		MutexAutoLock lock(m_mutex);
+		img->drop();
+	}
+	// Returns the SHA1 digest of the pixels of a source image,
+	// or "" if the image can't be loaded
+	std::string getHash(const std::string &name)
+	{
+		MutexAutoLock lock(m_mutex);
+		auto it = m_hashes.find(name);
+		if (it != m_hashes.end())
+			return it->second;
+
+		video::IImage *img = load(name);
+		if (!img)
+			return "";
+
+		std::ostringstream os(std::ios::binary);
+		writeU32(os, img->getColorFormat());
+		writeU32(os, img->getDimension().Width);
+		writeU32(os, img->getDimension().Height);
+		std::string header = os.str();
+
+		SHA1 sha1;
+		sha1.addBytes(header.c_str(), header.size());
+		sha1.addBytes((const char *)img->lock(), img->getImageDataSizeInBytes());
+		img->unlock();
+		unsigned char *digest = sha1.getDigest();
+		std::string hash((char *)digest, 20);
+		free(digest);
+
+		m_hashes[name] = hash;
+		return hash;
+	}
+private:
+	// Call with m_mutex locked
+	video::IImage *load(const std::string &name)
 	{
 		std::map<std::string, video::IImage*>::iterator n;
 		n = m_images.find(name);
-		if (n != m_images.end()){
-			n->second->grab(); // Grab for caller
+		if (n != m_images.end())
 			return n->second;
-		}
 		video::IVideoDriver *driver = RenderingEngine::get_video_driver();
 		std::string path = getTexturePath(name);
 		if (path.empty()) {
@@ -268,16 +333,188 @@ class SourceImageCache
 				<<"\""<<std::endl;
 		video::IImage *img = driver->createImageFromFile(path.c_str());
 
-		if (img){
+		if (img)
 			m_images[name] = img;
-			img->grab(); // Grab for caller
-		}
 		return img;
 	}
-private:
+
 	std::map<std::string, video::IImage*> m_images;
+	// SHA1 digests of the pixels of images, computed when needed
+	std::map<std::string, std::string> m_hashes;
+	std::mutex m_mutex;
 };
 
+/*
+	The source images used by an image that is being generated on this
+	thread, see TextureSource::generateImageCached().
+*/
+struct ImageSources
+{
+	std::vector<std::string> names;
+	// False if a source image was missing and replaced by a dummy
+	bool complete = true;
+};
+
+static thread_local ImageSources *t_image_sources = nullptr;
+
+static void record_image_source(const std::string &name, bool found)
+{
+	if (!t_image_sources)
+		return;
+	if (!found)
+		t_image_sources->complete = false;
+	else if (std::find(t_image_sources->names.begin(),
+			t_image_sources->names.end(), name) == t_image_sources->names.end())
+		t_image_sources->names.push_back(name);
+}
+
+/*
+	GeneratedImageCache: Stores generated images on disk, so that joining a
+	server again doesn't need to generate them again.
+
+	An image is stored under the hash of its name, together with the SHA1
+	digests of the source images it was generated from. It is only used if
+	all of those still match the current source images.
+
+	Each engine version has its own subdirectory. Those of other versions are
+	deleted on startup, and the directory of the current version is emptied
+	once it holds more than MAX_FILES images.
+*/
+
+class GeneratedImageCache
+{
+public:
+	// settings describes the settings that change generated images
+	// dir is the parent of the per-version directories
+	GeneratedImageCache(const std::string &dir, const std::string &settings);
+
+	// Returns NULL if the image isn't cached or its source images changed
+	video::IImage *load(const std::string &name, SourceImageCache &sources);
+	void save(const std::string &name, video::IImage *img,
+		const std::vector<std::string> &source_names, SourceImageCache &sources);
+
+	// Number of images loaded from the cache
+	std::atomic<u32> hits {0};
+
+private:
+	std::string getPath(const std::string &name) const;
+
+	static const u32 MAX_FILES = 20000;
+
+	std::string m_dir;
+	std::string m_settings;
+};
+
+GeneratedImageCache::GeneratedImageCache(const std::string &dir,
+		const std::string &settings) :
+	m_dir(dir + DIR_DELIM + sanitizeDirName(g_version_hash, "v_")),
+	m_settings(settings)
+{
+	const std::string version_dir = fs::GetFilenameFromPath(m_dir.c_str());
+	for (const fs::DirListNode &node : fs::GetDirListing(dir)) {
+		if (node.name == version_dir)
+			continue;
+		// Files directly in dir were stored by older versions
+		std::string path = dir + DIR_DELIM + node.name;
+		bool deleted = node.dir ? fs::RecursiveDelete(path) :
+			fs::DeleteSingleFileOrEmptyDirectory(path);
+		if (!deleted)
+			warningstream << "GeneratedImageCache: Failed to delete \""
+				<< path << "\"" << std::endl;
+	}
+
+	// Images of old media are never used again, so start over from time to time
+	if (fs::GetDirListing(m_dir).size() > MAX_FILES) {
+		infostream << "GeneratedImageCache: Clearing " << m_dir << std::endl;
+		fs::RecursiveDelete(m_dir);
+	}
+
+	fs::CreateAllDirs(m_dir);
+}
+
+std::string GeneratedImageCache::getPath(const std::string &name) const
+{
+	// Images of other settings get other files
+	std::string key = m_settings + "\n" + name;
+	SHA1 sha1;
+	sha1.addBytes(key.c_str(), key.size());
+	unsigned char *digest = sha1.getDigest();
+	std::string hex = hex_encode((char *)digest, 20);
+	free(digest);
+	return m_dir + DIR_DELIM + hex;
+}
+
+video::IImage *GeneratedImageCache::load(const std::string &name,
+	SourceImageCache &sources)
+{
+	std::string data;
+	if (!fs::ReadFile(getPath(name), data))
+		return NULL;
+
+	std::istringstream is(data, std::ios::binary);
+	std::ostringstream pixels(std::ios::binary);
+	core::dimension2d<u32> dim;
+	try {
+		if (readU8(is) != 1 || deSerializeString32(is) != name)
+			return NULL;
+
+		u16 source_count = readU16(is);
+		for (u16 i = 0; i < source_count; i++) {
+			std::string source_name = deSerializeString16(is);
+			std::string hash = deSerializeString16(is);
+			if (sources.getHash(source_name) != hash)
+				return NULL;
+		}
+
+		dim.Width = readU32(is);
+		dim.Height = readU32(is);
+		decompressZlib(is, pixels);
+	} catch (SerializationError &e) {
+		warningstream << "GeneratedImageCache: Ignoring invalid image \""
+			<< name << "\": " << e.what() << std::endl;
+		return NULL;
+	}
+
+	const std::string &pixel_data = pixels.str();
+	if (pixel_data.size() != (size_t)dim.Width * dim.Height * 4)
+		return NULL;
+
+	video::IImage *img = RenderingEngine::get_video_driver()->
+		createImage(video::ECF_A8R8G8B8, dim);
+	memcpy(img->lock(), pixel_data.c_str(), pixel_data.size());
+	img->unlock();
+
+	hits++;
+	return img;
+}
+
+void GeneratedImageCache::save(const std::string &name, video::IImage *img,
+	const std::vector<std::string> &source_names, SourceImageCache &sources)
+{
+	if (img->getColorFormat() != video::ECF_A8R8G8B8 ||
+			source_names.size() > U16_MAX)
+		return;
+
+	std::ostringstream os(std::ios::binary);
+	writeU8(os, 1); // version
+	os << serializeString32(name);
+	writeU16(os, source_names.size());
+	for (const std::string &source_name : source_names) {
+		os << serializeString16(source_name);
+		os << serializeString16(sources.getHash(source_name));
+	}
+
+	core::dimension2d<u32> dim = img->getDimension();
+	writeU32(os, dim.Width);
+	writeU32(os, dim.Height);
+	compressZlib((const u8 *)img->lock(), img->getImageDataSizeInBytes(), os);
+	img->unlock();
+
+	if (!fs::safeWriteToFile(getPath(name), os.str()))
+		warningstream << "GeneratedImageCache: Failed to save \"" << name
+			<< "\"" << std::endl;
+}
+
 /*
 	TextureSource
 */
@@ -352,6 +589,10 @@ class TextureSource : public IWritableTextureSource
 	*/
 	video::ITexture* getTextureForMesh(const std::string &name, u32 *id);
 
+	// Generates the textures for getTextureForMesh() that don't exist yet,
+	// in parallel if enabled. Shall be called from the main thread.
+	void prefetchTexturesForMesh(const std::vector<std::string> &names);
+
 	virtual Palette* getPalette(const std::string &name);
 
 	bool isKnownSourceImage(const std::string &name)
@@ -388,12 +629,25 @@ class TextureSource : public IWritableTextureSource
 	std::thread::id m_main_thread;
 
 	// Cache of source images
-	// This should be only accessed from the main thread
+	// Images are only inserted by the main thread
 	SourceImageCache m_sourcecache;
 
+	// Generated images on disk, NULL if disabled
+	std::unique_ptr<GeneratedImageCache> m_image_cache;
+
+	// Threads generating independent images, NULL if disabled
+	std::unique_ptr<WorkerPool> m_generation_pool;
+
 	// Generate a texture
 	u32 generateTexture(const std::string &name);
 
+	// Adds a texture made from a generated image (or a NULL texture if img
+	// is NULL) to the caches. Drops img.
+	u32 addTexture(const std::string &name, video::IImage *img);
+
+	// Name of the texture returned by getTextureForMesh()
+	std::string getTextureNameForMesh(const std::string &name);
+
 	// Generate image based on a string like "stone.png" or "[crack:1:0".
 	// if baseimg is NULL, it is created. Otherwise stuff is made on it.
 	bool generateImagePart(std::string part_of_name, video::IImage *& baseimg);
@@ -405,6 +659,16 @@ class TextureSource : public IWritableTextureSource
 	 */
 	video::IImage* generateImage(const std::string &name);
 
+	/*! Like generateImage(), but loads the image from m_image_cache if
+	 * possible and saves it there otherwise.
+	 * May be called from any thread.
+	 */
+	video::IImage* generateImageCached(const std::string &name);
+
+	// Generates the images for names, on m_generation_pool if enabled
+	void generateImages(const std::vector<std::string> &names,
+		std::vector<video::IImage *> *images);
+
 	// Thread-safe cache of what source images are known (true = known)
 	MutexedMap<std::string, bool> m_source_image_existence;
 
@@ -451,6 +715,23 @@ TextureSource::TextureSource()
 	m_setting_trilinear_filter = g_settings->getBool("trilinear_filter");
 	m_setting_bilinear_filter = g_settings->getBool("bilinear_filter");
 	m_setting_anisotropic_filter = g_settings->getBool("anisotropic_filter");
+
+	if (g_settings->getBool("enable_texture_cache")) {
+		// The settings used by [applyfiltersformesh
+		std::ostringstream settings;
+		settings << g_settings->getBool("texture_clean_transparent") << " "
+			<< (m_setting_trilinear_filter || m_setting_bilinear_filter) << " "
+			<< g_settings->getS32("texture_min_size");
+		m_image_cache.reset(new GeneratedImageCache(
+			porting::path_cache + DIR_DELIM + "textures", settings.str()));
+	}
+
+#if !ENABLE_GLES
+	// With GLES, generating images may need the GL context of the main thread
+	u16 generation_threads = g_settings->getU16("texture_generation_threads");
+	if (generation_threads > 0)
+		m_generation_pool.reset(new WorkerPool("TextureGen", generation_threads));
+#endif
 }
 
 TextureSource::~TextureSource()
@@ -528,44 +809,13 @@ u32 TextureSource::getTextureId(const std::string &name)
 	return 0;
 }
 
-// Draw an image on top of an another one, using the alpha channel of the
-// source image
-static void blit_with_alpha(video::IImage *src, video::IImage *dst,
-		v2s32 src_pos, v2s32 dst_pos, v2u32 size);
-
-// Like blit_with_alpha, but only modifies destination pixels that
-// are fully opaque
-static void blit_with_alpha_overlay(video::IImage *src, video::IImage *dst,
-		v2s32 src_pos, v2s32 dst_pos, v2u32 size);
-
-// Apply a color to an image.  Uses an int (0-255) to calculate the ratio.
-// If the ratio is 255 or -1 and keep_alpha is true, then it multiples the
-// color alpha with the destination alpha.
-// Otherwise, any pixels that are not fully transparent get the color alpha.
-static void apply_colorize(video::IImage *dst, v2u32 dst_pos, v2u32 size,
-		const video::SColor &color, int ratio, bool keep_alpha);
-
-// paint a texture using the given color
-static void apply_multiplication(video::IImage *dst, v2u32 dst_pos, v2u32 size,
-		const video::SColor &color);
-
-// Apply a mask to an image
-static void apply_mask(video::IImage *mask, video::IImage *dst,
-		v2s32 mask_pos, v2s32 dst_pos, v2u32 size);
-
 // Draw or overlay a crack
 static void draw_crack(video::IImage *crack, video::IImage *dst,
 		bool use_overlay, s32 frame_count, s32 progression,
 		video::IVideoDriver *driver, u8 tiles = 1);
 
-// Brighten image
-void brighten(video::IImage *image);
 // Parse a transform name
 u32 parseImageTransform(const std::string& s);
-// Apply transform to image dimension
-core::dimension2d<u32> imageTransformDimension(u32 transform, core::dimension2d<u32> dim);
-// Apply transform to image data
-void imageTransform(u32 transform, video::IImage *src, video::IImage *dst);
 
 /*
 	This method generates all the textures
@@ -601,11 +851,14 @@ u32 TextureSource::generateTexture(const std::string &name)
 		return 0;
 	}
 
+	return addTexture(name, generateImageCached(name));
+}
+
+u32 TextureSource::addTexture(const std::string &name, video::IImage *img)
+{
 	video::IVideoDriver *driver = RenderingEngine::get_video_driver();
 	sanity_check(driver);
 
-	video::IImage *img = generateImage(name);
-
 	video::ITexture *tex = NULL;
 
 	if (img != NULL) {
@@ -666,7 +919,7 @@ video::ITexture* TextureSource::getTexture(const std::string &name, u32 *id)
 	return getTexture(actual_id);
 }
 
-video::ITexture* TextureSource::getTextureForMesh(const std::string &name, u32 *id)
+std::string TextureSource::getTextureNameForMesh(const std::string &name)
 {
 	static thread_local bool filter_needed =
 		g_settings->getBool("texture_clean_transparent") ||
@@ -674,8 +927,46 @@ video::ITexture* TextureSource::getTextureForMesh(const std::string &name, u32 *
 		g_settings->getS32("texture_min_size") > 1);
 	// Avoid duplicating texture if it won't actually change
 	if (filter_needed)
-		return getTexture(name + "^[applyfiltersformesh", id);
-	return getTexture(name, id);
+		return name + "^[applyfiltersformesh";
+	return name;
+}
+
+video::ITexture* TextureSource::getTextureForMesh(const std::string &name, u32 *id)
+{
+	return getTexture(getTextureNameForMesh(name), id);
+}
+
+void TextureSource::prefetchTexturesForMesh(const std::vector<std::string> &names)
+{
+	sanity_check(std::this_thread::get_id() == m_main_thread);
+
+	std::vector<std::string> missing;
+	{
+		MutexAutoLock lock(m_textureinfo_cache_mutex);
+		std::unordered_set<std::string> seen;
+		for (const std::string &name : names) {
+			if (name.empty())
+				continue;
+			std::string full_name = getTextureNameForMesh(name);
+			if (!seen.insert(full_name).second)
+				continue;
+			if (m_name_to_id.find(full_name) == m_name_to_id.end())
+				missing.push_back(full_name);
+		}
+	}
+
+	TimeTaker timer("prefetchTexturesForMesh", nullptr, PRECISION_MILLI);
+	u32 hits_before = m_image_cache ? m_image_cache->hits.load() : 0;
+
+	std::vector<video::IImage *> images;
+	generateImages(missing, &images);
+	for (size_t i = 0; i < missing.size(); i++)
+		addTexture(missing[i], images[i]);
+
+	infostream << "TextureSource: generated " << missing.size()
+		<< " textures in " << timer.stop(true) << " ms ("
+		<< (m_image_cache ? m_image_cache->hits.load() - hits_before : 0)
+		<< " from the disk cache)" << std::endl;
 }
 
 Palette* TextureSource::getPalette(const std::string &name)
@@ -773,9 +1064,20 @@ void TextureSource::rebuildImagesAndTextures()
 	infostream << "TextureSource: recreating " << m_textureinfo_cache.size()
 		<< " textures" << std::endl;
 
+	TimeTaker timer("rebuildImagesAndTextures", nullptr, PRECISION_MILLI);
+	u32 hits_before = m_image_cache ? m_image_cache->hits.load() : 0;
+
+	std::vector<std::string> names;
+	names.reserve(m_textureinfo_cache.size());
+	for (const TextureInfo &ti : m_textureinfo_cache)
+		names.push_back(ti.name);
+	std::vector<video::IImage *> images;
+	generateImages(names, &images);
+
 	// Recreate textures
-	for (TextureInfo &ti : m_textureinfo_cache) {
-		video::IImage *img = generateImage(ti.name);
+	for (size_t i = 0; i < m_textureinfo_cache.size(); i++) {
+		TextureInfo &ti = m_textureinfo_cache[i];
+		video::IImage *img = images[i];
 #if ENABLE_GLES
 		img = Align2Npot2(img, driver);
 #endif
@@ -793,6 +1095,10 @@ void TextureSource::rebuildImagesAndTextures()
 		if (t_old)
 			m_texture_trash.push_back(t_old);
 	}
+
+	infostream << "TextureSource: recreated textures in " << timer.stop(true)
+		<< " ms (" << (m_image_cache ? m_image_cache->hits.load() - hits_before : 0)
+		<< " from the disk cache)" << std::endl;
 }
 
 inline static void applyShadeFactor(video::SColor &color, u32 factor)
@@ -1013,6 +1319,43 @@ video::IImage* TextureSource::generateImage(const std::string &name)
 	return baseimg;
 }
 
+video::IImage* TextureSource::generateImageCached(const std::string &name)
+{
+	// Source images would only be copied
+	if (!m_image_cache || name.find_first_of("^[") == std::string::npos)
+		return generateImage(name);
+
+	video::IImage *img = m_image_cache->load(name, m_sourcecache);
+	if (img)
+		return img;
+
+	ImageSources sources;
+	t_image_sources = &sources;
+	img = generateImage(name);
+	t_image_sources = nullptr;
+
+	// Images with dummies for missing source images aren't saved
+	if (img && sources.complete)
+		m_image_cache->save(name, img, sources.names, m_sourcecache);
+	return img;
+}
+
+void TextureSource::generateImages(const std::vector<std::string> &names,
+	std::vector<video::IImage *> *images)
+{
+	images->assign(names.size(), nullptr);
+	auto generate = [&] (u32 i) {
+		(*images)[i] = generateImageCached(names[i]);
+	};
+
+	if (m_generation_pool) {
+		m_generation_pool->parallelFor(names.size(), generate);
+	} else {
+		for (u32 i = 0; i < names.size(); i++)
+			generate(i);
+	}
+}
+
 #if ENABLE_GLES
 
 
@@ -1104,6 +1447,7 @@ bool TextureSource::generateImagePart(std::string part_of_name,
 	// Stuff starting with [ are special commands
 	if (part_of_name.empty() || part_of_name[0] != '[') {
 		video::IImage *image = m_sourcecache.getOrLoad(part_of_name);
+		record_image_source(part_of_name, image != NULL);
 #if ENABLE_GLES
 		image = Align2Npot2(image, driver);
 #endif
@@ -1194,7 +1538,7 @@ bool TextureSource::generateImagePart(std::string part_of_name,
 			}
 		}
 		//cleanup
-		image->drop();
+		m_sourcecache.release(image);
 	}
 	else
 	{
@@ -1246,12 +1590,13 @@ bool TextureSource::generateImagePart(std::string part_of_name,
 				*/
 				video::IImage *img_crack = m_sourcecache.getOrLoad(
 					"crack_anylength.png");
+				record_image_source("crack_anylength.png", img_crack != NULL);
 
 				if (img_crack) {
 					draw_crack(img_crack, baseimg,
 						use_overlay, frame_count,
 						progression, driver, tiles);
-					img_crack->drop();
+					m_sourcecache.release(img_crack);
 				}
 			}
 		}
@@ -1822,182 +2167,6 @@ bool TextureSource::generateImagePart(std::string part_of_name,
 	return true;
 }
 
-/*
-	Calculate the color of a single pixel drawn on top of another pixel.
-
-	This is a little more complicated than just video::SColor::getInterpolated
-	because getInterpolated does not handle alpha correctly.  For example, a
-	pixel with alpha=64 drawn atop a pixel with alpha=128 should yield a
-	pixel with alpha=160, while getInterpolated would yield alpha=96.
-*/
-static inline video::SColor blitPixel(const video::SColor &src_c, const video::SColor &dst_c, u32 ratio)
-{
-	if (dst_c.getAlpha() == 0)
-		return src_c;
-	video::SColor out_c = src_c.getInterpolated(dst_c, (float)ratio / 255.0f);
-	out_c.setAlpha(dst_c.getAlpha() + (255 - dst_c.getAlpha()) *
-		src_c.getAlpha() * ratio / (255 * 255));
-	return out_c;
-}
-
-/*
-	Draw an image on top of an another one, using the alpha channel of the
-	source image
-
-	This exists because IImage::copyToWithAlpha() doesn't seem to always
-	work.
-*/
-static void blit_with_alpha(video::IImage *src, video::IImage *dst,
-		v2s32 src_pos, v2s32 dst_pos, v2u32 size)
-{
-	for (u32 y0=0; y0<size.Y; y0++)
-	for (u32 x0=0; x0<size.X; x0++)
-	{
-		s32 src_x = src_pos.X + x0;
-		s32 src_y = src_pos.Y + y0;
-		s32 dst_x = dst_pos.X + x0;
-		s32 dst_y = dst_pos.Y + y0;
-		video::SColor src_c = src->getPixel(src_x, src_y);
-		video::SColor dst_c = dst->getPixel(dst_x, dst_y);
-		dst_c = blitPixel(src_c, dst_c, src_c.getAlpha());
-		dst->setPixel(dst_x, dst_y, dst_c);
-	}
-}
-
-/*
-	Draw an image on top of an another one, using the alpha channel of the
-	source image; only modify fully opaque pixels in destinaion
-*/
-static void blit_with_alpha_overlay(video::IImage *src, video::IImage *dst,
-		v2s32 src_pos, v2s32 dst_pos, v2u32 size)
-{
-	for (u32 y0=0; y0<size.Y; y0++)
-	for (u32 x0=0; x0<size.X; x0++)
-	{
-		s32 src_x = src_pos.X + x0;
-		s32 src_y = src_pos.Y + y0;
-		s32 dst_x = dst_pos.X + x0;
-		s32 dst_y = dst_pos.Y + y0;
-		video::SColor src_c = src->getPixel(src_x, src_y);
-		video::SColor dst_c = dst->getPixel(dst_x, dst_y);
-		if (dst_c.getAlpha() == 255 && src_c.getAlpha() != 0)
-		{
-			dst_c = blitPixel(src_c, dst_c, src_c.getAlpha());
-			dst->setPixel(dst_x, dst_y, dst_c);
-		}
-	}
-}
-
-// This function has been disabled because it is currently unused.
-// Feel free to re-enable if you find it handy.
-#if 0
-/*
-	Draw an image on top of an another one, using the specified ratio
-	modify all partially-opaque pixels in the destination.
-*/
-static void blit_with_interpolate_overlay(video::IImage *src, video::IImage *dst,
-		v2s32 src_pos, v2s32 dst_pos, v2u32 size, int ratio)
-{
-	for (u32 y0 = 0; y0 < size.Y; y0++)
-	for (u32 x0 = 0; x0 < size.X; x0++)
-	{
-		s32 src_x = src_pos.X + x0;
-		s32 src_y = src_pos.Y + y0;
-		s32 dst_x = dst_pos.X + x0;
-		s32 dst_y = dst_pos.Y + y0;
-		video::SColor src_c = src->getPixel(src_x, src_y);
-		video::SColor dst_c = dst->getPixel(dst_x, dst_y);
-		if (dst_c.getAlpha() > 0 && src_c.getAlpha() != 0)
-		{
-			if (ratio == -1)
-				dst_c = src_c.getInterpolated(dst_c, (float)src_c.getAlpha()/255.0f);
-			else
-				dst_c = src_c.getInterpolated(dst_c, (float)ratio/255.0f);
-			dst->setPixel(dst_x, dst_y, dst_c);
-		}
-	}
-}
-#endif
-
-/*
-	Apply color to destination
-*/
-static void apply_colorize(video::IImage *dst, v2u32 dst_pos, v2u32 size,
-		const video::SColor &color, int ratio, bool keep_alpha)
-{
-	u32 alpha = color.getAlpha();
-	video::SColor dst_c;
-	if ((ratio == -1 && alpha == 255) || ratio == 255) { // full replacement of color
-		if (keep_alpha) { // replace the color with alpha = dest alpha * color alpha
-			dst_c = color;
-			for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
-			for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++) {
-				u32 dst_alpha = dst->getPixel(x, y).getAlpha();
-				if (dst_alpha > 0) {
-					dst_c.setAlpha(dst_alpha * alpha / 255);
-					dst->setPixel(x, y, dst_c);
-				}
-			}
-		} else { // replace the color including the alpha
-			for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
-			for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++)
-				if (dst->getPixel(x, y).getAlpha() > 0)
-					dst->setPixel(x, y, color);
-		}
-	} else {  // interpolate between the color and destination
-		float interp = (ratio == -1 ? color.getAlpha() / 255.0f : ratio / 255.0f);
-		for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
-		for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++) {
-			dst_c = dst->getPixel(x, y);
-			if (dst_c.getAlpha() > 0) {
-				dst_c = color.getInterpolated(dst_c, interp);
-				dst->setPixel(x, y, dst_c);
-			}
-		}
-	}
-}
-
-/*
-	Apply color to destination
-*/
-static void apply_multiplication(video::IImage *dst, v2u32 dst_pos, v2u32 size,
-		const video::SColor &color)
-{
-	video::SColor dst_c;
-
-	for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
-	for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++) {
-		dst_c = dst->getPixel(x, y);
-		dst_c.set(
-				dst_c.getAlpha(),
-				(dst_c.getRed() * color.getRed()) / 255,
-				(dst_c.getGreen() * color.getGreen()) / 255,
-				(dst_c.getBlue() * color.getBlue()) / 255
-				);
-		dst->setPixel(x, y, dst_c);
-	}
-}
-
-/*
-	Apply mask to destination
-*/
-static void apply_mask(video::IImage *mask, video::IImage *dst,
-		v2s32 mask_pos, v2s32 dst_pos, v2u32 size)
-{
-	for (u32 y0 = 0; y0 < size.Y; y0++) {
-		for (u32 x0 = 0; x0 < size.X; x0++) {
-			s32 mask_x = x0 + mask_pos.X;
-			s32 mask_y = y0 + mask_pos.Y;
-			s32 dst_x = x0 + dst_pos.X;
-			s32 dst_y = y0 + dst_pos.Y;
-			video::SColor mask_c = mask->getPixel(mask_x, mask_y);
-			video::SColor dst_c = dst->getPixel(dst_x, dst_y);
-			dst_c.color &= mask_c.color;
-			dst->setPixel(dst_x, dst_y, dst_c);
-		}
-	}
-}
-
 video::IImage *create_crack_image(video::IImage *crack, s32 frame_index,
 		core::dimension2d<u32> size, u8 tiles, video::IVideoDriver *driver)
 {
@@ -2072,24 +2241,6 @@ static void draw_crack(video::IImage *crack, video::IImage *dst,
 	crack_scaled->drop();
 }
 
-void brighten(video::IImage *image)
-{
-	if (image == NULL)
-		return;
-
-	core::dimension2d<u32> dim = image->getDimension();
-
-	for (u32 y=0; y<dim.Height; y++)
-	for (u32 x=0; x<dim.Width; x++)
-	{
-		video::SColor c = image->getPixel(x,y);
-		c.setRed(0.5 * 255 + 0.5 * (float)c.getRed());
-		c.setGreen(0.5 * 255 + 0.5 * (float)c.getGreen());
-		c.setBlue(0.5 * 255 + 0.5 * (float)c.getBlue());
-		image->setPixel(x,y,c);
-	}
-}
-
 u32 parseImageTransform(const std::string& s)
 {
 	int total_transform = 0;
@@ -2140,59 +2291,6 @@ u32 parseImageTransform(const std::string& s)
 	return total_transform;
 }
 
-core::dimension2d<u32> imageTransformDimension(u32 transform, core::dimension2d<u32> dim)
-{
-	if (transform % 2 == 0)
-		return dim;
-
-	return core::dimension2d<u32>(dim.Height, dim.Width);
-}
-
-void imageTransform(u32 transform, video::IImage *src, video::IImage *dst)
-{
-	if (src == NULL || dst == NULL)
-		return;
-
-	core::dimension2d<u32> dstdim = dst->getDimension();
-
-	// Pre-conditions
-	assert(dstdim == imageTransformDimension(transform, src->getDimension()));
-	assert(transform <= 7);
-
-	/*
-		Compute the transformation from source coordinates (sx,sy)
-		to destination coordinates (dx,dy).
-	*/
-	int sxn = 0;
-	int syn = 2;
-	if (transform == 0)         // identity
-		sxn = 0, syn = 2;  //   sx = dx, sy = dy
-	else if (transform == 1)    // rotate by 90 degrees ccw
-		sxn = 3, syn = 0;  //   sx = (H-1) - dy, sy = dx
-	else if (transform == 2)    // rotate by 180 degrees
-		sxn = 1, syn = 3;  //   sx = (W-1) - dx, sy = (H-1) - dy
-	else if (transform == 3)    // rotate by 270 degrees ccw
-		sxn = 2, syn = 1;  //   sx = dy, sy = (W-1) - dx
-	else if (transform == 4)    // flip x
-		sxn = 1, syn = 2;  //   sx = (W-1) - dx, sy = dy
-	else if (transform == 5)    // flip x then rotate by 90 degrees ccw
-		sxn = 2, syn = 0;  //   sx = dy, sy = dx
-	else if (transform == 6)    // flip y
-		sxn = 0, syn = 3;  //   sx = dx, sy = (H-1) - dy
-	else if (transform == 7)    // flip y then rotate by 90 degrees ccw
-		sxn = 3, syn = 1;  //   sx = (H-1) - dy, sy = (W-1) - dx
-
-	for (u32 dy=0; dy<dstdim.Height; dy++)
-	for (u32 dx=0; dx<dstdim.Width; dx++)
-	{
-		u32 entries[4] = {dx, dstdim.Width-1-dx, dy, dstdim.Height-1-dy};
-		u32 sx = entries[sxn];
-		u32 sy = entries[syn];
-		video::SColor c = src->getPixel(sx,sy);
-		dst->setPixel(dx,dy,c);
-	}
-}
-
 video::ITexture* TextureSource::getNormalTexture(const std::string &name)
 {
 	if (isKnownSourceImage("override_normal.png"))
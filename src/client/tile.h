@@ -96,6 +96,13 @@ class ITextureSource : public ISimpleTextureSource
 			const std::string &name, u32 *id = nullptr)=0;
 	virtual video::ITexture* getTextureForMesh(
 			const std::string &name, u32 *id = nullptr) = 0;
+	/*!
+	 * Generates the textures that getTextureForMesh() would return for
+	 * the given names at once, so that independent textures can be
+	 * generated in parallel.
+	 * Should be called from the main thread.
+	 */
+	virtual void prefetchTexturesForMesh(const std::vector<std::string> &names) = 0;
 	/*!
 	 * Returns a palette from the given texture name.
 	 * The pointer is valid until the texture source is
@@ -726,15 +726,14 @@ void ClientInterface::sendToAllCompat(NetworkPacket *pkt, NetworkPacket *legacyp
 		RemoteClient *client = client_it.second;
 		NetworkPacket *pkt_to_send = nullptr;
 
-		if (client->net_proto_version >= min_proto_ver) {
+		// Clients that did not finish the handshake yet have no version
+		if (client->net_proto_version == 0)
+			continue;
+
+		if (client->net_proto_version >= min_proto_ver)
 			pkt_to_send = pkt;
-		} else if (client->net_proto_version != 0) {
+		else
 			pkt_to_send = legacypkt;
-		} else {
-			warningstream << "Client with unhandled version to handle: '"
-				<< client->net_proto_version << "'";
-			continue;
-		}
 
 		m_con->Send(client->peer_id,
 			clientCommandFactoryTable[pkt_to_send->getCommand()].channel,
@@ -229,7 +229,7 @@ collisionMoveResult collisionMoveSimple(Environment *env, IGameDef *gamedef,
 		v3f accel_f, ActiveObject *self,
 		bool collideWithObjects)
 {
-	static bool time_notification_done = false;
+	static thread_local bool time_notification_done = false;
 	Map *map = &env->getMap();
 
 	ScopeProfiler sp(g_profiler, "collisionMoveSimple()", SPT_AVG);
@@ -28,6 +28,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "settings.h"
 #include "porting.h"
 #include "convert_json.h"
+#include "database/database.h"
 
 bool parseDependsString(std::string &dep, std::unordered_set<char> &symbols)
 {
@@ -395,83 +396,70 @@ ClientModConfiguration::ClientModConfiguration(const std::string &path) :
 }
 #endif
 
-ModMetadata::ModMetadata(const std::string &mod_name) : m_mod_name(mod_name)
+ModMetadata::ModMetadata(const std::string &mod_name,
+		ModMetadataDatabase *database) :
+	m_mod_name(mod_name),
+	m_database(database)
 {
 }
 
 void ModMetadata::clear()
 {
 	Metadata::clear();
-	m_modified = true;
+	m_loaded = true;
+	m_cleared = true;
+	m_modified_keys.clear();
 }
 
-bool ModMetadata::save(const std::string &root_path)
+void ModMetadata::load()
 {
-	Json::Value json;
-	for (StringMap::const_iterator it = m_stringvars.begin();
-			it != m_stringvars.end(); ++it) {
-		json[it->first] = it->second;
-	}
-
-	if (!fs::PathExists(root_path)) {
-		if (!fs::CreateAllDirs(root_path)) {
-			errorstream << "ModMetadata[" << m_mod_name
-				    << "]: Unable to save. '" << root_path
-				    << "' tree cannot be created." << std::endl;
-			return false;
-		}
-	} else if (!fs::IsDir(root_path)) {
-		errorstream << "ModMetadata[" << m_mod_name << "]: Unable to save. '"
-			    << root_path << "' is not a directory." << std::endl;
-		return false;
-	}
+	if (m_loaded)
+		return;
 
-	bool w_ok = fs::safeWriteToFile(
-			root_path + DIR_DELIM + m_mod_name, fastWriteJson(json));
-
-	if (w_ok) {
-		m_modified = false;
-	} else {
-		errorstream << "ModMetadata[" << m_mod_name << "]: failed write file."
-			    << std::endl;
+	m_loaded = true;
+	if (!m_database->getModEntries(m_mod_name, &m_stringvars)) {
+		errorstream << "ModMetadata[" << m_mod_name
+			<< "]: failed to read data." << std::endl;
 	}
-	return w_ok;
 }
 
-bool ModMetadata::load(const std::string &root_path)
+bool ModMetadata::save()
 {
-	m_stringvars.clear();
-
-	std::ifstream is((root_path + DIR_DELIM + m_mod_name).c_str(),
-			std::ios_base::binary);
-	if (!is.good()) {
+	// Keep everything that could not be written so the next save retries it
+	if (m_cleared && !m_database->removeModEntries(m_mod_name)) {
+		errorstream << "ModMetadata[" << m_mod_name
+			<< "]: failed to clear data." << std::endl;
 		return false;
 	}
 
-	Json::Value root;
-	Json::CharReaderBuilder builder;
-	builder.settings_["collectComments"] = false;
-	std::string errs;
+	std::set<std::string> failed_keys;
+	for (const std::string &key : m_modified_keys) {
+		bool ok = true;
+		StringMap::const_iterator it = m_stringvars.find(key);
+		if (it != m_stringvars.end())
+			ok = m_database->setModEntry(m_mod_name, key, it->second);
+		else if (!m_cleared)
+			ok = m_database->removeModEntry(m_mod_name, key);
+		if (!ok)
+			failed_keys.insert(key);
+	}
 
-	if (!Json::parseFromStream(builder, is, &root, &errs)) {
+	m_cleared = false;
+	m_modified_keys.swap(failed_keys);
+	if (!m_modified_keys.empty()) {
 		errorstream << "ModMetadata[" << m_mod_name
-			    << "]: failed read data "
-			       "(Json decoding failure). Message: "
-			    << errs << std::endl;
+			<< "]: failed to write data." << std::endl;
 		return false;
 	}
-
-	const Json::Value::Members attr_list = root.getMemberNames();
-	for (const auto &it : attr_list) {
-		Json::Value attr_value = root[it];
-		m_stringvars[it] = attr_value.asString();
-	}
-
 	return true;
 }
 
 bool ModMetadata::setString(const std::string &name, const std::string &var)
 {
-	m_modified = Metadata::setString(name, var);
-	return m_modified;
+	load();
+	if (!Metadata::setString(name, var))
+		return false;
+
+	m_modified_keys.insert(name);
+	return true;
 }
@@ -140,24 +140,37 @@ class ClientModConfiguration : public ModConfiguration
 };
 #endif
 
+class ModMetadataDatabase;
+
+/*
+	The storage of a mod. The entries are read from the database on first use
+	and only the changed ones are written back.
+*/
 class ModMetadata : public Metadata
 {
 public:
 	ModMetadata() = delete;
-	ModMetadata(const std::string &mod_name);
+	ModMetadata(const std::string &mod_name, ModMetadataDatabase *database);
 	~ModMetadata() = default;
 
 	virtual void clear();
 
-	bool save(const std::string &root_path);
-	bool load(const std::string &root_path);
+	// Reads the entries if that wasn't done yet. Call it before reading.
+	void load();
+	// Writes the changed entries. Call it between beginSave() and endSave()
+	// of the database to write them in one transaction.
+	bool save();
 
-	bool isModified() const { return m_modified; }
+	bool isModified() const { return m_cleared || !m_modified_keys.empty(); }
 	const std::string &getModName() const { return m_mod_name; }
 
 	virtual bool setString(const std::string &name, const std::string &var);
 
 private:
 	std::string m_mod_name;
-	bool m_modified = false;
+	ModMetadataDatabase *m_database;
+	bool m_loaded = false;
+	// All entries in the database have to be removed
+	bool m_cleared = false;
+	std::set<std::string> m_modified_keys;
 };
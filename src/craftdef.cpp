@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "log.h"
 #include <sstream>
 #include <set>
+#include <list>
 #include <algorithm>
 #include "gamedef.h"
 #include "inventory.h"
@@ -31,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include "util/strfnd.h"
 #include "exceptions.h"
+#include "threading/mutex_auto_lock.h"
 
 inline bool isGroupRecipeStr(const std::string &rec_name)
 {
@@ -80,14 +82,19 @@ static u64 getHashForGrid(CraftHashType type, const std::vector<std::string> &gr
 }
 
 // Check if input matches recipe
-// Takes recipe groups into account
+// Takes recipe groups into account, using group_index if it is given
 static bool inputItemMatchesRecipe(const std::string &inp_name,
-		const std::string &rec_name, IItemDefManager *idef)
+		const std::string &rec_name, IItemDefManager *idef,
+		const CraftGroupIndex *group_index = nullptr)
 {
 	// Exact name
 	if (inp_name == rec_name)
 		return true;
 
+	if (group_index)
+		return isGroupRecipeStr(rec_name) &&
+			group_index->matches(inp_name, rec_name);
+
 	// Group
 	if (isGroupRecipeStr(rec_name) && idef->isKnown(inp_name)) {
 		const struct ItemDefinition &def = idef->get(inp_name);
@@ -283,6 +290,74 @@ std::string craftDumpMatrix(const std::vector<ItemStack> &items,
 }
 
 
+/*
+	CraftGroupIndex
+*/
+
+void CraftGroupIndex::addRecipeItem(const std::string &rec_name)
+{
+	if (!isGroupRecipeStr(rec_name) || m_recipe_items.count(rec_name))
+		return;
+
+	GroupSet &groups = m_recipe_items[rec_name];
+	Strfnd f(rec_name.substr(6));
+	do {
+		std::string group = f.next(",");
+		auto it = m_group_ids.emplace(group, m_group_ids.size()).first;
+		u32 id = it->second;
+		if (groups.size() <= id / 64)
+			groups.resize(id / 64 + 1, 0);
+		groups[id / 64] |= (u64)1 << (id % 64);
+	} while (!f.at_end());
+}
+
+void CraftGroupIndex::addItems(IItemDefManager *idef)
+{
+	m_items.clear();
+
+	std::set<std::string> names;
+	idef->getAll(names);
+	for (const std::string &name : names) {
+		GroupSet groups;
+		for (const auto &group : idef->get(name).groups) {
+			auto it = m_group_ids.find(group.first);
+			if (group.second == 0 || it == m_group_ids.end())
+				continue;
+			u32 id = it->second;
+			if (groups.size() <= id / 64)
+				groups.resize(id / 64 + 1, 0);
+			groups[id / 64] |= (u64)1 << (id % 64);
+		}
+		m_items[name] = std::move(groups);
+	}
+}
+
+void CraftGroupIndex::clear()
+{
+	m_group_ids.clear();
+	m_recipe_items.clear();
+	m_items.clear();
+}
+
+bool CraftGroupIndex::matches(const std::string &inp_name,
+		const std::string &rec_name) const
+{
+	auto item = m_items.find(inp_name);
+	if (item == m_items.end())
+		return false;
+	auto rec = m_recipe_items.find(rec_name);
+	assert(rec != m_recipe_items.end());
+
+	const GroupSet &required = rec->second;
+	const GroupSet &groups = item->second;
+	for (size_t i = 0; i < required.size(); i++) {
+		u64 has = i < groups.size() ? groups[i] : 0;
+		if ((required[i] & has) != required[i])
+			return false;
+	}
+	return true;
+}
+
 /*
 	CraftInput
 */
@@ -413,7 +488,8 @@ bool CraftDefinitionShaped::check(const CraftInput &input, IGameDef *gamedef) co
 
 			if (!inputItemMatchesRecipe(
 					inp_names[inp_y + inp_x],
-					rec_names[rec_y + rec_x], gamedef->idef())) {
+					rec_names[rec_y + rec_x], gamedef->idef(),
+					group_index)) {
 				return false;
 			}
 		}
@@ -449,12 +525,16 @@ u64 CraftDefinitionShaped::getHash(CraftHashType type) const
 	return getHashForGrid(type, rec_names);
 }
 
-void CraftDefinitionShaped::initHash(IGameDef *gamedef)
+void CraftDefinitionShaped::initHash(IGameDef *gamedef,
+		CraftGroupIndex *group_index)
 {
 	if (hash_inited)
 		return;
 	hash_inited = true;
 	recipe_names = craftGetItemNames(recipe, gamedef);
+	for (const std::string &rec_name : recipe_names)
+		group_index->addRecipeItem(rec_name);
+	this->group_index = group_index;
 
 	if (hasGroupItem(recipe_names))
 		hash_type = CRAFT_HASH_TYPE_COUNT;
@@ -530,7 +610,7 @@ bool CraftDefinitionShapeless::check(const CraftInput &input, IGameDef *gamedef)
 		for (size_t i=0; i<recipe.size(); i++) {
 			//dstream<<" ("<<input_filtered[i]<<" == "<<recipe_copy[i]<<")";
 			if (!inputItemMatchesRecipe(input_filtered[i], recipe_copy[i],
-					gamedef->idef())) {
+					gamedef->idef(), group_index)) {
 				all_match = false;
 				break;
 			}
@@ -567,13 +647,17 @@ u64 CraftDefinitionShapeless::getHash(CraftHashType type) const
 	return getHashForGrid(type, recipe_names);
 }
 
-void CraftDefinitionShapeless::initHash(IGameDef *gamedef)
+void CraftDefinitionShapeless::initHash(IGameDef *gamedef,
+		CraftGroupIndex *group_index)
 {
 	if (hash_inited)
 		return;
 	hash_inited = true;
 	recipe_names = craftGetItemNames(recipe, gamedef);
 	std::sort(recipe_names.begin(), recipe_names.end());
+	for (const std::string &rec_name : recipe_names)
+		group_index->addRecipeItem(rec_name);
+	this->group_index = group_index;
 
 	if (hasGroupItem(recipe_names))
 		hash_type = CRAFT_HASH_TYPE_COUNT;
@@ -734,6 +818,9 @@ bool CraftDefinitionCooking::check(const CraftInput &input, IGameDef *gamedef) c
 	}
 
 	// Check the single input item
+	if (hash_inited)
+		return inputItemMatchesRecipe(input_filtered[0], recipe_name,
+			gamedef->idef(), group_index);
 	return inputItemMatchesRecipe(input_filtered[0], recipe, gamedef->idef());
 }
 
@@ -770,12 +857,15 @@ u64 CraftDefinitionCooking::getHash(CraftHashType type) const
 	return 0;
 }
 
-void CraftDefinitionCooking::initHash(IGameDef *gamedef)
+void CraftDefinitionCooking::initHash(IGameDef *gamedef,
+		CraftGroupIndex *group_index)
 {
 	if (hash_inited)
 		return;
 	hash_inited = true;
 	recipe_name = craftGetItemName(recipe, gamedef);
+	group_index->addRecipeItem(recipe_name);
+	this->group_index = group_index;
 
 	if (isGroupRecipeStr(recipe_name))
 		hash_type = CRAFT_HASH_TYPE_COUNT;
@@ -836,6 +926,9 @@ bool CraftDefinitionFuel::check(const CraftInput &input, IGameDef *gamedef) cons
 	}
 
 	// Check the single input item
+	if (hash_inited)
+		return inputItemMatchesRecipe(input_filtered[0], recipe_name,
+			gamedef->idef(), group_index);
 	return inputItemMatchesRecipe(input_filtered[0], recipe, gamedef->idef());
 }
 
@@ -872,12 +965,15 @@ u64 CraftDefinitionFuel::getHash(CraftHashType type) const
 	return 0;
 }
 
-void CraftDefinitionFuel::initHash(IGameDef *gamedef)
+void CraftDefinitionFuel::initHash(IGameDef *gamedef,
+		CraftGroupIndex *group_index)
 {
 	if (hash_inited)
 		return;
 	hash_inited = true;
 	recipe_name = craftGetItemName(recipe, gamedef);
+	group_index->addRecipeItem(recipe_name);
+	this->group_index = group_index;
 
 	if (isGroupRecipeStr(recipe_name))
 		hash_type = CRAFT_HASH_TYPE_COUNT;
@@ -898,10 +994,36 @@ std::string CraftDefinitionFuel::dump() const
 	Craft definition manager
 */
 
+// Returns the key of the craft result cache for a crafting input.
+// Shaped recipes only look at the bounding box of the items and the other
+// recipes ignore the positions, so only the bounding box is part of it.
+static std::string craftGetCacheKey(const CraftInput &input, IGameDef *gamedef)
+{
+	std::vector<std::string> names = craftGetItemNames(input.items, gamedef);
+	unsigned int width = input.width;
+	unsigned int min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+	if (width != 0) {
+		while (names.size() % width != 0)
+			names.emplace_back("");
+		craftGetBounds(names, width, min_x, max_x, min_y, max_y);
+	} else {
+		// Never matches a shaped recipe; keep all items
+		max_x = names.size() - 1;
+	}
+
+	std::ostringstream os(std::ios::binary);
+	os << (int)input.method << ' ' << (width == 0 ? 0 : max_x - min_x + 1);
+	for (unsigned int y = min_y; y <= max_y; y++)
+	for (unsigned int x = min_x; x <= max_x; x++)
+		os << '\n' << names[y * width + x];
+	return os.str();
+}
+
 class CCraftDefManager: public IWritableCraftDefManager
 {
 public:
-	CCraftDefManager()
+	CCraftDefManager(u32 cache_size) :
+		m_cache_size(cache_size)
 	{
 		m_craft_defs.resize(craft_hash_type_max + 1);
 	}
@@ -918,56 +1040,37 @@ class CCraftDefManager: public IWritableCraftDefManager
 		if (input.empty())
 			return false;
 
-		std::vector<std::string> input_names;
-		input_names = craftGetItemNames(input.items, gamedef);
-		std::sort(input_names.begin(), input_names.end());
-
-		// Try hash types with increasing collision rate
-		// while remembering the latest, highest priority recipe.
 		CraftDefinition::RecipePriority priority_best =
 			CraftDefinition::PRIORITY_NO_RECIPE;
 		CraftDefinition *def_best = nullptr;
-		for (int type = 0; type <= craft_hash_type_max; type++) {
-			u64 hash = getHashForGrid((CraftHashType) type, input_names);
-
-			/*errorstream << "Checking type " << type << " with hash " << hash << std::endl;*/
-
-			// We'd like to do "const [...] hash_collisions = m_craft_defs[type][hash];"
-			// but that doesn't compile for some reason. This does.
-			auto col_iter = (m_craft_defs[type]).find(hash);
+		std::vector<CraftDefinition *> unchecked_defs;
 
-			if (col_iter == (m_craft_defs[type]).end())
-				continue;
-
-			const std::vector<CraftDefinition*> &hash_collisions = col_iter->second;
-			// Walk crafting definitions from back to front, so that later
-			// definitions can override earlier ones.
-			for (std::vector<CraftDefinition*>::size_type
-					i = hash_collisions.size(); i > 0; i--) {
-				CraftDefinition *def = hash_collisions[i - 1];
-
-				/*errorstream << "Checking " << input.dump() << std::endl
-					<< " against " << def->dump() << std::endl;*/
-
-				CraftDefinition::RecipePriority priority = def->getPriority();
-				if (priority > priority_best
-						&& def->check(input, gamedef)) {
-					// Check if the crafted node/item exists
-					CraftOutput out = def->getOutput(input, gamedef);
-					ItemStack is;
-					is.deSerialize(out.item, gamedef->idef());
-					if (!is.isKnown(gamedef->idef())) {
-						infostream << "trying to craft non-existent "
-							<< out.item << ", ignoring recipe" << std::endl;
-						continue;
-					}
+		std::string key = craftGetCacheKey(input, gamedef);
+		if (!getCachedCraft(key, &def_best, &unchecked_defs)) {
+			findCraft(input, gamedef, &def_best, &unchecked_defs);
+			setCachedCraft(key, def_best, unchecked_defs);
+		}
+		if (def_best) {
+			priority_best = def_best->getPriority();
+			output = def_best->getOutput(input, gamedef);
+		}
 
-					output = out;
-					priority_best = priority;
-					def_best = def;
-				}
+		// The recipes that depend on more than the item names are checked
+		// every time. They have a lower priority than the others, so that
+		// this gives the same result as checking everything in order.
+		for (CraftDefinition *def : unchecked_defs) {
+			CraftDefinition::RecipePriority priority = def->getPriority();
+			if (priority > priority_best && def->check(input, gamedef)) {
+				CraftOutput out = def->getOutput(input, gamedef);
+				if (!isOutputKnown(out, gamedef))
+					continue;
+
+				output = out;
+				priority_best = priority;
+				def_best = def;
 			}
 		}
+
 		if (priority_best == CraftDefinition::PRIORITY_NO_RECIPE)
 			return false;
 		if (decrementInput)
@@ -1014,6 +1117,7 @@ class CCraftDefManager: public IWritableCraftDefManager
 			delete def;
 		}
 		m_output_craft_definitions.erase(to_clear);
+		clearCachedCrafts();
 		return true;
 	}
 
@@ -1040,8 +1144,10 @@ class CCraftDefManager: public IWritableCraftDefManager
 			std::vector<CraftDefinition *> &outdefs = it->second;
 			outdefs.erase(std::remove(outdefs.begin(), outdefs.end(), def), outdefs.end());
 		}
-		if (got_hit)
+		if (got_hit) {
 			defs.swap(new_defs);
+			clearCachedCrafts();
+		}
 
 		return got_hit;
 	}
@@ -1074,6 +1180,7 @@ class CCraftDefManager: public IWritableCraftDefManager
 		std::string output_name = craftGetItemName(
 				def->getOutput(input, gamedef).item, gamedef);
 		m_output_craft_definitions[output_name].push_back(def);
+		clearCachedCrafts();
 	}
 	virtual void clear()
 	{
@@ -1087,6 +1194,8 @@ class CCraftDefManager: public IWritableCraftDefManager
 			m_craft_defs[type].clear();
 		}
 		m_output_craft_definitions.clear();
+		m_group_index.clear();
+		clearCachedCrafts();
 	}
 	virtual void initHashes(IGameDef *gamedef)
 	{
@@ -1095,7 +1204,7 @@ class CCraftDefManager: public IWritableCraftDefManager
 			m_craft_defs[(int) CRAFT_HASH_TYPE_UNHASHED][0];
 		for (auto def : unhashed) {
 			// Initialize and get the definition's hash
-			def->initHash(gamedef);
+			def->initHash(gamedef, &m_group_index);
 			CraftHashType type = def->getHashType();
 			u64 hash = def->getHash(type);
 
@@ -1103,15 +1212,136 @@ class CCraftDefManager: public IWritableCraftDefManager
 			m_craft_defs[type][hash].push_back(def);
 		}
 		unhashed.clear();
+		m_group_index.addItems(gamedef->idef());
+		clearCachedCrafts();
 	}
 private:
+	static bool isOutputKnown(const CraftOutput &output, IGameDef *gamedef)
+	{
+		ItemStack is;
+		is.deSerialize(output.item, gamedef->idef());
+		if (is.isKnown(gamedef->idef()))
+			return true;
+		infostream << "trying to craft non-existent "
+			<< output.item << ", ignoring recipe" << std::endl;
+		return false;
+	}
+
+	// Finds the recipe with the highest priority among those that only
+	// depend on the item names, and collects the others in order
+	void findCraft(const CraftInput &input, IGameDef *gamedef,
+			CraftDefinition **def_best,
+			std::vector<CraftDefinition *> *unchecked_defs) const
+	{
+		std::vector<std::string> input_names;
+		input_names = craftGetItemNames(input.items, gamedef);
+		std::sort(input_names.begin(), input_names.end());
+
+		// Try hash types with increasing collision rate
+		// while remembering the latest, highest priority recipe.
+		CraftDefinition::RecipePriority priority_best =
+			CraftDefinition::PRIORITY_NO_RECIPE;
+		for (int type = 0; type <= craft_hash_type_max; type++) {
+			u64 hash = getHashForGrid((CraftHashType) type, input_names);
+
+			/*errorstream << "Checking type " << type << " with hash " << hash << std::endl;*/
+
+			// We'd like to do "const [...] hash_collisions = m_craft_defs[type][hash];"
+			// but that doesn't compile for some reason. This does.
+			auto col_iter = (m_craft_defs[type]).find(hash);
+
+			if (col_iter == (m_craft_defs[type]).end())
+				continue;
+
+			const std::vector<CraftDefinition*> &hash_collisions = col_iter->second;
+			// Walk crafting definitions from back to front, so that later
+			// definitions can override earlier ones.
+			for (std::vector<CraftDefinition*>::size_type
+					i = hash_collisions.size(); i > 0; i--) {
+				CraftDefinition *def = hash_collisions[i - 1];
+
+				/*errorstream << "Checking " << input.dump() << std::endl
+					<< " against " << def->dump() << std::endl;*/
+
+				if (!def->checksItemNamesOnly()) {
+					unchecked_defs->push_back(def);
+					continue;
+				}
+
+				CraftDefinition::RecipePriority priority = def->getPriority();
+				if (priority > priority_best
+						&& def->check(input, gamedef)) {
+					// Check if the crafted node/item exists
+					if (!isOutputKnown(def->getOutput(input, gamedef), gamedef))
+						continue;
+
+					priority_best = priority;
+					*def_best = def;
+				}
+			}
+		}
+	}
+
+	struct CachedCraft
+	{
+		std::string key;
+		CraftDefinition *def_best;
+		std::vector<CraftDefinition *> unchecked_defs;
+	};
+
+	bool getCachedCraft(const std::string &key, CraftDefinition **def_best,
+			std::vector<CraftDefinition *> *unchecked_defs) const
+	{
+		MutexAutoLock lock(m_cache_mutex);
+		auto it = m_cache.find(key);
+		if (it == m_cache.end())
+			return false;
+
+		// Move it to the front of the LRU list
+		m_cache_lru.splice(m_cache_lru.begin(), m_cache_lru, it->second);
+		*def_best = it->second->def_best;
+		*unchecked_defs = it->second->unchecked_defs;
+		return true;
+	}
+
+	void setCachedCraft(const std::string &key, CraftDefinition *def_best,
+			const std::vector<CraftDefinition *> &unchecked_defs) const
+	{
+		MutexAutoLock lock(m_cache_mutex);
+		if (m_cache_size == 0 || m_cache.find(key) != m_cache.end())
+			return;
+
+		if (m_cache.size() >= m_cache_size) {
+			m_cache.erase(m_cache_lru.back().key);
+			m_cache_lru.pop_back();
+		}
+		m_cache_lru.push_front(CachedCraft{key, def_best, unchecked_defs});
+		m_cache[key] = m_cache_lru.begin();
+	}
+
+	// To be called whenever the recipes change
+	void clearCachedCrafts()
+	{
+		MutexAutoLock lock(m_cache_mutex);
+		m_cache.clear();
+		m_cache_lru.clear();
+	}
+
 	std::vector<std::unordered_map<u64, std::vector<CraftDefinition*> > >
 		m_craft_defs;
 	std::unordered_map<std::string, std::vector<CraftDefinition*> >
 		m_output_craft_definitions;
+	CraftGroupIndex m_group_index;
+
+	// Results of getCraftResult() for the most recently used craft grids
+	const u32 m_cache_size;
+	mutable std::mutex m_cache_mutex;
+	mutable std::list<CachedCraft> m_cache_lru;
+	mutable std::unordered_map<std::string, std::list<CachedCraft>::iterator>
+		m_cache;
 };
 
-IWritableCraftDefManager* createCraftDefManager()
+IWritableCraftDefManager* createCraftDefManager(u32 cache_size)
 {
-	return new CCraftDefManager();
+	return new CCraftDefManager(cache_size);
 }
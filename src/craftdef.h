@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include <string>
 #include <iostream>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include "gamedef.h"
@@ -126,6 +127,35 @@ struct CraftReplacements
 	std::string dump() const;
 };
 
+/*
+	Group memberships of all items, limited to the groups that are used by
+	the group recipe items ("group:a,b").
+
+	Every group gets a bit, so that a recipe item can be matched without
+	parsing it or looking up the groups of the input item.
+*/
+class CraftGroupIndex
+{
+public:
+	// Adds the groups of a recipe item, if it is a group recipe item.
+	// addItems() must be called again afterwards.
+	void addRecipeItem(const std::string &rec_name);
+	// Computes the group memberships of all items and aliases
+	void addItems(IItemDefManager *idef);
+	void clear();
+
+	// Returns true if the item is in every group of the recipe item,
+	// which must have been added before
+	bool matches(const std::string &inp_name, const std::string &rec_name) const;
+
+private:
+	typedef std::vector<u64> GroupSet;
+
+	std::unordered_map<std::string, u32> m_group_ids;
+	std::unordered_map<std::string, GroupSet> m_recipe_items;
+	std::unordered_map<std::string, GroupSet> m_items;
+};
+
 /*
 	Crafting definition base class
 */
@@ -157,6 +187,9 @@ class CraftDefinition
 
 	// Checks whether the recipe is applicable
 	virtual bool check(const CraftInput &input, IGameDef *gamedef) const=0;
+	// Returns false if check() and getOutput() depend on more than the
+	// item names of the input, so that their result can't be cached
+	virtual bool checksItemNamesOnly() const { return true; }
 	RecipePriority getPriority() const
 	{
 		return priority;
@@ -176,8 +209,10 @@ class CraftDefinition
 	}
 	virtual u64 getHash(CraftHashType type) const = 0;
 
-	// to be called after all mods are loaded, so that we catch all aliases
-	virtual void initHash(IGameDef *gamedef) = 0;
+	// to be called after all mods are loaded, so that we catch all aliases.
+	// Adds the group recipe items to group_index, which check() uses
+	// from then on.
+	virtual void initHash(IGameDef *gamedef, CraftGroupIndex *group_index) = 0;
 
 	virtual std::string dump() const=0;
 
@@ -213,7 +248,7 @@ class CraftDefinitionShaped: public CraftDefinition
 
 	virtual u64 getHash(CraftHashType type) const;
 
-	virtual void initHash(IGameDef *gamedef);
+	virtual void initHash(IGameDef *gamedef, CraftGroupIndex *group_index);
 
 	virtual std::string dump() const;
 
@@ -228,6 +263,8 @@ class CraftDefinitionShaped: public CraftDefinition
 	std::vector<std::string> recipe_names;
 	// bool indicating if initHash has been called already
 	bool hash_inited = false;
+	// Group memberships, set by initHash
+	const CraftGroupIndex *group_index = nullptr;
 	// Replacement items for decrementInput()
 	CraftReplacements replacements;
 };
@@ -257,7 +294,7 @@ class CraftDefinitionShapeless: public CraftDefinition
 
 	virtual u64 getHash(CraftHashType type) const;
 
-	virtual void initHash(IGameDef *gamedef);
+	virtual void initHash(IGameDef *gamedef, CraftGroupIndex *group_index);
 
 	virtual std::string dump() const;
 
@@ -270,6 +307,8 @@ class CraftDefinitionShapeless: public CraftDefinition
 	std::vector<std::string> recipe_names;
 	// bool indicating if initHash has been called already
 	bool hash_inited = false;
+	// Group memberships, set by initHash
+	const CraftGroupIndex *group_index = nullptr;
 	// Replacement items for decrementInput()
 	CraftReplacements replacements;
 };
@@ -297,7 +336,9 @@ class CraftDefinitionToolRepair: public CraftDefinition
 
 	virtual u64 getHash(CraftHashType type) const { return 2; }
 
-	virtual void initHash(IGameDef *gamedef)
+	virtual bool checksItemNamesOnly() const { return false; }
+
+	virtual void initHash(IGameDef *gamedef, CraftGroupIndex *group_index)
 	{
 		hash_type = CRAFT_HASH_TYPE_COUNT;
 	}
@@ -338,7 +379,7 @@ class CraftDefinitionCooking: public CraftDefinition
 
 	virtual u64 getHash(CraftHashType type) const;
 
-	virtual void initHash(IGameDef *gamedef);
+	virtual void initHash(IGameDef *gamedef, CraftGroupIndex *group_index);
 
 	virtual std::string dump() const;
 
@@ -351,6 +392,8 @@ class CraftDefinitionCooking: public CraftDefinition
 	std::string recipe_name;
 	// bool indicating if initHash has been called already
 	bool hash_inited = false;
+	// Group memberships, set by initHash
+	const CraftGroupIndex *group_index = nullptr;
 	// Time in seconds
 	float cooktime;
 	// Replacement items for decrementInput()
@@ -381,7 +424,7 @@ class CraftDefinitionFuel: public CraftDefinition
 
 	virtual u64 getHash(CraftHashType type) const;
 
-	virtual void initHash(IGameDef *gamedef);
+	virtual void initHash(IGameDef *gamedef, CraftGroupIndex *group_index);
 
 	virtual std::string dump() const;
 
@@ -392,6 +435,8 @@ class CraftDefinitionFuel: public CraftDefinition
 	std::string recipe_name;
 	// bool indicating if initHash has been called already
 	bool hash_inited = false;
+	// Group memberships, set by initHash
+	const CraftGroupIndex *group_index = nullptr;
 	// Time in seconds
 	float burntime;
 	// Replacement items for decrementInput()
@@ -410,6 +455,9 @@ class ICraftDefManager
 	/**
 	 * The main crafting function.
 	 *
+	 * The matching recipes of the most recently used grids are cached
+	 * until the recipes change.
+	 *
 	 * @param input The input grid.
 	 * @param output CraftOutput where the result is placed.
 	 * @param output_replacements A vector of ItemStacks where replacements are
@@ -460,4 +508,5 @@ class IWritableCraftDefManager : public ICraftDefManager
 	virtual void initHashes(IGameDef *gamedef) = 0;
 };
 
-IWritableCraftDefManager* createCraftDefManager();
+// cache_size is the number of craft grids whose results are remembered
+IWritableCraftDefManager* createCraftDefManager(u32 cache_size = 1024);
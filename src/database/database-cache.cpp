@@ -0,0 +1,294 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "database-cache.h"
+#include "log.h"
+#include "porting.h"
+
+// Rough per-entry overhead of the hash map and LRU list nodes
+#define ENTRY_OVERHEAD 96
+
+MapDatabaseCache::MapDatabaseCache(MapDatabase *backend, u64 max_bytes,
+		u32 write_delay, MetricsBackend *mb) :
+	m_backend(backend),
+	m_max_bytes(max_bytes),
+	m_write_delay(write_delay)
+{
+	if (mb) {
+		m_hit_counter = mb->addCounter("minetest_core_map_cache_hits",
+			"Map blocks loaded from the block cache");
+		m_miss_counter = mb->addCounter("minetest_core_map_cache_misses",
+			"Map blocks loaded from the database");
+		m_memory_gauge = mb->addGauge("minetest_core_map_cache_bytes",
+			"Memory used by the block cache (in bytes)");
+	}
+}
+
+MapDatabaseCache::~MapDatabaseCache()
+{
+	flush();
+	delete m_backend;
+}
+
+size_t MapDatabaseCache::entrySize(const std::string &data)
+{
+	return data.size() + ENTRY_OVERHEAD;
+}
+
+MapDatabaseCache::Entry *MapDatabaseCache::find(s64 key)
+{
+	auto it = m_entries.find(key);
+	if (it == m_entries.end())
+		return nullptr;
+
+	Entry &e = it->second;
+	m_lru.splice(m_lru.begin(), m_lru, e.lru_it);
+	return &e;
+}
+
+void MapDatabaseCache::insert(s64 key, const std::string &data, bool dirty,
+		u64 now)
+{
+	Entry *e = find(key);
+	if (e) {
+		m_bytes -= entrySize(e->data);
+		e->data = data;
+		if (dirty && !e->dirty) {
+			e->dirty_since = now;
+			m_dirty_count++;
+		} else if (!dirty && e->dirty) {
+			m_dirty_count--;
+		}
+		e->dirty = dirty;
+	} else {
+		m_lru.push_front(key);
+		Entry &n = m_entries[key];
+		n.data = data;
+		n.lru_it = m_lru.begin();
+		n.dirty_since = now;
+		n.dirty = dirty;
+		if (dirty)
+			m_dirty_count++;
+	}
+	m_bytes += entrySize(data);
+	m_generation++;
+
+	evict();
+}
+
+void MapDatabaseCache::erase(s64 key)
+{
+	auto it = m_entries.find(key);
+	if (it == m_entries.end())
+		return;
+
+	m_bytes -= entrySize(it->second.data);
+	if (it->second.dirty)
+		m_dirty_count--;
+	m_lru.erase(it->second.lru_it);
+	m_entries.erase(it);
+	m_generation++;
+}
+
+void MapDatabaseCache::evict()
+{
+	// Never evict the entry that was just inserted
+	while (m_bytes > m_max_bytes && m_lru.size() > 1) {
+		s64 key = m_lru.back();
+		Entry &e = m_entries[key];
+		if (e.dirty && !m_backend->saveBlock(getIntegerAsBlock(key), e.data)) {
+			errorstream << "MapDatabaseCache: Failed to write evicted block "
+				<< PP(getIntegerAsBlock(key)) << std::endl;
+		}
+		erase(key);
+	}
+
+	if (m_memory_gauge)
+		m_memory_gauge->set(m_bytes);
+}
+
+void MapDatabaseCache::writeBack(u64 max_age)
+{
+	u64 now = porting::getTimeMs();
+	std::vector<std::pair<s64, std::string>> pending;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_dirty_count == 0)
+			return;
+
+		for (auto &it : m_entries) {
+			Entry &e = it.second;
+			if (!e.dirty || now - e.dirty_since < max_age)
+				continue;
+			// Entries stay cached while being written, so concurrent
+			// readers still find the new data
+			pending.emplace_back(it.first, e.data);
+			e.dirty = false;
+			m_dirty_count--;
+		}
+	}
+
+	for (auto &it : pending) {
+		if (m_backend->saveBlock(getIntegerAsBlock(it.first), it.second))
+			continue;
+
+		errorstream << "MapDatabaseCache: Failed to write block "
+			<< PP(getIntegerAsBlock(it.first)) << std::endl;
+		// Retry with the next save unless the block changed meanwhile
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry *e = find(it.first);
+		if (e && !e->dirty && e->data == it.second) {
+			e->dirty = true;
+			e->dirty_since = now;
+			m_dirty_count++;
+		}
+	}
+}
+
+void MapDatabaseCache::beginSave()
+{
+	m_in_transaction = true;
+	m_backend->beginSave();
+}
+
+void MapDatabaseCache::endSave()
+{
+	writeBack(m_write_delay);
+	m_backend->endSave();
+	m_in_transaction = false;
+}
+
+void MapDatabaseCache::flush()
+{
+	bool started = !m_in_transaction;
+	if (started)
+		m_backend->beginSave();
+	writeBack(0);
+	if (started)
+		m_backend->endSave();
+}
+
+bool MapDatabaseCache::saveBlock(const v3s16 &pos, const std::string &data)
+{
+	// Outside of a save transaction nothing would write the block back
+	// soon, so write it through unless writes are meant to be delayed.
+	bool write_through = !m_in_transaction && m_write_delay == 0;
+	if (write_through && !m_backend->saveBlock(pos, data))
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	insert(getBlockAsInteger(pos), data, !write_through, porting::getTimeMs());
+	return true;
+}
+
+void MapDatabaseCache::loadBlock(const v3s16 &pos, std::string *block)
+{
+	s64 key = getBlockAsInteger(pos);
+	u64 generation;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (Entry *e = find(key)) {
+			*block = e->data;
+			m_hits++;
+			if (m_hit_counter)
+				m_hit_counter->increment();
+			return;
+		}
+		m_misses++;
+		if (m_miss_counter)
+			m_miss_counter->increment();
+		generation = m_generation;
+	}
+
+	m_backend->loadBlock(pos, block);
+
+	// Blocks that don't exist are not cached; they are generated and saved
+	// soon anyway.
+	if (block->empty())
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (generation == m_generation)
+		insert(key, *block, false, 0);
+}
+
+bool MapDatabaseCache::loadBlockConcurrent(const v3s16 &pos, std::string *block)
+{
+	s64 key = getBlockAsInteger(pos);
+	u64 generation;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (Entry *e = find(key)) {
+			*block = e->data;
+			m_hits++;
+			if (m_hit_counter)
+				m_hit_counter->increment();
+			return true;
+		}
+		if (!m_backend->canLoadConcurrently())
+			return false;
+		m_misses++;
+		if (m_miss_counter)
+			m_miss_counter->increment();
+		generation = m_generation;
+	}
+
+	if (!m_backend->loadBlockConcurrent(pos, block))
+		return false;
+	if (block->empty())
+		return true;
+
+	// Anything saved since the read started may be newer than what was read.
+	// Evicting dirty blocks would write to the backend from this thread, so
+	// only cache the block if it fits.
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (generation == m_generation &&
+			m_bytes + entrySize(*block) <= m_max_bytes)
+		insert(key, *block, false, 0);
+	return true;
+}
+
+bool MapDatabaseCache::deleteBlock(const v3s16 &pos)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		erase(getBlockAsInteger(pos));
+		if (m_memory_gauge)
+			m_memory_gauge->set(m_bytes);
+	}
+	return m_backend->deleteBlock(pos);
+}
+
+u64 MapDatabaseCache::getMemoryUsage() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bytes;
+}
+
+u32 MapDatabaseCache::getDirtyCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_dirty_count;
+}
+
+void MapDatabaseCache::listAllLoadableBlocks(std::vector<v3s16> &dst)
+{
+	flush();
+	m_backend->listAllLoadableBlocks(dst);
+}
@@ -0,0 +1,108 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "database.h"
+#include "irrlichttypes.h"
+#include "util/metricsbackend.h"
+
+/*
+	Write-back LRU cache of serialized map blocks in front of another
+	MapDatabase.
+
+	Blocks that are unloaded and loaded again shortly after are served from
+	memory, and repeated saves of the same block are written to the backend
+	only once. Dirty blocks are written at the end of a save transaction once
+	they have been dirty for at least write_delay milliseconds, when they are
+	evicted, and when the cache is destroyed.
+*/
+class MapDatabaseCache : public MapDatabase
+{
+public:
+	// Takes ownership of backend. mb may be nullptr.
+	MapDatabaseCache(MapDatabase *backend, u64 max_bytes, u32 write_delay,
+			MetricsBackend *mb = nullptr);
+	~MapDatabaseCache();
+
+	void beginSave();
+	void endSave();
+
+	bool saveBlock(const v3s16 &pos, const std::string &data);
+	void loadBlock(const v3s16 &pos, std::string *block);
+	bool deleteBlock(const v3s16 &pos);
+	void listAllLoadableBlocks(std::vector<v3s16> &dst);
+
+	// Misses are loaded from the backend, so this depends on the backend
+	bool canLoadConcurrently() const { return m_backend->canLoadConcurrently(); }
+	bool loadBlockConcurrent(const v3s16 &pos, std::string *block);
+
+	// Writes all dirty blocks to the backend
+	void flush();
+
+	u64 getHits() const { return m_hits; }
+	u64 getMisses() const { return m_misses; }
+	u64 getMemoryUsage() const;
+	u32 getDirtyCount() const;
+
+private:
+	struct Entry {
+		std::string data;
+		std::list<s64>::iterator lru_it;
+		u64 dirty_since;
+		bool dirty;
+	};
+
+	static size_t entrySize(const std::string &data);
+
+	// These require m_mutex
+	Entry *find(s64 key);
+	void insert(s64 key, const std::string &data, bool dirty, u64 now);
+	void erase(s64 key);
+	void evict();
+
+	// Writes dirty blocks older than max_age to the backend
+	void writeBack(u64 max_age);
+
+	MapDatabase *m_backend;
+	const u64 m_max_bytes;
+	const u32 m_write_delay;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<s64, Entry> m_entries;
+	// Most recently used first
+	std::list<s64> m_lru;
+	u64 m_bytes = 0;
+	u32 m_dirty_count = 0;
+	// Incremented on every change, so that concurrent readers can tell whether
+	// the blob they read from the backend may still be cached
+	u64 m_generation = 0;
+	bool m_in_transaction = false;
+
+	std::atomic<u64> m_hits{0};
+	std::atomic<u64> m_misses{0};
+	MetricCounterPtr m_hit_counter;
+	MetricCounterPtr m_miss_counter;
+	MetricGaugePtr m_memory_gauge;
+};
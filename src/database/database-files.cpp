@@ -20,6 +20,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <cassert>
 #include <json/json.h>
 #include "database-files.h"
+#include "convert_json.h"
+#include "log.h"
 #include "remoteplayer.h"
 #include "settings.h"
 #include "porting.h"
@@ -36,37 +38,44 @@ PlayerDatabaseFiles::PlayerDatabaseFiles(const std::string &savedir) : m_savedir
 	fs::CreateDir(m_savedir);
 }
 
-void PlayerDatabaseFiles::serialize(std::ostringstream &os, RemotePlayer *player)
+void PlayerDatabaseFiles::serialize(std::ostringstream &os, const PlayerSaveData &player)
 {
 	// Utilize a Settings object for storing values
 	Settings args;
 	args.setS32("version", 1);
-	args.set("name", player->getName());
+	args.set("name", player.name);
 
-	sanity_check(player->getPlayerSAO());
-	args.setU16("hp", player->getPlayerSAO()->getHP());
-	args.setV3F("position", player->getPlayerSAO()->getBasePosition());
-	args.setFloat("pitch", player->getPlayerSAO()->getLookPitch());
-	args.setFloat("yaw", player->getPlayerSAO()->getRotation().Y);
-	args.setU16("breath", player->getPlayerSAO()->getBreath());
+	args.setU16("hp", player.hp);
+	args.setV3F("position", player.position);
+	args.setFloat("pitch", player.pitch);
+	args.setFloat("yaw", player.yaw);
+	args.setU16("breath", player.breath);
 
-	std::string extended_attrs;
-	player->serializeExtraAttributes(extended_attrs);
-	args.set("extended_attributes", extended_attrs);
+	Json::Value json_root;
+	for (const auto &attr : player.meta)
+		json_root[attr.first] = attr.second;
+	args.set("extended_attributes", fastWriteJson(json_root));
 
 	args.writeLines(os);
 
 	os << "PlayerArgsEnd\n";
 
-	player->inventory.serialize(os);
+	player.inventory.serialize(os);
 }
 
-void PlayerDatabaseFiles::savePlayer(RemotePlayer *player)
+void PlayerDatabaseFiles::savePlayers(const std::vector<PlayerSaveData> &players)
+{
+	// Every player has its own file, so they are always written whole
+	for (const PlayerSaveData &player : players)
+		savePlayerData(player);
+}
+
+void PlayerDatabaseFiles::savePlayerData(const PlayerSaveData &player)
 {
 	fs::CreateDir(m_savedir);
 
 	std::string savedir = m_savedir + DIR_DELIM;
-	std::string path = savedir + player->getName();
+	std::string path = savedir + player.name;
 	bool path_found = false;
 	RemotePlayer testplayer("", NULL);
 
@@ -85,16 +94,16 @@ void PlayerDatabaseFiles::savePlayer(RemotePlayer *player)
 
 		testplayer.deSerialize(is, path, NULL);
 		is.close();
-		if (strcmp(testplayer.getName(), player->getName()) == 0) {
+		if (player.name == testplayer.getName()) {
 			path_found = true;
 			continue;
 		}
 
-		path = savedir + player->getName() + itos(i);
+		path = savedir + player.name + itos(i);
 	}
 
 	if (!path_found) {
-		errorstream << "Didn't find free file for player " << player->getName()
+		errorstream << "Didn't find free file for player " << player.name
 				<< std::endl;
 		return;
 	}
@@ -105,8 +114,6 @@ void PlayerDatabaseFiles::savePlayer(RemotePlayer *player)
 	if (!fs::safeWriteToFile(path, ss.str())) {
 		infostream << "Failed to write " << path << std::endl;
 	}
-
-	player->onSuccessfulSave();
 }
 
 bool PlayerDatabaseFiles::removePlayer(const std::string &name)
@@ -288,3 +295,141 @@ bool AuthDatabaseFiles::writeAuthFile()
 	}
 	return true;
 }
+
+ModMetadataDatabaseFiles::ModMetadataDatabaseFiles(const std::string &savedir):
+	m_storage_dir(savedir)
+{
+}
+
+bool ModMetadataDatabaseFiles::getModEntries(const std::string &modname,
+	StringMap *storage)
+{
+	StringMap *meta = getMod(modname);
+	if (!meta)
+		return false;
+
+	for (const auto &entry : *meta)
+		(*storage)[entry.first] = entry.second;
+	return true;
+}
+
+bool ModMetadataDatabaseFiles::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	StringMap *meta = getMod(modname);
+	if (!meta)
+		return false;
+
+	(*meta)[key] = value;
+	m_modified.insert(modname);
+	return true;
+}
+
+bool ModMetadataDatabaseFiles::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	StringMap *meta = getMod(modname);
+	if (!meta)
+		return false;
+
+	if (meta->erase(key) > 0)
+		m_modified.insert(modname);
+	return true;
+}
+
+bool ModMetadataDatabaseFiles::removeModEntries(const std::string &modname)
+{
+	StringMap *meta = getMod(modname);
+	if (!meta)
+		return false;
+
+	if (!meta->empty()) {
+		meta->clear();
+		m_modified.insert(modname);
+	}
+	return true;
+}
+
+void ModMetadataDatabaseFiles::listMods(std::vector<std::string> *res)
+{
+	// Mods with unsaved changes may not have a file yet
+	std::unordered_set<std::string> mods;
+	for (const fs::DirListNode &node : fs::GetDirListing(m_storage_dir)) {
+		if (!node.dir && node.name[0] != '.')
+			mods.insert(node.name);
+	}
+	for (const auto &mod : m_mod_meta) {
+		if (!mod.second.empty())
+			mods.insert(mod.first);
+	}
+	res->insert(res->end(), mods.begin(), mods.end());
+}
+
+void ModMetadataDatabaseFiles::beginSave()
+{
+}
+
+void ModMetadataDatabaseFiles::endSave()
+{
+	if (m_modified.empty())
+		return;
+
+	if (!fs::CreateAllDirs(m_storage_dir)) {
+		errorstream << "ModMetadataDatabaseFiles: Unable to save. '"
+			<< m_storage_dir << "' tree cannot be created." << std::endl;
+		return;
+	}
+
+	for (auto it = m_modified.begin(); it != m_modified.end();) {
+		const std::string &modname = *it;
+		const std::string path = m_storage_dir + DIR_DELIM + modname;
+		const StringMap &meta = m_mod_meta[modname];
+
+		bool ok;
+		if (meta.empty()) {
+			ok = !fs::PathExists(path) || fs::DeleteSingleFileOrEmptyDirectory(path);
+		} else {
+			Json::Value json;
+			for (const auto &entry : meta)
+				json[entry.first] = entry.second;
+			ok = fs::safeWriteToFile(path, fastWriteJson(json));
+		}
+
+		if (ok) {
+			it = m_modified.erase(it);
+		} else {
+			errorstream << "ModMetadataDatabaseFiles[" << modname
+				<< "]: failed to write file." << std::endl;
+			++it;
+		}
+	}
+}
+
+StringMap *ModMetadataDatabaseFiles::getMod(const std::string &modname)
+{
+	auto found = m_mod_meta.find(modname);
+	if (found != m_mod_meta.end())
+		return &found->second;
+
+	StringMap meta;
+	std::ifstream is(m_storage_dir + DIR_DELIM + modname, std::ios_base::binary);
+	if (is.good()) {
+		Json::Value root;
+		Json::CharReaderBuilder builder;
+		builder.settings_["collectComments"] = false;
+		std::string errs;
+
+		if (!Json::parseFromStream(builder, is, &root, &errs)) {
+			errorstream << "ModMetadataDatabaseFiles[" << modname
+				<< "]: failed to read data (Json decoding failure). Message: "
+				<< errs << std::endl;
+			return nullptr;
+		}
+
+		const Json::Value::Members attr_list = root.getMemberNames();
+		for (const auto &it : attr_list)
+			meta[it] = root[it].asString();
+	}
+
+	return &(m_mod_meta[modname] = std::move(meta));
+}
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "database.h"
 #include <unordered_map>
+#include <unordered_set>
 
 class PlayerDatabaseFiles : public PlayerDatabase
 {
@@ -32,13 +33,14 @@ class PlayerDatabaseFiles : public PlayerDatabase
 	PlayerDatabaseFiles(const std::string &savedir);
 	virtual ~PlayerDatabaseFiles() = default;
 
-	void savePlayer(RemotePlayer *player);
+	void savePlayers(const std::vector<PlayerSaveData> &players);
 	bool loadPlayer(RemotePlayer *player, PlayerSAO *sao);
 	bool removePlayer(const std::string &name);
 	void listPlayers(std::vector<std::string> &res);
 
 private:
-	void serialize(std::ostringstream &os, RemotePlayer *player);
+	void serialize(std::ostringstream &os, const PlayerSaveData &player);
+	void savePlayerData(const PlayerSaveData &player);
 
 	std::string m_savedir;
 };
@@ -62,3 +64,31 @@ class AuthDatabaseFiles : public AuthDatabase
 	bool readAuthFile();
 	bool writeAuthFile();
 };
+
+// One JSON file per mod, like the mod storage of Minetest 5.3 and older.
+// Changed mods are rewritten entirely in endSave().
+class ModMetadataDatabaseFiles : public ModMetadataDatabase
+{
+public:
+	ModMetadataDatabaseFiles(const std::string &savedir);
+	virtual ~ModMetadataDatabaseFiles() = default;
+
+	virtual bool getModEntries(const std::string &modname, StringMap *storage);
+	virtual bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	virtual bool removeModEntry(const std::string &modname,
+		const std::string &key);
+	virtual bool removeModEntries(const std::string &modname);
+	virtual void listMods(std::vector<std::string> *res);
+
+	virtual void beginSave();
+	virtual void endSave();
+
+private:
+	// Returns nullptr if the file of the mod could not be read
+	StringMap *getMod(const std::string &modname);
+
+	std::string m_storage_dir;
+	std::unordered_map<std::string, StringMap> m_mod_meta;
+	std::unordered_set<std::string> m_modified;
+};
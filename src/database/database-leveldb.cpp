@@ -32,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/string.h"
 
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 
 #define ENSURE_STATUS_OK(s) \
@@ -114,7 +115,7 @@ PlayerDatabaseLevelDB::~PlayerDatabaseLevelDB()
 	delete m_database;
 }
 
-void PlayerDatabaseLevelDB::savePlayer(RemotePlayer *player)
+void PlayerDatabaseLevelDB::savePlayers(const std::vector<PlayerSaveData> &players)
 {
 	/*
 	u8 version = 1
@@ -131,30 +132,31 @@ void PlayerDatabaseLevelDB::savePlayer(RemotePlayer *player)
 	std::string (long) serialized_inventory
 	*/
 
-	std::ostringstream os;
-	writeU8(os, 1);
+	// Players are stored in one piece, so they are always written whole
+	leveldb::WriteBatch batch;
+	for (const PlayerSaveData &player : players) {
+		std::ostringstream os;
+		writeU8(os, 1);
 
-	PlayerSAO *sao = player->getPlayerSAO();
-	sanity_check(sao);
-	writeU16(os, sao->getHP());
-	writeV3F32(os, sao->getBasePosition());
-	writeF32(os, sao->getLookPitch());
-	writeF32(os, sao->getRotation().Y);
-	writeU16(os, sao->getBreath());
-
-	StringMap stringvars = sao->getMeta().getStrings();
-	writeU32(os, stringvars.size());
-	for (const auto &it : stringvars) {
-		os << serializeString16(it.first);
-		os << serializeString32(it.second);
-	}
+		writeU16(os, player.hp);
+		writeV3F32(os, player.position);
+		writeF32(os, player.pitch);
+		writeF32(os, player.yaw);
+		writeU16(os, player.breath);
 
-	player->inventory.serialize(os);
+		writeU32(os, player.meta.size());
+		for (const auto &it : player.meta) {
+			os << serializeString16(it.first);
+			os << serializeString32(it.second);
+		}
 
-	leveldb::Status status = m_database->Put(leveldb::WriteOptions(),
-		player->getName(), os.str());
+		player.inventory.serialize(os);
+
+		batch.Put(player.name, os.str());
+	}
+
+	leveldb::Status status = m_database->Write(leveldb::WriteOptions(), &batch);
 	ENSURE_STATUS_OK(status);
-	player->onSuccessfulSave();
 }
 
 bool PlayerDatabaseLevelDB::removePlayer(const std::string &name)
@@ -306,4 +308,100 @@ void AuthDatabaseLevelDB::reload()
 	// No-op for LevelDB.
 }
 
+ModMetadataDatabaseLevelDB::ModMetadataDatabaseLevelDB(const std::string &savedir)
+{
+	leveldb::Options options;
+	options.create_if_missing = true;
+	leveldb::Status status = leveldb::DB::Open(options,
+		savedir + DIR_DELIM + "mod_storage.db", &m_database);
+	ENSURE_STATUS_OK(status);
+}
+
+ModMetadataDatabaseLevelDB::~ModMetadataDatabaseLevelDB()
+{
+	delete m_database;
+}
+
+bool ModMetadataDatabaseLevelDB::getModEntries(const std::string &modname,
+	StringMap *storage)
+{
+	const std::string prefix = modname + '\0';
+	leveldb::Iterator *it = m_database->NewIterator(leveldb::ReadOptions());
+	for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+		leveldb::Slice key = it->key();
+		key.remove_prefix(prefix.size());
+		(*storage)[key.ToString()] = it->value().ToString();
+	}
+	bool ok = it->status().ok();
+	delete it;
+	return ok;
+}
+
+bool ModMetadataDatabaseLevelDB::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	const std::string db_key = modname + '\0' + key;
+	if (m_batching) {
+		m_batch.Put(db_key, value);
+		return true;
+	}
+	leveldb::Status s = m_database->Put(leveldb::WriteOptions(), db_key, value);
+	return s.ok();
+}
+
+bool ModMetadataDatabaseLevelDB::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	const std::string db_key = modname + '\0' + key;
+	if (m_batching) {
+		m_batch.Delete(db_key);
+		return true;
+	}
+	leveldb::Status s = m_database->Delete(leveldb::WriteOptions(), db_key);
+	return s.ok();
+}
+
+bool ModMetadataDatabaseLevelDB::removeModEntries(const std::string &modname)
+{
+	const std::string prefix = modname + '\0';
+	leveldb::WriteBatch batch;
+	leveldb::WriteBatch &target = m_batching ? m_batch : batch;
+	leveldb::Iterator *it = m_database->NewIterator(leveldb::ReadOptions());
+	for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next())
+		target.Delete(it->key());
+	bool ok = it->status().ok();
+	delete it;
+
+	if (!m_batching)
+		ok = m_database->Write(leveldb::WriteOptions(), &batch).ok() && ok;
+	return ok;
+}
+
+void ModMetadataDatabaseLevelDB::listMods(std::vector<std::string> *res)
+{
+	// Keys are sorted, so the entries of a mod are next to each other
+	leveldb::Iterator *it = m_database->NewIterator(leveldb::ReadOptions());
+	for (it->SeekToFirst(); it->Valid();) {
+		std::string key = it->key().ToString();
+		std::string modname = key.substr(0, key.find('\0'));
+		res->push_back(modname);
+		// Skip to the first key after all keys starting with modname + '\0'
+		it->Seek(modname + '\1');
+	}
+	delete it;
+}
+
+void ModMetadataDatabaseLevelDB::beginSave()
+{
+	m_batching = true;
+}
+
+void ModMetadataDatabaseLevelDB::endSave()
+{
+	m_batching = false;
+	leveldb::Status status = m_database->Write(leveldb::WriteOptions(), &m_batch);
+	m_batch.Clear();
+	ENSURE_STATUS_OK(status);
+}
+
 #endif // USE_LEVELDB
@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <string>
 #include "database.h"
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 class Database_LevelDB : public MapDatabase
 {
@@ -51,7 +52,7 @@ class PlayerDatabaseLevelDB : public PlayerDatabase
 	PlayerDatabaseLevelDB(const std::string &savedir);
 	~PlayerDatabaseLevelDB();
 
-	void savePlayer(RemotePlayer *player);
+	void savePlayers(const std::vector<PlayerSaveData> &players);
 	bool loadPlayer(RemotePlayer *player, PlayerSAO *sao);
 	bool removePlayer(const std::string &name);
 	void listPlayers(std::vector<std::string> &res);
@@ -77,4 +78,29 @@ class AuthDatabaseLevelDB : public AuthDatabase
 	leveldb::DB *m_database;
 };
 
+// Keys are the mod name and the entry key separated by a null byte
+class ModMetadataDatabaseLevelDB : public ModMetadataDatabase
+{
+public:
+	ModMetadataDatabaseLevelDB(const std::string &savedir);
+	virtual ~ModMetadataDatabaseLevelDB();
+
+	virtual bool getModEntries(const std::string &modname, StringMap *storage);
+	virtual bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	virtual bool removeModEntry(const std::string &modname,
+		const std::string &key);
+	virtual bool removeModEntries(const std::string &modname);
+	virtual void listMods(std::vector<std::string> *res);
+
+	// Changes between these are written in one batch
+	virtual void beginSave();
+	virtual void endSave();
+
+private:
+	leveldb::DB *m_database;
+	leveldb::WriteBatch m_batch;
+	bool m_batching = false;
+};
+
 #endif // USE_LEVELDB
@@ -408,6 +408,12 @@ void PlayerDatabasePostgreSQL::initStatements()
 	prepareStatement("remove_player_inventory_items",
 		"DELETE FROM player_inventory_items WHERE player = $1");
 
+	prepareStatement("remove_player_inventory",
+		"DELETE FROM player_inventories WHERE player = $1 AND inv_id = $2::int");
+
+	prepareStatement("remove_player_inventory_list_items",
+		"DELETE FROM player_inventory_items WHERE player = $1 AND inv_id = $2::int");
+
 	prepareStatement("add_player_inventory",
 		"INSERT INTO player_inventories (player, inv_id, inv_width, inv_name, inv_size) VALUES "
 			"($1, $2::int, $3::int, $4, $5::int)");
@@ -450,24 +456,28 @@ bool PlayerDatabasePostgreSQL::playerDataExists(const std::string &playername)
 	return res;
 }
 
-void PlayerDatabasePostgreSQL::savePlayer(RemotePlayer *player)
+void PlayerDatabasePostgreSQL::savePlayers(const std::vector<PlayerSaveData> &players)
 {
-	PlayerSAO* sao = player->getPlayerSAO();
-	if (!sao)
-		return;
-
 	verifyDatabase();
 
-	v3f pos = sao->getBasePosition();
-	std::string pitch = ftos(sao->getLookPitch());
-	std::string yaw = ftos(sao->getRotation().Y);
-	std::string posx = ftos(pos.X);
-	std::string posy = ftos(pos.Y);
-	std::string posz = ftos(pos.Z);
-	std::string hp = itos(sao->getHP());
-	std::string breath = itos(sao->getBreath());
+	beginSave();
+	for (const PlayerSaveData &player : players)
+		savePlayerData(player);
+	endSave();
+}
+
+void PlayerDatabasePostgreSQL::savePlayerData(const PlayerSaveData &player)
+{
+	const char *name = player.name.c_str();
+	std::string pitch = ftos(player.pitch);
+	std::string yaw = ftos(player.yaw);
+	std::string posx = ftos(player.position.X);
+	std::string posy = ftos(player.position.Y);
+	std::string posz = ftos(player.position.Z);
+	std::string hp = itos(player.hp);
+	std::string breath = itos(player.breath);
 	const char *values[] = {
-		player->getName(),
+		name,
 		pitch.c_str(),
 		yaw.c_str(),
 		posx.c_str(), posy.c_str(), posz.c_str(),
@@ -475,11 +485,10 @@ void PlayerDatabasePostgreSQL::savePlayer(RemotePlayer *player)
 		breath.c_str()
 	};
 
-	const char* rmvalues[] = { player->getName() };
-	beginSave();
+	const char* rmvalues[] = { name };
 
 	if (getPGVersion() < 90500) {
-		if (!playerDataExists(player->getName()))
+		if (!playerDataExists(player.name))
 			execPrepared("create_player", 8, values, true, false);
 		else
 			execPrepared("update_player", 8, values, true, false);
@@ -487,22 +496,33 @@ void PlayerDatabasePostgreSQL::savePlayer(RemotePlayer *player)
 	else
 		execPrepared("save_player", 8, values, true, false);
 
-	// Write player inventories
-	execPrepared("remove_player_inventories", 1, rmvalues);
-	execPrepared("remove_player_inventory_items", 1, rmvalues);
+	// Write player inventories, only the changed lists if possible
+	if (player.lists_unsaved) {
+		execPrepared("remove_player_inventories", 1, rmvalues);
+		execPrepared("remove_player_inventory_items", 1, rmvalues);
+	}
 
-	std::vector<const InventoryList*> inventory_lists = sao->getInventory()->getLists();
+	std::vector<const InventoryList*> inventory_lists = player.inventory.getLists();
 	for (u16 i = 0; i < inventory_lists.size(); i++) {
+		if (!player.lists_unsaved && !player.unsaved_lists[i])
+			continue;
+
 		const InventoryList* list = inventory_lists[i];
-		const std::string &name = list->getName();
+		const std::string &list_name = list->getName();
 		std::string width = itos(list->getWidth()),
 			inv_id = itos(i), lsize = itos(list->getSize());
 
+		if (!player.lists_unsaved) {
+			const char* rmlist_values[] = { name, inv_id.c_str() };
+			execPrepared("remove_player_inventory", 2, rmlist_values);
+			execPrepared("remove_player_inventory_list_items", 2, rmlist_values);
+		}
+
 		const char* inv_values[] = {
-			player->getName(),
+			name,
 			inv_id.c_str(),
 			width.c_str(),
-			name.c_str(),
+			list_name.c_str(),
 			lsize.c_str()
 		};
 		execPrepared("add_player_inventory", 5, inv_values);
@@ -513,7 +533,7 @@ void PlayerDatabasePostgreSQL::savePlayer(RemotePlayer *player)
 			std::string itemStr = os.str(), slotId = itos(j);
 
 			const char* invitem_values[] = {
-				player->getName(),
+				name,
 				inv_id.c_str(),
 				slotId.c_str(),
 				itemStr.c_str()
@@ -522,19 +542,18 @@ void PlayerDatabasePostgreSQL::savePlayer(RemotePlayer *player)
 		}
 	}
 
+	if (!player.meta_unsaved)
+		return;
+
 	execPrepared("remove_player_metadata", 1, rmvalues);
-	const StringMap &attrs = sao->getMeta().getStrings();
-	for (const auto &attr : attrs) {
+	for (const auto &attr : player.meta) {
 		const char *meta_values[] = {
-			player->getName(),
+			name,
 			attr.first.c_str(),
 			attr.second.c_str()
 		};
 		execPrepared("save_player_metadata", 3, meta_values);
 	}
-	endSave();
-
-	player->onSuccessfulSave();
 }
 
 bool PlayerDatabasePostgreSQL::loadPlayer(RemotePlayer *player, PlayerSAO *sao)
@@ -806,4 +825,155 @@ void AuthDatabasePostgreSQL::writePrivileges(const AuthEntry &authEntry)
 }
 
 
+ModMetadataDatabasePostgreSQL::ModMetadataDatabasePostgreSQL(
+		const std::string &connect_string) :
+	Database_PostgreSQL(connect_string),
+	ModMetadataDatabase()
+{
+	connectToDatabase();
+}
+
+void ModMetadataDatabasePostgreSQL::createDatabase()
+{
+	// Keys and values are binary because Lua strings may contain any byte
+	createTableIfNotExists("mod_storage",
+		"CREATE TABLE mod_storage ("
+			"modname TEXT NOT NULL,"
+			"key BYTEA NOT NULL,"
+			"value BYTEA NOT NULL,"
+			"PRIMARY KEY (modname, key)"
+		");");
+
+	infostream << "PostgreSQL: Mod Storage Database was initialized." << std::endl;
+}
+
+void ModMetadataDatabasePostgreSQL::initStatements()
+{
+	prepareStatement("get_mod_entries",
+		"SELECT key, value FROM mod_storage WHERE modname = $1");
+
+	if (getPGVersion() < 90500) {
+		prepareStatement("set_mod_entry_insert",
+			"INSERT INTO mod_storage (modname, key, value) SELECT "
+				"$1, $2::bytea, $3::bytea "
+				"WHERE NOT EXISTS (SELECT true FROM mod_storage "
+				"WHERE modname = $1 AND key = $2::bytea)");
+
+		prepareStatement("set_mod_entry_update",
+			"UPDATE mod_storage SET value = $3::bytea "
+				"WHERE modname = $1 AND key = $2::bytea");
+	} else {
+		prepareStatement("set_mod_entry",
+			"INSERT INTO mod_storage (modname, key, value) VALUES "
+				"($1, $2::bytea, $3::bytea) "
+				"ON CONFLICT ON CONSTRAINT mod_storage_pkey DO "
+				"UPDATE SET value = $3::bytea");
+	}
+
+	prepareStatement("remove_mod_entry",
+		"DELETE FROM mod_storage WHERE modname = $1 AND key = $2::bytea");
+
+	prepareStatement("remove_mod_entries",
+		"DELETE FROM mod_storage WHERE modname = $1");
+
+	prepareStatement("list_mods", "SELECT DISTINCT modname FROM mod_storage");
+}
+
+bool ModMetadataDatabasePostgreSQL::getModEntries(const std::string &modname,
+	StringMap *storage)
+{
+	verifyDatabase();
+
+	const void *args[] = { modname.c_str() };
+	const int argLen[] = { (int)modname.size() };
+	const int argFmt[] = { 1 };
+
+	PGresult *results = execPrepared("get_mod_entries", ARRLEN(args), args,
+		argLen, argFmt, false);
+
+	int numrows = PQntuples(results);
+	for (int row = 0; row < numrows; ++row) {
+		(*storage)[std::string(PQgetvalue(results, row, 0), PQgetlength(results, row, 0))] =
+			std::string(PQgetvalue(results, row, 1), PQgetlength(results, row, 1));
+	}
+
+	PQclear(results);
+
+	return true;
+}
+
+bool ModMetadataDatabasePostgreSQL::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	if (value.size() > INT_MAX) {
+		errorstream << "ModMetadataDatabasePostgreSQL::setModEntry: Data "
+			<< "truncation! value.size() over 0x7FFFFFFF" << std::endl;
+		return false;
+	}
+
+	verifyDatabase();
+
+	const void *args[] = { modname.c_str(), key.c_str(), value.c_str() };
+	const int argLen[] = {
+		(int)modname.size(),
+		(int)key.size(),
+		(int)value.size(),
+	};
+	const int argFmt[] = { 1, 1, 1 };
+
+	if (getPGVersion() < 90500) {
+		execPrepared("set_mod_entry_update", ARRLEN(args), args, argLen, argFmt);
+		execPrepared("set_mod_entry_insert", ARRLEN(args), args, argLen, argFmt);
+	} else {
+		execPrepared("set_mod_entry", ARRLEN(args), args, argLen, argFmt);
+	}
+
+	return true;
+}
+
+bool ModMetadataDatabasePostgreSQL::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	verifyDatabase();
+
+	const void *args[] = { modname.c_str(), key.c_str() };
+	const int argLen[] = {
+		(int)modname.size(),
+		(int)key.size(),
+	};
+	const int argFmt[] = { 1, 1 };
+
+	execPrepared("remove_mod_entry", ARRLEN(args), args, argLen, argFmt);
+
+	return true;
+}
+
+bool ModMetadataDatabasePostgreSQL::removeModEntries(const std::string &modname)
+{
+	verifyDatabase();
+
+	const void *args[] = { modname.c_str() };
+	const int argLen[] = { (int)modname.size() };
+	const int argFmt[] = { 1 };
+
+	execPrepared("remove_mod_entries", ARRLEN(args), args, argLen, argFmt);
+
+	return true;
+}
+
+void ModMetadataDatabasePostgreSQL::listMods(std::vector<std::string> *res)
+{
+	verifyDatabase();
+
+	PGresult *results = execPrepared("list_mods", 0,
+		NULL, NULL, NULL, false, false);
+
+	int numrows = PQntuples(results);
+
+	for (int row = 0; row < numrows; ++row)
+		res->emplace_back(PQgetvalue(results, row, 0), PQgetlength(results, row, 0));
+
+	PQclear(results);
+}
+
 #endif // USE_POSTGRESQL
@@ -133,7 +133,7 @@ class PlayerDatabasePostgreSQL : private Database_PostgreSQL, public PlayerDatab
 	PlayerDatabasePostgreSQL(const std::string &connect_string);
 	virtual ~PlayerDatabasePostgreSQL() = default;
 
-	void savePlayer(RemotePlayer *player);
+	void savePlayers(const std::vector<PlayerSaveData> &players);
 	bool loadPlayer(RemotePlayer *player, PlayerSAO *sao);
 	bool removePlayer(const std::string &name);
 	void listPlayers(std::vector<std::string> &res);
@@ -144,6 +144,7 @@ class PlayerDatabasePostgreSQL : private Database_PostgreSQL, public PlayerDatab
 
 private:
 	bool playerDataExists(const std::string &playername);
+	void savePlayerData(const PlayerSaveData &player);
 };
 
 class AuthDatabasePostgreSQL : private Database_PostgreSQL, public AuthDatabase
@@ -168,3 +169,25 @@ class AuthDatabasePostgreSQL : private Database_PostgreSQL, public AuthDatabase
 private:
 	virtual void writePrivileges(const AuthEntry &authEntry);
 };
+
+class ModMetadataDatabasePostgreSQL : private Database_PostgreSQL, public ModMetadataDatabase
+{
+public:
+	ModMetadataDatabasePostgreSQL(const std::string &connect_string);
+	virtual ~ModMetadataDatabasePostgreSQL() = default;
+
+	virtual bool getModEntries(const std::string &modname, StringMap *storage);
+	virtual bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	virtual bool removeModEntry(const std::string &modname,
+		const std::string &key);
+	virtual bool removeModEntries(const std::string &modname);
+	virtual void listMods(std::vector<std::string> *res);
+
+	virtual void beginSave() { Database_PostgreSQL::beginSave(); }
+	virtual void endSave() { Database_PostgreSQL::endSave(); }
+
+protected:
+	virtual void createDatabase();
+	virtual void initStatements();
+};
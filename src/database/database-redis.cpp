@@ -32,12 +32,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <cassert>
 
 
-Database_Redis::Database_Redis(Settings &conf)
+// Connects to the server configured in world.mt and reads the hash
+static redisContext *connect_redis(Settings &conf, std::string *hash)
 {
 	std::string tmp;
 	try {
 		tmp = conf.get("redis_address");
-		hash = conf.get("redis_hash");
+		*hash = conf.get("redis_hash");
 	} catch (SettingNotFoundException &) {
 		throw SettingNotFoundException("Set redis_address and "
 			"redis_hash in world.mt to use the redis backend");
@@ -45,7 +46,8 @@ Database_Redis::Database_Redis(Settings &conf)
 	const char *addr = tmp.c_str();
 	int port = conf.exists("redis_port") ? conf.getU16("redis_port") : 6379;
 	// if redis_address contains '/' assume unix socket, else hostname/ip
-	ctx = tmp.find('/') != std::string::npos ? redisConnectUnix(addr) : redisConnect(addr, port);
+	redisContext *ctx = tmp.find('/') != std::string::npos ?
+		redisConnectUnix(addr) : redisConnect(addr, port);
 	if (!ctx) {
 		throw DatabaseException("Cannot allocate redis context");
 	} else if (ctx->err) {
@@ -65,6 +67,13 @@ Database_Redis::Database_Redis(Settings &conf)
 		}
 		freeReplyObject(reply);
 	}
+	return ctx;
+}
+
+
+Database_Redis::Database_Redis(Settings &conf)
+{
+	ctx = connect_redis(conf, &hash);
 }
 
 Database_Redis::~Database_Redis()
@@ -199,5 +208,139 @@ void Database_Redis::listAllLoadableBlocks(std::vector<v3s16> &dst)
 	freeReplyObject(reply);
 }
 
+
+/*
+ * Mod storage database
+ */
+
+ModMetadataDatabaseRedis::ModMetadataDatabaseRedis(Settings &conf)
+{
+	ctx = connect_redis(conf, &prefix);
+	prefix += ":mod_storage";
+}
+
+ModMetadataDatabaseRedis::~ModMetadataDatabaseRedis()
+{
+	redisFree(ctx);
+}
+
+void ModMetadataDatabaseRedis::beginSave()
+{
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx, "MULTI"));
+	if (!reply) {
+		throw DatabaseException(std::string(
+			"Redis command 'MULTI' failed: ") + ctx->errstr);
+	}
+	freeReplyObject(reply);
+}
+
+void ModMetadataDatabaseRedis::endSave()
+{
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx, "EXEC"));
+	if (!reply) {
+		throw DatabaseException(std::string(
+			"Redis command 'EXEC' failed: ") + ctx->errstr);
+	}
+	freeReplyObject(reply);
+}
+
+bool ModMetadataDatabaseRedis::checkReply(redisReply *reply, const char *command)
+{
+	if (!reply) {
+		throw DatabaseException(std::string("Redis command '") + command +
+			"' failed: " + ctx->errstr);
+	}
+	bool ok = reply->type != REDIS_REPLY_ERROR;
+	if (!ok) {
+		warningstream << "Redis command '" << command << "' failed: "
+			<< std::string(reply->str, reply->len) << std::endl;
+	}
+	freeReplyObject(reply);
+	return ok;
+}
+
+bool ModMetadataDatabaseRedis::getModEntries(const std::string &modname,
+	StringMap *storage)
+{
+	std::string key = prefix + ":" + modname;
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx,
+		"HGETALL %b", key.c_str(), key.size()));
+	if (!reply) {
+		throw DatabaseException(std::string(
+			"Redis command 'HGETALL %s' failed: ") + ctx->errstr);
+	}
+	bool ok = reply->type == REDIS_REPLY_ARRAY;
+	if (ok) {
+		// Field names and values alternate
+		for (size_t i = 0; i + 1 < reply->elements; i += 2) {
+			const redisReply *field = reply->element[i];
+			const redisReply *value = reply->element[i + 1];
+			(*storage)[std::string(field->str, field->len)] =
+				std::string(value->str, value->len);
+		}
+	} else if (reply->type == REDIS_REPLY_ERROR) {
+		errorstream << "getModEntries: loading mod storage of " << modname
+			<< " failed: " << std::string(reply->str, reply->len) << std::endl;
+	}
+	freeReplyObject(reply);
+	return ok;
+}
+
+bool ModMetadataDatabaseRedis::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	std::string hash = prefix + ":" + modname;
+	bool ok = checkReply(static_cast<redisReply *>(redisCommand(ctx,
+		"HSET %b %b %b", hash.c_str(), hash.size(), key.c_str(), key.size(),
+		value.c_str(), value.size())), "HSET");
+	// Set of mod names for listMods()
+	return checkReply(static_cast<redisReply *>(redisCommand(ctx,
+		"SADD %b %b", prefix.c_str(), prefix.size(), modname.c_str(),
+		modname.size())), "SADD") && ok;
+}
+
+bool ModMetadataDatabaseRedis::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	std::string hash = prefix + ":" + modname;
+	return checkReply(static_cast<redisReply *>(redisCommand(ctx,
+		"HDEL %b %b", hash.c_str(), hash.size(), key.c_str(), key.size())),
+		"HDEL");
+}
+
+bool ModMetadataDatabaseRedis::removeModEntries(const std::string &modname)
+{
+	std::string hash = prefix + ":" + modname;
+	bool ok = checkReply(static_cast<redisReply *>(redisCommand(ctx,
+		"DEL %b", hash.c_str(), hash.size())), "DEL");
+	return checkReply(static_cast<redisReply *>(redisCommand(ctx,
+		"SREM %b %b", prefix.c_str(), prefix.size(), modname.c_str(),
+		modname.size())), "SREM") && ok;
+}
+
+void ModMetadataDatabaseRedis::listMods(std::vector<std::string> *res)
+{
+	redisReply *reply = static_cast<redisReply *>(redisCommand(ctx,
+		"SMEMBERS %b", prefix.c_str(), prefix.size()));
+	if (!reply) {
+		throw DatabaseException(std::string(
+			"Redis command 'SMEMBERS %s' failed: ") + ctx->errstr);
+	}
+	switch (reply->type) {
+	case REDIS_REPLY_ARRAY:
+		res->reserve(res->size() + reply->elements);
+		for (size_t i = 0; i < reply->elements; i++) {
+			assert(reply->element[i]->type == REDIS_REPLY_STRING);
+			res->emplace_back(reply->element[i]->str, reply->element[i]->len);
+		}
+		break;
+	case REDIS_REPLY_ERROR:
+		throw DatabaseException(std::string(
+			"Failed to get mod names from database: ") +
+			std::string(reply->str, reply->len));
+	}
+	freeReplyObject(reply);
+}
+
 #endif // USE_REDIS
 
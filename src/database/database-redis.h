@@ -48,4 +48,30 @@ class Database_Redis : public MapDatabase
 	std::string hash = "";
 };
 
+// Every mod has a hash "<redis_hash>:mod_storage:<modname>", and the set
+// "<redis_hash>:mod_storage" contains the names of the mods
+class ModMetadataDatabaseRedis : public ModMetadataDatabase
+{
+public:
+	ModMetadataDatabaseRedis(Settings &conf);
+	~ModMetadataDatabaseRedis();
+
+	void beginSave();
+	void endSave();
+
+	bool getModEntries(const std::string &modname, StringMap *storage);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+	bool removeModEntries(const std::string &modname);
+	void listMods(std::vector<std::string> *res);
+
+private:
+	// Frees the reply. Returns false if the command failed.
+	bool checkReply(redisReply *reply, const char *command);
+
+	redisContext *ctx = nullptr;
+	std::string prefix = "";
+};
+
 #endif // USE_REDIS
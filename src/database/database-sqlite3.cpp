@@ -35,6 +35,9 @@ SQLite format specification:
 #include "util/string.h"
 #include "remoteplayer.h"
 #include "server/player_sao.h"
+#include "threading/mutex_auto_lock.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
 
 #include <cassert>
 
@@ -113,12 +116,70 @@ int Database_SQLite3::busyHandler(void *data, int count)
 }
 
 
+/*
+ * Runs passive WAL checkpoints on its own connection, so that committing
+ * transactions on the server thread never has to copy the log back into
+ * the database file.
+ */
+class SQLite3CheckpointThread : public Thread
+{
+public:
+	SQLite3CheckpointThread(const std::string &path, u32 interval_ms) :
+		Thread("SQLite3Checkpoint"),
+		m_path(path),
+		m_interval_ms(interval_ms)
+	{}
+
+	void wakeUp() { m_signal.post(); }
+
+protected:
+	void *run()
+	{
+		sqlite3 *db = nullptr;
+		if (sqlite3_open_v2(m_path.c_str(), &db, SQLITE_OPEN_READWRITE, NULL)
+				!= SQLITE_OK) {
+			errorstream << "SQLite3 checkpointer: failed to open " << m_path
+				<< ": " << sqlite3_errmsg(db) << std::endl;
+			sqlite3_close(db);
+			return nullptr;
+		}
+
+		while (!stopRequested()) {
+			m_signal.wait(m_interval_ms);
+
+			int log_frames, checkpointed_frames;
+			int res = sqlite3_wal_checkpoint_v2(db, NULL,
+				SQLITE_CHECKPOINT_PASSIVE, &log_frames, &checkpointed_frames);
+			if (res != SQLITE_OK && res != SQLITE_BUSY) {
+				warningstream << "SQLite3 checkpointer: " << sqlite3_errmsg(db)
+					<< std::endl;
+			}
+		}
+
+		sqlite3_close(db);
+		return nullptr;
+	}
+
+private:
+	std::string m_path;
+	u32 m_interval_ms;
+	Semaphore m_signal;
+};
+
+
 Database_SQLite3::Database_SQLite3(const std::string &savedir, const std::string &dbname) :
+	m_wal_mode(g_settings->getBool("sqlite_high_throughput")),
+	m_mmap_size(m_wal_mode ? g_settings->getU64("sqlite_mmap_size") : 0),
 	m_savedir(savedir),
 	m_dbname(dbname)
 {
 }
 
+std::string Database_SQLite3::getDatabasePath() const
+{
+	return m_savedir + DIR_DELIM + m_dbname + ".sqlite";
+}
+
 void Database_SQLite3::beginSave()
 {
 	verifyDatabase();
@@ -139,7 +200,7 @@ void Database_SQLite3::openDatabase()
 {
 	if (m_database) return;
 
-	std::string dbp = m_savedir + DIR_DELIM + m_dbname + ".sqlite";
+	std::string dbp = getDatabasePath();
 
 	// Open the database connection
 
@@ -169,6 +230,41 @@ void Database_SQLite3::openDatabase()
 		"Failed to modify sqlite3 synchronous mode");
 	SQLOK(sqlite3_exec(m_database, "PRAGMA foreign_keys = ON", NULL, NULL, NULL),
 		"Failed to enable sqlite3 foreign key support");
+
+	if (!m_wal_mode)
+		return;
+
+	// With write-ahead logging readers on other connections see the last
+	// committed state instead of waiting for the writer
+	sqlite3_stmt *stmt_journal;
+	SQLOK(sqlite3_prepare_v2(m_database, "PRAGMA journal_mode = WAL", -1,
+			&stmt_journal, NULL),
+		"Failed to prepare journal mode query");
+	std::string journal_mode;
+	if (sqlite3_step(stmt_journal) == SQLITE_ROW)
+		journal_mode = sqlite_to_string(stmt_journal, 0);
+	sqlite3_finalize(stmt_journal);
+	if (journal_mode != "wal") {
+		warningstream << "Database_SQLite3: Failed to enable write-ahead "
+			"logging for " << dbp << ", journal mode is \"" << journal_mode
+			<< "\"" << std::endl;
+	}
+
+	query_str = std::string("PRAGMA mmap_size = ") + std::to_string(m_mmap_size);
+	SQLOK(sqlite3_exec(m_database, query_str.c_str(), NULL, NULL, NULL),
+		"Failed to set sqlite3 mmap size");
+	// Negative values are in KiB
+	query_str = std::string("PRAGMA cache_size = -")
+			+ itos(g_settings->getU32("sqlite_cache_size"));
+	SQLOK(sqlite3_exec(m_database, query_str.c_str(), NULL, NULL, NULL),
+		"Failed to set sqlite3 cache size");
+	// Checkpoints are done by m_checkpoint_thread instead
+	SQLOK(sqlite3_exec(m_database, "PRAGMA wal_autocheckpoint = 0", NULL, NULL, NULL),
+		"Failed to disable sqlite3 automatic checkpoints");
+
+	float interval = MYMAX(g_settings->getFloat("sqlite_checkpoint_interval"), 0.1f);
+	m_checkpoint_thread = new SQLite3CheckpointThread(dbp, interval * 1000);
+	m_checkpoint_thread->start();
 }
 
 void Database_SQLite3::verifyDatabase()
@@ -187,6 +283,13 @@ void Database_SQLite3::verifyDatabase()
 
 Database_SQLite3::~Database_SQLite3()
 {
+	if (m_checkpoint_thread) {
+		m_checkpoint_thread->stop();
+		m_checkpoint_thread->wakeUp();
+		m_checkpoint_thread->wait();
+		delete m_checkpoint_thread;
+	}
+
 	FINALIZE_STATEMENT(m_stmt_begin)
 	FINALIZE_STATEMENT(m_stmt_end)
 
@@ -203,8 +306,16 @@ MapDatabaseSQLite3::MapDatabaseSQLite3(const std::string &savedir):
 {
 }
 
+MapDatabaseSQLite3::ReadConnection::~ReadConnection()
+{
+	sqlite3_finalize(stmt_read);
+	sqlite3_close(db);
+}
+
 MapDatabaseSQLite3::~MapDatabaseSQLite3()
 {
+	m_readers.clear();
+
 	FINALIZE_STATEMENT(m_stmt_read)
 	FINALIZE_STATEMENT(m_stmt_write)
 	FINALIZE_STATEMENT(m_stmt_list)
@@ -309,6 +420,63 @@ void MapDatabaseSQLite3::loadBlock(const v3s16 &pos, std::string *block)
 	sqlite3_reset(m_stmt_read);
 }
 
+MapDatabaseSQLite3::ReadConnection *MapDatabaseSQLite3::getReadConnection()
+{
+	MutexAutoLock lock(m_readers_mutex);
+
+	std::unique_ptr<ReadConnection> &conn = m_readers[std::this_thread::get_id()];
+	if (conn)
+		return conn.get();
+
+	std::unique_ptr<ReadConnection> new_conn(new ReadConnection());
+	std::string dbp = getDatabasePath();
+	if (sqlite3_open_v2(dbp.c_str(), &new_conn->db, SQLITE_OPEN_READONLY, NULL)
+				!= SQLITE_OK ||
+			sqlite3_busy_handler(new_conn->db, Database_SQLite3::busyHandler,
+				new_conn->busy_handler_data) != SQLITE_OK ||
+			sqlite3_prepare_v2(new_conn->db,
+				"SELECT `data` FROM `blocks` WHERE `pos` = ? LIMIT 1", -1,
+				&new_conn->stmt_read, NULL) != SQLITE_OK) {
+		// Not fatal, the caller falls back to the main connection
+		warningstream << "MapDatabaseSQLite3: Failed to open read connection: "
+			<< sqlite3_errmsg(new_conn->db) << std::endl;
+		m_readers.erase(std::this_thread::get_id());
+		return nullptr;
+	}
+
+	std::string query_str = std::string("PRAGMA mmap_size = ") + std::to_string(m_mmap_size);
+	sqlite3_exec(new_conn->db, query_str.c_str(), NULL, NULL, NULL);
+
+	conn = std::move(new_conn);
+	return conn.get();
+}
+
+bool MapDatabaseSQLite3::loadBlockConcurrent(const v3s16 &pos, std::string *block)
+{
+	if (!m_wal_mode)
+		return false;
+
+	ReadConnection *conn = getReadConnection();
+	if (!conn)
+		return false;
+
+	sqlite3_stmt *stmt = conn->stmt_read;
+	if (sqlite3_bind_int64(stmt, 1, getBlockAsInteger(pos)) != SQLITE_OK)
+		return false;
+
+	int res = sqlite3_step(stmt);
+	if (res == SQLITE_ROW) {
+		const char *data = (const char *) sqlite3_column_blob(stmt, 0);
+		size_t len = sqlite3_column_bytes(stmt, 0);
+		*block = (data) ? std::string(data, len) : "";
+	} else {
+		block->clear();
+	}
+	sqlite3_reset(stmt);
+
+	return res == SQLITE_ROW || res == SQLITE_DONE;
+}
+
 void MapDatabaseSQLite3::listAllLoadableBlocks(std::vector<v3s16> &dst)
 {
 	verifyDatabase();
@@ -340,6 +508,8 @@ PlayerDatabaseSQLite3::~PlayerDatabaseSQLite3()
 	FINALIZE_STATEMENT(m_stmt_player_add_inventory_items)
 	FINALIZE_STATEMENT(m_stmt_player_remove_inventory)
 	FINALIZE_STATEMENT(m_stmt_player_remove_inventory_items)
+	FINALIZE_STATEMENT(m_stmt_player_remove_inventory_list)
+	FINALIZE_STATEMENT(m_stmt_player_remove_inventory_list_items)
 	FINALIZE_STATEMENT(m_stmt_player_load_inventory)
 	FINALIZE_STATEMENT(m_stmt_player_load_inventory_items)
 	FINALIZE_STATEMENT(m_stmt_player_metadata_load)
@@ -423,6 +593,10 @@ void PlayerDatabaseSQLite3::initStatements()
 		"WHERE `player` = ?")
 	PREPARE_STATEMENT(player_remove_inventory_items, "DELETE FROM `player_inventory_items` "
 		"WHERE `player` = ?")
+	PREPARE_STATEMENT(player_remove_inventory_list, "DELETE FROM `player_inventories` "
+		"WHERE `player` = ? AND `inv_id` = ?")
+	PREPARE_STATEMENT(player_remove_inventory_list_items, "DELETE FROM "
+		"`player_inventory_items` WHERE `player` = ? AND `inv_id` = ?")
 	PREPARE_STATEMENT(player_load_inventory, "SELECT `inv_id`, `inv_width`, `inv_name`, "
 		"`inv_size` FROM `player_inventories` WHERE `player` = ? ORDER BY inv_id")
 	PREPARE_STATEMENT(player_load_inventory_items, "SELECT `slot_id`, `item` "
@@ -446,55 +620,78 @@ bool PlayerDatabaseSQLite3::playerDataExists(const std::string &name)
 	return res;
 }
 
-void PlayerDatabaseSQLite3::savePlayer(RemotePlayer *player)
+void PlayerDatabaseSQLite3::savePlayers(const std::vector<PlayerSaveData> &players)
 {
-	PlayerSAO* sao = player->getPlayerSAO();
-	sanity_check(sao);
+	verifyDatabase();
 
-	const v3f &pos = sao->getBasePosition();
 	// Begin save in brace is mandatory
-	if (!playerDataExists(player->getName())) {
-		beginSave();
-		str_to_sqlite(m_stmt_player_add, 1, player->getName());
-		double_to_sqlite(m_stmt_player_add, 2, sao->getLookPitch());
-		double_to_sqlite(m_stmt_player_add, 3, sao->getRotation().Y);
+	beginSave();
+	for (const PlayerSaveData &player : players)
+		savePlayerData(player);
+	endSave();
+}
+
+void PlayerDatabaseSQLite3::savePlayerData(const PlayerSaveData &player)
+{
+	const v3f &pos = player.position;
+	if (!playerDataExists(player.name)) {
+		str_to_sqlite(m_stmt_player_add, 1, player.name);
+		double_to_sqlite(m_stmt_player_add, 2, player.pitch);
+		double_to_sqlite(m_stmt_player_add, 3, player.yaw);
 		double_to_sqlite(m_stmt_player_add, 4, pos.X);
 		double_to_sqlite(m_stmt_player_add, 5, pos.Y);
 		double_to_sqlite(m_stmt_player_add, 6, pos.Z);
-		int64_to_sqlite(m_stmt_player_add, 7, sao->getHP());
-		int64_to_sqlite(m_stmt_player_add, 8, sao->getBreath());
+		int64_to_sqlite(m_stmt_player_add, 7, player.hp);
+		int64_to_sqlite(m_stmt_player_add, 8, player.breath);
 
 		sqlite3_vrfy(sqlite3_step(m_stmt_player_add), SQLITE_DONE);
 		sqlite3_reset(m_stmt_player_add);
 	} else {
-		beginSave();
-		double_to_sqlite(m_stmt_player_update, 1, sao->getLookPitch());
-		double_to_sqlite(m_stmt_player_update, 2, sao->getRotation().Y);
+		double_to_sqlite(m_stmt_player_update, 1, player.pitch);
+		double_to_sqlite(m_stmt_player_update, 2, player.yaw);
 		double_to_sqlite(m_stmt_player_update, 3, pos.X);
 		double_to_sqlite(m_stmt_player_update, 4, pos.Y);
 		double_to_sqlite(m_stmt_player_update, 5, pos.Z);
-		int64_to_sqlite(m_stmt_player_update, 6, sao->getHP());
-		int64_to_sqlite(m_stmt_player_update, 7, sao->getBreath());
-		str_to_sqlite(m_stmt_player_update, 8, player->getName());
+		int64_to_sqlite(m_stmt_player_update, 6, player.hp);
+		int64_to_sqlite(m_stmt_player_update, 7, player.breath);
+		str_to_sqlite(m_stmt_player_update, 8, player.name);
 
 		sqlite3_vrfy(sqlite3_step(m_stmt_player_update), SQLITE_DONE);
 		sqlite3_reset(m_stmt_player_update);
 	}
 
-	// Write player inventories
-	str_to_sqlite(m_stmt_player_remove_inventory, 1, player->getName());
-	sqlite3_vrfy(sqlite3_step(m_stmt_player_remove_inventory), SQLITE_DONE);
-	sqlite3_reset(m_stmt_player_remove_inventory);
+	// Write player inventories, only the changed lists if possible
+	if (player.lists_unsaved) {
+		str_to_sqlite(m_stmt_player_remove_inventory, 1, player.name);
+		sqlite3_vrfy(sqlite3_step(m_stmt_player_remove_inventory), SQLITE_DONE);
+		sqlite3_reset(m_stmt_player_remove_inventory);
 
-	str_to_sqlite(m_stmt_player_remove_inventory_items, 1, player->getName());
-	sqlite3_vrfy(sqlite3_step(m_stmt_player_remove_inventory_items), SQLITE_DONE);
-	sqlite3_reset(m_stmt_player_remove_inventory_items);
+		str_to_sqlite(m_stmt_player_remove_inventory_items, 1, player.name);
+		sqlite3_vrfy(sqlite3_step(m_stmt_player_remove_inventory_items), SQLITE_DONE);
+		sqlite3_reset(m_stmt_player_remove_inventory_items);
+	}
 
-	std::vector<const InventoryList*> inventory_lists = sao->getInventory()->getLists();
+	std::vector<const InventoryList*> inventory_lists = player.inventory.getLists();
 	for (u16 i = 0; i < inventory_lists.size(); i++) {
+		if (!player.lists_unsaved && !player.unsaved_lists[i])
+			continue;
+
 		const InventoryList* list = inventory_lists[i];
 
-		str_to_sqlite(m_stmt_player_add_inventory, 1, player->getName());
+		if (!player.lists_unsaved) {
+			str_to_sqlite(m_stmt_player_remove_inventory_list, 1, player.name);
+			int_to_sqlite(m_stmt_player_remove_inventory_list, 2, i);
+			sqlite3_vrfy(sqlite3_step(m_stmt_player_remove_inventory_list), SQLITE_DONE);
+			sqlite3_reset(m_stmt_player_remove_inventory_list);
+
+			str_to_sqlite(m_stmt_player_remove_inventory_list_items, 1, player.name);
+			int_to_sqlite(m_stmt_player_remove_inventory_list_items, 2, i);
+			sqlite3_vrfy(sqlite3_step(m_stmt_player_remove_inventory_list_items),
+				SQLITE_DONE);
+			sqlite3_reset(m_stmt_player_remove_inventory_list_items);
+		}
+
+		str_to_sqlite(m_stmt_player_add_inventory, 1, player.name);
 		int_to_sqlite(m_stmt_player_add_inventory, 2, i);
 		int_to_sqlite(m_stmt_player_add_inventory, 3, list->getWidth());
 		str_to_sqlite(m_stmt_player_add_inventory, 4, list->getName());
@@ -507,7 +704,7 @@ void PlayerDatabaseSQLite3::savePlayer(RemotePlayer *player)
 			list->getItem(j).serialize(os);
 			std::string itemStr = os.str();
 
-			str_to_sqlite(m_stmt_player_add_inventory_items, 1, player->getName());
+			str_to_sqlite(m_stmt_player_add_inventory_items, 1, player.name);
 			int_to_sqlite(m_stmt_player_add_inventory_items, 2, i);
 			int_to_sqlite(m_stmt_player_add_inventory_items, 3, j);
 			str_to_sqlite(m_stmt_player_add_inventory_items, 4, itemStr);
@@ -516,22 +713,20 @@ void PlayerDatabaseSQLite3::savePlayer(RemotePlayer *player)
 		}
 	}
 
-	str_to_sqlite(m_stmt_player_metadata_remove, 1, player->getName());
+	if (!player.meta_unsaved)
+		return;
+
+	str_to_sqlite(m_stmt_player_metadata_remove, 1, player.name);
 	sqlite3_vrfy(sqlite3_step(m_stmt_player_metadata_remove), SQLITE_DONE);
 	sqlite3_reset(m_stmt_player_metadata_remove);
 
-	const StringMap &attrs = sao->getMeta().getStrings();
-	for (const auto &attr : attrs) {
-		str_to_sqlite(m_stmt_player_metadata_add, 1, player->getName());
+	for (const auto &attr : player.meta) {
+		str_to_sqlite(m_stmt_player_metadata_add, 1, player.name);
 		str_to_sqlite(m_stmt_player_metadata_add, 2, attr.first);
 		str_to_sqlite(m_stmt_player_metadata_add, 3, attr.second);
 		sqlite3_vrfy(sqlite3_step(m_stmt_player_metadata_add), SQLITE_DONE);
 		sqlite3_reset(m_stmt_player_metadata_add);
 	}
-
-	endSave();
-
-	player->onSuccessfulSave();
 }
 
 bool PlayerDatabaseSQLite3::loadPlayer(RemotePlayer *player, PlayerSAO *sao)
@@ -774,3 +969,109 @@ void AuthDatabaseSQLite3::writePrivileges(const AuthEntry &authEntry)
 		sqlite3_reset(m_stmt_write_privs);
 	}
 }
+
+/*
+ * Mod storage database
+ */
+
+ModMetadataDatabaseSQLite3::ModMetadataDatabaseSQLite3(const std::string &savedir):
+	Database_SQLite3(savedir, "mod_storage"), ModMetadataDatabase()
+{
+}
+
+ModMetadataDatabaseSQLite3::~ModMetadataDatabaseSQLite3()
+{
+	FINALIZE_STATEMENT(m_stmt_get)
+	FINALIZE_STATEMENT(m_stmt_set)
+	FINALIZE_STATEMENT(m_stmt_remove)
+	FINALIZE_STATEMENT(m_stmt_remove_all)
+	FINALIZE_STATEMENT(m_stmt_list_mods)
+}
+
+void ModMetadataDatabaseSQLite3::createDatabase()
+{
+	assert(m_database); // Pre-condition
+
+	// Keys and values are blobs because Lua strings may contain any byte
+	SQLOK(sqlite3_exec(m_database,
+		"CREATE TABLE IF NOT EXISTS `entries` ("
+			"`modname` TEXT NOT NULL,"
+			"`key` BLOB NOT NULL,"
+			"`value` BLOB NOT NULL,"
+			"PRIMARY KEY (`modname`, `key`)"
+		");",
+		NULL, NULL, NULL),
+		"Failed to create mod storage table");
+}
+
+void ModMetadataDatabaseSQLite3::initStatements()
+{
+	PREPARE_STATEMENT(get, "SELECT `key`, `value` FROM `entries` WHERE `modname` = ?");
+	PREPARE_STATEMENT(set,
+		"REPLACE INTO `entries` (`modname`, `key`, `value`) VALUES (?, ?, ?)");
+	PREPARE_STATEMENT(remove, "DELETE FROM `entries` WHERE `modname` = ? AND `key` = ?");
+	PREPARE_STATEMENT(remove_all, "DELETE FROM `entries` WHERE `modname` = ?");
+	PREPARE_STATEMENT(list_mods, "SELECT DISTINCT `modname` FROM `entries`");
+}
+
+bool ModMetadataDatabaseSQLite3::getModEntries(const std::string &modname,
+	StringMap *storage)
+{
+	verifyDatabase();
+
+	str_to_sqlite(m_stmt_get, 1, modname);
+	while (sqlite3_step(m_stmt_get) == SQLITE_ROW) {
+		(*storage)[sqlite_to_blob(m_stmt_get, 0)] =
+			sqlite_to_blob(m_stmt_get, 1);
+	}
+	sqlite3_reset(m_stmt_get);
+
+	return true;
+}
+
+bool ModMetadataDatabaseSQLite3::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	verifyDatabase();
+
+	str_to_sqlite(m_stmt_set, 1, modname);
+	blob_to_sqlite(m_stmt_set, 2, key);
+	blob_to_sqlite(m_stmt_set, 3, value);
+	SQLRES(sqlite3_step(m_stmt_set), SQLITE_DONE, "Failed to set mod entry")
+	sqlite3_reset(m_stmt_set);
+
+	return true;
+}
+
+bool ModMetadataDatabaseSQLite3::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	verifyDatabase();
+
+	str_to_sqlite(m_stmt_remove, 1, modname);
+	blob_to_sqlite(m_stmt_remove, 2, key);
+	sqlite3_vrfy(sqlite3_step(m_stmt_remove), SQLITE_DONE);
+	sqlite3_reset(m_stmt_remove);
+
+	return true;
+}
+
+bool ModMetadataDatabaseSQLite3::removeModEntries(const std::string &modname)
+{
+	verifyDatabase();
+
+	str_to_sqlite(m_stmt_remove_all, 1, modname);
+	sqlite3_vrfy(sqlite3_step(m_stmt_remove_all), SQLITE_DONE);
+	sqlite3_reset(m_stmt_remove_all);
+
+	return true;
+}
+
+void ModMetadataDatabaseSQLite3::listMods(std::vector<std::string> *res)
+{
+	verifyDatabase();
+
+	while (sqlite3_step(m_stmt_list_mods) == SQLITE_ROW)
+		res->push_back(sqlite_to_string(m_stmt_list_mods, 0));
+	sqlite3_reset(m_stmt_list_mods);
+}
@@ -20,7 +20,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include "database.h"
 #include "exceptions.h"
 
@@ -28,6 +32,8 @@ extern "C" {
 #include "sqlite3.h"
 }
 
+class SQLite3CheckpointThread;
+
 class Database_SQLite3 : public Database
 {
 public:
@@ -122,7 +128,15 @@ class Database_SQLite3 : public Database
 	virtual void createDatabase() = 0;
 	virtual void initStatements() = 0;
 
+	std::string getDatabasePath() const;
+
 	sqlite3 *m_database = nullptr;
+
+	// Write-ahead logging enabled through sqlite_high_throughput
+	const bool m_wal_mode;
+	const u64 m_mmap_size;
+
+	static int busyHandler(void *data, int count);
 private:
 	// Open the database
 	void openDatabase();
@@ -137,7 +151,7 @@ class Database_SQLite3 : public Database
 
 	s64 m_busy_handler_data[2];
 
-	static int busyHandler(void *data, int count);
+	SQLite3CheckpointThread *m_checkpoint_thread = nullptr;
 };
 
 class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
@@ -151,6 +165,9 @@ class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 	bool deleteBlock(const v3s16 &pos);
 	void listAllLoadableBlocks(std::vector<v3s16> &dst);
 
+	bool canLoadConcurrently() const { return m_wal_mode; }
+	bool loadBlockConcurrent(const v3s16 &pos, std::string *block);
+
 	void beginSave() { Database_SQLite3::beginSave(); }
 	void endSave() { Database_SQLite3::endSave(); }
 protected:
@@ -158,7 +175,21 @@ class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 	virtual void initStatements();
 
 private:
+	// Read-only connection owned by a single thread, used for loading
+	// blocks while a write transaction is open on m_database
+	struct ReadConnection {
+		sqlite3 *db = nullptr;
+		sqlite3_stmt *stmt_read = nullptr;
+		s64 busy_handler_data[2];
+
+		~ReadConnection();
+	};
+
 	void bindPos(sqlite3_stmt *stmt, const v3s16 &pos, int index = 1);
+	ReadConnection *getReadConnection();
+
+	std::mutex m_readers_mutex;
+	std::unordered_map<std::thread::id, std::unique_ptr<ReadConnection>> m_readers;
 
 	// Map
 	sqlite3_stmt *m_stmt_read = nullptr;
@@ -173,7 +204,7 @@ class PlayerDatabaseSQLite3 : private Database_SQLite3, public PlayerDatabase
 	PlayerDatabaseSQLite3(const std::string &savedir);
 	virtual ~PlayerDatabaseSQLite3();
 
-	void savePlayer(RemotePlayer *player);
+	void savePlayers(const std::vector<PlayerSaveData> &players);
 	bool loadPlayer(RemotePlayer *player, PlayerSAO *sao);
 	bool removePlayer(const std::string &name);
 	void listPlayers(std::vector<std::string> &res);
@@ -184,6 +215,7 @@ class PlayerDatabaseSQLite3 : private Database_SQLite3, public PlayerDatabase
 
 private:
 	bool playerDataExists(const std::string &name);
+	void savePlayerData(const PlayerSaveData &player);
 
 	// Players
 	sqlite3_stmt *m_stmt_player_load = nullptr;
@@ -197,6 +229,8 @@ class PlayerDatabaseSQLite3 : private Database_SQLite3, public PlayerDatabase
 	sqlite3_stmt *m_stmt_player_add_inventory_items = nullptr;
 	sqlite3_stmt *m_stmt_player_remove_inventory = nullptr;
 	sqlite3_stmt *m_stmt_player_remove_inventory_items = nullptr;
+	sqlite3_stmt *m_stmt_player_remove_inventory_list = nullptr;
+	sqlite3_stmt *m_stmt_player_remove_inventory_list_items = nullptr;
 	sqlite3_stmt *m_stmt_player_metadata_load = nullptr;
 	sqlite3_stmt *m_stmt_player_metadata_remove = nullptr;
 	sqlite3_stmt *m_stmt_player_metadata_add = nullptr;
@@ -232,3 +266,43 @@ class AuthDatabaseSQLite3 : private Database_SQLite3, public AuthDatabase
 	sqlite3_stmt *m_stmt_delete_privs = nullptr;
 	sqlite3_stmt *m_stmt_last_insert_rowid = nullptr;
 };
+
+class ModMetadataDatabaseSQLite3 : private Database_SQLite3, public ModMetadataDatabase
+{
+public:
+	ModMetadataDatabaseSQLite3(const std::string &savedir);
+	virtual ~ModMetadataDatabaseSQLite3();
+
+	virtual bool getModEntries(const std::string &modname, StringMap *storage);
+	virtual bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	virtual bool removeModEntry(const std::string &modname,
+		const std::string &key);
+	virtual bool removeModEntries(const std::string &modname);
+	virtual void listMods(std::vector<std::string> *res);
+
+	virtual void beginSave() { Database_SQLite3::beginSave(); }
+	virtual void endSave() { Database_SQLite3::endSave(); }
+
+protected:
+	virtual void createDatabase();
+	virtual void initStatements();
+
+private:
+	inline void blob_to_sqlite(sqlite3_stmt *s, int iCol, const std::string &str) const
+	{
+		sqlite3_vrfy(sqlite3_bind_blob(s, iCol, str.data(), str.size(), NULL));
+	}
+
+	inline std::string sqlite_to_blob(sqlite3_stmt *s, int iCol)
+	{
+		const char *data = (const char *) sqlite3_column_blob(s, iCol);
+		return data ? std::string(data, sqlite3_column_bytes(s, iCol)) : "";
+	}
+
+	sqlite3_stmt *m_stmt_get = nullptr;
+	sqlite3_stmt *m_stmt_set = nullptr;
+	sqlite3_stmt *m_stmt_remove = nullptr;
+	sqlite3_stmt *m_stmt_remove_all = nullptr;
+	sqlite3_stmt *m_stmt_list_mods = nullptr;
+};
@@ -0,0 +1,159 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "database-writer.h"
+#include "exceptions.h"
+#include "log.h"
+#include "threading/thread.h"
+
+class PlayerDatabaseWriterThread : public Thread
+{
+public:
+	PlayerDatabaseWriterThread(PlayerDatabaseWriter *writer) :
+		Thread("PlayerDatabaseWriter"),
+		m_writer(writer)
+	{}
+
+protected:
+	void *run()
+	{
+		m_writer->work();
+		return nullptr;
+	}
+
+private:
+	PlayerDatabaseWriter *m_writer;
+};
+
+
+PlayerDatabaseWriter::PlayerDatabaseWriter(PlayerDatabase *backend) :
+	m_backend(backend)
+{
+	m_thread = new PlayerDatabaseWriterThread(this);
+	m_thread->start();
+}
+
+PlayerDatabaseWriter::~PlayerDatabaseWriter()
+{
+	// The thread writes the rest of the queue before it stops
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_queued.notify_one();
+	m_thread->wait();
+	delete m_thread;
+
+	if (!m_error.empty())
+		errorstream << "PlayerDatabaseWriter: " << m_error << std::endl;
+
+	delete m_backend;
+}
+
+void PlayerDatabaseWriter::savePlayers(const std::vector<PlayerSaveData> &players)
+{
+	// Queue the players before throwing the error of an earlier batch, the
+	// caller has already marked them as saved
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.insert(m_queue.end(), players.begin(), players.end());
+	}
+	m_queued.notify_one();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	throwError();
+}
+
+bool PlayerDatabaseWriter::loadPlayer(RemotePlayer *player, PlayerSAO *sao)
+{
+	flush();
+	return m_backend->loadPlayer(player, sao);
+}
+
+bool PlayerDatabaseWriter::removePlayer(const std::string &name)
+{
+	flush();
+	return m_backend->removePlayer(name);
+}
+
+void PlayerDatabaseWriter::listPlayers(std::vector<std::string> &res)
+{
+	flush();
+	m_backend->listPlayers(res);
+}
+
+void PlayerDatabaseWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_written.wait(lock, [this] { return m_queue.empty() && !m_writing; });
+	throwError();
+}
+
+std::vector<std::string> PlayerDatabaseWriter::takeFailedPlayers()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<std::string> names;
+	names.swap(m_failed_players);
+	return names;
+}
+
+void PlayerDatabaseWriter::work()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_queued.wait(lock, [this] { return !m_queue.empty() || m_stopping; });
+		if (m_queue.empty())
+			break;
+
+		std::vector<PlayerSaveData> players;
+		players.swap(m_queue);
+		m_writing = true;
+		lock.unlock();
+
+		std::string error;
+		try {
+			m_backend->savePlayers(players);
+		} catch (DatabaseException &e) {
+			error = e.what();
+			errorstream << "Failed to save " << players.size() << " players: "
+				<< error << std::endl;
+		}
+
+		lock.lock();
+		m_writing = false;
+		if (!error.empty()) {
+			for (const PlayerSaveData &player : players)
+				m_failed_players.push_back(player.name);
+		}
+		if (m_error.empty())
+			m_error = error;
+		m_written.notify_all();
+	}
+}
+
+void PlayerDatabaseWriter::throwError()
+{
+	// Must be called with m_mutex locked
+	if (m_error.empty())
+		return;
+
+	std::string error;
+	error.swap(m_error);
+	throw DatabaseException("Failed to save players: " + error);
+}
@@ -0,0 +1,84 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "database.h"
+#include "remoteplayer.h"
+#include "util/basic_macros.h"
+
+class PlayerDatabaseWriterThread;
+
+/*
+	Writes the player saves of another PlayerDatabase on its own thread, so
+	that the server thread doesn't wait for the backend.
+
+	savePlayers() only queues the players. Everything that was queued until
+	the thread gets to it is written in one call to the backend, i.e. one
+	transaction. The other functions wait until the queue is written, so
+	they always see the latest saves and never use the backend at the same
+	time as the thread.
+
+	Write errors can't be thrown on the thread; they are thrown as a
+	DatabaseException by the next call on the server thread instead.
+*/
+class PlayerDatabaseWriter : public PlayerDatabase
+{
+public:
+	// Takes ownership of backend
+	PlayerDatabaseWriter(PlayerDatabase *backend);
+	~PlayerDatabaseWriter();
+
+	DISABLE_CLASS_COPY(PlayerDatabaseWriter)
+
+	void savePlayers(const std::vector<PlayerSaveData> &players);
+	bool loadPlayer(RemotePlayer *player, PlayerSAO *sao);
+	bool removePlayer(const std::string &name);
+	void listPlayers(std::vector<std::string> &res);
+
+	// Waits until all queued players are written
+	void flush();
+
+	// Returns the names of the players whose saves failed since the last
+	// call, so that they can be marked as unsaved again
+	std::vector<std::string> takeFailedPlayers();
+
+private:
+	friend class PlayerDatabaseWriterThread;
+
+	// Writes the queue until the writer is destroyed
+	void work();
+	void throwError();
+
+	PlayerDatabase *m_backend;
+	PlayerDatabaseWriterThread *m_thread;
+
+	std::mutex m_mutex;
+	std::condition_variable m_queued;
+	std::condition_variable m_written;
+	std::vector<PlayerSaveData> m_queue;
+	bool m_writing = false;
+	bool m_stopping = false;
+	std::string m_error;
+	std::vector<std::string> m_failed_players;
+};
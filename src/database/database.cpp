@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "database.h"
 #include "irrlichttypes.h"
+#include "remoteplayer.h"
 
 
 /****************
@@ -67,3 +68,10 @@ v3s16 MapDatabase::getIntegerAsBlock(s64 i)
 	return pos;
 }
 
+
+void PlayerDatabase::savePlayer(RemotePlayer *player)
+{
+	std::vector<PlayerSaveData> players(1);
+	player->makeSaveData(&players[0], true);
+	savePlayers(players);
+}
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"
 #include "irrlichttypes.h"
 #include "util/basic_macros.h"
+#include "util/string.h"
 
 class Database
 {
@@ -43,6 +44,14 @@ class MapDatabase : public Database
 	virtual void loadBlock(const v3s16 &pos, std::string *block) = 0;
 	virtual bool deleteBlock(const v3s16 &pos) = 0;
 
+	// Whether loadBlockConcurrent() may be called from any thread while
+	// another thread saves blocks
+	virtual bool canLoadConcurrently() const { return false; }
+	// Only reads committed data. Returns false if the block could not be
+	// read this way and loadBlock() should be used instead.
+	virtual bool loadBlockConcurrent(const v3s16 &pos, std::string *block)
+	{ return false; }
+
 	static s64 getBlockAsInteger(const v3s16 &pos);
 	static v3s16 getIntegerAsBlock(s64 i);
 
@@ -51,13 +60,19 @@ class MapDatabase : public Database
 
 class PlayerSAO;
 class RemotePlayer;
+struct PlayerSaveData;
 
 class PlayerDatabase
 {
 public:
 	virtual ~PlayerDatabase() = default;
 
-	virtual void savePlayer(RemotePlayer *player) = 0;
+	// Writes the whole player
+	void savePlayer(RemotePlayer *player);
+	// Writes the changed parts of the players, in one transaction if the
+	// backend has them. May be called from another thread, as long as the
+	// database isn't used by the server thread at the same time.
+	virtual void savePlayers(const std::vector<PlayerSaveData> &players) = 0;
 	virtual bool loadPlayer(RemotePlayer *player, PlayerSAO *sao) = 0;
 	virtual bool removePlayer(const std::string &name) = 0;
 	virtual void listPlayers(std::vector<std::string> &res) = 0;
@@ -84,3 +99,19 @@ class AuthDatabase
 	virtual void listNames(std::vector<std::string> &res) = 0;
 	virtual void reload() = 0;
 };
+
+class ModMetadataDatabase : public Database
+{
+public:
+	virtual ~ModMetadataDatabase() = default;
+
+	// Adds all entries of a mod to storage. Returns false on read errors.
+	virtual bool getModEntries(const std::string &modname, StringMap *storage) = 0;
+	virtual bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value) = 0;
+	// Returns false on write errors only, not if there was no such entry
+	virtual bool removeModEntry(const std::string &modname,
+		const std::string &key) = 0;
+	virtual bool removeModEntries(const std::string &modname) = 0;
+	virtual void listMods(std::vector<std::string> *res) = 0;
+};
@@ -43,6 +43,7 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("enable_mesh_cache", "false");
 	settings->setDefault("mesh_generation_interval", "0");
 	settings->setDefault("meshgen_block_cache_size", "20");
+	settings->setDefault("greedy_meshing", "false");
 	settings->setDefault("enable_vbo", "true");
 	settings->setDefault("free_move", "false");
 	settings->setDefault("pitch_move", "false");
@@ -230,6 +231,8 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("show_entity_selectionbox", "false");
 	settings->setDefault("texture_clean_transparent", "false");
 	settings->setDefault("texture_min_size", "64");
+	settings->setDefault("enable_texture_cache", "true");
+	settings->setDefault("texture_generation_threads", "0");
 	settings->setDefault("ambient_occlusion_gamma", "1.8");
 #if ENABLE_GLES
 	settings->setDefault("enable_shaders", "false");
@@ -358,6 +361,8 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("disallow_empty_password", "false");
 	settings->setDefault("disable_anticheat", "false");
 	settings->setDefault("enable_rollback_recording", "false");
+	settings->setDefault("rollback_write_interval", "5.0");
+	settings->setDefault("rollback_queue_max", "10000");
 	settings->setDefault("deprecated_lua_api_handling", "log");
 
 	settings->setDefault("kick_msg_shutdown", "Server shutting down.");
@@ -367,6 +372,8 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("chat_message_format", "<@name> @message");
 	settings->setDefault("profiler_print_interval", "0");
 	settings->setDefault("active_object_send_range_blocks", "8");
+	settings->setDefault("active_object_lod_interval", "0.5");
+	settings->setDefault("entity_physics_threads", "0");
 	settings->setDefault("active_block_range", "4");
 	//settings->setDefault("max_simultaneous_block_sends_per_client", "1");
 	// This causes frametime jitter on client side, or does it?
@@ -379,12 +386,19 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("time_speed", "72");
 	settings->setDefault("world_start_time", "6125");
 	settings->setDefault("server_unload_unused_data_timeout", "29");
+	settings->setDefault("mapblock_compact_delay", "10.0");
 	settings->setDefault("max_objects_per_block", "64");
 	settings->setDefault("server_map_save_interval", "5.3");
 	settings->setDefault("chat_message_max_size", "500");
 	settings->setDefault("chat_message_limit_per_10sec", "8.0");
 	settings->setDefault("chat_message_limit_trigger_kick", "50");
+	settings->setDefault("map_blob_cache_size", "0");
+	settings->setDefault("map_blob_cache_write_delay", "0.0");
 	settings->setDefault("sqlite_synchronous", "2");
+	settings->setDefault("sqlite_high_throughput", "false");
+	settings->setDefault("sqlite_mmap_size", "268435456");
+	settings->setDefault("sqlite_cache_size", "65536");
+	settings->setDefault("sqlite_checkpoint_interval", "10.0");
 	settings->setDefault("full_block_send_enable_min_time_from_building", "2.0");
 	settings->setDefault("dedicated_server_step", "0.09");
 	settings->setDefault("active_block_mgmt_interval", "2.0");
@@ -400,6 +414,7 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("emergequeue_limit_diskonly", "64");
 	settings->setDefault("emergequeue_limit_generate", "64");
 	settings->setDefault("num_emerge_threads", "1");
+	settings->setDefault("mapgen_threads", "1");
 	settings->setDefault("secure.enable_security", "true");
 	settings->setDefault("secure.trusted_mods", "");
 	settings->setDefault("secure.http_mods", "");
@@ -420,6 +435,8 @@ void set_default_settings(Settings *settings)
 
 	// Liquids
 	settings->setDefault("liquid_loop_max", "100000");
+	settings->setDefault("liquid_time_budget", "100");
+	settings->setDefault("liquid_threads", "1");
 	settings->setDefault("liquid_queue_purge_time", "0");
 	settings->setDefault("liquid_update", "1.0");
 
@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "util/container.h"
 #include "util/thread.h"
+#include "util/workerpool.h"
 #include "threading/event.h"
 
 #include "config.h"
@@ -126,6 +127,7 @@ EmergeParams::EmergeParams(EmergeManager *parent, const BiomeManager *biomemgr,
 	enable_mapgen_debug_info(parent->enable_mapgen_debug_info),
 	gen_notify_on(parent->gen_notify_on),
 	gen_notify_on_deco_ids(&parent->gen_notify_on_deco_ids),
+	pool(parent->m_mapgen_pool.get()),
 	biomemgr(biomemgr->clone()), oremgr(oremgr->clone()),
 	decomgr(decomgr->clone()), schemmgr(schemmgr->clone())
 {
@@ -176,6 +178,9 @@ EmergeManager::EmergeManager(Server *server)
 	for (s16 i = 0; i < nthreads; i++)
 		m_threads.push_back(new EmergeThread(server, i));
 
+	m_mapgen_pool.reset(new WorkerPool("Mapgen",
+		MYMAX(1, g_settings->getU16("mapgen_threads"))));
+
 	infostream << "EmergeManager: using " << nthreads << " threads" << std::endl;
 }
 
@@ -578,6 +583,21 @@ bool EmergeThread::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
 EmergeAction EmergeThread::getBlockOrStartGen(
 	const v3s16 &pos, bool allow_gen, MapBlock **block, BlockMakeData *bmdata)
 {
+	// If the database allows it, read the block from disk before taking the
+	// environment lock so that the read doesn't wait for the server thread
+	std::string blob;
+	bool have_blob = false;
+	u32 save_counter = 0;
+	if (m_map->canReadConcurrently()) {
+		{
+			MutexAutoLock envlock(m_server->m_env_mutex);
+			*block = m_map->getBlockNoCreateNoEx(pos);
+			save_counter = m_map->getSaveCounter();
+		}
+		if (!*block || (*block)->isDummy())
+			have_blob = m_map->readBlockConcurrent(pos, &blob);
+	}
+
 	MutexAutoLock envlock(m_server->m_env_mutex);
 
 	// 1). Attempt to fetch block from memory
@@ -586,8 +606,12 @@ EmergeAction EmergeThread::getBlockOrStartGen(
 		if ((*block)->isGenerated())
 			return EMERGE_FROM_MEMORY;
 	} else {
-		// 2). Attempt to load block from disk if it was not in the memory
-		*block = m_map->loadBlock(pos);
+		// 2). Attempt to load block from disk if it was not in the memory.
+		// The blob read above is stale if anything was saved since.
+		if (have_blob && m_map->getSaveCounter() == save_counter)
+			*block = m_map->loadBlockFromBlob(pos, &blob);
+		else
+			*block = m_map->loadBlock(pos);
 		if (*block && (*block)->isGenerated())
 			return EMERGE_FROM_DISK;
 	}
@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include "network/networkprotocol.h"
 #include "irr_v3d.h"
@@ -45,6 +46,7 @@ class DecorationManager;
 class SchematicManager;
 class Server;
 class ModApiMapgen;
+class WorkerPool;
 
 // Structure containing inputs/outputs for chunk generation
 struct BlockMakeData {
@@ -100,6 +102,10 @@ class EmergeParams {
 	u32 gen_notify_on;
 	const std::set<u32> *gen_notify_on_deco_ids; // shared
 
+	// Parallelizes parts of generating a mapchunk; may be busy with the
+	// mapchunk of another emerge thread
+	WorkerPool *pool; // shared
+
 	BiomeManager *biomemgr;
 	OreManager *oremgr;
 	DecorationManager *decomgr;
@@ -187,6 +193,8 @@ class EmergeManager {
 	std::vector<EmergeThread *> m_threads;
 	bool m_threads_active = false;
 
+	std::unique_ptr<WorkerPool> m_mapgen_pool;
+
 	std::mutex m_queue_mutex;
 	std::map<v3s16, BlockEmergeData> m_blocks_enqueued;
 	std::unordered_map<u16, u16> m_peer_queue_count;
@@ -215,5 +223,7 @@ class EmergeManager {
 
 	bool popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata);
 
+	friend class EmergeParams;
 	friend class EmergeThread;
+	friend class MapgenBenchmark;
 };
@@ -30,6 +30,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/serialize.h"
 #include "util/string.h"
 
+// First byte of the binary inventory format.
+// The text format starts with a keyword.
+#define INVENTORY_BINARY_MARK 0x00
+
 /*
 	ItemStack
 */
@@ -243,6 +247,56 @@ void ItemStack::deSerialize(const std::string &str, IItemDefManager *itemdef)
 	deSerialize(is, itemdef);
 }
 
+void ItemStack::serializeBinary(std::ostream &os, IItemDefManager *itemdef) const
+{
+	writeU16(os, count);
+	if (empty())
+		return;
+
+	// Items that are not defined have no id
+	u16 id = itemdef->getItemId(name);
+	writeU16(os, id);
+	if (id == ITEM_ID_INVALID)
+		os << serializeString16(name);
+
+	u8 flags = (wear != 0 ? 0x01 : 0) | (!metadata.empty() ? 0x02 : 0);
+	writeU8(os, flags);
+	if (flags & 0x01)
+		writeU16(os, wear);
+	if (flags & 0x02)
+		metadata.serializeBinary(os);
+}
+
+void ItemStack::deSerializeBinary(std::istream &is, IItemDefManager *itemdef)
+{
+	clear();
+
+	count = readU16(is);
+	if (count == 0)
+		return;
+
+	u16 id = readU16(is);
+	if (id == ITEM_ID_INVALID) {
+		name = deSerializeString16(is);
+	} else {
+		// A client gets the item ids with the item definitions. Detached
+		// inventories sent to all clients may arrive before them.
+		const std::string *id_name = itemdef->getItemName(id);
+		name = id_name ? *id_name : "unknown";
+	}
+
+	u8 flags = readU8(is);
+	if (flags & 0x01)
+		wear = readU16(is);
+	if (flags & 0x02)
+		metadata.deSerializeBinary(is);
+
+	if (name.empty())
+		clear();
+	else if (itemdef->get(name).type == ITEM_TOOL)
+		count = 1;
+}
+
 std::string ItemStack::getItemString(bool include_meta) const
 {
 	std::ostringstream os(std::ios::binary);
@@ -504,6 +558,22 @@ void InventoryList::deSerialize(std::istream &is)
 	throw SerializationError(ss.str());
 }
 
+void InventoryList::serializeBinary(std::ostream &os) const
+{
+	writeU32(os, m_width);
+	for (const auto &item : m_items)
+		item.serializeBinary(os, m_itemdef);
+}
+
+void InventoryList::deSerializeBinary(std::istream &is)
+{
+	setModified();
+
+	m_width = readU32(is);
+	for (auto &item : m_items)
+		item.deSerializeBinary(is, m_itemdef);
+}
+
 InventoryList::InventoryList(const InventoryList &other)
 {
 	*this = other;
@@ -847,8 +917,13 @@ bool Inventory::operator == (const Inventory &other) const
 	return true;
 }
 
-void Inventory::serialize(std::ostream &os, bool incremental) const
+void Inventory::serialize(std::ostream &os, bool incremental, bool binary) const
 {
+	if (binary) {
+		serializeBinary(os, incremental);
+		return;
+	}
+
 	//std::cout << "Serialize " << (int)incremental << ", n=" << m_lists.size() << std::endl;
 	for (const InventoryList *list : m_lists) {
 		if (!incremental || list->checkModified()) {
@@ -864,6 +939,11 @@ void Inventory::serialize(std::ostream &os, bool incremental) const
 
 void Inventory::deSerialize(std::istream &is)
 {
+	if (is.peek() == INVENTORY_BINARY_MARK) {
+		deSerializeBinary(is);
+		return;
+	}
+
 	std::vector<InventoryList *> new_lists;
 	new_lists.reserve(m_lists.size());
 
@@ -877,17 +957,7 @@ void Inventory::deSerialize(std::istream &is)
 		std::getline(iss, name, ' ');
 
 		if (name == "EndInventory" || name == "end") {
-			// Remove all lists that were not sent
-			for (auto &list : m_lists) {
-				if (std::find(new_lists.begin(), new_lists.end(), list) != new_lists.end())
-					continue;
-
-				delete list;
-				list = nullptr;
-				setModified();
-			}
-			m_lists.erase(std::remove(m_lists.begin(), m_lists.end(),
-					nullptr), m_lists.end());
+			removeOtherLists(new_lists);
 			return;
 		}
 
@@ -935,6 +1005,82 @@ void Inventory::deSerialize(std::istream &is)
 	throw SerializationError(ss.str());
 }
 
+void Inventory::serializeBinary(std::ostream &os, bool incremental) const
+{
+	writeU8(os, INVENTORY_BINARY_MARK);
+	writeU8(os, 0); // version
+	writeU16(os, m_lists.size());
+	for (const InventoryList *list : m_lists) {
+		os << serializeString16(list->getName());
+		if (incremental && !list->checkModified()) {
+			writeU8(os, 1); // keep the list
+			continue;
+		}
+
+		writeU8(os, 0);
+		writeU32(os, list->getSize());
+		list->serializeBinary(os);
+	}
+}
+
+void Inventory::deSerializeBinary(std::istream &is)
+{
+	readU8(is); // INVENTORY_BINARY_MARK
+	u8 version = readU8(is);
+	if (version != 0)
+		throw SerializationError("Unsupported binary inventory version");
+
+	std::vector<InventoryList *> new_lists;
+	u16 num_lists = readU16(is);
+	new_lists.reserve(num_lists);
+	for (u16 i = 0; i < num_lists; i++) {
+		std::string listname = deSerializeString16(is);
+		InventoryList *list = getList(listname);
+
+		if (readU8(is) == 1) {
+			// Incrementally sent list
+			if (list) {
+				new_lists.push_back(list);
+			} else {
+				errorstream << "Inventory::deSerializeBinary(): Tried to keep list '" <<
+					listname << "' which is non-existent." << std::endl;
+			}
+			continue;
+		}
+
+		u32 listsize = readU32(is);
+		bool create_new = !list;
+		if (create_new)
+			list = new InventoryList(listname, listsize, m_itemdef);
+		else
+			list->setSize(listsize);
+		list->deSerializeBinary(is);
+
+		new_lists.push_back(list);
+		if (create_new)
+			m_lists.push_back(list);
+	}
+
+	if (is.fail())
+		throw SerializationError("Malformatted binary inventory");
+
+	removeOtherLists(new_lists);
+}
+
+void Inventory::removeOtherLists(const std::vector<InventoryList *> &new_lists)
+{
+	for (auto &list : m_lists) {
+		if (std::find(new_lists.begin(), new_lists.end(), list) != new_lists.end())
+			continue;
+
+		delete list;
+		list = nullptr;
+		setModified();
+	}
+	m_lists.erase(std::remove(m_lists.begin(), m_lists.end(),
+			nullptr), m_lists.end());
+}
+
 InventoryList * Inventory::addList(const std::string &name, u32 size)
 {
 	setModified();
@@ -969,7 +1115,7 @@ InventoryList * Inventory::getList(const std::string &name)
 	return m_lists[i];
 }
 
-std::vector<const InventoryList*> Inventory::getLists()
+std::vector<const InventoryList*> Inventory::getLists() const
 {
 	std::vector<const InventoryList*> lists;
 	for (auto list : m_lists) {
@@ -44,6 +44,9 @@ struct ItemStack
 	// Deserialization. Pass itemdef unless you don't want aliases resolved.
 	void deSerialize(std::istream &is, IItemDefManager *itemdef = NULL);
 	void deSerialize(const std::string &s, IItemDefManager *itemdef = NULL);
+	// Binary format with the item ids of itemdef, for the network
+	void serializeBinary(std::ostream &os, IItemDefManager *itemdef) const;
+	void deSerializeBinary(std::istream &is, IItemDefManager *itemdef);
 
 	// Returns the string used for inventory
 	std::string getItemString(bool include_meta = true) const;
@@ -197,6 +200,8 @@ class InventoryList
 	void setName(const std::string &name);
 	void serialize(std::ostream &os, bool incremental) const;
 	void deSerialize(std::istream &is);
+	void serializeBinary(std::ostream &os) const;
+	void deSerializeBinary(std::istream &is);
 
 	InventoryList(const InventoryList &other);
 	InventoryList & operator = (const InventoryList &other);
@@ -267,7 +272,16 @@ class InventoryList
 	void moveItemSomewhere(u32 i, InventoryList *dest, u32 count);
 
 	inline bool checkModified() const { return m_dirty; }
-	inline void setModified(bool dirty = true) { m_dirty = dirty; }
+	inline void setModified(bool dirty = true)
+	{
+		m_dirty = dirty;
+		m_unsaved |= dirty;
+	}
+
+	// Unlike the modified flag, which is reset when the list is sent to
+	// clients, this one is only reset when the list is saved
+	inline bool checkUnsaved() const { return m_unsaved; }
+	inline void setSaved() { m_unsaved = false; }
 
 private:
 	std::vector<ItemStack> m_items;
@@ -276,6 +290,7 @@ class InventoryList
 	u32 m_width = 0;
 	IItemDefManager *m_itemdef;
 	bool m_dirty = true;
+	bool m_unsaved = true;
 };
 
 class Inventory
@@ -295,13 +310,17 @@ class Inventory
 	}
 
 	// Never ever serialize to disk using "incremental"!
-	void serialize(std::ostream &os, bool incremental = false) const;
+	// The binary format is for the network only: it uses the item ids, and
+	// clients before protocol version 40 don't understand it.
+	void serialize(std::ostream &os, bool incremental = false,
+		bool binary = false) const;
+	// Reads both formats
 	void deSerialize(std::istream &is);
 
 	InventoryList * addList(const std::string &name, u32 size);
 	InventoryList * getList(const std::string &name);
 	const InventoryList * getList(const std::string &name) const;
-	std::vector<const InventoryList*> getLists();
+	std::vector<const InventoryList*> getLists() const;
 	bool deleteList(const std::string &name);
 	// A shorthand for adding items. Returns leftover item (possibly empty).
 	ItemStack addItem(const std::string &listname, const ItemStack &newitem)
@@ -327,17 +346,36 @@ class Inventory
 	inline void setModified(bool dirty = true)
 	{
 		m_dirty = dirty;
+		m_lists_unsaved |= dirty;
 		// Set all as handled
 		if (!dirty) {
 			for (const auto &list : m_lists)
 				list->setModified(dirty);
 		}
 	}
+
+	// Whether lists were added, removed or replaced since the last save.
+	// The changes of the items are tracked by InventoryList::checkUnsaved().
+	inline bool checkListsUnsaved() const { return m_lists_unsaved; }
+	inline void setSaved()
+	{
+		m_lists_unsaved = false;
+		for (const auto &list : m_lists)
+			list->setSaved();
+	}
+	// Makes the next save write all lists
+	inline void setUnsaved() { m_lists_unsaved = true; }
 private:
+	void serializeBinary(std::ostream &os, bool incremental) const;
+	void deSerializeBinary(std::istream &is);
+	// Removes the lists that are not in new_lists after deserialization
+	void removeOtherLists(const std::vector<InventoryList *> &new_lists);
+
 	// -1 if not found
 	const s32 getListIndex(const std::string &name) const;
 
 	std::vector<InventoryList*> m_lists;
 	IItemDefManager *m_itemdef;
 	bool m_dirty = true;
+	bool m_lists_unsaved = true;
 };
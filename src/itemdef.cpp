@@ -37,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/thread.h"
 #include <map>
 #include <set>
+#include <unordered_map>
 
 /*
 	ItemDefinition
@@ -306,6 +307,24 @@ class CItemDefManager: public IWritableItemDefManager
 		// Get the definition
 		return m_item_definitions.find(name) != m_item_definitions.cend();
 	}
+	virtual u16 getItemId(const std::string &name) const
+	{
+		auto it = m_item_ids.find(name);
+		if (it == m_item_ids.cend())
+			return ITEM_ID_INVALID;
+		return it->second;
+	}
+	virtual const std::string *getItemName(u16 id) const
+	{
+		if (id >= m_item_names.size())
+			return nullptr;
+		// Unregistered items keep their id, but not the name mapping
+		const std::string &name = m_item_names[id];
+		auto it = m_item_ids.find(name);
+		if (it == m_item_ids.cend() || it->second != id)
+			return nullptr;
+		return &name;
+	}
 #ifndef SERVER
 public:
 	ClientCached* createClientCachedDirect(const std::string &name,
@@ -452,6 +471,8 @@ class CItemDefManager: public IWritableItemDefManager
 		}
 		m_item_definitions.clear();
 		m_aliases.clear();
+		m_item_ids.clear();
+		m_item_names.clear();
 
 		// Add the four builtin items:
 		//   "" is the hand
@@ -480,6 +501,9 @@ class CItemDefManager: public IWritableItemDefManager
 		ignore_def->type = ITEM_NODE;
 		ignore_def->name = "ignore";
 		m_item_definitions.insert(std::make_pair("ignore", ignore_def));
+
+		for (const auto &it : m_item_definitions)
+			addItemId(it.first);
 	}
 	virtual void registerItem(const ItemDefinition &def)
 	{
@@ -492,6 +516,7 @@ class CItemDefManager: public IWritableItemDefManager
 			m_item_definitions[def.name] = new ItemDefinition(def);
 		else
 			*(m_item_definitions[def.name]) = def;
+		addItemId(def.name);
 
 		// Remove conflicting alias if it exists
 		bool alias_removed = (m_aliases.erase(def.name) != 0);
@@ -505,6 +530,7 @@ class CItemDefManager: public IWritableItemDefManager
 
 		delete m_item_definitions[name];
 		m_item_definitions.erase(name);
+		m_item_ids.erase(name);
 	}
 	virtual void registerAlias(const std::string &name,
 			const std::string &convert_to)
@@ -535,6 +561,13 @@ class CItemDefManager: public IWritableItemDefManager
 			os << serializeString16(it.first);
 			os << serializeString16(it.second);
 		}
+
+		if (protocol_version >= 40) {
+			// Item ids, for the binary inventory format
+			writeU16(os, m_item_names.size());
+			for (const std::string &name : m_item_names)
+				os << serializeString16(name);
+		}
 	}
 	void deSerialize(std::istream &is)
 	{
@@ -561,6 +594,20 @@ class CItemDefManager: public IWritableItemDefManager
 			std::string convert_to = deSerializeString16(is);
 			registerAlias(name, convert_to);
 		}
+
+		// Use the item ids of the server, if it sends them
+		u16 num_ids = readU16(is);
+		if (!is.good())
+			return;
+
+		m_item_ids.clear();
+		m_item_names.clear();
+		m_item_names.reserve(num_ids);
+		for (u16 i = 0; i < num_ids; i++) {
+			m_item_names.push_back(deSerializeString16(is));
+			if (m_item_definitions.count(m_item_names[i]))
+				m_item_ids[m_item_names[i]] = i;
+		}
 	}
 	void processQueue(IGameDef *gamedef)
 	{
@@ -577,10 +624,21 @@ class CItemDefManager: public IWritableItemDefManager
 #endif
 	}
 private:
+	void addItemId(const std::string &name)
+	{
+		if (m_item_ids.count(name) || m_item_names.size() >= ITEM_ID_INVALID)
+			return;
+		m_item_ids[name] = m_item_names.size();
+		m_item_names.push_back(name);
+	}
+
 	// Key is name
 	std::map<std::string, ItemDefinition*> m_item_definitions;
 	// Aliases
 	StringMap m_aliases;
+	// Item ids of the defined items, and the names of all assigned ids
+	std::unordered_map<std::string, u16> m_item_ids;
+	std::vector<std::string> m_item_names;
 #ifndef SERVER
 	// The id of the thread that is allowed to use irrlicht directly
 	std::thread::id m_main_thread;
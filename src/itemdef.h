@@ -36,6 +36,13 @@ struct ItemMesh;
 struct ItemStack;
 #endif
 
+/*
+	Item ids are compact ids for the names of the defined items. They are
+	assigned by the server, sent to the clients with the item definitions
+	and used in the binary inventory format.
+*/
+#define ITEM_ID_INVALID 0xffff
+
 /*
 	Base item definition
 */
@@ -116,6 +123,10 @@ class IItemDefManager
 	virtual void getAll(std::set<std::string> &result) const=0;
 	// Check if item is known
 	virtual bool isKnown(const std::string &name) const=0;
+	// Get the id of a defined item (not an alias), or ITEM_ID_INVALID
+	virtual u16 getItemId(const std::string &name) const=0;
+	// Get the name of an item id, or nullptr if it is not assigned
+	virtual const std::string *getItemName(u16 id) const=0;
 #ifndef SERVER
 	// Get item inventory texture
 	virtual video::ITexture* getInventoryTexture(const std::string &name,
@@ -150,6 +161,10 @@ class IWritableItemDefManager : public IItemDefManager
 	virtual void getAll(std::set<std::string> &result) const=0;
 	// Check if item is known
 	virtual bool isKnown(const std::string &name) const=0;
+	// Get the id of a defined item (not an alias), or ITEM_ID_INVALID
+	virtual u16 getItemId(const std::string &name) const=0;
+	// Get the name of an item id, or nullptr if it is not assigned
+	virtual const std::string *getItemName(u16 id) const=0;
 #ifndef SERVER
 	// Get item inventory texture
 	virtual video::ITexture* getInventoryTexture(const std::string &name,
@@ -80,6 +80,35 @@ void ItemStackMetadata::deSerialize(std::istream &is)
 	updateToolCapabilities();
 }
 
+void ItemStackMetadata::serializeBinary(std::ostream &os) const
+{
+	u32 num_vars = 0;
+	for (const auto &stringvar : m_stringvars) {
+		if (!stringvar.first.empty() || !stringvar.second.empty())
+			num_vars++;
+	}
+
+	writeU32(os, num_vars);
+	for (const auto &stringvar : m_stringvars) {
+		if (!stringvar.first.empty() || !stringvar.second.empty()) {
+			os << serializeString16(stringvar.first);
+			os << serializeString32(stringvar.second);
+		}
+	}
+}
+
+void ItemStackMetadata::deSerializeBinary(std::istream &is)
+{
+	m_stringvars.clear();
+
+	u32 num_vars = readU32(is);
+	for (u32 i = 0; i < num_vars; i++) {
+		std::string name = deSerializeString16(is);
+		m_stringvars[name] = deSerializeString32(is);
+	}
+	updateToolCapabilities();
+}
+
 void ItemStackMetadata::updateToolCapabilities()
 {
 	if (contains(TOOLCAP_KEY)) {
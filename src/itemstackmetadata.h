@@ -36,6 +36,9 @@ class ItemStackMetadata : public Metadata
 
 	void serialize(std::ostream &os) const;
 	void deSerialize(std::istream &is);
+	// For the binary inventory format
+	void serializeBinary(std::ostream &os) const;
+	void deSerializeBinary(std::istream &is);
 
 	const ToolCapabilities &getToolCapabilities(
 			const ToolCapabilities &default_caps) const
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "debug.h"
 #include "unittest/test.h"
 #include "server.h"
+#include "mapgen/mapgen_benchmark.h"
 #include "filesys.h"
 #include "version.h"
 #include "client/game.h"
@@ -186,9 +187,9 @@ int main(int argc, char *argv[])
 
 #ifndef __ANDROID__
 	// Run unit tests
-	if (cmd_args.getFlag("run-unittests")) {
+	if (cmd_args.getFlag("run-unittests") || cmd_args.getFlag("run-benchmarks")) {
 #if BUILD_UNITTESTS
-		return run_tests();
+		return run_tests(cmd_args.getFlag("run-benchmarks"));
 #else
 		errorstream << "Unittest support is not enabled in this binary. "
 			<< "If you want to enable it, compile project with BUILD_UNITTESTS=1 flag."
@@ -197,6 +198,10 @@ int main(int argc, char *argv[])
 	}
 #endif
 
+	// Run the mapgen benchmark
+	if (cmd_args.getFlag("run-mapgen-benchmark"))
+		return MapgenBenchmark::run(cmd_args) ? 0 : 1;
+
 	GameStartData game_params;
 #ifdef SERVER
 	porting::attachOrCreateConsole();
@@ -264,6 +269,16 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Set network port (UDP)"))));
 	allowed_options->insert(std::make_pair("run-unittests", ValueSpec(VALUETYPE_FLAG,
 			_("Run the unit tests and exit"))));
+	allowed_options->insert(std::make_pair("run-benchmarks", ValueSpec(VALUETYPE_FLAG,
+			_("Run the unit test benchmarks and exit"))));
+	allowed_options->insert(std::make_pair("run-mapgen-benchmark", ValueSpec(VALUETYPE_FLAG,
+			_("Benchmark the mapgens with the nodes, biomes, ores and decorations of a game and exit"))));
+	allowed_options->insert(std::make_pair("benchmark-chunks", ValueSpec(VALUETYPE_STRING,
+			_("Number of mapchunks per mapgen for --run-mapgen-benchmark"))));
+	allowed_options->insert(std::make_pair("benchmark-threads", ValueSpec(VALUETYPE_STRING,
+			_("Number of threads for --run-mapgen-benchmark (0 = like num_emerge_threads)"))));
+	allowed_options->insert(std::make_pair("benchmark-mapgens", ValueSpec(VALUETYPE_STRING,
+			_("Comma-separated mapgens for --run-mapgen-benchmark"))));
 	allowed_options->insert(std::make_pair("map-dir", ValueSpec(VALUETYPE_STRING,
 			_("Same as --world (deprecated)"))));
 	allowed_options->insert(std::make_pair("world", ValueSpec(VALUETYPE_STRING,
@@ -294,6 +309,8 @@ static void set_allowed_options(OptionList *allowed_options)
 		_("Migrate from current players backend to another (Only works when using minetestserver or with --server)"))));
 	allowed_options->insert(std::make_pair("migrate-auth", ValueSpec(VALUETYPE_STRING,
 		_("Migrate from current auth backend to another (Only works when using minetestserver or with --server)"))));
+	allowed_options->insert(std::make_pair("migrate-mod-storage", ValueSpec(VALUETYPE_STRING,
+		_("Migrate from current mod storage backend to another (Only works when using minetestserver or with --server)"))));
 	allowed_options->insert(std::make_pair("terminal", ValueSpec(VALUETYPE_FLAG,
 			_("Feature an interactive terminal (Only works when using minetestserver or with --server)"))));
 #ifndef SERVER
@@ -861,6 +878,9 @@ static bool run_dedicated_server(const GameParams &game_params, const Settings &
 	if (cmd_args.exists("migrate-auth"))
 		return ServerEnvironment::migrateAuthDatabase(game_params, cmd_args);
 
+	if (cmd_args.exists("migrate-mod-storage"))
+		return Server::migrateModStorageDatabase(game_params, cmd_args);
+
 	if (cmd_args.exists("terminal")) {
 #if USE_CURSES
 		bool name_ok = true;
@@ -33,6 +33,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "gamedef.h"
 #include "util/directiontables.h"
 #include "util/basic_macros.h"
+#include "util/workerpool.h"
 #include "rollback_interface.h"
 #include "environment.h"
 #include "reflowscan.h"
@@ -42,9 +43,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "config.h"
 #include "server.h"
 #include "database/database.h"
+#include "database/database-cache.h"
 #include "database/database-dummy.h"
 #include "database/database-sqlite3.h"
 #include "script/scripting_server.h"
+#include <algorithm>
 #include <deque>
 #include <queue>
 #if USE_LEVELDB
@@ -110,8 +113,10 @@ MapSector * Map::getSectorNoGenerateNoLock(v2s16 p)
 	MapSector *sector = n->second;
 
 	// Cache the last result
-	m_sector_cache_p = p;
-	m_sector_cache = sector;
+	if (!m_concurrent_reads) {
+		m_sector_cache_p = p;
+		m_sector_cache = sector;
+	}
 
 	return sector;
 }
@@ -212,12 +217,18 @@ void Map::addNodeAndUpdate(v3s16 p, MapNode n,
 	setNode(p, n);
 
 	// Update lighting
-	std::vector<std::pair<v3s16, MapNode> > oldnodes;
-	oldnodes.emplace_back(p, oldnode);
-	voxalgo::update_lighting_nodes(this, oldnodes, modified_blocks);
+	if (m_lighting_batch_depth > 0) {
+		m_lighting_batch.emplace_back(p, oldnode);
+		v3s16 blockpos = getNodeBlockPos(p);
+		modified_blocks[blockpos] = getBlockNoCreateNoEx(blockpos);
+	} else {
+		std::vector<std::pair<v3s16, MapNode> > oldnodes;
+		oldnodes.emplace_back(p, oldnode);
+		voxalgo::update_lighting_nodes(this, oldnodes, modified_blocks);
 
-	for (auto &modified_block : modified_blocks) {
-		modified_block.second->expireDayNightDiff();
+		for (auto &modified_block : modified_blocks) {
+			modified_block.second->expireDayNightDiff();
+		}
 	}
 
 	// Report for rollback
@@ -278,6 +289,30 @@ bool Map::addNodeWithEvent(v3s16 p, MapNode n, bool remove_metadata)
 	return succeeded;
 }
 
+void Map::beginLightingBatch()
+{
+	m_lighting_batch_depth++;
+}
+
+void Map::endLightingBatch()
+{
+	assert(m_lighting_batch_depth > 0);
+	if (--m_lighting_batch_depth > 0 || m_lighting_batch.empty())
+		return;
+
+	std::map<v3s16, MapBlock*> modified_blocks;
+	voxalgo::update_lighting_nodes(this, m_lighting_batch, modified_blocks);
+	m_lighting_batch.clear();
+
+	MapEditEvent event;
+	event.type = MEET_OTHER;
+	for (auto &modified_block : modified_blocks) {
+		modified_block.second->expireDayNightDiff();
+		event.modified_blocks.insert(modified_block.first);
+	}
+	dispatchEvent(event);
+}
+
 bool Map::removeNodeWithEvent(v3s16 p)
 {
 	MapEditEvent event;
@@ -333,6 +368,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 	u32 deleted_blocks_count = 0;
 	u32 saved_blocks_count = 0;
 	u32 block_count_all = 0;
+	u64 node_data_size = 0;
 
 	beginSave();
 
@@ -372,6 +408,8 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 				} else {
 					all_blocks_deleted = false;
 					block_count_all++;
+					block->compactIfIdle(dtime, m_compact_delay);
+					node_data_size += block->getNodeDataSize();
 				}
 			}
 
@@ -389,6 +427,9 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 
 			for (MapBlock *block : blocks) {
 				block->incrementUsageTimer(dtime);
+				if (block->getUsageTimer() <= unload_timeout)
+					block->compactIfIdle(dtime, m_compact_delay);
+				node_data_size += block->getNodeDataSize();
 				mapblock_queue.push(TimeOrderedMapBlock(sector, block));
 			}
 		}
@@ -415,6 +456,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 			}
 
 			// Delete from memory
+			node_data_size -= block->getNodeDataSize();
 			b.sect->deleteBlock(block);
 
 			if (unloaded_blocks)
@@ -435,6 +477,10 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 	// Finally delete the empty sectors
 	deleteSectors(sector_deletion_queue);
 
+	if (block_count_all != 0)
+		g_profiler->avg("Map: node bytes per block",
+			node_data_size / block_count_all);
+
 	if(deleted_blocks_count != 0)
 	{
 		PrintInfo(infostream); // ServerMap/ClientMap:
@@ -443,6 +489,9 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 		if(save_before_unloading)
 			infostream<<", of which "<<saved_blocks_count<<" were written";
 		infostream<<", "<<block_count_all<<" blocks in memory";
+		if (block_count_all != 0)
+			infostream<<" using "<<(node_data_size / block_count_all)
+				<<" bytes of node data per block";
 		infostream<<"."<<std::endl;
 		if(saved_blocks_count != 0){
 			PrintInfo(infostream); // ServerMap/ClientMap:
@@ -513,331 +562,445 @@ void Map::transforming_liquid_add(v3s16 p) {
         m_transforming_liquid.push_back(p);
 }
 
-void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
-		ServerEnvironment *env)
-{
-	u32 loopcount = 0;
-	u32 initial_size = m_transforming_liquid.size();
+// Liquid nodes evaluated between two checks of the time budget
+#define LIQUID_BATCH_SIZE 4096
 
-	/*if(initial_size != 0)
-		infostream<<"transformLiquids(): initial_size="<<initial_size<<std::endl;*/
+/*
+	The outcome of evaluating one queued liquid node. Neighbors to queue are
+	stored as bits, bit i stands for liquid_6dirs[i].
+*/
+struct LiquidUpdate {
+	v3s16 p;
+	MapNode n_old;
+	MapNode n_new;
+	// Queued whether the node changes or not
+	u8 queue_always = 0;
+	// Queued once the node was changed to n_new
+	u8 queue_changed = 0;
+	bool changed = false;
+	// n_old is floodable, on_flood() has to be called
+	bool floods = false;
+	// Didn't reach its final level yet due to viscosity
+	bool reflow = false;
+};
 
-	// list of nodes that due to viscosity have not reached their max level height
-	std::deque<v3s16> must_reflow;
+// Reads the nodes around the nodes of one block, looking up only the
+// neighboring blocks in the map
+class LiquidNodeReader {
+public:
+	LiquidNodeReader(Map *map, v3s16 blockpos) :
+		m_map(map),
+		m_origin(blockpos * MAP_BLOCKSIZE),
+		m_block(map->getBlockNoCreateNoEx(blockpos))
+	{
+	}
 
-	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
+	MapNode get(v3s16 p)
+	{
+		v3s16 rel = p - m_origin;
+		if (m_block && (u16)rel.X < MAP_BLOCKSIZE &&
+				(u16)rel.Y < MAP_BLOCKSIZE && (u16)rel.Z < MAP_BLOCKSIZE) {
+			bool is_valid;
+			return m_block->getNodeNoCheck(rel, &is_valid);
+		}
+		return m_map->getNode(p);
+	}
 
-	u32 liquid_loop_max = g_settings->getS32("liquid_loop_max");
-	u32 loop_max = liquid_loop_max;
+private:
+	Map *m_map;
+	v3s16 m_origin;
+	MapBlock *m_block;
+};
 
-#if 0
+/*
+	Decides what happens to one queued liquid node. Only reads the map, so
+	the nodes of a batch can be evaluated in any order and on any thread.
+*/
+static void evaluate_liquid(const NodeDefManager *nodedef,
+	LiquidNodeReader &reader, LiquidUpdate &u)
+{
+	const v3s16 p0 = u.p;
+	MapNode n0 = reader.get(p0);
+	u.n_old = n0;
 
-	/* If liquid_loop_max is not keeping up with the queue size increase
-	 * loop_max up to a maximum of liquid_loop_max * dedicated_server_step.
+	/*
+		Collect information about current node
 	 */
-	if (m_transforming_liquid.size() > loop_max * 2) {
-		// "Burst" mode
-		float server_step = g_settings->getFloat("dedicated_server_step");
-		if (m_transforming_liquid_loop_count_multiplier - 1.0 < server_step)
-			m_transforming_liquid_loop_count_multiplier *= 1.0 + server_step / 10;
-	} else {
-		m_transforming_liquid_loop_count_multiplier = 1.0;
-	}
-
-	loop_max *= m_transforming_liquid_loop_count_multiplier;
-#endif
-
-	while (m_transforming_liquid.size() != 0)
-	{
-		// This should be done here so that it is done when continue is used
-		if (loopcount >= initial_size || loopcount >= loop_max)
+	s8 liquid_level = -1;
+	// The liquid node which will be placed there if
+	// the liquid flows into this node.
+	content_t liquid_kind = CONTENT_IGNORE;
+	// The node which will be placed there if liquid
+	// can't flow into this node.
+	content_t floodable_node = CONTENT_AIR;
+	const ContentFeatures &cf = nodedef->get(n0);
+	LiquidType liquid_type = cf.liquid_type;
+	switch (liquid_type) {
+		case LIQUID_SOURCE:
+			liquid_level = LIQUID_LEVEL_SOURCE;
+			liquid_kind = cf.liquid_alternative_flowing_id;
 			break;
-		loopcount++;
-
-		/*
-			Get a queued transforming liquid node
-		*/
-		v3s16 p0 = m_transforming_liquid.front();
-		m_transforming_liquid.pop_front();
-
-		MapNode n0 = getNode(p0);
+		case LIQUID_FLOWING:
+			liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
+			liquid_kind = n0.getContent();
+			break;
+		case LIQUID_NONE:
+			// if this node is 'floodable', it *could* be transformed
+			// into a liquid, otherwise, continue with the next node.
+			if (!cf.floodable)
+				return;
+			floodable_node = n0.getContent();
+			liquid_kind = CONTENT_AIR;
+			break;
+	}
 
-		/*
-			Collect information about current node
-		 */
-		s8 liquid_level = -1;
-		// The liquid node which will be placed there if
-		// the liquid flows into this node.
-		content_t liquid_kind = CONTENT_IGNORE;
-		// The node which will be placed there if liquid
-		// can't flow into this node.
-		content_t floodable_node = CONTENT_AIR;
-		const ContentFeatures &cf = m_nodedef->get(n0);
-		LiquidType liquid_type = cf.liquid_type;
-		switch (liquid_type) {
-			case LIQUID_SOURCE:
-				liquid_level = LIQUID_LEVEL_SOURCE;
-				liquid_kind = cf.liquid_alternative_flowing_id;
+	/*
+		Collect information about the environment
+	 */
+	NodeNeighbor sources[6]; // surrounding sources
+	int num_sources = 0;
+	NodeNeighbor flows[6]; // surrounding flowing liquid nodes
+	int num_flows = 0;
+	NodeNeighbor airs[6]; // surrounding air
+	int num_airs = 0;
+	NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
+	int num_neutrals = 0;
+	bool flowing_down = false;
+	bool ignored_sources = false;
+	// Neighbors to queue if the node becomes a liquid or stops being one
+	u8 queue_liquid = 0;
+	u8 queue_none = 0;
+	for (u16 i = 0; i < 6; i++) {
+		NeighborType nt = NEIGHBOR_SAME_LEVEL;
+		switch (i) {
+			case 0:
+				nt = NEIGHBOR_UPPER;
 				break;
-			case LIQUID_FLOWING:
-				liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
-				liquid_kind = n0.getContent();
+			case 5:
+				nt = NEIGHBOR_LOWER;
 				break;
-			case LIQUID_NONE:
-				// if this node is 'floodable', it *could* be transformed
-				// into a liquid, otherwise, continue with the next node.
-				if (!cf.floodable)
-					continue;
-				floodable_node = n0.getContent();
-				liquid_kind = CONTENT_AIR;
+			default:
 				break;
 		}
-
-		/*
-			Collect information about the environment
-		 */
-		NodeNeighbor sources[6]; // surrounding sources
-		int num_sources = 0;
-		NodeNeighbor flows[6]; // surrounding flowing liquid nodes
-		int num_flows = 0;
-		NodeNeighbor airs[6]; // surrounding air
-		int num_airs = 0;
-		NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
-		int num_neutrals = 0;
-		bool flowing_down = false;
-		bool ignored_sources = false;
-		for (u16 i = 0; i < 6; i++) {
-			NeighborType nt = NEIGHBOR_SAME_LEVEL;
-			switch (i) {
-				case 0:
-					nt = NEIGHBOR_UPPER;
-					break;
-				case 5:
-					nt = NEIGHBOR_LOWER;
-					break;
-				default:
-					break;
-			}
-			v3s16 npos = p0 + liquid_6dirs[i];
-			NodeNeighbor nb(getNode(npos), nt, npos);
-			const ContentFeatures &cfnb = m_nodedef->get(nb.n);
-			switch (m_nodedef->get(nb.n.getContent()).liquid_type) {
-				case LIQUID_NONE:
-					if (cfnb.floodable) {
-						airs[num_airs++] = nb;
-						// if the current node is a water source the neighbor
-						// should be enqueded for transformation regardless of whether the
-						// current node changes or not.
-						if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
-							m_transforming_liquid.push_back(npos);
-						// if the current node happens to be a flowing node, it will start to flow down here.
+		v3s16 npos = p0 + liquid_6dirs[i];
+		NodeNeighbor nb(reader.get(npos), nt, npos);
+		const ContentFeatures &cfnb = nodedef->get(nb.n);
+		switch (cfnb.liquid_type) {
+			case LIQUID_NONE:
+				if (cfnb.floodable) {
+					airs[num_airs++] = nb;
+					// if the current node is a water source the neighbor
+					// should be enqueded for transformation regardless of whether the
+					// current node changes or not.
+					if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
+						u.queue_always |= 1 << i;
+					if (nb.t != NEIGHBOR_UPPER)
+						queue_liquid |= 1 << i;
+					// if the current node happens to be a flowing node, it will start to flow down here.
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				} else {
+					neutrals[num_neutrals++] = nb;
+					if (nb.n.getContent() == CONTENT_IGNORE) {
+						// If node below is ignore prevent water from
+						// spreading outwards and otherwise prevent from
+						// flowing away as ignore node might be the source
 						if (nb.t == NEIGHBOR_LOWER)
 							flowing_down = true;
-					} else {
-						neutrals[num_neutrals++] = nb;
-						if (nb.n.getContent() == CONTENT_IGNORE) {
-							// If node below is ignore prevent water from
-							// spreading outwards and otherwise prevent from
-							// flowing away as ignore node might be the source
-							if (nb.t == NEIGHBOR_LOWER)
-								flowing_down = true;
-							else
-								ignored_sources = true;
-						}
+						else
+							ignored_sources = true;
 					}
-					break;
-				case LIQUID_SOURCE:
+				}
+				break;
+			case LIQUID_SOURCE:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = cfnb.liquid_alternative_flowing_id;
+				if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					// Do not count bottom source, it will screw things up
+					if(nt != NEIGHBOR_LOWER)
+						sources[num_sources++] = nb;
+				}
+				break;
+			case LIQUID_FLOWING:
+				if (nb.t != NEIGHBOR_SAME_LEVEL ||
+					(nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK) {
 					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+					// but exclude falling liquids on the same level, they cannot flow here anyway
 					if (liquid_kind == CONTENT_AIR)
 						liquid_kind = cfnb.liquid_alternative_flowing_id;
-					if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						// Do not count bottom source, it will screw things up
-						if(nt != NEIGHBOR_LOWER)
-							sources[num_sources++] = nb;
+				}
+				if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					flows[num_flows++] = nb;
+					if (nb.t != NEIGHBOR_UPPER)
+						queue_liquid |= 1 << i;
+					queue_none |= 1 << i;
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				}
+				break;
+		}
+	}
+
+	/*
+		decide on the type (and possibly level) of the current node
+	 */
+	content_t new_node_content;
+	s8 new_node_level = -1;
+	s8 max_node_level = -1;
+
+	u8 range = nodedef->get(liquid_kind).liquid_range;
+	if (range > LIQUID_LEVEL_MAX + 1)
+		range = LIQUID_LEVEL_MAX + 1;
+
+	if ((num_sources >= 2 && nodedef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
+		// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
+		// or the flowing alternative of the first of the surrounding sources (if it's air), so
+		// it's perfectly safe to use liquid_kind here to determine the new node content.
+		new_node_content = nodedef->get(liquid_kind).liquid_alternative_source_id;
+	} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
+		// liquid_kind is set properly, see above
+		max_node_level = new_node_level = LIQUID_LEVEL_MAX;
+		if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+	} else if (ignored_sources && liquid_level >= 0) {
+		// Maybe there are neighbouring sources that aren't loaded yet
+		// so prevent flowing away.
+		new_node_level = liquid_level;
+		new_node_content = liquid_kind;
+	} else {
+		// no surrounding sources, so get the maximum level that can flow into this node
+		for (u16 i = 0; i < num_flows; i++) {
+			u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
+			switch (flows[i].t) {
+				case NEIGHBOR_UPPER:
+					if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
+						max_node_level = LIQUID_LEVEL_MAX;
+						if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
+							max_node_level = nb_liquid_level + WATER_DROP_BOOST;
+					} else if (nb_liquid_level > max_node_level) {
+						max_node_level = nb_liquid_level;
 					}
 					break;
-				case LIQUID_FLOWING:
-					if (nb.t != NEIGHBOR_SAME_LEVEL ||
-						(nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK) {
-						// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-						// but exclude falling liquids on the same level, they cannot flow here anyway
-						if (liquid_kind == CONTENT_AIR)
-							liquid_kind = cfnb.liquid_alternative_flowing_id;
-					}
-					if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						flows[num_flows++] = nb;
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					}
+				case NEIGHBOR_LOWER:
+					break;
+				case NEIGHBOR_SAME_LEVEL:
+					if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
+							nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
+						max_node_level = nb_liquid_level - 1;
 					break;
 			}
 		}
 
-		/*
-			decide on the type (and possibly level) of the current node
-		 */
-		content_t new_node_content;
-		s8 new_node_level = -1;
-		s8 max_node_level = -1;
-
-		u8 range = m_nodedef->get(liquid_kind).liquid_range;
-		if (range > LIQUID_LEVEL_MAX + 1)
-			range = LIQUID_LEVEL_MAX + 1;
-
-		if ((num_sources >= 2 && m_nodedef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
-			// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
-			// or the flowing alternative of the first of the surrounding sources (if it's air), so
-			// it's perfectly safe to use liquid_kind here to determine the new node content.
-			new_node_content = m_nodedef->get(liquid_kind).liquid_alternative_source_id;
-		} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
-			// liquid_kind is set properly, see above
-			max_node_level = new_node_level = LIQUID_LEVEL_MAX;
-			if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-		} else if (ignored_sources && liquid_level >= 0) {
-			// Maybe there are neighbouring sources that aren't loaded yet
-			// so prevent flowing away.
-			new_node_level = liquid_level;
-			new_node_content = liquid_kind;
+		u8 viscosity = nodedef->get(liquid_kind).liquid_viscosity;
+		if (viscosity > 1 && max_node_level != liquid_level) {
+			// amount to gain, limited by viscosity
+			// must be at least 1 in absolute value
+			s8 level_inc = max_node_level - liquid_level;
+			if (level_inc < -viscosity || level_inc > viscosity)
+				new_node_level = liquid_level + level_inc/viscosity;
+			else if (level_inc < 0)
+				new_node_level = liquid_level - 1;
+			else if (level_inc > 0)
+				new_node_level = liquid_level + 1;
+			if (new_node_level != max_node_level)
+				u.reflow = true;
 		} else {
-			// no surrounding sources, so get the maximum level that can flow into this node
-			for (u16 i = 0; i < num_flows; i++) {
-				u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
-				switch (flows[i].t) {
-					case NEIGHBOR_UPPER:
-						if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
-							max_node_level = LIQUID_LEVEL_MAX;
-							if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
-								max_node_level = nb_liquid_level + WATER_DROP_BOOST;
-						} else if (nb_liquid_level > max_node_level) {
-							max_node_level = nb_liquid_level;
-						}
-						break;
-					case NEIGHBOR_LOWER:
-						break;
-					case NEIGHBOR_SAME_LEVEL:
-						if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
-								nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
-							max_node_level = nb_liquid_level - 1;
-						break;
-				}
-			}
+			new_node_level = max_node_level;
+		}
 
-			u8 viscosity = m_nodedef->get(liquid_kind).liquid_viscosity;
-			if (viscosity > 1 && max_node_level != liquid_level) {
-				// amount to gain, limited by viscosity
-				// must be at least 1 in absolute value
-				s8 level_inc = max_node_level - liquid_level;
-				if (level_inc < -viscosity || level_inc > viscosity)
-					new_node_level = liquid_level + level_inc/viscosity;
-				else if (level_inc < 0)
-					new_node_level = liquid_level - 1;
-				else if (level_inc > 0)
-					new_node_level = liquid_level + 1;
-				if (new_node_level != max_node_level)
-					must_reflow.push_back(p0);
-			} else {
-				new_node_level = max_node_level;
-			}
+		if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
 
-			if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
+	}
 
-		}
+	/*
+		check if anything has changed. if not, just continue with the next node.
+	 */
+	if (new_node_content == n0.getContent() &&
+			(nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+			((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
+			((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
+			== flowing_down)))
+		return;
 
-		/*
-			check if anything has changed. if not, just continue with the next node.
-		 */
-		if (new_node_content == n0.getContent() &&
-				(m_nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
-				((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
-				((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
-				== flowing_down)))
-			continue;
 
+	/*
+		update the current node
+	 */
+	if (nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		// set level to last 3 bits, flowing down bit to 4th bit
+		n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
+	} else {
+		// set the liquid level and flow bits to 0
+		n0.param2 &= ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
+	}
+
+	// change the node.
+	n0.setContent(new_node_content);
+
+	// Ignore light (because calling voxalgo::update_lighting_nodes)
+	n0.setLight(LIGHTBANK_DAY, 0, nodedef);
+	n0.setLight(LIGHTBANK_NIGHT, 0, nodedef);
+
+	u.n_new = n0;
+	u.changed = true;
+	u.floods = floodable_node != CONTENT_AIR;
+
+	/*
+		enqueue neighbors for update if neccessary
+	 */
+	switch (nodedef->get(n0.getContent()).liquid_type) {
+		case LIQUID_SOURCE:
+		case LIQUID_FLOWING:
+			// make sure source flows into all neighboring nodes
+			u.queue_changed = queue_liquid;
+			break;
+		case LIQUID_NONE:
+			// this flow has turned to air; neighboring flows might need to do the same
+			u.queue_changed = queue_none;
+			break;
+	}
+}
+
+u32 Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
+		ServerEnvironment *env)
+{
+	u64 start_time = porting::getTimeUs();
+	u32 loopcount = 0;
+	u32 initial_size = m_transforming_liquid.size();
+
+	/*if(initial_size != 0)
+		infostream<<"transformLiquids(): initial_size="<<initial_size<<std::endl;*/
+
+	// list of nodes that due to viscosity have not reached their max level height
+	std::deque<v3s16> must_reflow;
+
+	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
+
+	u32 liquid_loop_max = g_settings->getS32("liquid_loop_max");
+	u32 loop_max = MYMIN(initial_size, liquid_loop_max);
+	u64 time_budget = (u64)g_settings->getU32("liquid_time_budget") * 1000;
+
+	if (!m_liquid_pool) {
+		m_liquid_pool.reset(new WorkerPool("Liquid",
+			MYMAX(1, g_settings->getU16("liquid_threads"))));
+	}
+
+	std::vector<LiquidUpdate> updates;
+	// (block, index into updates) pairs, sorted by block
+	std::vector<std::pair<s64, u32>> order;
+	std::vector<u32> groups;
+
+	while (loopcount < loop_max) {
+		if (loopcount > 0 && time_budget > 0 &&
+				porting::getTimeUs() - start_time >= time_budget)
+			break;
 
 		/*
-			update the current node
-		 */
-		MapNode n00 = n0;
-		//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
-		if (m_nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
-			// set level to last 3 bits, flowing down bit to 4th bit
-			n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
-		} else {
-			// set the liquid level and flow bits to 0
-			n0.param2 &= ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
+			Take a batch of queued nodes. They are all evaluated against
+			the map as it was before the batch, then applied in queue order.
+		*/
+		u32 batch_size = MYMIN(loop_max - loopcount, LIQUID_BATCH_SIZE);
+		loopcount += batch_size;
+
+		updates.clear();
+		updates.resize(batch_size);
+		order.clear();
+		for (u32 i = 0; i < batch_size; i++) {
+			v3s16 p = m_transforming_liquid.front();
+			m_transforming_liquid.pop_front();
+			updates[i].p = p;
+			order.emplace_back(MapDatabase::getBlockAsInteger(getNodeBlockPos(p)), i);
 		}
 
-		// change the node.
-		n0.setContent(new_node_content);
+		// Every block is evaluated by one thread, which only looks up the
+		// block once and reads most neighbors from it
+		std::sort(order.begin(), order.end());
+		groups.clear();
+		for (u32 i = 0; i < batch_size; i++) {
+			if (i == 0 || order[i].first != order[i - 1].first)
+				groups.push_back(i);
+		}
+		groups.push_back(batch_size);
+
+		setConcurrentReads(true);
+		m_liquid_pool->parallelFor(groups.size() - 1, [&] (u32 g) {
+			LiquidNodeReader reader(this,
+				MapDatabase::getIntegerAsBlock(order[groups[g]].first));
+			for (u32 i = groups[g]; i < groups[g + 1]; i++)
+				evaluate_liquid(m_nodedef, reader, updates[order[i].second]);
+		});
+		setConcurrentReads(false);
+
+		for (const LiquidUpdate &u : updates) {
+			for (u16 i = 0; i < 6; i++) {
+				if (u.queue_always & (1 << i))
+					m_transforming_liquid.push_back(u.p + liquid_6dirs[i]);
+			}
+			if (u.reflow)
+				must_reflow.push_back(u.p);
+			if (!u.changed)
+				continue;
+
+			const v3s16 &p0 = u.p;
+			const MapNode &n00 = u.n_old;
+			MapNode n0 = u.n_new;
 
-		// on_flood() the node
-		if (floodable_node != CONTENT_AIR) {
-			if (env->getScriptIface()->node_on_flood(p0, n00, n0))
+			// An on_flood() callback of this batch changed the node, so
+			// the update is outdated
+			if (!(getNode(p0) == n00)) {
+				m_transforming_liquid.push_back(p0);
 				continue;
-		}
+			}
 
-		// Ignore light (because calling voxalgo::update_lighting_nodes)
-		n0.setLight(LIGHTBANK_DAY, 0, m_nodedef);
-		n0.setLight(LIGHTBANK_NIGHT, 0, m_nodedef);
-
-		// Find out whether there is a suspect for this action
-		std::string suspect;
-		if (m_gamedef->rollback())
-			suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
-
-		if (m_gamedef->rollback() && !suspect.empty()) {
-			// Blame suspect
-			RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
-			// Get old node for rollback
-			RollbackNode rollback_oldnode(this, p0, m_gamedef);
-			// Set node
-			setNode(p0, n0);
-			// Report
-			RollbackNode rollback_newnode(this, p0, m_gamedef);
-			RollbackAction action;
-			action.setSetNode(p0, rollback_oldnode, rollback_newnode);
-			m_gamedef->rollback()->reportAction(action);
-		} else {
-			// Set node
-			setNode(p0, n0);
-		}
+			// on_flood() the node
+			if (u.floods) {
+				if (env->getScriptIface()->node_on_flood(p0, n00, n0))
+					continue;
+			}
 
-		v3s16 blockpos = getNodeBlockPos(p0);
-		MapBlock *block = getBlockNoCreateNoEx(blockpos);
-		if (block != NULL) {
-			modified_blocks[blockpos] =  block;
-			changed_nodes.emplace_back(p0, n00);
-		}
+			// Find out whether there is a suspect for this action
+			std::string suspect;
+			if (m_gamedef->rollback())
+				suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
+
+			if (m_gamedef->rollback() && !suspect.empty()) {
+				// Blame suspect
+				RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
+				// Get old node for rollback
+				RollbackNode rollback_oldnode(this, p0, m_gamedef);
+				// Set node
+				setNode(p0, n0);
+				// Report
+				RollbackNode rollback_newnode(this, p0, m_gamedef);
+				RollbackAction action;
+				action.setSetNode(p0, rollback_oldnode, rollback_newnode);
+				m_gamedef->rollback()->reportAction(action);
+			} else {
+				// Set node
+				setNode(p0, n0);
+			}
 
-		/*
-			enqueue neighbors for update if neccessary
-		 */
-		switch (m_nodedef->get(n0.getContent()).liquid_type) {
-			case LIQUID_SOURCE:
-			case LIQUID_FLOWING:
-				// make sure source flows into all neighboring nodes
-				for (u16 i = 0; i < num_flows; i++)
-					if (flows[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(flows[i].p);
-				for (u16 i = 0; i < num_airs; i++)
-					if (airs[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(airs[i].p);
-				break;
-			case LIQUID_NONE:
-				// this flow has turned to air; neighboring flows might need to do the same
-				for (u16 i = 0; i < num_flows; i++)
-					m_transforming_liquid.push_back(flows[i].p);
-				break;
+			v3s16 blockpos = getNodeBlockPos(p0);
+			MapBlock *block = getBlockNoCreateNoEx(blockpos);
+			if (block != NULL) {
+				modified_blocks[blockpos] =  block;
+				changed_nodes.emplace_back(p0, n00);
+			}
+
+			for (u16 i = 0; i < 6; i++) {
+				if (u.queue_changed & (1 << i))
+					m_transforming_liquid.push_back(p0 + liquid_6dirs[i]);
+			}
 		}
 	}
 	//infostream<<"Map::transformLiquids(): loopcount="<<loopcount<<std::endl;
@@ -854,7 +1017,7 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 	u16 time_until_purge = g_settings->getU16("liquid_queue_purge_time");
 
 	if (time_until_purge == 0)
-		return; // Feature disabled
+		return loopcount; // Feature disabled
 
 	time_until_purge *= 1000;	// seconds -> milliseconds
 
@@ -895,6 +1058,8 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 		m_queue_size_timer_started = false; // optimistically assume we can keep up now
 		m_unprocessed_count = m_transforming_liquid.size();
 	}
+
+	return loopcount;
 }
 
 std::vector<v3s16> Map::findNodesWithMetadata(v3s16 p1, v3s16 p2)
@@ -1206,6 +1371,8 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 {
 	verbosestream<<FUNCTION_NAME<<std::endl;
 
+	m_compact_delay = g_settings->getFloat("mapblock_compact_delay");
+
 	// Tell the EmergeManager about our MapSettingsManager
 	emerge->map_settings_mgr = &settings_mgr;
 
@@ -1223,6 +1390,12 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 	}
 	std::string backend = conf.get("backend");
 	dbase = createDatabase(backend, savedir, conf);
+	u64 cache_size = g_settings->getU64("map_blob_cache_size") * 1024 * 1024;
+	if (cache_size > 0) {
+		u32 write_delay = MYMAX(0.0f,
+			g_settings->getFloat("map_blob_cache_write_delay")) * 1000;
+		dbase = new MapDatabaseCache(dbase, cache_size, write_delay, mb);
+	}
 	if (conf.exists("readonly_backend")) {
 		std::string readonly_dir = savedir + DIR_DELIM + "readonly";
 		dbase_ro = createDatabase(conf.get("readonly_backend"), readonly_dir, conf);
@@ -1856,10 +2029,12 @@ void ServerMap::beginSave()
 void ServerMap::endSave()
 {
 	dbase->endSave();
+	m_save_counter++;
 }
 
 bool ServerMap::saveBlock(MapBlock *block)
 {
+	m_save_counter++;
 	return saveBlock(block, dbase);
 }
 
@@ -1955,19 +2130,34 @@ void ServerMap::loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool
 }
 
 MapBlock* ServerMap::loadBlock(v3s16 blockpos)
+{
+	std::string ret;
+	dbase->loadBlock(blockpos, &ret);
+	return loadBlockFromBlob(blockpos, &ret);
+}
+
+bool ServerMap::canReadConcurrently() const
+{
+	return dbase->canLoadConcurrently();
+}
+
+bool ServerMap::readBlockConcurrent(v3s16 blockpos, std::string *blob)
+{
+	return dbase->loadBlockConcurrent(blockpos, blob);
+}
+
+MapBlock *ServerMap::loadBlockFromBlob(v3s16 blockpos, std::string *blob)
 {
 	bool created_new = (getBlockNoCreateNoEx(blockpos) == NULL);
 
 	v2s16 p2d(blockpos.X, blockpos.Z);
 
-	std::string ret;
-	dbase->loadBlock(blockpos, &ret);
-	if (!ret.empty()) {
-		loadBlock(&ret, blockpos, createSector(p2d), false);
+	if (!blob->empty()) {
+		loadBlock(blob, blockpos, createSector(p2d), false);
 	} else if (dbase_ro) {
-		dbase_ro->loadBlock(blockpos, &ret);
-		if (!ret.empty()) {
-			loadBlock(&ret, blockpos, createSector(p2d), false);
+		dbase_ro->loadBlock(blockpos, blob);
+		if (!blob->empty()) {
+			loadBlock(blob, blockpos, createSector(p2d), false);
 		}
 	} else {
 		return NULL;
@@ -1994,6 +2184,7 @@ MapBlock* ServerMap::loadBlock(v3s16 blockpos)
 
 bool ServerMap::deleteBlock(v3s16 blockpos)
 {
+	m_save_counter++;
 	if (!dbase->deleteBlock(blockpos))
 		return false;
 
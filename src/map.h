@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <set>
 #include <map>
 #include <list>
+#include <memory>
 
 #include "irrlichttypes_bloated.h"
 #include "mapnode.h"
@@ -48,6 +49,7 @@ class IRollbackManager;
 class EmergeManager;
 class MetricsBackend;
 class ServerEnvironment;
+class WorkerPool;
 struct BlockMakeData;
 
 /*
@@ -197,6 +199,16 @@ class Map /*: public NodeContainer*/
 	bool addNodeWithEvent(v3s16 p, MapNode n, bool remove_metadata = true);
 	bool removeNodeWithEvent(v3s16 p);
 
+	/*
+		While a lighting batch is open, addNodeAndUpdate() and
+		removeNodeAndUpdate() only remember the changed nodes. Ending the
+		batch updates the light of all of them at once and emits an event
+		for the blocks whose light changed.
+		Batches can be nested, only the outermost one updates the light.
+	*/
+	void beginLightingBatch();
+	void endLightingBatch();
+
 	// Call these before and after saving of many blocks
 	virtual void beginSave() {}
 	virtual void endSave() {}
@@ -229,7 +241,12 @@ class Map /*: public NodeContainer*/
 	// For debug printing. Prints "Map: ", "ServerMap: " or "ClientMap: "
 	virtual void PrintInfo(std::ostream &out);
 
-	void transformLiquids(std::map<v3s16, MapBlock*> & modified_blocks,
+	/*
+		Processes the queued liquid nodes until all nodes that were queued
+		before the call are done or liquid_time_budget is used up.
+		Returns the number of nodes processed.
+	*/
+	u32 transformLiquids(std::map<v3s16, MapBlock*> & modified_blocks,
 			ServerEnvironment *env);
 
 	/*
@@ -271,6 +288,15 @@ class Map /*: public NodeContainer*/
 	*/
 
 	void transforming_liquid_add(v3s16 p);
+	u32 transforming_liquid_size() const { return m_transforming_liquid.size(); }
+
+	/*
+		While enabled, reading nodes and blocks doesn't update the lookup
+		caches, so that several threads can read the map at once. Nothing
+		may modify the map meanwhile.
+	*/
+	void setConcurrentReads(bool enable) { m_concurrent_reads = enable; }
+	bool isConcurrentReading() const { return m_concurrent_reads; }
 
 	bool isBlockOccluded(MapBlock *block, v3s16 cam_pos_nodes);
 protected:
@@ -285,6 +311,11 @@ class Map /*: public NodeContainer*/
 	// Be sure to set this to NULL when the cached sector is deleted
 	MapSector *m_sector_cache = nullptr;
 	v2s16 m_sector_cache_p;
+	bool m_concurrent_reads = false;
+
+	// Nodes changed in the open lighting batch, with the nodes they replaced
+	std::vector<std::pair<v3s16, MapNode>> m_lighting_batch;
+	u32 m_lighting_batch_depth = 0;
 
 	// Queued transforming water nodes
 	UniqueQueue<v3s16> m_transforming_liquid;
@@ -298,13 +329,34 @@ class Map /*: public NodeContainer*/
 		float step, float stepfac, float start_offset, float end_offset,
 		u32 needed_count);
 
+	// Idle time after which blocks switch to compact node storage. Only the
+	// server map compacts blocks; the mesh generator of the client reads the
+	// node arrays directly.
+	float m_compact_delay = -1.0f;
+
 private:
-	f32 m_transforming_liquid_loop_count_multiplier = 1.0f;
+	// Evaluates liquid nodes in parallel, created on first use
+	std::unique_ptr<WorkerPool> m_liquid_pool;
 	u32 m_unprocessed_count = 0;
 	u64 m_inc_trending_up_start_time = 0; // milliseconds
 	bool m_queue_size_timer_started = false;
 };
 
+/*
+	Keeps a lighting batch of the map open while it exists
+*/
+class MapLightingBatch
+{
+public:
+	MapLightingBatch(Map *map) : m_map(map) { m_map->beginLightingBatch(); }
+	~MapLightingBatch() { m_map->endLightingBatch(); }
+
+	DISABLE_CLASS_COPY(MapLightingBatch);
+
+private:
+	Map *m_map;
+};
+
 /*
 	ServerMap
 
@@ -386,6 +438,17 @@ class ServerMap : public Map
 	// Database version
 	void loadBlock(std::string *blob, v3s16 p3d, MapSector *sector, bool save_after_load=false);
 
+	/*
+		Reading blocks without holding the environment lock.
+		readBlockConcurrent() may be called from any thread. The blob is
+		only valid if getSaveCounter() has not changed in between, in which
+		case it can be passed to loadBlockFromBlob().
+	*/
+	bool canReadConcurrently() const;
+	bool readBlockConcurrent(v3s16 blockpos, std::string *blob);
+	MapBlock *loadBlockFromBlob(v3s16 blockpos, std::string *blob);
+	u32 getSaveCounter() const { return m_save_counter; }
+
 	bool deleteBlock(v3s16 blockpos);
 
 	void updateVManip(v3s16 pos);
@@ -431,6 +494,8 @@ class ServerMap : public Map
 	bool m_map_metadata_changed = true;
 	MapDatabase *dbase = nullptr;
 	MapDatabase *dbase_ro = nullptr;
+	// Incremented whenever blocks are written to or deleted from dbase
+	u32 m_save_counter = 0;
 
 	MetricCounterPtr m_save_time_counter;
 };
@@ -19,7 +19,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapblock.h"
 
+#include <cstring>
 #include <sstream>
+#include <unordered_map>
 #include "map.h"
 #include "light.h"
 #include "nodedef.h"
@@ -85,6 +87,7 @@ MapBlock::~MapBlock()
 	}
 #endif
 
+	freeCompact();
 	delete[] data;
 }
 
@@ -102,14 +105,14 @@ MapNode MapBlock::getNodeParent(v3s16 p, bool *is_valid_position)
 	if (!isValidPosition(p))
 		return m_parent->getNode(getPosRelative() + p, is_valid_position);
 
-	if (!data) {
+	if (isDummy()) {
 		if (is_valid_position)
 			*is_valid_position = false;
 		return {CONTENT_IGNORE};
 	}
 	if (is_valid_position)
 		*is_valid_position = true;
-	return data[p.Z * zstride + p.Y * ystride + p.X];
+	return nodeAt(p.Z * zstride + p.Y * ystride + p.X);
 }
 
 std::string MapBlock::getModifiedReasonString()
@@ -139,8 +142,16 @@ void MapBlock::copyTo(VoxelManipulator &dst)
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
+	// Compact blocks are decoded into a buffer that is reused by the thread
+	static thread_local std::vector<MapNode> tmp_nodes(nodecount);
+	MapNode *src = data;
+	if (isCompact()) {
+		copyNodesTo(tmp_nodes.data());
+		src = tmp_nodes.data();
+	}
+
 	// Copy from data to VoxelManipulator
-	dst.copyFrom(data, data_area, v3s16(0,0,0),
+	dst.copyFrom(src, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
 }
 
@@ -149,11 +160,124 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
+	if (isCompact())
+		expand();
+	m_write_idle_timer = 0;
+
 	// Copy from VoxelManipulator to data
 	dst.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
 }
 
+void MapBlock::copyNodesTo(MapNode *dst)
+{
+	if (data) {
+		memcpy(dst, data, nodecount * sizeof(MapNode));
+	} else if (!m_indices) {
+		for (u32 i = 0; i < nodecount; i++)
+			dst[i] = m_palette[0];
+	} else {
+		for (u32 i = 0; i < nodecount; i++)
+			dst[i] = nodeAt(i);
+	}
+}
+
+static inline u32 palette_key(const MapNode &n)
+{
+	return (u32)n.param0 << 16 | n.param1 << 8 | n.param2;
+}
+
+bool MapBlock::compact()
+{
+	if (!data)
+		return isCompact();
+
+	// Find the distinct nodes, giving up when there are too many
+	std::unordered_map<u32, u8> palette_ids;
+	std::vector<MapNode> palette;
+	MapNode previous = data[0];
+	palette_ids[palette_key(previous)] = 0;
+	palette.push_back(previous);
+	for (u32 i = 1; i < nodecount; i++) {
+		const MapNode &n = data[i];
+		if (n == previous)
+			continue;
+		previous = n;
+		u32 key = palette_key(n);
+		if (palette_ids.find(key) != palette_ids.end())
+			continue;
+		if (palette.size() == 256) {
+			m_compact_failed = true;
+			return false;
+		}
+		palette_ids[key] = palette.size();
+		palette.push_back(n);
+	}
+
+	if (palette.size() > 1) {
+		u8 bits_log2 = 0;
+		while ((size_t)1 << (1 << bits_log2) < palette.size())
+			bits_log2++;
+		m_index_bits_log2 = bits_log2;
+
+		m_indices = new u8[(nodecount << bits_log2) / 8]();
+		for (u32 i = 0; i < nodecount; i++) {
+			const MapNode &n = data[i];
+			u32 id = palette_ids[palette_key(n)];
+			u32 bit = i << bits_log2;
+			m_indices[bit >> 3] |= id << (bit & 7);
+		}
+	}
+
+	m_palette = std::move(palette);
+	m_palette.shrink_to_fit();
+	delete[] data;
+	data = nullptr;
+	return true;
+}
+
+void MapBlock::expand()
+{
+	if (!isCompact())
+		return;
+
+	MapNode *nodes = new MapNode[nodecount];
+	copyNodesTo(nodes);
+	freeCompact();
+	data = nodes;
+	m_write_idle_timer = 0;
+}
+
+void MapBlock::freeCompact()
+{
+	m_palette.clear();
+	m_palette.shrink_to_fit();
+	delete[] m_indices;
+	m_indices = nullptr;
+	m_index_bits_log2 = 0;
+}
+
+void MapBlock::compactIfIdle(float dtime, float delay)
+{
+	if (!data || m_compact_failed || delay < 0)
+		return;
+
+	m_write_idle_timer += dtime;
+	if (m_write_idle_timer >= delay)
+		compact();
+}
+
+size_t MapBlock::getNodeDataSize() const
+{
+	if (data)
+		return nodecount * sizeof(MapNode);
+
+	size_t size = m_palette.capacity() * sizeof(MapNode);
+	if (m_indices)
+		size += (nodecount << m_index_bits_log2) / 8;
+	return size;
+}
+
 void MapBlock::actuallyUpdateDayNightDiff()
 {
 	const NodeDefManager *nodemgr = m_gamedef->ndef();
@@ -161,11 +285,20 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	// Running this function un-expires m_day_night_differs
 	m_day_night_differs_expired = false;
 
-	if (!data) {
+	if (isDummy()) {
 		m_day_night_differs = false;
 		return;
 	}
 
+	// Every palette entry of a compact block is used, so it is enough to
+	// look at those
+	const MapNode *nodes = data;
+	u32 count = nodecount;
+	if (!data) {
+		nodes = m_palette.data();
+		count = m_palette.size();
+	}
+
 	bool differs = false;
 
 	/*
@@ -173,8 +306,8 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	*/
 
 	MapNode previous_n(CONTENT_IGNORE);
-	for (u32 i = 0; i < nodecount; i++) {
-		MapNode n = data[i];
+	for (u32 i = 0; i < count; i++) {
+		MapNode n = nodes[i];
 
 		// If node is identical to previous node, don't verify if it differs
 		if (n == previous_n)
@@ -192,8 +325,8 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	*/
 	if (differs) {
 		bool only_air = true;
-		for (u32 i = 0; i < nodecount; i++) {
-			MapNode &n = data[i];
+		for (u32 i = 0; i < count; i++) {
+			const MapNode &n = nodes[i];
 			if (n.getContent() != CONTENT_AIR) {
 				only_air = false;
 				break;
@@ -209,7 +342,7 @@ void MapBlock::actuallyUpdateDayNightDiff()
 
 void MapBlock::expireDayNightDiff()
 {
-	if (!data) {
+	if (isDummy()) {
 		m_day_night_differs = false;
 		m_day_night_differs_expired = false;
 		return;
@@ -227,7 +360,10 @@ s16 MapBlock::getGroundLevel(v2s16 p2d)
 		s16 y = MAP_BLOCKSIZE-1;
 		for(; y>=0; y--)
 		{
-			MapNode n = getNodeRef(p2d.X, y, p2d.Y);
+			bool is_valid;
+			MapNode n = getNode(p2d.X, y, p2d.Y, &is_valid);
+			if (!is_valid)
+				throw InvalidPositionException();
 			if (m_gamedef->ndef()->get(n).walkable) {
 				if(y == MAP_BLOCKSIZE-1)
 					return -2;
@@ -360,7 +496,7 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
-	if (!data)
+	if (isDummy())
 		throw SerializationError("ERROR: Not writing dummy block.");
 
 	FATAL_ERROR_IF(version < SER_FMT_VER_LOWEST_WRITE, "Serialisation version error");
@@ -385,8 +521,7 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 	if(disk)
 	{
 		MapNode *tmp_nodes = new MapNode[nodecount];
-		for(u32 i=0; i<nodecount; i++)
-			tmp_nodes[i] = data[i];
+		copyNodesTo(tmp_nodes);
 		getBlockNodeIdMapping(&nimap, tmp_nodes, m_gamedef->ndef());
 
 		u8 content_width = 2;
@@ -399,12 +534,19 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 	}
 	else
 	{
+		MapNode *tmp_nodes = nullptr;
+		if (isCompact()) {
+			tmp_nodes = new MapNode[nodecount];
+			copyNodesTo(tmp_nodes);
+		}
+
 		u8 content_width = 2;
 		u8 params_width = 2;
 		writeU8(os, content_width);
 		writeU8(os, params_width);
-		MapNode::serializeBulk(os, version, data, nodecount,
-				content_width, params_width, true);
+		MapNode::serializeBulk(os, version, tmp_nodes ? tmp_nodes : data,
+				nodecount, content_width, params_width, true);
+		delete[] tmp_nodes;
 	}
 
 	/*
@@ -442,7 +584,7 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk)
 
 void MapBlock::serializeNetworkSpecific(std::ostream &os)
 {
-	if (!data) {
+	if (isDummy()) {
 		throw SerializationError("ERROR: Not writing dummy block.");
 	}
 
@@ -458,6 +600,11 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 
 	m_day_night_differs_expired = false;
 
+	// The nodes are overwritten in place
+	expand();
+	m_write_idle_timer = 0;
+	m_compact_failed = false;
+
 	if(version <= 21)
 	{
 		deSerialize_pre22(is, version, disk);
@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #pragma once
 
 #include <set>
+#include <vector>
 #include "irr_v3d.h"
 #include "mapnode.h"
 #include "exceptions.h"
@@ -88,6 +89,7 @@ class MapBlock
 
 	void reallocate()
 	{
+		freeCompact();
 		delete[] data;
 		data = new MapNode[nodecount];
 		for (u32 i = 0; i < nodecount; i++)
@@ -96,11 +98,42 @@ class MapBlock
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
 	}
 
+	// Returns the full node array for writing; expands a compact block
 	MapNode* getData()
 	{
+		if (isCompact())
+			expand();
 		return data;
 	}
 
+	// Copies all nodes of a non-dummy block to dst without expanding it
+	void copyNodesTo(MapNode *dst);
+
+	////
+	//// Compact node storage
+	////
+
+	/*
+		Blocks that haven't been written to for a while are stored as a
+		palette of distinct nodes and one 0, 1, 2, 4 or 8 bit index per node.
+		Reads decode in place, writes expand the block to a full array.
+	*/
+
+	inline bool isCompact() const
+	{
+		return !data && !m_palette.empty();
+	}
+
+	// Returns false if the block has too many distinct nodes
+	bool compact();
+	void expand();
+
+	// Compacts the block once it hasn't been written to for delay seconds
+	void compactIfIdle(float dtime, float delay);
+
+	// Bytes used to store the nodes of this block
+	size_t getNodeDataSize() const;
+
 	////
 	//// Modification tracking methods
 	////
@@ -114,8 +147,11 @@ class MapBlock
 		} else if (mod == m_modified) {
 			m_modified_reason |= reason;
 		}
-		if (mod == MOD_STATE_WRITE_NEEDED)
+		if (mod == MOD_STATE_WRITE_NEEDED) {
 			contents_cached = false;
+			m_write_idle_timer = 0;
+			m_compact_failed = false;
+		}
 	}
 
 	inline u32 getModified()
@@ -142,7 +178,7 @@ class MapBlock
 
 	inline bool isDummy()
 	{
-		return !data;
+		return !data && m_palette.empty();
 	}
 
 	inline void unDummify()
@@ -242,7 +278,7 @@ class MapBlock
 
 	inline bool isValidPosition(s16 x, s16 y, s16 z)
 	{
-		return data
+		return !isDummy()
 			&& x >= 0 && x < MAP_BLOCKSIZE
 			&& y >= 0 && y < MAP_BLOCKSIZE
 			&& z >= 0 && z < MAP_BLOCKSIZE;
@@ -260,7 +296,7 @@ class MapBlock
 		if (!*valid_position)
 			return {CONTENT_IGNORE};
 
-		return data[z * zstride + y * ystride + x];
+		return nodeAt(z * zstride + y * ystride + x);
 	}
 
 	inline MapNode getNode(v3s16 p, bool *valid_position)
@@ -279,6 +315,8 @@ class MapBlock
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
+		if (isCompact())
+			expand();
 		data[z * zstride + y * ystride + x] = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
@@ -294,11 +332,11 @@ class MapBlock
 
 	inline MapNode getNodeNoCheck(s16 x, s16 y, s16 z, bool *valid_position)
 	{
-		*valid_position = data != nullptr;
+		*valid_position = !isDummy();
 		if (!*valid_position)
 			return {CONTENT_IGNORE};
 
-		return data[z * zstride + y * ystride + x];
+		return nodeAt(z * zstride + y * ystride + x);
 	}
 
 	inline MapNode getNodeNoCheck(v3s16 p, bool *valid_position)
@@ -310,23 +348,27 @@ class MapBlock
 	//// Non-checking, unsafe variants of the above
 	//// MapBlock must be loaded by another function in the same scope/function
 	//// Caller must ensure that this is not a dummy block (by calling isDummy())
+	//// The node is returned by value: the palette of a compact block is
+	//// freed when the block is expanded by a write.
 	////
 
-	inline const MapNode &getNodeUnsafe(s16 x, s16 y, s16 z)
+	inline MapNode getNodeUnsafe(s16 x, s16 y, s16 z)
 	{
-		return data[z * zstride + y * ystride + x];
+		return nodeAt(z * zstride + y * ystride + x);
 	}
 
-	inline const MapNode &getNodeUnsafe(v3s16 &p)
+	inline MapNode getNodeUnsafe(v3s16 &p)
 	{
 		return getNodeUnsafe(p.X, p.Y, p.Z);
 	}
 
 	inline void setNodeNoCheck(s16 x, s16 y, s16 z, MapNode & n)
 	{
-		if (!data)
+		if (isDummy())
 			throw InvalidPositionException();
 
+		if (isCompact())
+			expand();
 		data[z * zstride + y * ystride + x] = n;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE_NO_CHECK);
 	}
@@ -496,6 +538,20 @@ class MapBlock
 
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
 
+	void freeCompact();
+
+	// Node at index i of a non-dummy block
+	inline const MapNode &nodeAt(u32 i) const
+	{
+		if (data)
+			return data[i];
+		if (!m_indices)
+			return m_palette[0];
+		u32 bit = i << m_index_bits_log2;
+		u32 mask = (1 << (1 << m_index_bits_log2)) - 1;
+		return m_palette[(m_indices[bit >> 3] >> (bit & 7)) & mask];
+	}
+
 	/*
 		Used only internally, because changes can't be tracked
 	*/
@@ -505,6 +561,8 @@ class MapBlock
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
+		if (isCompact())
+			expand();
 		return data[z * zstride + y * ystride + x];
 	}
 
@@ -560,11 +618,25 @@ class MapBlock
 	IGameDef *m_gamedef;
 
 	/*
-		If NULL, block is a dummy block.
+		If NULL and the block is not compact, block is a dummy block.
 		Dummy blocks are used for caching not-found-on-disk blocks.
 	*/
 	MapNode *data = nullptr;
 
+	/*
+		Compact storage, used while data is NULL.
+		A single palette entry without indices is a uniform block.
+	*/
+	std::vector<MapNode> m_palette;
+	u8 *m_indices = nullptr;
+	// Each index has 1 << m_index_bits_log2 bits
+	u8 m_index_bits_log2 = 0;
+
+	// Time since the nodes were last written to
+	float m_write_idle_timer = 0;
+	// Set when compacting failed, until the next write
+	bool m_compact_failed = false;
+
 	/*
 		- On the server, this is used for telling whether the
 		  block has been modified from the one on disk.
@@ -39,7 +39,8 @@ static NoiseParams nparams_caveliquids(0, 1, v3f(150.0, 150.0, 150.0), 776, 3, 0
 
 CavesNoiseIntersection::CavesNoiseIntersection(
 	const NodeDefManager *nodedef, BiomeManager *biomemgr, v3s16 chunksize,
-	NoiseParams *np_cave1, NoiseParams *np_cave2, s32 seed, float cave_width)
+	NoiseParams *np_cave1, NoiseParams *np_cave2, s32 seed, float cave_width,
+	WorkerPool *pool)
 {
 	assert(nodedef);
 	assert(biomemgr);
@@ -58,6 +59,8 @@ CavesNoiseIntersection::CavesNoiseIntersection(
 	// re-carving the solid overtop placed for blocking sunlight
 	noise_cave1 = new Noise(np_cave1, seed, m_csize.X, m_csize.Y + 1, m_csize.Z);
 	noise_cave2 = new Noise(np_cave2, seed, m_csize.X, m_csize.Y + 1, m_csize.Z);
+	noise_cave1->pool = pool;
+	noise_cave2->pool = pool;
 }
 
 
@@ -177,7 +180,8 @@ void CavesNoiseIntersection::generateCaves(MMVManip *vm,
 
 CavernsNoise::CavernsNoise(
 	const NodeDefManager *nodedef, v3s16 chunksize, NoiseParams *np_cavern,
-	s32 seed, float cavern_limit, float cavern_taper, float cavern_threshold)
+	s32 seed, float cavern_limit, float cavern_taper, float cavern_threshold,
+	WorkerPool *pool)
 {
 	assert(nodedef);
 
@@ -195,6 +199,7 @@ CavernsNoise::CavernsNoise(
 	// A Nx-by-1-by-Nz-sized plane is at the bottom of the desired for
 	// re-carving the solid overtop placed for blocking sunlight
 	noise_cavern = new Noise(np_cavern, seed, m_csize.X, m_csize.Y + 1, m_csize.Z);
+	noise_cavern->pool = pool;
 
 	c_water_source = m_ndef->getId("mapgen_water_source");
 	if (c_water_source == CONTENT_IGNORE)
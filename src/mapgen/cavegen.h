@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 typedef u16 biome_t;  // copy from mg_biome.h to avoid an unnecessary include
 
 class GenerateNotifier;
+class WorkerPool;
 
 /*
 	CavesNoiseIntersection is a cave digging algorithm that carves smooth,
@@ -43,7 +44,8 @@ class CavesNoiseIntersection
 public:
 	CavesNoiseIntersection(const NodeDefManager *nodedef,
 		BiomeManager *biomemgr, v3s16 chunksize, NoiseParams *np_cave1,
-		NoiseParams *np_cave2, s32 seed, float cave_width);
+		NoiseParams *np_cave2, s32 seed, float cave_width,
+		WorkerPool *pool = nullptr);
 	~CavesNoiseIntersection();
 
 	void generateCaves(MMVManip *vm, v3s16 nmin, v3s16 nmax, biome_t *biomemap);
@@ -72,7 +74,8 @@ class CavernsNoise
 public:
 	CavernsNoise(const NodeDefManager *nodedef, v3s16 chunksize,
 		NoiseParams *np_cavern, s32 seed, float cavern_limit,
-		float cavern_taper, float cavern_threshold);
+		float cavern_taper, float cavern_threshold,
+		WorkerPool *pool = nullptr);
 	~CavernsNoise();
 
 	bool generateCaverns(MMVManip *vm, v3s16 nmin, v3s16 nmax);
@@ -30,6 +30,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "map.h"
 #include "nodedef.h"
 #include "emerge.h"
+#include "util/workerpool.h"
 #include "voxelalgorithms.h"
 #include "porting.h"
 #include "profiler.h"
@@ -135,6 +136,52 @@ Mapgen::Mapgen(int mapgenid, MapgenParams *params, EmergeParams *emerge) :
 }
 
 
+const char *mapgen_stage_names[MGSTAGE_COUNT] = {
+	"noise",
+	"terrain",
+	"caves",
+	"dungeons",
+	"biomes",
+	"ores",
+	"decorations",
+	"lighting",
+	"liquids",
+};
+
+thread_local MapgenStageTimer *MapgenStageTimer::s_current = nullptr;
+
+MapgenStageTimer::MapgenStageTimer(MapgenStageTimes *times, MapgenStage stage) :
+	m_times(times),
+	m_stage(stage),
+	m_parent(s_current)
+{
+	if (!m_times)
+		return;
+
+	m_start = porting::getTimeUs();
+	if (m_parent)
+		m_parent->m_times->us[m_parent->m_stage] += m_start - m_parent->m_start;
+	s_current = this;
+}
+
+MapgenStageTimer::MapgenStageTimer(MapgenStage stage) :
+	MapgenStageTimer(s_current ? s_current->m_times : nullptr, stage)
+{
+}
+
+MapgenStageTimer::~MapgenStageTimer()
+{
+	if (!m_times)
+		return;
+
+	u64 now = porting::getTimeUs();
+	m_times->us[m_stage] += now - m_start;
+	s_current = m_parent;
+	if (m_parent)
+		m_parent->m_start = now;
+}
+
+
 MapgenType Mapgen::getMapgenType(const std::string &mgname)
 {
 	for (size_t i = 0; i != ARRLEN(g_reg_mapgens); i++) {
@@ -362,6 +409,7 @@ inline bool Mapgen::isLiquidHorizontallyFlowable(u32 vi, v3s16 em)
 
 void Mapgen::updateLiquid(UniqueQueue<v3s16> *trans_liquid, v3s16 nmin, v3s16 nmax)
 {
+	MapgenStageTimer timer(MGSTAGE_LIQUIDS);
 	bool isignored, isliquid, wasignored, wasliquid, waschecked, waspushed;
 	const v3s16 &em  = vm->m_area.getExtent();
 
@@ -468,6 +516,7 @@ void Mapgen::lightSpread(VoxelArea &a, std::queue<std::pair<v3s16, u8>> &queue,
 void Mapgen::calcLighting(v3s16 nmin, v3s16 nmax, v3s16 full_nmin, v3s16 full_nmax,
 	bool propagate_shadow)
 {
+	MapgenStageTimer timer(MGSTAGE_LIGHTING);
 	ScopeProfiler sp(g_profiler, "EmergeThread: update lighting", SPT_AVG);
 	//TimeTaker t("updateLighting");
 
@@ -630,143 +679,148 @@ MapgenBasic::~MapgenBasic()
 
 void MapgenBasic::generateBiomes()
 {
+	MapgenStageTimer timer(MGSTAGE_BIOMES);
 	// can't generate biomes without a biome generator!
 	assert(biomegen);
 	assert(biomemap);
 
 	const v3s16 &em = vm->m_area.getExtent();
-	u32 index = 0;
 
 	noise_filler_depth->perlinMap2D(node_min.X, node_min.Z);
 
-	for (s16 z = node_min.Z; z <= node_max.Z; z++)
-	for (s16 x = node_min.X; x <= node_max.X; x++, index++) {
-		Biome *biome = NULL;
-		biome_t water_biome_index = 0;
-		u16 depth_top = 0;
-		u16 base_filler = 0;
-		u16 depth_water_top = 0;
-		u16 depth_riverbed = 0;
-		s16 biome_y_min = -MAX_MAP_GENERATION_LIMIT;
-		u32 vi = vm->m_area.index(x, node_max.Y, z);
-
-		// Check node at base of mapchunk above, either a node of a previously
-		// generated mapchunk or if not, a node of overgenerated base terrain.
-		content_t c_above = vm->m_data[vi + em.X].getContent();
-		bool air_above = c_above == CONTENT_AIR;
-		bool river_water_above = c_above == c_river_water_source;
-		bool water_above = c_above == c_water_source || river_water_above;
-
-		biomemap[index] = BIOME_NONE;
-
-		// If there is air or water above enable top/filler placement, otherwise force
-		// nplaced to stone level by setting a number exceeding any possible filler depth.
-		u16 nplaced = (air_above || water_above) ? 0 : U16_MAX;
-
-		for (s16 y = node_max.Y; y >= node_min.Y; y--) {
-			content_t c = vm->m_data[vi].getContent();
-			// Biome is (re)calculated:
-			// 1. At the surface of stone below air or water.
-			// 2. At the surface of water below air.
-			// 3. When stone or water is detected but biome has not yet been calculated.
-			// 4. When stone or water is detected just below a biome's lower limit.
-			bool is_stone_surface = (c == c_stone) &&
-				(air_above || water_above || !biome || y < biome_y_min); // 1, 3, 4
-
-			bool is_water_surface =
-				(c == c_water_source || c == c_river_water_source) &&
-				(air_above || !biome || y < biome_y_min); // 2, 3, 4
-
-			if (is_stone_surface || is_water_surface) {
-				// (Re)calculate biome
-				biome = biomegen->getBiomeAtIndex(index, v3s16(x, y, z));
-
-				// Add biome to biomemap at first stone surface detected
-				if (biomemap[index] == BIOME_NONE && is_stone_surface)
-					biomemap[index] = biome->index;
-
-				// Store biome of first water surface detected, as a fallback
-				// entry for the biomemap.
-				if (water_biome_index == 0 && is_water_surface)
-					water_biome_index = biome->index;
-
-				depth_top = biome->depth_top;
-				base_filler = MYMAX(depth_top +
-					biome->depth_filler +
-					noise_filler_depth->result[index], 0.0f);
-				depth_water_top = biome->depth_water_top;
-				depth_riverbed = biome->depth_riverbed;
-				biome_y_min = biome->min_pos.Y;
-			}
+	// The columns are independent of each other
+	m_emerge->pool->parallelFor(csize.Z, [&] (u32 row) {
+		s16 z = node_min.Z + row;
+		u32 index = row * csize.X;
+		for (s16 x = node_min.X; x <= node_max.X; x++, index++) {
+			Biome *biome = NULL;
+			biome_t water_biome_index = 0;
+			u16 depth_top = 0;
+			u16 base_filler = 0;
+			u16 depth_water_top = 0;
+			u16 depth_riverbed = 0;
+			s16 biome_y_min = -MAX_MAP_GENERATION_LIMIT;
+			u32 vi = vm->m_area.index(x, node_max.Y, z);
+
+			// Check node at base of mapchunk above, either a node of a previously
+			// generated mapchunk or if not, a node of overgenerated base terrain.
+			content_t c_above = vm->m_data[vi + em.X].getContent();
+			bool air_above = c_above == CONTENT_AIR;
+			bool river_water_above = c_above == c_river_water_source;
+			bool water_above = c_above == c_water_source || river_water_above;
+
+			biomemap[index] = BIOME_NONE;
+
+			// If there is air or water above enable top/filler placement, otherwise force
+			// nplaced to stone level by setting a number exceeding any possible filler depth.
+			u16 nplaced = (air_above || water_above) ? 0 : U16_MAX;
+
+			for (s16 y = node_max.Y; y >= node_min.Y; y--) {
+				content_t c = vm->m_data[vi].getContent();
+				// Biome is (re)calculated:
+				// 1. At the surface of stone below air or water.
+				// 2. At the surface of water below air.
+				// 3. When stone or water is detected but biome has not yet been calculated.
+				// 4. When stone or water is detected just below a biome's lower limit.
+				bool is_stone_surface = (c == c_stone) &&
+					(air_above || water_above || !biome || y < biome_y_min); // 1, 3, 4
+
+				bool is_water_surface =
+					(c == c_water_source || c == c_river_water_source) &&
+					(air_above || !biome || y < biome_y_min); // 2, 3, 4
+
+				if (is_stone_surface || is_water_surface) {
+					// (Re)calculate biome
+					biome = biomegen->getBiomeAtIndex(index, v3s16(x, y, z));
+
+					// Add biome to biomemap at first stone surface detected
+					if (biomemap[index] == BIOME_NONE && is_stone_surface)
+						biomemap[index] = biome->index;
+
+					// Store biome of first water surface detected, as a fallback
+					// entry for the biomemap.
+					if (water_biome_index == 0 && is_water_surface)
+						water_biome_index = biome->index;
+
+					depth_top = biome->depth_top;
+					base_filler = MYMAX(depth_top +
+						biome->depth_filler +
+						noise_filler_depth->result[index], 0.0f);
+					depth_water_top = biome->depth_water_top;
+					depth_riverbed = biome->depth_riverbed;
+					biome_y_min = biome->min_pos.Y;
+				}
 
-			if (c == c_stone) {
-				content_t c_below = vm->m_data[vi - em.X].getContent();
-
-				// If the node below isn't solid, make this node stone, so that
-				// any top/filler nodes above are structurally supported.
-				// This is done by aborting the cycle of top/filler placement
-				// immediately by forcing nplaced to stone level.
-				if (c_below == CONTENT_AIR
-						|| c_below == c_water_source
-						|| c_below == c_river_water_source)
-					nplaced = U16_MAX;
-
-				if (river_water_above) {
-					if (nplaced < depth_riverbed) {
-						vm->m_data[vi] = MapNode(biome->c_riverbed);
+				if (c == c_stone) {
+					content_t c_below = vm->m_data[vi - em.X].getContent();
+
+					// If the node below isn't solid, make this node stone, so that
+					// any top/filler nodes above are structurally supported.
+					// This is done by aborting the cycle of top/filler placement
+					// immediately by forcing nplaced to stone level.
+					if (c_below == CONTENT_AIR
+							|| c_below == c_water_source
+							|| c_below == c_river_water_source)
+						nplaced = U16_MAX;
+
+					if (river_water_above) {
+						if (nplaced < depth_riverbed) {
+							vm->m_data[vi] = MapNode(biome->c_riverbed);
+							nplaced++;
+						} else {
+							nplaced = U16_MAX;  // Disable top/filler placement
+							river_water_above = false;
+						}
+					} else if (nplaced < depth_top) {
+						vm->m_data[vi] = MapNode(biome->c_top);
+						nplaced++;
+					} else if (nplaced < base_filler) {
+						vm->m_data[vi] = MapNode(biome->c_filler);
 						nplaced++;
 					} else {
+						vm->m_data[vi] = MapNode(biome->c_stone);
 						nplaced = U16_MAX;  // Disable top/filler placement
-						river_water_above = false;
 					}
-				} else if (nplaced < depth_top) {
-					vm->m_data[vi] = MapNode(biome->c_top);
-					nplaced++;
-				} else if (nplaced < base_filler) {
-					vm->m_data[vi] = MapNode(biome->c_filler);
-					nplaced++;
-				} else {
-					vm->m_data[vi] = MapNode(biome->c_stone);
+
+					air_above = false;
+					water_above = false;
+				} else if (c == c_water_source) {
+					vm->m_data[vi] = MapNode((y > (s32)(water_level - depth_water_top))
+							? biome->c_water_top : biome->c_water);
+					nplaced = 0;  // Enable top/filler placement for next surface
+					air_above = false;
+					water_above = true;
+				} else if (c == c_river_water_source) {
+					vm->m_data[vi] = MapNode(biome->c_river_water);
+					nplaced = 0;  // Enable riverbed placement for next surface
+					air_above = false;
+					water_above = true;
+					river_water_above = true;
+				} else if (c == CONTENT_AIR) {
+					nplaced = 0;  // Enable top/filler placement for next surface
+					air_above = true;
+					water_above = false;
+				} else {  // Possible various nodes overgenerated from neighbouring mapchunks
 					nplaced = U16_MAX;  // Disable top/filler placement
+					air_above = false;
+					water_above = false;
 				}
 
-				air_above = false;
-				water_above = false;
-			} else if (c == c_water_source) {
-				vm->m_data[vi] = MapNode((y > (s32)(water_level - depth_water_top))
-						? biome->c_water_top : biome->c_water);
-				nplaced = 0;  // Enable top/filler placement for next surface
-				air_above = false;
-				water_above = true;
-			} else if (c == c_river_water_source) {
-				vm->m_data[vi] = MapNode(biome->c_river_water);
-				nplaced = 0;  // Enable riverbed placement for next surface
-				air_above = false;
-				water_above = true;
-				river_water_above = true;
-			} else if (c == CONTENT_AIR) {
-				nplaced = 0;  // Enable top/filler placement for next surface
-				air_above = true;
-				water_above = false;
-			} else {  // Possible various nodes overgenerated from neighbouring mapchunks
-				nplaced = U16_MAX;  // Disable top/filler placement
-				air_above = false;
-				water_above = false;
+				VoxelArea::add_y(em, vi, -1);
 			}
-
-			VoxelArea::add_y(em, vi, -1);
+			// If no stone surface detected in mapchunk column and a water surface
+			// biome fallback exists, add it to the biomemap. This avoids water
+			// surface decorations failing in deep water.
+			if (biomemap[index] == BIOME_NONE && water_biome_index != 0)
+				biomemap[index] = water_biome_index;
 		}
-		// If no stone surface detected in mapchunk column and a water surface
-		// biome fallback exists, add it to the biomemap. This avoids water
-		// surface decorations failing in deep water.
- 		if (biomemap[index] == BIOME_NONE && water_biome_index != 0)
-			biomemap[index] = water_biome_index;
-	}
+	});
 }
 
 
 void MapgenBasic::dustTopNodes()
 {
+	MapgenStageTimer timer(MGSTAGE_BIOMES);
 	if (node_max.Y < water_level)
 		return;
 
@@ -831,13 +885,14 @@ void MapgenBasic::dustTopNodes()
 
 void MapgenBasic::generateCavesNoiseIntersection(s16 max_stone_y)
 {
+	MapgenStageTimer timer(MGSTAGE_CAVES);
 	// cave_width >= 10 is used to disable generation and avoid the intensive
 	// 3D noise calculations. Tunnels already have zero width when cave_width > 1.
 	if (node_min.Y > max_stone_y || cave_width >= 10.0f)
 		return;
 
 	CavesNoiseIntersection caves_noise(ndef, m_bmgr, csize,
-		&np_cave1, &np_cave2, seed, cave_width);
+		&np_cave1, &np_cave2, seed, cave_width, m_emerge->pool);
 
 	caves_noise.generateCaves(vm, node_min, node_max, biomemap);
 }
@@ -845,6 +900,7 @@ void MapgenBasic::generateCavesNoiseIntersection(s16 max_stone_y)
 
 void MapgenBasic::generateCavesRandomWalk(s16 max_stone_y, s16 large_cave_ymax)
 {
+	MapgenStageTimer timer(MGSTAGE_CAVES);
 	if (node_min.Y > max_stone_y)
 		return;
 
@@ -876,11 +932,12 @@ void MapgenBasic::generateCavesRandomWalk(s16 max_stone_y, s16 large_cave_ymax)
 
 bool MapgenBasic::generateCavernsNoise(s16 max_stone_y)
 {
+	MapgenStageTimer timer(MGSTAGE_CAVES);
 	if (node_min.Y > max_stone_y || node_min.Y > cavern_limit)
 		return false;
 
 	CavernsNoise caverns_noise(ndef, csize, &np_cavern,
-		seed, cavern_limit, cavern_taper, cavern_threshold);
+		seed, cavern_limit, cavern_taper, cavern_threshold, m_emerge->pool);
 
 	return caverns_noise.generateCaverns(vm, node_min, node_max);
 }
@@ -888,6 +945,7 @@ bool MapgenBasic::generateCavernsNoise(s16 max_stone_y)
 
 void MapgenBasic::generateDungeons(s16 max_stone_y)
 {
+	MapgenStageTimer timer(MGSTAGE_DUNGEONS);
 	if (node_min.Y > max_stone_y || node_min.Y > dungeon_ymax ||
 			node_max.Y < dungeon_ymin)
 		return;
@@ -102,6 +102,50 @@ class GenerateNotifier {
 	std::list<GenNotifyEvent> m_notify_events;
 };
 
+enum MapgenStage {
+	MGSTAGE_NOISE,
+	MGSTAGE_TERRAIN, // Everything not covered by the other stages
+	MGSTAGE_CAVES,
+	MGSTAGE_DUNGEONS,
+	MGSTAGE_BIOMES,
+	MGSTAGE_ORES,
+	MGSTAGE_DECORATIONS,
+	MGSTAGE_LIGHTING,
+	MGSTAGE_LIQUIDS,
+	MGSTAGE_COUNT
+};
+
+extern const char *mapgen_stage_names[MGSTAGE_COUNT];
+
+struct MapgenStageTimes {
+	u64 us[MGSTAGE_COUNT] = {};
+};
+
+/*
+	Measures the time spent in the stages of map generation, for the mapgen
+	benchmark.
+
+	The outermost timer of a thread is given the times to add to. Timers
+	created while it is running add to the same times and pause their parent,
+	so that every microsecond is counted for exactly one stage. Without an
+	outermost timer, timers do nothing.
+*/
+class MapgenStageTimer {
+public:
+	MapgenStageTimer(MapgenStageTimes *times, MapgenStage stage);
+	MapgenStageTimer(MapgenStage stage);
+	~MapgenStageTimer();
+	DISABLE_CLASS_COPY(MapgenStageTimer);
+
+private:
+	MapgenStageTimes *m_times;
+	MapgenStage m_stage;
+	u64 m_start;
+	MapgenStageTimer *m_parent;
+
+	static thread_local MapgenStageTimer *s_current;
+};
+
 // Order must match the order of 'static MapgenDesc g_reg_mapgens[]' in mapgen.cpp
 enum MapgenType {
 	MAPGEN_V7,
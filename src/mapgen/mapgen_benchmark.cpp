@@ -0,0 +1,230 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mapgen_benchmark.h"
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include "content/subgames.h"
+#include "emerge.h"
+#include "filesys.h"
+#include "log.h"
+#include "map.h"
+#include "mg_biome.h"
+#include "mg_decoration.h"
+#include "mg_ore.h"
+#include "porting.h"
+#include "server.h"
+#include "settings.h"
+#include "threading/thread.h"
+#include "util/string.h"
+
+#define DEFAULT_CHUNKS 32
+#define DEFAULT_MAPGENS "v5,v6,v7,valleys,carpathian,flat,fractal"
+
+bool MapgenBenchmark::run(const Settings &cmd_args)
+{
+	std::string gameid = cmd_args.exists("gameid") ?
+		cmd_args.get("gameid") : g_settings->get("default_game");
+	SubgameSpec gamespec = findSubgame(gameid);
+	if (!gamespec.isValid()) {
+		errorstream << "Game \"" << gameid << "\" not found" << std::endl;
+		return false;
+	}
+
+	u32 num_chunks = DEFAULT_CHUNKS;
+	if (cmd_args.exists("benchmark-chunks"))
+		num_chunks = cmd_args.getU32("benchmark-chunks");
+
+	// 0 chooses the number of threads like the emerge manager
+	s16 num_threads = 0;
+	if (cmd_args.exists("benchmark-threads"))
+		num_threads = cmd_args.getS16("benchmark-threads");
+	else
+		g_settings->getS16NoEx("num_emerge_threads", num_threads);
+	if (num_threads == 0)
+		num_threads = Thread::getNumberOfProcessors() - 2;
+	num_threads = MYMAX(num_threads, 1);
+
+	std::vector<std::string> mgnames = str_split(
+		cmd_args.exists("benchmark-mapgens") ?
+		cmd_args.get("benchmark-mapgens") : DEFAULT_MAPGENS, ',');
+	for (std::string &mgname : mgnames) {
+		mgname = trim(mgname);
+		if (Mapgen::getMapgenType(mgname) == MAPGEN_INVALID) {
+			errorstream << "Unknown mapgen \"" << mgname << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	if (num_chunks == 0) {
+		errorstream << "--benchmark-chunks must be positive" << std::endl;
+		return false;
+	}
+
+	std::cout << "Mapgen benchmark: game \"" << gamespec.id << "\", "
+		<< num_chunks << " mapchunks per mapgen, " << num_threads
+		<< (num_threads == 1 ? " thread" : " threads") << std::endl;
+
+	MapgenBenchmark benchmark(gamespec, num_chunks, num_threads);
+	for (const std::string &mgname : mgnames) {
+		if (!benchmark.runMapgen(mgname, std::cout))
+			return false;
+	}
+
+	return true;
+}
+
+
+MapgenBenchmark::MapgenBenchmark(const SubgameSpec &gamespec, u32 num_chunks,
+		u32 num_threads) :
+	m_gamespec(gamespec),
+	m_num_chunks(num_chunks),
+	m_num_threads(num_threads)
+{
+}
+
+
+bool MapgenBenchmark::runMapgen(const std::string &mgname, std::ostream &os)
+{
+	std::string world_path = fs::TempPath() + DIR_DELIM "minetest_mapgen_benchmark";
+	fs::RecursiveDelete(world_path);
+
+	// The benchmark exits afterwards, so there is no need to restore these.
+	// Without a fixed seed the results would not be comparable.
+	g_settings->set("mg_name", mgname);
+	g_settings->setS16("num_emerge_threads", m_num_threads);
+	if (g_settings->get("fixed_map_seed").empty())
+		g_settings->set("fixed_map_seed", "mapgen benchmark");
+
+	std::vector<MapgenStageTimes> times(m_num_threads);
+	u64 time_total;
+	size_t num_biomes, num_ores, num_decos;
+
+	try {
+		// The server is never started, so it doesn't open a socket or run
+		// the emerge threads
+		Server server(world_path, m_gamespec, false, Address(), true);
+		server.init();
+
+		EmergeManager *emerge = server.getEmergeManager();
+		num_biomes = emerge->getBiomeManager()->getNumObjects();
+		num_ores = emerge->getOreManager()->getNumObjects();
+		num_decos = emerge->getDecorationManager()->getNumObjects();
+
+		// Every thread uses the mapgen of one emerge thread
+		std::atomic<u32> next_chunk(0);
+		std::vector<std::thread> threads;
+		u64 t = porting::getTimeUs();
+		for (u32 i = 0; i != m_num_threads; i++) {
+			threads.emplace_back(&MapgenBenchmark::generate, this,
+				emerge->m_mapgens[i], emerge->mgparams,
+				server.getNodeDefManager(), &next_chunk, &times[i]);
+		}
+		for (std::thread &thread : threads)
+			thread.join();
+		time_total = porting::getTimeUs() - t;
+	} catch (const ModError &e) {
+		errorstream << "ModError: " << e.what() << std::endl;
+		fs::RecursiveDelete(world_path);
+		return false;
+	} catch (const ServerError &e) {
+		errorstream << "ServerError: " << e.what() << std::endl;
+		fs::RecursiveDelete(world_path);
+		return false;
+	}
+	fs::RecursiveDelete(world_path);
+
+	MapgenStageTimes sum;
+	u64 time_stages = 0;
+	for (const MapgenStageTimes &thread_times : times) {
+		for (int i = 0; i != MGSTAGE_COUNT; i++) {
+			sum.us[i] += thread_times.us[i];
+			time_stages += thread_times.us[i];
+		}
+	}
+
+	os << std::fixed << std::setprecision(1) << mgname << ": "
+		<< m_num_chunks << " mapchunks in " << time_total / 1000 << " ms, "
+		<< m_num_chunks * 1000000.0 / MYMAX(time_total, 1) << " mapchunks/s ("
+		<< num_biomes << " biomes, " << num_ores << " ores, "
+		<< num_decos << " decorations)" << std::endl;
+
+	// Per mapchunk and thread
+	os << "   ";
+	for (int i = 0; i != MGSTAGE_COUNT; i++) {
+		os << " " << mapgen_stage_names[i] << " "
+			<< sum.us[i] / 1000.0 / m_num_chunks << " ms ("
+			<< sum.us[i] * 100.0 / MYMAX(time_stages, 1) << "%)";
+	}
+	os << std::endl;
+
+	return true;
+}
+
+
+v3s16 MapgenBenchmark::getChunkPos(u32 i, s16 chunksize) const
+{
+	// Columns of two mapchunks in a square around the origin: the one at the
+	// surface and the one below it, with caves, ores and dungeons
+	u32 num_columns = (m_num_chunks + 1) / 2;
+	s16 side = std::ceil(std::sqrt(num_columns));
+	u32 column = i / 2;
+	v3s16 chunk(column % side - side / 2, -(s16)(i % 2),
+		column / side - side / 2);
+
+	return EmergeManager::getContainingChunk(v3s16(0, 0, 0), chunksize) +
+		chunk * chunksize;
+}
+
+
+void MapgenBenchmark::generate(Mapgen *mg, const MapgenParams *params,
+		const NodeDefManager *ndef, std::atomic<u32> *next_chunk,
+		MapgenStageTimes *times)
+{
+	s16 csize = params->chunksize;
+
+	for (u32 i = (*next_chunk)++; i < m_num_chunks; i = (*next_chunk)++) {
+		BlockMakeData data;
+		data.seed = params->seed;
+		data.blockpos_min = getChunkPos(i, csize);
+		data.blockpos_max = data.blockpos_min + v3s16(1, 1, 1) * (csize - 1);
+		data.blockpos_requested = data.blockpos_min;
+		data.nodedef = ndef;
+
+		// Like ServerMap::initBlockMake() with no generated neighbours
+		v3s16 full_bpmin = data.blockpos_min - v3s16(1, 1, 1);
+		v3s16 full_bpmax = data.blockpos_max + v3s16(1, 1, 1);
+		data.vmanip = new MMVManip(nullptr);
+		data.vmanip->addArea(VoxelArea(full_bpmin * MAP_BLOCKSIZE,
+			(full_bpmax + 1) * MAP_BLOCKSIZE - v3s16(1, 1, 1)));
+		s32 volume = data.vmanip->m_area.getVolume();
+		for (s32 j = 0; j != volume; j++)
+			data.vmanip->m_data[j] = MapNode(CONTENT_IGNORE);
+		memset(data.vmanip->m_flags, 0, volume);
+
+		{
+			MapgenStageTimer timer(times, MGSTAGE_TERRAIN);
+			mg->makeChunk(&data);
+		}
+		mg->gennotify.clearEvents();
+	}
+}
@@ -0,0 +1,59 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include "irrlichttypes.h"
+#include "mapgen.h"
+
+class NodeDefManager;
+class Settings;
+struct SubgameSpec;
+
+/*
+	Generates mapchunks with the nodes, biomes, ores and decorations of a game,
+	without a map, networking or Lua callbacks, and reports the throughput and
+	the time spent in every stage of map generation.
+
+	Every mapgen gets a fresh server in a temporary world, so that mods can
+	register different things depending on the mapgen.
+*/
+class MapgenBenchmark {
+public:
+	// Runs the benchmark for --run-mapgen-benchmark
+	static bool run(const Settings &cmd_args);
+
+	MapgenBenchmark(const SubgameSpec &gamespec, u32 num_chunks, u32 num_threads);
+
+	// Returns false if the game could not be loaded
+	bool runMapgen(const std::string &mgname, std::ostream &os);
+
+private:
+	v3s16 getChunkPos(u32 i, s16 chunksize) const;
+	void generate(Mapgen *mg, const MapgenParams *params,
+		const NodeDefManager *ndef, std::atomic<u32> *next_chunk,
+		MapgenStageTimes *times);
+
+	const SubgameSpec &m_gamespec;
+	const u32 m_num_chunks;
+	const u32 m_num_threads;
+};
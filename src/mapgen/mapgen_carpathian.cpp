@@ -91,6 +91,7 @@ MapgenCarpathian::MapgenCarpathian(MapgenCarpathianParams *params, EmergeParams
 	//// 3D terrain noise
 	// 1 up 1 down overgeneration
 	noise_mnt_var = new Noise(&params->np_mnt_var, seed, csize.X, csize.Y + 2, csize.Z);
+	noise_mnt_var->pool = m_emerge->pool;
 
 	//// Cave noise
 	MapgenBasic::np_cave1  = params->np_cave1;
@@ -69,6 +69,7 @@ MapgenV5::MapgenV5(MapgenV5Params *params, EmergeParams *emerge)
 	// 3D terrain noise
 	// 1-up 1-down overgeneration
 	noise_ground = new Noise(&params->np_ground, seed, csize.X, csize.Y + 2, csize.Z);
+	noise_ground->pool = m_emerge->pool;
 	// 1 down overgeneration
 	MapgenBasic::np_cave1    = params->np_cave1;
 	MapgenBasic::np_cave2    = params->np_cave2;
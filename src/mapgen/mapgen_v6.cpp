@@ -581,6 +581,7 @@ void MapgenV6::makeChunk(BlockMakeData *data)
 	// Add dungeons
 	if ((flags & MG_DUNGEONS) && stone_surface_max_y >= node_min.Y &&
 			full_node_min.Y >= dungeon_ymin && full_node_max.Y <= dungeon_ymax) {
+		MapgenStageTimer timer(MGSTAGE_DUNGEONS);
 		u16 num_dungeons = std::fmax(std::floor(
 			NoisePerlin3D(&np_dungeons, node_min.X, node_min.Y, node_min.Z, seed)), 0.0f);
 
@@ -661,6 +662,7 @@ void MapgenV6::makeChunk(BlockMakeData *data)
 
 void MapgenV6::calculateNoise()
 {
+	MapgenStageTimer timer(MGSTAGE_NOISE);
 	int x = node_min.X;
 	int z = node_min.Z;
 	int fx = full_node_min.X;
@@ -944,6 +946,7 @@ void MapgenV6::moveMud(u32 remove_index, u32 place_index,
 
 void MapgenV6::placeTreesAndJungleGrass()
 {
+	MapgenStageTimer timer(MGSTAGE_DECORATIONS);
 	//TimeTaker t("placeTrees");
 	if (node_max.Y < water_level)
 		return;
@@ -1110,6 +1113,7 @@ void MapgenV6::growGrass() // Add surface nodes
 
 void MapgenV6::generateCaves(int max_stone_y)
 {
+	MapgenStageTimer timer(MGSTAGE_CAVES);
 	float cave_amount = NoisePerlin2D(np_cave, node_min.X, node_min.Y, seed);
 	int volume_nodes = (node_max.X - node_min.X + 1) *
 					   (node_max.Y - node_min.Y + 1) * MAP_BLOCKSIZE;
@@ -31,6 +31,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 //#include "profiler.h" // For TimeTaker
 #include "settings.h" // For g_settings
 #include "emerge.h"
+#include "util/workerpool.h"
 #include "dungeongen.h"
 #include "cavegen.h"
 #include "mg_biome.h"
@@ -98,6 +99,7 @@ MapgenV7::MapgenV7(MapgenV7Params *params, EmergeParams *emerge)
 		// 3D noise, 1 up, 1 down overgeneration
 		noise_mountain =
 			new Noise(&params->np_mountain,     seed, csize.X, csize.Y + 2, csize.Z);
+		noise_mountain->pool = m_emerge->pool;
 	}
 
 	if (spflags & MGV7_RIDGES) {
@@ -107,12 +109,14 @@ MapgenV7::MapgenV7(MapgenV7Params *params, EmergeParams *emerge)
 		// 3D noise, 1 up, 1 down overgeneration
 		noise_ridge =
 			new Noise(&params->np_ridge,        seed, csize.X, csize.Y + 2, csize.Z);
+		noise_ridge->pool = m_emerge->pool;
 	}
 
 	if (spflags & MGV7_FLOATLANDS) {
 		// 3D noise, 1 up, 1 down overgeneration
 		noise_floatland =
 			new Noise(&params->np_floatland,    seed, csize.X, csize.Y + 2, csize.Z);
+		noise_floatland->pool = m_emerge->pool;
 	}
 
 	// 3D noise, 1 down overgeneration
@@ -496,7 +500,6 @@ int MapgenV7::generateTerrain()
 	// 'Generate floatlands in this mapchunk' bool for
 	// simplification of condition checks in y-loop.
 	bool gen_floatlands = false;
-	u8 cache_index = 0;
 	// Y values where floatland tapering starts
 	s16 float_taper_ymax = floatland_ymax - floatland_taper;
 	s16 float_taper_ymin = floatland_ymin + floatland_taper;
@@ -508,6 +511,7 @@ int MapgenV7::generateTerrain()
 		noise_floatland->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
 
 		// Cache floatland noise offset values, for floatland tapering
+		u8 cache_index = 0;
 		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1; y++, cache_index++) {
 			float float_offset = 0.0f;
 			if (y > float_taper_ymax) {
@@ -523,49 +527,58 @@ int MapgenV7::generateTerrain()
 
 	//// Place nodes
 	const v3s16 &em = vm->m_area.getExtent();
-	s16 stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
-	u32 index2d = 0;
-
-	for (s16 z = node_min.Z; z <= node_max.Z; z++)
-	for (s16 x = node_min.X; x <= node_max.X; x++, index2d++) {
-		s16 surface_y = baseTerrainLevelFromMap(index2d);
-		if (surface_y > stone_surface_max_y)
-			stone_surface_max_y = surface_y;
-
-		cache_index = 0;
-		u32 vi = vm->m_area.index(x, node_min.Y - 1, z);
-		u32 index3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
-
-		for (s16 y = node_min.Y - 1; y <= node_max.Y + 1;
-				y++,
-				index3d += ystride,
-				VoxelArea::add_y(em, vi, 1),
-				cache_index++) {
-			if (vm->m_data[vi].getContent() != CONTENT_IGNORE)
-				continue;
-
-			if (y <= surface_y) {
-				vm->m_data[vi] = n_stone; // Base terrain
-			} else if ((spflags & MGV7_MOUNTAINS) &&
-					getMountainTerrainFromMap(index3d, index2d, y)) {
-				vm->m_data[vi] = n_stone; // Mountain terrain
-				if (y > stone_surface_max_y)
-					stone_surface_max_y = y;
-			} else if (gen_floatlands &&
-					getFloatlandTerrainFromMap(index3d,
-					float_offset_cache[cache_index])) {
-				vm->m_data[vi] = n_stone; // Floatland terrain
-				if (y > stone_surface_max_y)
-					stone_surface_max_y = y;
-			} else if (y <= water_level) { // Surface water
-				vm->m_data[vi] = n_water;
-			} else if (gen_floatlands && y >= float_taper_ymax && y <= floatland_ywater) {
-				vm->m_data[vi] = n_water; // Water for solid floatland layer only
-			} else {
-				vm->m_data[vi] = n_air; // Air
+	// The columns are independent of each other, rows of them are placed in
+	// parallel
+	std::vector<s16> row_max_y(csize.Z, -MAX_MAP_GENERATION_LIMIT);
+
+	m_emerge->pool->parallelFor(csize.Z, [&] (u32 row) {
+		s16 z = node_min.Z + row;
+		s16 &stone_surface_max_y = row_max_y[row];
+		u32 index2d = row * csize.X;
+		for (s16 x = node_min.X; x <= node_max.X; x++, index2d++) {
+			s16 surface_y = baseTerrainLevelFromMap(index2d);
+			if (surface_y > stone_surface_max_y)
+				stone_surface_max_y = surface_y;
+
+			u8 cache_index = 0;
+			u32 vi = vm->m_area.index(x, node_min.Y - 1, z);
+			u32 index3d = (z - node_min.Z) * zstride_1u1d + (x - node_min.X);
+
+			for (s16 y = node_min.Y - 1; y <= node_max.Y + 1;
+					y++,
+					index3d += ystride,
+					VoxelArea::add_y(em, vi, 1),
+					cache_index++) {
+				if (vm->m_data[vi].getContent() != CONTENT_IGNORE)
+					continue;
+
+				if (y <= surface_y) {
+					vm->m_data[vi] = n_stone; // Base terrain
+				} else if ((spflags & MGV7_MOUNTAINS) &&
+						getMountainTerrainFromMap(index3d, index2d, y)) {
+					vm->m_data[vi] = n_stone; // Mountain terrain
+					if (y > stone_surface_max_y)
+						stone_surface_max_y = y;
+				} else if (gen_floatlands &&
+						getFloatlandTerrainFromMap(index3d,
+						float_offset_cache[cache_index])) {
+					vm->m_data[vi] = n_stone; // Floatland terrain
+					if (y > stone_surface_max_y)
+						stone_surface_max_y = y;
+				} else if (y <= water_level) { // Surface water
+					vm->m_data[vi] = n_water;
+				} else if (gen_floatlands && y >= float_taper_ymax && y <= floatland_ywater) {
+					vm->m_data[vi] = n_water; // Water for solid floatland layer only
+				} else {
+					vm->m_data[vi] = n_air; // Air
+				}
 			}
 		}
-	}
+	});
+
+	s16 stone_surface_max_y = -MAX_MAP_GENERATION_LIMIT;
+	for (s16 max_y : row_max_y)
+		stone_surface_max_y = MYMAX(stone_surface_max_y, max_y);
 
 	return stone_surface_max_y;
 }
@@ -90,6 +90,7 @@ MapgenValleys::MapgenValleys(MapgenValleysParams *params, EmergeParams *emerge)
 	// 1-up 1-down overgeneration
 	noise_inter_valley_fill = new Noise(&params->np_inter_valley_fill,
 		seed, csize.X, csize.Y + 2, csize.Z);
+	noise_inter_valley_fill->pool = m_emerge->pool;
 	// 1-down overgeneraion
 	MapgenBasic::np_cave1    = params->np_cave1;
 	MapgenBasic::np_cave2    = params->np_cave2;
@@ -27,6 +27,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/numeric.h"
 #include "porting.h"
 #include "settings.h"
+#include <algorithm>
+#include <cmath>
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -186,6 +188,205 @@ void BiomeParamsOriginal::writeParams(Settings *settings) const
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+
+#define BIOME_GRID_MAX_SIZE 16
+
+static bool covers_world_xz(const Biome *b)
+{
+	return b->min_pos.X <= -MAX_MAP_GENERATION_LIMIT &&
+		b->max_pos.X >= MAX_MAP_GENERATION_LIMIT &&
+		b->min_pos.Z <= -MAX_MAP_GENERATION_LIMIT &&
+		b->max_pos.Z >= MAX_MAP_GENERATION_LIMIT;
+}
+
+
+BiomeIndex::BiomeIndex(const std::vector<Biome *> &biomes) :
+	m_biomes(biomes)
+{
+	// Every y where a biome enters or leaves its y limits or blend area
+	// starts a new band
+	m_band_min_y.push_back(S16_MIN);
+	for (const Biome *b : biomes) {
+		m_band_min_y.push_back(b->min_pos.Y);
+		m_band_min_y.push_back(b->max_pos.Y + 1);
+		m_band_min_y.push_back(b->max_pos.Y + b->vertical_blend + 1);
+	}
+	std::sort(m_band_min_y.begin(), m_band_min_y.end());
+	m_band_min_y.erase(std::unique(m_band_min_y.begin(), m_band_min_y.end()),
+		m_band_min_y.end());
+	while (m_band_min_y.size() > 1 && m_band_min_y[1] <= S16_MIN)
+		m_band_min_y.erase(m_band_min_y.begin());
+
+	m_bands.resize(m_band_min_y.size());
+	for (size_t i = 0; i != m_bands.size(); i++) {
+		s32 y_min = m_band_min_y[i];
+		s32 y_max = i + 1 < m_bands.size() ? m_band_min_y[i + 1] - 1 : S16_MAX;
+
+		for (Biome *b : biomes) {
+			if (y_min < b->min_pos.Y || y_max > b->max_pos.Y + b->vertical_blend)
+				continue;
+			if (y_max <= b->max_pos.Y)
+				m_bands[i].normal.biomes.push_back(b);
+			else
+				m_bands[i].blend.biomes.push_back(b);
+		}
+
+		m_bands[i].normal.build();
+		m_bands[i].blend.build();
+	}
+}
+
+
+void BiomeIndex::Candidates::build()
+{
+	// Only biomes that exist everywhere can rule out others
+	bool any_global = false;
+	float heat_min = FLT_MAX, heat_max = -FLT_MAX;
+	float humidity_min = FLT_MAX, humidity_max = -FLT_MAX;
+	for (const Biome *b : biomes) {
+		any_global |= covers_world_xz(b);
+		heat_min = MYMIN(heat_min, b->heat_point);
+		heat_max = MYMAX(heat_max, b->heat_point);
+		humidity_min = MYMIN(humidity_min, b->humidity_point);
+		humidity_max = MYMAX(humidity_max, b->humidity_point);
+	}
+	if (biomes.size() < 2 || !any_global)
+		return;
+
+	// Cover the heat and humidity points with some margin, noise values
+	// outside of the grid fall back to checking all biomes
+	float heat_margin = MYMAX((heat_max - heat_min) / 2, 25.0f);
+	float humidity_margin = MYMAX((humidity_max - humidity_min) / 2, 25.0f);
+	m_heat_min = heat_min - heat_margin;
+	m_humidity_min = humidity_min - humidity_margin;
+	m_grid_size = MYMIN((u16)std::ceil(2 * std::sqrt((float)biomes.size())),
+		BIOME_GRID_MAX_SIZE);
+	m_cell_heat = (heat_max + heat_margin - m_heat_min) / m_grid_size;
+	m_cell_humidity = (humidity_max + humidity_margin - m_humidity_min) /
+		m_grid_size;
+
+	std::vector<double> dist_min(biomes.size());
+	m_cell_start.reserve(m_grid_size * m_grid_size + 1);
+	for (u16 y = 0; y != m_grid_size; y++)
+	for (u16 x = 0; x != m_grid_size; x++) {
+		// Slightly larger than the cell, in case rounding puts a point
+		// into the neighbouring cell
+		double h0 = m_heat_min + (x - 0.01) * m_cell_heat;
+		double h1 = m_heat_min + (x + 1.01) * m_cell_heat;
+		double u0 = m_humidity_min + (y - 0.01) * m_cell_humidity;
+		double u1 = m_humidity_min + (y + 1.01) * m_cell_humidity;
+
+		// No point of the cell is farther than bound from the closest
+		// biome that exists everywhere
+		double bound = DBL_MAX;
+		for (size_t i = 0; i != biomes.size(); i++) {
+			const Biome *b = biomes[i];
+			double dh = MYMAX(b->heat_point - h0, h1 - b->heat_point);
+			double du = MYMAX(b->humidity_point - u0, u1 - b->humidity_point);
+			if (covers_world_xz(b))
+				bound = MYMIN(bound, dh * dh + du * du);
+
+			dh = MYMAX(MYMAX(h0 - b->heat_point, b->heat_point - h1), 0.0);
+			du = MYMAX(MYMAX(u0 - b->humidity_point, b->humidity_point - u1), 0.0);
+			dist_min[i] = dh * dh + du * du;
+		}
+		// Leave room for the rounding of the distances in float
+		bound = bound * 1.0001 + 0.001;
+
+		m_cell_start.push_back(m_cell_biomes.size());
+		for (size_t i = 0; i != biomes.size(); i++) {
+			if (dist_min[i] <= bound || !covers_world_xz(biomes[i]))
+				m_cell_biomes.push_back(i);
+		}
+	}
+	m_cell_start.push_back(m_cell_biomes.size());
+}
+
+
+void BiomeIndex::Candidates::findClosest(float heat, float humidity, v3s16 pos,
+	bool use_grid, Biome **closest, float *dist) const
+{
+	const u16 *begin = nullptr;
+	const u16 *end = nullptr;
+	if (use_grid && m_grid_size > 0) {
+		float x = (heat - m_heat_min) / m_cell_heat;
+		float y = (humidity - m_humidity_min) / m_cell_humidity;
+		if (x >= 0 && x < m_grid_size && y >= 0 && y < m_grid_size) {
+			u32 cell = (u32)y * m_grid_size + (u32)x;
+			begin = m_cell_biomes.data() + m_cell_start[cell];
+			end = m_cell_biomes.data() + m_cell_start[cell + 1];
+		}
+	}
+
+	auto check = [&] (Biome *b) {
+		if (pos.X < b->min_pos.X || pos.X > b->max_pos.X ||
+				pos.Z < b->min_pos.Z || pos.Z > b->max_pos.Z)
+			return;
+
+		float d_heat = heat - b->heat_point;
+		float d_humidity = humidity - b->humidity_point;
+		float d = (d_heat * d_heat) + (d_humidity * d_humidity);
+		if (d < *dist) {
+			*dist = d;
+			*closest = b;
+		}
+	};
+
+	if (begin) {
+		for (const u16 *i = begin; i != end; i++)
+			check(biomes[*i]);
+	} else {
+		for (Biome *b : biomes)
+			check(b);
+	}
+}
+
+
+void BiomeIndex::findClosest(float heat, float humidity, v3s16 pos,
+	Result &res) const
+{
+	size_t band = std::upper_bound(m_band_min_y.begin(), m_band_min_y.end(),
+		(s32)pos.Y) - m_band_min_y.begin() - 1;
+
+	// Biomes that don't cover the whole world can only be ruled out within it
+	bool use_grid =
+		pos.X >= -MAX_MAP_GENERATION_LIMIT && pos.X <= MAX_MAP_GENERATION_LIMIT &&
+		pos.Z >= -MAX_MAP_GENERATION_LIMIT && pos.Z <= MAX_MAP_GENERATION_LIMIT;
+
+	m_bands[band].normal.findClosest(heat, humidity, pos, use_grid,
+		&res.closest, &res.dist);
+	m_bands[band].blend.findClosest(heat, humidity, pos, use_grid,
+		&res.closest_blend, &res.dist_blend);
+}
+
+
+void BiomeIndex::findClosestLinear(float heat, float humidity, v3s16 pos,
+	Result &res) const
+{
+	for (Biome *b : m_biomes) {
+		if (pos.Y < b->min_pos.Y || pos.Y > b->max_pos.Y + b->vertical_blend ||
+				pos.X < b->min_pos.X || pos.X > b->max_pos.X ||
+				pos.Z < b->min_pos.Z || pos.Z > b->max_pos.Z)
+			continue;
+
+		float d_heat = heat - b->heat_point;
+		float d_humidity = humidity - b->humidity_point;
+		float dist = (d_heat * d_heat) + (d_humidity * d_humidity);
+
+		if (pos.Y <= b->max_pos.Y) { // Within y limits of biome b
+			if (dist < res.dist) {
+				res.dist = dist;
+				res.closest = b;
+			}
+		} else if (dist < res.dist_blend) { // Blend area above biome b
+			res.dist_blend = dist;
+			res.closest_blend = b;
+		}
+	}
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 
 BiomeGenOriginal::BiomeGenOriginal(BiomeManager *biomemgr,
@@ -195,6 +396,15 @@ BiomeGenOriginal::BiomeGenOriginal(BiomeManager *biomemgr,
 	m_params = params;
 	m_csize  = chunksize;
 
+	// Biomes can't change anymore once mapgens exist
+	std::vector<Biome *> biomes;
+	for (size_t i = 1; i < biomemgr->getNumObjects(); i++) {
+		Biome *b = (Biome *)biomemgr->getRaw(i);
+		if (b)
+			biomes.push_back(b);
+	}
+	m_index = new BiomeIndex(biomes);
+
 	noise_heat           = new Noise(&params->np_heat,
 									params->seed, m_csize.X, m_csize.Z);
 	noise_humidity       = new Noise(&params->np_humidity,
@@ -217,6 +427,7 @@ BiomeGenOriginal::BiomeGenOriginal(BiomeManager *biomemgr,
 BiomeGenOriginal::~BiomeGenOriginal()
 {
 	delete []biomemap;
+	delete m_index;
 
 	delete noise_heat;
 	delete noise_humidity;
@@ -240,6 +451,7 @@ Biome *BiomeGenOriginal::calcBiomeAtPoint(v3s16 pos) const
 
 void BiomeGenOriginal::calcBiomeNoise(v3s16 pmin)
 {
+	MapgenStageTimer timer(MGSTAGE_NOISE);
 	m_pmin = pmin;
 
 	noise_heat->perlinMap2D(pmin.X, pmin.Z);
@@ -290,33 +502,12 @@ Biome *BiomeGenOriginal::getBiomeAtIndex(size_t index, v3s16 pos) const
 
 Biome *BiomeGenOriginal::calcBiomeFromNoise(float heat, float humidity, v3s16 pos) const
 {
-	Biome *biome_closest = nullptr;
-	Biome *biome_closest_blend = nullptr;
-	float dist_min = FLT_MAX;
-	float dist_min_blend = FLT_MAX;
-
-	for (size_t i = 1; i < m_bmgr->getNumObjects(); i++) {
-		Biome *b = (Biome *)m_bmgr->getRaw(i);
-		if (!b ||
-				pos.Y < b->min_pos.Y || pos.Y > b->max_pos.Y + b->vertical_blend ||
-				pos.X < b->min_pos.X || pos.X > b->max_pos.X ||
-				pos.Z < b->min_pos.Z || pos.Z > b->max_pos.Z)
-			continue;
-
-		float d_heat = heat - b->heat_point;
-		float d_humidity = humidity - b->humidity_point;
-		float dist = (d_heat * d_heat) + (d_humidity * d_humidity);
-
-		if (pos.Y <= b->max_pos.Y) { // Within y limits of biome b
-			if (dist < dist_min) {
-				dist_min = dist;
-				biome_closest = b;
-			}
-		} else if (dist < dist_min_blend) { // Blend area above biome b
-			dist_min_blend = dist;
-			biome_closest_blend = b;
-		}
-	}
+	BiomeIndex::Result res;
+	m_index->findClosest(heat, humidity, pos, res);
+	Biome *biome_closest = res.closest;
+	Biome *biome_closest_blend = res.closest_blend;
+	float dist_min = res.dist;
+	float dist_min_blend = res.dist_blend;
 
 	// Carefully tune pseudorandom seed variation to avoid single node dither
 	// and create larger scale blending patterns similar to horizontal biome
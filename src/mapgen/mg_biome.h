@@ -20,6 +20,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 
+#include <cfloat>
+#include <vector>
 #include "objdef.h"
 #include "nodedef.h"
 #include "noise.h"
@@ -137,6 +139,67 @@ class BiomeGen {
 // Original biome algorithm (Whittaker's classification + surface height)
 //
 
+/*
+	Finds the biomes closest to a point in heat/humidity space for
+	BiomeGenOriginal.
+
+	The y axis is split into bands in which the same biomes are either within
+	their y limits or in their vertical blend area. Within a band, a grid over
+	heat and humidity lists for each cell the biomes that can be the closest
+	one to some point of the cell. Only those are checked, in registration
+	order, so the results are the same as when checking all biomes.
+*/
+class BiomeIndex {
+public:
+	struct Result {
+		// Closest biome within its y limits
+		Biome *closest = nullptr;
+		float dist = FLT_MAX;
+		// Closest biome with pos in its vertical blend area
+		Biome *closest_blend = nullptr;
+		float dist_blend = FLT_MAX;
+	};
+
+	// biomes must be in registration order and not contain BIOME_NONE
+	BiomeIndex(const std::vector<Biome *> &biomes);
+
+	void findClosest(float heat, float humidity, v3s16 pos, Result &res) const;
+	// Same as above, checking every biome
+	void findClosestLinear(float heat, float humidity, v3s16 pos,
+		Result &res) const;
+
+private:
+	// Biomes of one kind in one band
+	class Candidates {
+	public:
+		void build();
+		void findClosest(float heat, float humidity, v3s16 pos, bool use_grid,
+			Biome **closest, float *dist) const;
+
+		std::vector<Biome *> biomes;
+
+	private:
+		u16 m_grid_size = 0;
+		float m_heat_min;
+		float m_humidity_min;
+		float m_cell_heat;
+		float m_cell_humidity;
+		// Indices into biomes, by cell
+		std::vector<u32> m_cell_start;
+		std::vector<u16> m_cell_biomes;
+	};
+
+	struct Band {
+		Candidates normal;
+		Candidates blend;
+	};
+
+	std::vector<Biome *> m_biomes;
+	// Lowest y of each band, ascending
+	std::vector<s32> m_band_min_y;
+	std::vector<Band> m_bands;
+};
+
 struct BiomeParamsOriginal : public BiomeParams {
 	BiomeParamsOriginal() :
 		np_heat(50, 50, v3f(1000.0, 1000.0, 1000.0), 5349, 3, 0.5, 2.0),
@@ -177,6 +240,7 @@ class BiomeGenOriginal : public BiomeGen {
 
 private:
 	BiomeParamsOriginal *m_params;
+	BiomeIndex *m_index;
 
 	Noise *noise_heat;
 	Noise *noise_humidity;
@@ -53,14 +53,16 @@ DecorationManager::DecorationManager(IGameDef *gamedef) :
 size_t DecorationManager::placeAllDecos(Mapgen *mg, u32 blockseed,
 	v3s16 nmin, v3s16 nmax)
 {
+	MapgenStageTimer timer(MGSTAGE_DECORATIONS);
 	size_t nplaced = 0;
+	DecoPlacementCache cache(mg, nmin, nmax);
 
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Decoration *deco = (Decoration *)m_objects[i];
 		if (!deco)
 			continue;
 
-		nplaced += deco->placeDeco(mg, blockseed, nmin, nmax);
+		nplaced += deco->placeDeco(mg, blockseed, nmin, nmax, cache);
 		blockseed++;
 	}
 
@@ -136,7 +138,14 @@ bool Decoration::canPlaceDecoration(MMVManip *vm, v3s16 p)
 
 size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 {
-	PcgRandom ps(blockseed + 53);
+	DecoPlacementCache cache(mg, nmin, nmax);
+	return placeDeco(mg, blockseed, nmin, nmax, cache);
+}
+
+
+size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+	DecoPlacementCache &cache)
+{
 	int carea_size = nmax.X - nmin.X + 1;
 
 	// Divide area into parts
@@ -144,15 +153,30 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 	if (carea_size % sidelen)
 		sidelen = carea_size;
 
+	// Skip decorations that cannot be placed anywhere in the area. Each
+	// decoration has its own random number generator, so this doesn't
+	// change the placement of the others.
+	if (y_max < nmin.Y || y_min > nmax.Y)
+		return 0;
+
+	bool check_biome = mg->biomemap && !biomes.empty();
+	if (check_biome && !cache.hasAnyBiome(biomes))
+		return 0;
+
+	bool all_surfaces = flags & (DECO_ALL_FLOORS | DECO_ALL_CEILINGS);
+	if (!all_surfaces && !(flags & DECO_LIQUID_SURFACE) && mg->heightmap &&
+			!cache.isInHeightRange(y_min, y_max))
+		return 0;
+
+	PcgRandom ps(blockseed + 53);
 	s16 divlen = carea_size / sidelen;
 	int area = sidelen * sidelen;
+	const std::vector<float> *noise = (flags & DECO_USE_NOISE) ?
+		&cache.getDivisionNoise(np, mapseed, sidelen) : nullptr;
+	s16 change_radius = getSurfaceChangeRadius(mg->ndef);
 
 	for (s16 z0 = 0; z0 < divlen; z0++)
 	for (s16 x0 = 0; x0 < divlen; x0++) {
-		v2s16 p2d_center( // Center position of part of division
-			nmin.X + sidelen / 2 + sidelen * x0,
-			nmin.Z + sidelen / 2 + sidelen * z0
-		);
 		v2s16 p2d_min( // Minimum edge of part of division
 			nmin.X + sidelen * x0,
 			nmin.Z + sidelen * z0
@@ -164,9 +188,7 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 
 		bool cover = false;
 		// Amount of decorations
-		float nval = (flags & DECO_USE_NOISE) ?
-			NoisePerlin2D(&np, p2d_center.X, p2d_center.Y, mapseed) :
-			fill_ratio;
+		float nval = noise ? (*noise)[z0 * divlen + x0] : fill_ratio;
 		u32 deco_count = 0;
 
 		if (nval >= 10.0f) {
@@ -201,71 +223,76 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 			}
 			int mapindex = carea_size * (z - nmin.Z) + (x - nmin.X);
 
-			if ((flags & DECO_ALL_FLOORS) ||
-					(flags & DECO_ALL_CEILINGS)) {
+			if (all_surfaces) {
 				// All-surfaces decorations
 				// Check biome of column
-				if (mg->biomemap && !biomes.empty()) {
+				if (check_biome) {
 					auto iter = biomes.find(mg->biomemap[mapindex]);
 					if (iter == biomes.end())
 						continue;
 				}
 
-				// Get all floors and ceilings in node column
-				u16 size = (nmax.Y - nmin.Y + 1) / 2;
-				std::vector<s16> floors;
-				std::vector<s16> ceilings;
-				floors.reserve(size);
-				ceilings.reserve(size);
-
-				mg->getSurfaces(v2s16(x, z), nmin.Y, nmax.Y, floors, ceilings);
+				// Get all floors and ceilings in node column.
+				// Placing decorations only marks the column as changed,
+				// so the lists stay the same during the loops below.
+				const std::vector<s16> *floors, *ceilings;
+				cache.getSurfaces(v2s16(x, z), &floors, &ceilings);
 
 				if (flags & DECO_ALL_FLOORS) {
 					// Floor decorations
-					for (const s16 y : floors) {
+					for (const s16 y : *floors) {
 						if (y < y_min || y > y_max)
 							continue;
 
 						v3s16 pos(x, y, z);
-						if (generate(mg->vm, &ps, pos, false))
+						if (generate(mg->vm, &ps, pos, false)) {
+							if (change_radius >= 0)
+								cache.invalidate(v2s16(x, z), change_radius);
 							mg->gennotify.addEvent(
 									GENNOTIFY_DECORATION, pos, index);
+						}
 					}
 				}
 
 				if (flags & DECO_ALL_CEILINGS) {
 					// Ceiling decorations
-					for (const s16 y : ceilings) {
+					for (const s16 y : *ceilings) {
 						if (y < y_min || y > y_max)
 							continue;
 
 						v3s16 pos(x, y, z);
-						if (generate(mg->vm, &ps, pos, true))
+						if (generate(mg->vm, &ps, pos, true)) {
+							if (change_radius >= 0)
+								cache.invalidate(v2s16(x, z), change_radius);
 							mg->gennotify.addEvent(
 									GENNOTIFY_DECORATION, pos, index);
+						}
 					}
 				}
 			} else { // Heightmap decorations
 				s16 y = -MAX_MAP_GENERATION_LIMIT;
 				if (flags & DECO_LIQUID_SURFACE)
-					y = mg->findLiquidSurface(v2s16(x, z), nmin.Y, nmax.Y);
+					y = cache.getLiquidSurface(v2s16(x, z));
 				else if (mg->heightmap)
 					y = mg->heightmap[mapindex];
 				else
-					y = mg->findGroundLevel(v2s16(x, z), nmin.Y, nmax.Y);
+					y = cache.getGroundLevel(v2s16(x, z));
 
 				if (y < y_min || y > y_max || y < nmin.Y || y > nmax.Y)
 					continue;
 
-				if (mg->biomemap && !biomes.empty()) {
+				if (check_biome) {
 					auto iter = biomes.find(mg->biomemap[mapindex]);
 					if (iter == biomes.end())
 						continue;
 				}
 
 				v3s16 pos(x, y, z);
-				if (generate(mg->vm, &ps, pos, false))
+				if (generate(mg->vm, &ps, pos, false)) {
+					if (change_radius >= 0)
+						cache.invalidate(v2s16(x, z), change_radius);
 					mg->gennotify.addEvent(GENNOTIFY_DECORATION, pos, index);
+				}
 			}
 		}
 	}
@@ -274,6 +301,162 @@ size_t Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+
+
+DecoPlacementCache::DecoPlacementCache(Mapgen *mg, v3s16 nmin, v3s16 nmax) :
+	m_mg(mg),
+	m_nmin(nmin),
+	m_nmax(nmax),
+	m_size(nmax.X - nmin.X + 1),
+	m_height_min(MAX_MAP_GENERATION_LIMIT),
+	m_height_max(-MAX_MAP_GENERATION_LIMIT)
+{
+	// Decorations index the maps as square
+	u32 area = m_size * m_size;
+
+	if (mg->biomemap) {
+		for (u32 i = 0; i != area; i++) {
+			biome_t biome = mg->biomemap[i];
+			if (biome >= m_biomes_present.size())
+				m_biomes_present.resize(biome + 1, false);
+			m_biomes_present[biome] = true;
+		}
+	}
+
+	if (mg->heightmap) {
+		for (u32 i = 0; i != area; i++) {
+			m_height_min = MYMIN(m_height_min, mg->heightmap[i]);
+			m_height_max = MYMAX(m_height_max, mg->heightmap[i]);
+		}
+	}
+}
+
+
+bool DecoPlacementCache::hasAnyBiome(const std::unordered_set<biome_t> &biomes) const
+{
+	for (biome_t biome : biomes) {
+		if (biome < m_biomes_present.size() && m_biomes_present[biome])
+			return true;
+	}
+	return false;
+}
+
+
+bool DecoPlacementCache::isInHeightRange(s16 y_min, s16 y_max) const
+{
+	return y_min <= m_height_max && y_max >= m_height_min;
+}
+
+
+const std::vector<float> &DecoPlacementCache::getDivisionNoise(
+	const NoiseParams &np, s32 seed, s16 sidelen)
+{
+	for (const DivisionNoise &noise : m_noise) {
+		if (noise.seed == seed && noise.sidelen == sidelen &&
+				noise.np.offset == np.offset &&
+				noise.np.scale == np.scale &&
+				noise.np.spread == np.spread &&
+				noise.np.seed == np.seed &&
+				noise.np.octaves == np.octaves &&
+				noise.np.persist == np.persist &&
+				noise.np.lacunarity == np.lacunarity &&
+				noise.np.flags == np.flags)
+			return noise.values;
+	}
+
+	// Sampled per point like before, Noise::perlinMap2D() interpolates
+	// differently and would move decorations
+	m_noise.emplace_back();
+	DivisionNoise &noise = m_noise.back();
+	noise.np = np;
+	noise.seed = seed;
+	noise.sidelen = sidelen;
+
+	s16 divlen = m_size / sidelen;
+	noise.values.reserve(divlen * divlen);
+	for (s16 z0 = 0; z0 < divlen; z0++)
+	for (s16 x0 = 0; x0 < divlen; x0++) {
+		v2s16 p2d_center( // Center position of part of division
+			m_nmin.X + sidelen / 2 + sidelen * x0,
+			m_nmin.Z + sidelen / 2 + sidelen * z0
+		);
+		noise.values.push_back(NoisePerlin2D(&noise.np,
+			p2d_center.X, p2d_center.Y, seed));
+	}
+	return noise.values;
+}
+
+
+#define COLUMN_GROUND_LEVEL   0x01
+#define COLUMN_LIQUID_SURFACE 0x02
+#define COLUMN_SURFACES       0x04
+
+DecoPlacementCache::Column &DecoPlacementCache::getColumn(v2s16 p2d)
+{
+	if (m_columns.empty())
+		m_columns.resize(m_size * m_size);
+
+	return m_columns[m_size * (p2d.Y - m_nmin.Z) + (p2d.X - m_nmin.X)];
+}
+
+
+s16 DecoPlacementCache::getGroundLevel(v2s16 p2d)
+{
+	Column &col = getColumn(p2d);
+	if (!(col.valid & COLUMN_GROUND_LEVEL)) {
+		col.ground_level = m_mg->findGroundLevel(p2d, m_nmin.Y, m_nmax.Y);
+		col.valid |= COLUMN_GROUND_LEVEL;
+	}
+	return col.ground_level;
+}
+
+
+s16 DecoPlacementCache::getLiquidSurface(v2s16 p2d)
+{
+	Column &col = getColumn(p2d);
+	if (!(col.valid & COLUMN_LIQUID_SURFACE)) {
+		col.liquid_surface = m_mg->findLiquidSurface(p2d, m_nmin.Y, m_nmax.Y);
+		col.valid |= COLUMN_LIQUID_SURFACE;
+	}
+	return col.liquid_surface;
+}
+
+
+void DecoPlacementCache::getSurfaces(v2s16 p2d,
+	const std::vector<s16> **floors, const std::vector<s16> **ceilings)
+{
+	Column &col = getColumn(p2d);
+	if (!(col.valid & COLUMN_SURFACES)) {
+		col.floors.clear();
+		col.ceilings.clear();
+		m_mg->getSurfaces(p2d, m_nmin.Y, m_nmax.Y, col.floors, col.ceilings);
+		col.valid |= COLUMN_SURFACES;
+	}
+	*floors = &col.floors;
+	*ceilings = &col.ceilings;
+}
+
+
+void DecoPlacementCache::invalidate(v2s16 p2d, s16 radius)
+{
+	if (m_columns.empty())
+		return;
+
+	s16 x_min = MYMAX(p2d.X - radius, m_nmin.X);
+	s16 x_max = MYMIN(p2d.X + radius, m_nmin.X + m_size - 1);
+	s16 z_min = MYMAX(p2d.Y - radius, m_nmin.Z);
+	s16 z_max = MYMIN(p2d.Y + radius, m_nmin.Z + m_size - 1);
+
+	for (s16 z = z_min; z <= z_max; z++)
+	for (s16 x = x_min; x <= x_max; x++)
+		getColumn(v2s16(x, z)).valid = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+
 void Decoration::cloneTo(Decoration *def) const
 {
 	ObjDef::cloneTo(def);
@@ -386,6 +569,22 @@ size_t DecoSimple::generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling)
 }
 
 
+s16 DecoSimple::getSurfaceChangeRadius(const NodeDefManager *ndef) const
+{
+	// Without force_placement only air and ignore are replaced, so nodes
+	// that are neither walkable nor liquid leave the surfaces as they are
+	if (flags & DECO_FORCE_PLACEMENT)
+		return 0;
+
+	for (content_t c : c_decos) {
+		const ContentFeatures &f = ndef->get(c);
+		if (f.walkable || f.isLiquid())
+			return 0;
+	}
+	return -1;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -465,3 +664,13 @@ size_t DecoSchematic::generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceilin
 
 	return 1;
 }
+
+
+s16 DecoSchematic::getSurfaceChangeRadius(const NodeDefManager *ndef) const
+{
+	// Covers any rotation and centering
+	if (schematic == NULL)
+		return -1;
+
+	return MYMAX(schematic->size.X, schematic->size.Z) - 1;
+}
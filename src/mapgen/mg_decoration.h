@@ -31,6 +31,7 @@ class Mapgen;
 class MMVManip;
 class PcgRandom;
 class Schematic;
+class DecoPlacementCache;
 
 enum DecorationType {
 	DECO_SIMPLE,
@@ -59,8 +60,16 @@ class Decoration : public ObjDef, public NodeResolver {
 
 	bool canPlaceDecoration(MMVManip *vm, v3s16 p);
 	size_t placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
+	size_t placeDeco(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+		DecoPlacementCache &cache);
 
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling) = 0;
+	// Horizontal distance from p up to which generate() may change the
+	// surfaces of node columns, or -1 if it never changes them
+	virtual s16 getSurfaceChangeRadius(const NodeDefManager *ndef) const
+	{
+		return 0;
+	}
 
 	u32 flags = 0;
 	int mapseed = 0;
@@ -87,6 +96,7 @@ class DecoSimple : public Decoration {
 
 	virtual void resolveNodeNames();
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling);
+	virtual s16 getSurfaceChangeRadius(const NodeDefManager *ndef) const;
 
 	std::vector<content_t> c_decos;
 	s16 deco_height;
@@ -104,6 +114,7 @@ class DecoSchematic : public Decoration {
 	virtual ~DecoSchematic();
 
 	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3s16 p, bool ceiling);
+	virtual s16 getSurfaceChangeRadius(const NodeDefManager *ndef) const;
 
 	Rotation rotation;
 	Schematic *schematic = nullptr;
@@ -111,6 +122,69 @@ class DecoSchematic : public Decoration {
 };
 
 
+/*
+	Data shared by all decorations placed in one area.
+
+	The noise of a decoration is evaluated once per part of the area for
+	each distinct set of noise parameters. Surfaces of node columns are
+	looked up once and cached until a decoration is placed close to the
+	column, so that every decoration still sees the nodes placed by the
+	ones before it.
+*/
+class DecoPlacementCache {
+public:
+	DecoPlacementCache(Mapgen *mg, v3s16 nmin, v3s16 nmax);
+
+	// Whether any column of the biome map has one of these biomes
+	bool hasAnyBiome(const std::unordered_set<biome_t> &biomes) const;
+	// Whether any value of the heightmap is within [y_min, y_max]
+	bool isInHeightRange(s16 y_min, s16 y_max) const;
+
+	// Noise values at the centers of the sidelen * sidelen parts of the
+	// area, X first
+	const std::vector<float> &getDivisionNoise(const NoiseParams &np,
+		s32 seed, s16 sidelen);
+
+	s16 getGroundLevel(v2s16 p2d);
+	s16 getLiquidSurface(v2s16 p2d);
+	// The lists stay valid until the next call for the same column
+	void getSurfaces(v2s16 p2d, const std::vector<s16> **floors,
+		const std::vector<s16> **ceilings);
+
+	// Marks the columns within radius of p2d as changed
+	void invalidate(v2s16 p2d, s16 radius);
+
+private:
+	struct Column {
+		s16 ground_level;
+		s16 liquid_surface;
+		u8 valid = 0;
+		std::vector<s16> floors;
+		std::vector<s16> ceilings;
+	};
+
+	struct DivisionNoise {
+		NoiseParams np;
+		s32 seed;
+		s16 sidelen;
+		std::vector<float> values;
+	};
+
+	Column &getColumn(v2s16 p2d);
+
+	Mapgen *m_mg;
+	v3s16 m_nmin;
+	v3s16 m_nmax;
+	s16 m_size;
+
+	std::vector<Column> m_columns;
+	std::vector<DivisionNoise> m_noise;
+	std::vector<bool> m_biomes_present;
+	s16 m_height_min;
+	s16 m_height_max;
+};
+
+
 /*
 class DecoLSystem : public Decoration {
 public:
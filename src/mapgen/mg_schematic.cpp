@@ -262,10 +262,34 @@ void Schematic::placeOnMap(ServerMap *map, v3s16 p, u32 flags,
 
 	MMVManip vm(map);
 	vm.initialEmerge(bp1, bp2);
+	std::vector<MapNode> old_data(vm.m_data, vm.m_data + vm.m_area.getVolume());
 
 	blitToVManip(&vm, p, rot, force_place);
 
-	voxalgo::blit_back_with_light(map, &vm, &modified_blocks);
+	//// Only relight the nodes the schematic changed
+	std::vector<std::pair<v3s16, MapNode> > changed_nodes;
+	VoxelArea area(p, p + s - v3s16(1, 1, 1));
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+	for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+		v3s16 pos(x, y, z);
+		if (!vm.m_area.contains(pos))
+			continue;
+		u32 vi = vm.m_area.index(pos);
+		MapNode &n = vm.m_data[vi];
+		const MapNode &n_old = old_data[vi];
+		if (n.getContent() == n_old.getContent() && n.param2 == n_old.param2) {
+			// Placed nodes have no light, keep the light of unchanged ones
+			n.param1 = n_old.param1;
+			continue;
+		}
+		changed_nodes.emplace_back(pos, n_old);
+	}
+
+	vm.blitBackAll(&modified_blocks, true);
+	voxalgo::update_lighting_nodes(map, changed_nodes, modified_blocks);
+	for (it = modified_blocks.begin(); it != modified_blocks.end(); ++it)
+		it->second->expireDayNightDiff();
 
 	//// Carry out post-map-modification actions
 
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapsector.h"
 #include "exceptions.h"
+#include "map.h"
 #include "mapblock.h"
 #include "serialization.h"
 
@@ -61,8 +62,10 @@ MapBlock * MapSector::getBlockBuffered(s16 y)
 	block = (n != m_blocks.end() ? n->second : nullptr);
 
 	// Cache the last result
-	m_block_cache_y = y;
-	m_block_cache = block;
+	if (!m_parent || !m_parent->isConcurrentReading()) {
+		m_block_cache_y = y;
+		m_block_cache = block;
+	}
 
 	return block;
 }
@@ -205,9 +205,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 		Updated set_sky packet
 		Adds new sun, moon and stars packets
 		Minimap modes
+	PROTOCOL VERSION 40:
+		Item ids sent with TOCLIENT_ITEMDEF
+		Binary inventory format in TOCLIENT_INVENTORY and
+		TOCLIENT_DETACHED_INVENTORY
 */
 
-#define LATEST_PROTOCOL_VERSION 39
+#define LATEST_PROTOCOL_VERSION 40
 #define LATEST_PROTOCOL_VERSION_STRING TOSTRING(LATEST_PROTOCOL_VERSION)
 
 // Server's supported network protocol range
@@ -304,7 +308,7 @@ enum ToClientCommand
 	TOCLIENT_INVENTORY = 0x27,
 	/*
 		[0] u16 command
-		[2] serialized inventory
+		[2] serialized inventory, binary for protocol version >= 40
 	*/
 
 	TOCLIENT_OBJECTDATA = 0x28, // Obsolete
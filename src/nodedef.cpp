@@ -1005,6 +1005,7 @@ void NodeDefManager::clear()
 	m_name_id_mapping_with_aliases.clear();
 	m_group_to_items.clear();
 	m_next_id = 0;
+	m_revision++;
 	m_selection_box_union.reset(0,0,0);
 	m_selection_box_int_union.reset(0,0,0);
 
@@ -1322,6 +1323,7 @@ content_t NodeDefManager::set(const std::string &name, const ContentFeatures &de
 		const std::string &group_name = group.first;
 		m_group_to_items[group_name].push_back(id);
 	}
+	m_revision++;
 
 	return id;
 }
@@ -1349,11 +1351,13 @@ void NodeDefManager::removeNode(const std::string &name)
 	}
 
 	eraseIdFromGroups(id);
+	m_revision++;
 }
 
 
 void NodeDefManager::updateAliases(IItemDefManager *idef)
 {
+	m_revision++;
 	std::set<std::string> all;
 	idef->getAll(all);
 	m_name_id_mapping_with_aliases.clear();
@@ -1436,6 +1440,18 @@ void NodeDefManager::updateTextures(IGameDef *gamedef,
 	TextureSettings tsettings;
 	tsettings.readSettings();
 
+	// Generate the textures of all tiles at once
+	std::vector<std::string> texture_names;
+	for (const ContentFeatures &f : m_content_features) {
+		for (const TileDef &tiledef : f.tiledef)
+			texture_names.push_back(tiledef.name);
+		for (const TileDef &tiledef : f.tiledef_overlay)
+			texture_names.push_back(tiledef.name);
+		for (const TileDef &tiledef : f.tiledef_special)
+			texture_names.push_back(tiledef.name);
+	}
+	tsrc->prefetchTexturesForMesh(texture_names);
+
 	u32 size = m_content_features.size();
 
 	for (u32 i = 0; i < size; i++) {
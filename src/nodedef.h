@@ -553,6 +553,12 @@ class NodeDefManager {
 	 */
 	bool getIds(const std::string &name, std::vector<content_t> &result) const;
 
+	/*!
+	 * Returns a number that changes whenever node names, aliases or groups
+	 * change, so that the results of @ref getIds() can be cached.
+	 */
+	inline u32 getRevision() const { return m_revision; }
+
 	/*!
 	 * Returns the smallest box in integer node coordinates that
 	 * contains all nodes' selection boxes. The returned box might be larger
@@ -748,6 +754,9 @@ class NodeDefManager {
 	//! True if all nodes have been registered.
 	bool m_node_registration_complete;
 
+	//! Incremented on every change that affects \ref getIds().
+	u32 m_revision = 0;
+
 	/*!
 	 * The union of all nodes' selection boxes.
 	 * Might be larger if big nodes are removed from the manager.
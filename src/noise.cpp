@@ -27,10 +27,12 @@
 #include "noise.h"
 #include <iostream>
 #include <cstring> // memset
+#include <vector>
 #include "debug.h"
 #include "util/numeric.h"
 #include "util/string.h"
 #include "exceptions.h"
+#include "util/workerpool.h"
 
 #define NOISE_MAGIC_X    1619
 #define NOISE_MAGIC_Y    31337
@@ -620,43 +622,52 @@ void Noise::gradientMap3D(
 		float step_x, float step_y, float step_z,
 		s32 seed)
 {
-	float v000, v010, v100, v110;
-	float v001, v011, v101, v111;
-	float u, v, w, orig_u, orig_v;
-	u32 index, i, j, k, noisex, noisey, noisez;
-	u32 nlx, nly, nlz;
-	s32 x0, y0, z0;
-
 	Interp3dFxn interpolate = (np.flags & NOISE_FLAG_EASED) ?
 		triLinearInterpolation : triLinearInterpolationNoEase;
 
-	x0 = std::floor(x);
-	y0 = std::floor(y);
-	z0 = std::floor(z);
-	u = x - (float)x0;
-	v = y - (float)y0;
-	w = z - (float)z0;
-	orig_u = u;
-	orig_v = v;
+	s32 x0 = std::floor(x);
+	s32 y0 = std::floor(y);
+	s32 z0 = std::floor(z);
+	float orig_u = x - (float)x0;
+	float orig_v = y - (float)y0;
+	float w = z - (float)z0;
 
 	//calculate noise point lattice
-	nlx = (u32)(u + sx * step_x) + 2;
-	nly = (u32)(v + sy * step_y) + 2;
-	nlz = (u32)(w + sz * step_z) + 2;
-	index = 0;
-	for (k = 0; k != nlz; k++)
-		for (j = 0; j != nly; j++)
-			for (i = 0; i != nlx; i++)
+	u32 nlx = (u32)(orig_u + sx * step_x) + 2;
+	u32 nly = (u32)(orig_v + sy * step_y) + 2;
+	u32 nlz = (u32)(w + sz * step_z) + 2;
+	forEach(nlz, [&] (u32 k) {
+		u32 index = k * nly * nlx;
+		for (u32 j = 0; j != nly; j++)
+			for (u32 i = 0; i != nlx; i++)
 				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+	});
+
+	// The z coordinates are accumulated like they always were, so that the
+	// slices can be interpolated independently with the same result
+	std::vector<float> slice_w(sz);
+	std::vector<u32> slice_noisez(sz);
+	u32 noisez = 0;
+	for (u32 k = 0; k != sz; k++) {
+		slice_w[k] = w;
+		slice_noisez[k] = noisez;
+		w += step_z;
+		if (w >= 1.0) {
+			w -= 1.0;
+			noisez++;
+		}
+	}
 
 	//calculate interpolations
-	index  = 0;
-	noisey = 0;
-	noisez = 0;
-	for (k = 0; k != sz; k++) {
-		v = orig_v;
-		noisey = 0;
-		for (j = 0; j != sy; j++) {
+	forEach(sz, [&] (u32 k) {
+		float v000, v010, v100, v110;
+		float v001, v011, v101, v111;
+		float u, v = orig_v;
+		float w = slice_w[k];
+		u32 noisex, noisey = 0, noisez = slice_noisez[k];
+		u32 index = k * sy * sx;
+
+		for (u32 j = 0; j != sy; j++) {
 			v000 = noise_buf[idx(0, noisey,     noisez)];
 			v100 = noise_buf[idx(1, noisey,     noisez)];
 			v010 = noise_buf[idx(0, noisey + 1, noisez)];
@@ -668,7 +679,7 @@ void Noise::gradientMap3D(
 
 			u = orig_u;
 			noisex = 0;
-			for (i = 0; i != sx; i++) {
+			for (u32 i = 0; i != sx; i++) {
 				gradient_buf[index++] = interpolate(
 					v000, v100, v010, v110,
 					v001, v101, v011, v111,
@@ -695,13 +706,7 @@ void Noise::gradientMap3D(
 				noisey++;
 			}
 		}
-
-		w += step_z;
-		if (w >= 1.0) {
-			w -= 1.0;
-			noisez++;
-		}
-	}
+	});
 }
 #undef idx
 
@@ -728,7 +733,7 @@ float *Noise::perlinMap2D(float x, float y, float *persistence_map)
 			f / np.spread.X, f / np.spread.Y,
 			seed + np.seed + oct);
 
-		updateResults(g, persist_buf, persistence_map, bufsize);
+		updateResults(g, persist_buf, persistence_map, 0, bufsize);
 
 		f *= np.lacunarity;
 		g *= np.persist;
@@ -761,12 +766,16 @@ float *Noise::perlinMap3D(float x, float y, float z, float *persistence_map)
 			persist_buf[i] = 1.0;
 	}
 
+	size_t slice_size = sx * sy;
 	for (size_t oct = 0; oct < np.octaves; oct++) {
 		gradientMap3D(x * f, y * f, z * f,
 			f / np.spread.X, f / np.spread.Y, f / np.spread.Z,
 			seed + np.seed + oct);
 
-		updateResults(g, persist_buf, persistence_map, bufsize);
+		forEach(sz, [&] (u32 k) {
+			updateResults(g, persist_buf, persistence_map,
+				k * slice_size, (k + 1) * slice_size);
+		});
 
 		f *= np.lacunarity;
 		g *= np.persist;
@@ -782,29 +791,41 @@ float *Noise::perlinMap3D(float x, float y, float z, float *persistence_map)
 
 
 void Noise::updateResults(float g, float *gmap,
-	const float *persistence_map, size_t bufsize)
+	const float *persistence_map, size_t begin, size_t end)
 {
 	// This looks very ugly, but it is 50-70% faster than having
 	// conditional statements inside the loop
 	if (np.flags & NOISE_FLAG_ABSVALUE) {
 		if (persistence_map) {
-			for (size_t i = 0; i != bufsize; i++) {
+			for (size_t i = begin; i != end; i++) {
 				result[i] += gmap[i] * std::fabs(gradient_buf[i]);
 				gmap[i] *= persistence_map[i];
 			}
 		} else {
-			for (size_t i = 0; i != bufsize; i++)
+			for (size_t i = begin; i != end; i++)
 				result[i] += g * std::fabs(gradient_buf[i]);
 		}
 	} else {
 		if (persistence_map) {
-			for (size_t i = 0; i != bufsize; i++) {
+			for (size_t i = begin; i != end; i++) {
 				result[i] += gmap[i] * gradient_buf[i];
 				gmap[i] *= persistence_map[i];
 			}
 		} else {
-			for (size_t i = 0; i != bufsize; i++)
+			for (size_t i = begin; i != end; i++)
 				result[i] += g * gradient_buf[i];
 		}
 	}
 }
+
+
+void Noise::forEach(u32 count, const std::function<void(u32)> &f)
+{
+	if (pool) {
+		pool->parallelFor(count, f);
+		return;
+	}
+
+	for (u32 i = 0; i != count; i++)
+		f(i);
+}
@@ -25,6 +25,7 @@
 
 #pragma once
 
+#include <functional>
 #include "irr_v3d.h"
 #include "exceptions.h"
 #include "util/string.h"
@@ -38,6 +39,8 @@
 
 extern FlagDesc flagdesc_noiseparams[];
 
+class WorkerPool;
+
 // Note: this class is not polymorphic so that its high level of
 // optimizability may be preserved in the common use case
 class PseudoRandom {
@@ -145,6 +148,9 @@ class Noise {
 	float *gradient_buf = nullptr;
 	float *persist_buf = nullptr;
 	float *result = nullptr;
+	// If set, 3D noise maps are computed in z slices on this pool. The
+	// result is the same.
+	WorkerPool *pool = nullptr;
 
 	Noise(NoiseParams *np, s32 seed, u32 sx, u32 sy, u32 sz=1);
 	~Noise();
@@ -188,7 +194,9 @@ class Noise {
 	void allocBuffers();
 	void resizeNoiseBuf(bool is3d);
 	void updateResults(float g, float *gmap, const float *persistence_map,
-			size_t bufsize);
+			size_t begin, size_t end);
+	// Calls f(i) for every i in [0, count), on the pool if there is one
+	void forEach(u32 count, const std::function<void(u32)> &f);
 
 };
 
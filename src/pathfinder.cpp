@@ -23,7 +23,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /******************************************************************************/
 
 #include "pathfinder.h"
+#include <deque>
+#include <queue>
+#include <unordered_map>
 #include "map.h"
+#include "mapblock.h"
 #include "nodedef.h"
 
 //#define PATHFINDER_DEBUG
@@ -43,8 +47,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 /* Typedefs and macros                                                        */
 /******************************************************************************/
 
-#define LVL "(" << level << ")" <<
-
 #ifdef PATHFINDER_DEBUG
 #define DEBUG_OUT(a)     std::cout << a
 #define INFO_TARGET      std::cout
@@ -58,6 +60,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #endif
 
 #define PATHFINDER_MAX_WAYPOINTS 700
+// Search areas up to this many nodes are indexed by an array
+#define PATHFINDER_MAX_DENSE_VOLUME (1 << 20)
 
 /******************************************************************************/
 /* Class definitions                                                          */
@@ -136,43 +140,87 @@ class PathGridnode {
                                                 */
 };
 
-class Pathfinder;
-class PathfinderCompareHeuristic;
+/** Type of a map node as seen by the pathfinder */
+enum PathNodeType : u8 {
+	PATHNODE_UNKNOWN,                  /**< not read from the map yet       */
+	PATHNODE_IGNORE,                   /**< node isn't loaded               */
+	PATHNODE_WALKABLE,                 /**< node can be stood on            */
+	PATHNODE_FREE                      /**< node can be walked through      */
+};
 
-/** Abstract class to manage the map data */
-class GridNodeContainer {
+/** Lazily filled snapshot of the node types in the search area, so that
+ *  the cost calculations don't look up the map and the node definitions
+ *  for every node again. */
+class PathNodeCache {
 public:
-	virtual PathGridnode &access(v3s16 p)=0;
-	virtual ~GridNodeContainer() = default;
+	PathNodeCache(Map *map, const NodeDefManager *ndef,
+			const core::aabbox3d<s16> &area);
+	~PathNodeCache();
 
-protected:
-	Pathfinder *m_pathf;
+	/**
+	 * get the type of a node
+	 * @param pos real world position
+	 * @return node type, never PATHNODE_UNKNOWN
+	 */
+	PathNodeType get(v3s16 pos);
 
-	void initNode(v3s16 ipos, PathGridnode *p_node);
+private:
+	/** node types of one MapBlock */
+	struct CachedBlock {
+		MapBlock *block;                   /**< NULL if not loaded          */
+		u8 types[MapBlock::nodecount];     /**< PathNodeType of each node   */
+	};
+
+	PathNodeType getType(const MapNode &n);
+	CachedBlock *getBlock(v3s16 blockpos);
+
+	Map *m_map;
+	const NodeDefManager *m_ndef;
+
+	v3s16 m_min_block;                 /**< first MapBlock of the area      */
+	v3s16 m_blocks_size;               /**< area size in MapBlocks          */
+	std::vector<CachedBlock *> m_blocks; /**< NULL until first accessed     */
 };
 
-class ArrayGridNodeContainer : public GridNodeContainer {
+class Pathfinder;
+
+/** Search data of the nodes within the search area, created on first access */
+class GridNodeContainer {
 public:
-	virtual ~ArrayGridNodeContainer() = default;
+	GridNodeContainer(Pathfinder *pathf, v3s16 dimensions);
+
+	PathGridnode &access(v3s16 p);
 
-	ArrayGridNodeContainer(Pathfinder *pathf, v3s16 dimensions);
-	virtual PathGridnode &access(v3s16 p);
 private:
-	v3s16 m_dimensions;
+	void initNode(v3s16 ipos, PathGridnode *p_node);
+
+	Pathfinder *m_pathf;
 
-	int m_x_stride;
 	int m_y_stride;
-	std::vector<PathGridnode> m_nodes_array;
+	int m_z_stride;
+
+	/** created nodes; a deque keeps references valid while it grows */
+	std::deque<PathGridnode> m_nodes;
+	/** index + 1 into m_nodes for each position, for small search areas */
+	std::vector<u32> m_slots;
+	/** index into m_nodes for each position, for large search areas */
+	std::unordered_map<u32, u32> m_slot_map;
 };
 
-class MapGridNodeContainer : public GridNodeContainer {
-public:
-	virtual ~MapGridNodeContainer() = default;
-
-	MapGridNodeContainer(Pathfinder *pathf);
-	virtual PathGridnode &access(v3s16 p);
-private:
-	std::map<v3s16, PathGridnode> m_nodes;
+/** Entry of the open list of the A* search */
+struct PathOpenEntry {
+	int   estimated_cost;              /**< totalcost + heuristic cost      */
+	int   totalcost;                   /**< cost when the entry was added   */
+	v3s16 ipos;                        /**< index position of the node      */
+
+	bool operator<(const PathOpenEntry &b) const
+	{
+		// std::priority_queue puts the largest entry on top, so the lowest
+		// estimate wins. On ties prefer nodes further from the start.
+		if (estimated_cost != b.estimated_cost)
+			return estimated_cost > b.estimated_cost;
+		return totalcost < b.totalcost;
+	}
 };
 
 /** class doing pathfinding */
@@ -181,6 +229,7 @@ class Pathfinder {
 public:
 	Pathfinder() = delete;
 	Pathfinder(Map *map, const NodeDefManager *ndef) : m_map(map), m_ndef(ndef) {}
+	DISABLE_CLASS_COPY(Pathfinder);
 
 	~Pathfinder();
 
@@ -193,13 +242,15 @@ class Pathfinder {
 	 * @param max_jump maximum number of blocks a path may jump up
 	 * @param max_drop maximum number of blocks a path may drop
 	 * @param algo Algorithm to use for finding a path
+	 * @param max_nodes maximum number of nodes to visit, 0 for no limit
 	 */
 	std::vector<v3s16> getPath(v3s16 source,
 			v3s16 destination,
 			unsigned int searchdistance,
 			unsigned int max_jump,
 			unsigned int max_drop,
-			PathAlgorithm algo);
+			PathAlgorithm algo,
+			unsigned int max_nodes);
 
 private:
 	/* helper functions */
@@ -263,24 +314,16 @@ class Pathfinder {
 	 */
 	PathCost     calcCost(v3s16 pos, v3s16 dir);
 
-	/**
-	 * recursive update whole search areas total cost information
-	 * @param ipos position to check next
-	 * @param srcdir positionc checked last time
-	 * @param total_cost cost of moving to ipos
-	 * @param level current recursion depth
-	 * @return true/false path to destination has been found
-	 */
-	bool          updateAllCosts(v3s16 ipos, v3s16 srcdir, int current_cost, int level);
-
 	/**
 	 * try to find a path to destination using a heuristic function
 	 * to estimate distance to target (A* search algorithm)
 	 * @param isource start position (index pos)
 	 * @param idestination end position (index pos)
+	 * @param use_heuristic false to search without heuristic (Dijkstra)
 	 * @return true/false path to destination has been found
 	 */
-	bool          updateCostHeuristic(v3s16 isource, v3s16 idestination);
+	bool          updateCostHeuristic(v3s16 isource, v3s16 idestination,
+			bool use_heuristic);
 
 	/**
 	 * build a vector containing all nodes from destination to source;
@@ -310,7 +353,7 @@ class Pathfinder {
 	int m_searchdistance = 0;         /**< max distance to search in each direction */
 	int m_maxdrop = 0;                /**< maximum number of blocks a path may drop */
 	int m_maxjump = 0;                /**< maximum number of blocks a path may jump */
-	int m_min_target_distance = 0;    /**< current smalest path to target           */
+	unsigned int m_max_nodes = 0;     /**< maximum number of nodes to visit         */
 
 	bool m_prefetch = true;              /**< prefetch cost data                       */
 
@@ -324,12 +367,13 @@ class Pathfinder {
 	friend class GridNodeContainer;
 	GridNodeContainer *m_nodes_container = nullptr;
 
+	/** node types read from the map so far */
+	PathNodeCache *m_node_cache = nullptr;
+
 	Map *m_map = nullptr;
 
 	const NodeDefManager *m_ndef = nullptr;
 
-	friend class PathfinderCompareHeuristic;
-
 #ifdef PATHFINDER_DEBUG
 
 	/**
@@ -379,31 +423,6 @@ class Pathfinder {
 #endif
 };
 
-/** Helper class for the open list priority queue in the A* pathfinder
- *  to sort the pathfinder nodes by cost.
- */
-class PathfinderCompareHeuristic
-{
-	private:
-		Pathfinder *myPathfinder;
-	public:
-		PathfinderCompareHeuristic(Pathfinder *pf)
-		{
-			myPathfinder = pf;
-		}
-		bool operator() (v3s16 pos1, v3s16 pos2) {
-			v3s16 ipos1 = myPathfinder->getIndexPos(pos1);
-			v3s16 ipos2 = myPathfinder->getIndexPos(pos2);
-			PathGridnode &g_pos1 = myPathfinder->getIndexElement(ipos1);
-			PathGridnode &g_pos2 = myPathfinder->getIndexElement(ipos2);
-			if (!g_pos1.valid)
-				return false;
-			if (!g_pos2.valid)
-				return false;
-			return g_pos1.estimated_cost > g_pos2.estimated_cost;
-		}
-};
-
 /******************************************************************************/
 /* implementation                                                             */
 /******************************************************************************/
@@ -414,10 +433,11 @@ std::vector<v3s16> get_path(Map* map, const NodeDefManager *ndef,
 		unsigned int searchdistance,
 		unsigned int max_jump,
 		unsigned int max_drop,
-		PathAlgorithm algo)
+		PathAlgorithm algo,
+		unsigned int max_nodes)
 {
 	return Pathfinder(map, ndef).getPath(source, destination,
-				searchdistance, max_jump, max_drop, algo);
+				searchdistance, max_jump, max_drop, algo, max_nodes);
 }
 
 /******************************************************************************/
@@ -514,22 +534,115 @@ void PathGridnode::setCost(v3s16 dir, const PathCost &cost)
 	}
 }
 
+/******************************************************************************/
+PathNodeCache::PathNodeCache(Map *map, const NodeDefManager *ndef,
+		const core::aabbox3d<s16> &area) :
+	m_map(map),
+	m_ndef(ndef)
+{
+	m_min_block = getNodeBlockPos(area.MinEdge);
+	m_blocks_size = getNodeBlockPos(area.MaxEdge) - m_min_block + v3s16(1, 1, 1);
+	m_blocks.resize(m_blocks_size.X * m_blocks_size.Y * m_blocks_size.Z, nullptr);
+}
+
+/******************************************************************************/
+PathNodeCache::~PathNodeCache()
+{
+	for (CachedBlock *block : m_blocks)
+		delete block;
+}
+
+/******************************************************************************/
+PathNodeType PathNodeCache::get(v3s16 pos)
+{
+	v3s16 blockpos = getNodeBlockPos(pos);
+	v3s16 rel = blockpos - m_min_block;
+	if (rel.X < 0 || rel.Y < 0 || rel.Z < 0 || rel.X >= m_blocks_size.X ||
+			rel.Y >= m_blocks_size.Y || rel.Z >= m_blocks_size.Z)
+		return getType(m_map->getNode(pos));
+
+	CachedBlock *&cached = m_blocks[(rel.Z * m_blocks_size.Y + rel.Y) *
+			m_blocks_size.X + rel.X];
+	if (!cached)
+		cached = getBlock(blockpos);
+
+	v3s16 p = pos - blockpos * MAP_BLOCKSIZE;
+	u8 &type = cached->types[p.Z * MapBlock::zstride + p.Y * MapBlock::ystride + p.X];
+	if (type == PATHNODE_UNKNOWN)
+		type = getType(cached->block->getNodeUnsafe(p));
+	return (PathNodeType)type;
+}
+
+/******************************************************************************/
+PathNodeType PathNodeCache::getType(const MapNode &n)
+{
+	if (n.getContent() == CONTENT_IGNORE)
+		return PATHNODE_IGNORE;
+	return m_ndef->get(n).walkable ? PATHNODE_WALKABLE : PATHNODE_FREE;
+}
+
+/******************************************************************************/
+PathNodeCache::CachedBlock *PathNodeCache::getBlock(v3s16 blockpos)
+{
+	CachedBlock *cached = new CachedBlock();
+
+	cached->block = m_map->getBlockNoCreateNoEx(blockpos);
+	if (cached->block && cached->block->isDummy())
+		cached->block = nullptr;
+
+	memset(cached->types, cached->block ? PATHNODE_UNKNOWN : PATHNODE_IGNORE,
+			MapBlock::nodecount);
+	return cached;
+}
+
+/******************************************************************************/
+GridNodeContainer::GridNodeContainer(Pathfinder *pathf, v3s16 dimensions) :
+	m_pathf(pathf),
+	m_y_stride(dimensions.X),
+	m_z_stride(dimensions.X * dimensions.Y)
+{
+	u32 volume = (u32)dimensions.X * dimensions.Y * dimensions.Z;
+	if (volume <= PATHFINDER_MAX_DENSE_VOLUME)
+		m_slots.resize(volume, 0);
+}
+
+/******************************************************************************/
+PathGridnode &GridNodeContainer::access(v3s16 p)
+{
+	u32 key = p.Z * m_z_stride + p.Y * m_y_stride + p.X;
+	if (!m_slots.empty()) {
+		u32 &slot = m_slots[key];
+		if (slot)
+			return m_nodes[slot - 1];
+		slot = m_nodes.size() + 1;
+	} else {
+		auto it = m_slot_map.find(key);
+		if (it != m_slot_map.end())
+			return m_nodes[it->second];
+		m_slot_map[key] = m_nodes.size();
+	}
+
+	m_nodes.emplace_back();
+	PathGridnode &n = m_nodes.back();
+	initNode(p, &n);
+	return n;
+}
+
+/******************************************************************************/
 void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 {
-	const NodeDefManager *ndef = m_pathf->m_ndef;
 	PathGridnode &elem = *p_node;
 
 	v3s16 realpos = m_pathf->getRealPos(ipos);
 
-	MapNode current = m_pathf->m_map->getNode(realpos);
-	MapNode below   = m_pathf->m_map->getNode(realpos + v3s16(0, -1, 0));
-
+	PathNodeType current = m_pathf->m_node_cache->get(realpos);
+	PathNodeType below   = m_pathf->m_node_cache->get(realpos + v3s16(0, -1, 0));
 
-	if ((current.param0 == CONTENT_IGNORE) ||
-			(below.param0 == CONTENT_IGNORE)) {
+	if ((current == PATHNODE_IGNORE) ||
+			(below == PATHNODE_IGNORE)) {
 		DEBUG_OUT("Pathfinder: " << PP(realpos) <<
 			" current or below is invalid element" << std::endl);
-		if (current.param0 == CONTENT_IGNORE) {
+		if (current == PATHNODE_IGNORE) {
 			elem.type = 'i';
 			DEBUG_OUT(PP(ipos) << ": " << 'i' << std::endl);
 		}
@@ -537,10 +650,10 @@ void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 	}
 
 	//don't add anything if it isn't an air node
-	if (ndef->get(current).walkable || !ndef->get(below).walkable) {
+	if (current == PATHNODE_WALKABLE || below != PATHNODE_WALKABLE) {
 			DEBUG_OUT("Pathfinder: " << PP(realpos)
 				<< " not on surface" << std::endl);
-			if (ndef->get(current).walkable) {
+			if (current == PATHNODE_WALKABLE) {
 				elem.type = 's';
 				DEBUG_OUT(PP(ipos) << ": " << 's' << std::endl);
 			} else {
@@ -563,54 +676,14 @@ void GridNodeContainer::initNode(v3s16 ipos, PathGridnode *p_node)
 	}
 }
 
-ArrayGridNodeContainer::ArrayGridNodeContainer(Pathfinder *pathf, v3s16 dimensions) :
-	m_x_stride(dimensions.Y * dimensions.Z),
-	m_y_stride(dimensions.Z)
-{
-	m_pathf = pathf;
-
-	m_nodes_array.resize(dimensions.X * dimensions.Y * dimensions.Z);
-	INFO_TARGET << "Pathfinder ArrayGridNodeContainer constructor." << std::endl;
-	for (int x = 0; x < dimensions.X; x++) {
-		for (int y = 0; y < dimensions.Y; y++) {
-			for (int z= 0; z < dimensions.Z; z++) {
-				v3s16 ipos(x, y, z);
-				initNode(ipos, &access(ipos));
-			}
-		}
-	}
-}
-
-PathGridnode &ArrayGridNodeContainer::access(v3s16 p)
-{
-	return m_nodes_array[p.X * m_x_stride + p.Y * m_y_stride + p.Z];
-}
-
-MapGridNodeContainer::MapGridNodeContainer(Pathfinder *pathf)
-{
-	m_pathf = pathf;
-}
-
-PathGridnode &MapGridNodeContainer::access(v3s16 p)
-{
-	std::map<v3s16, PathGridnode>::iterator it = m_nodes.find(p);
-	if (it != m_nodes.end()) {
-		return it->second;
-	}
-	PathGridnode &n = m_nodes[p];
-	initNode(p, &n);
-	return n;
-}
-
-
-
 /******************************************************************************/
 std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 							v3s16 destination,
 							unsigned int searchdistance,
 							unsigned int max_jump,
 							unsigned int max_drop,
-							PathAlgorithm algo)
+							PathAlgorithm algo,
+							unsigned int max_nodes)
 {
 #ifdef PATHFINDER_CALC_TIME
 	timespec ts;
@@ -624,7 +697,7 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	m_maxdrop = max_drop;
 	m_start       = source;
 	m_destination = destination;
-	m_min_target_distance = -1;
+	m_max_nodes = max_nodes;
 	m_prefetch = true;
 
 	if (algo == PA_PLAIN_NP) {
@@ -655,12 +728,14 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	m_max_index_y = diff.Y;
 	m_max_index_z = diff.Z;
 
+	// Nodes below the search area are needed to find the surface
+	core::aabbox3d<s16> cache_area = m_limits;
+	cache_area.MinEdge.Y--;
+
+	delete m_node_cache;
+	m_node_cache = new PathNodeCache(m_map, m_ndef, cache_area);
 	delete m_nodes_container;
-	if (diff.getLength() > 5) {
-		m_nodes_container = new MapGridNodeContainer(this);
-	} else {
-		m_nodes_container = new ArrayGridNodeContainer(this, diff);
-	}
+	m_nodes_container = new GridNodeContainer(this, diff);
 #ifdef PATHFINDER_DEBUG
 	printType();
 	printCost();
@@ -668,14 +743,12 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 #endif
 
 	//fail if source or destination is walkable
-	MapNode node_at_pos = m_map->getNode(destination);
-	if (m_ndef->get(node_at_pos).walkable) {
+	if (m_node_cache->get(destination) == PATHNODE_WALKABLE) {
 		VERBOSE_TARGET << "Destination is walkable. " <<
 				"Pos: " << PP(destination) << std::endl;
 		return retval;
 	}
-	node_at_pos = m_map->getNode(source);
-	if (m_ndef->get(node_at_pos).walkable) {
+	if (m_node_cache->get(source) == PATHNODE_WALKABLE) {
 		VERBOSE_TARGET << "Source is walkable. " <<
 				"Pos: " << PP(source) << std::endl;
 		return retval;
@@ -725,11 +798,11 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 	//calculate node costs
 	switch (algo) {
 		case PA_DIJKSTRA:
-			update_cost_retval = updateAllCosts(StartIndex, v3s16(0, 0, 0), 0, 0);
+			update_cost_retval = updateCostHeuristic(StartIndex, EndIndex, false);
 			break;
 		case PA_PLAIN_NP:
 		case PA_PLAIN:
-			update_cost_retval = updateCostHeuristic(StartIndex, EndIndex);
+			update_cost_retval = updateCostHeuristic(StartIndex, EndIndex, true);
 			break;
 		default:
 			ERROR_TARGET << "Missing PathAlgorithm" << std::endl;
@@ -819,6 +892,7 @@ std::vector<v3s16> Pathfinder::getPath(v3s16 source,
 Pathfinder::~Pathfinder()
 {
 	delete m_nodes_container;
+	delete m_node_cache;
 }
 /******************************************************************************/
 v3s16 Pathfinder::getRealPos(v3s16 ipos)
@@ -842,28 +916,28 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		return retval;
 	}
 
-	MapNode node_at_pos2 = m_map->getNode(pos2);
+	PathNodeType node_at_pos2 = m_node_cache->get(pos2);
 
 	//did we get information about node?
-	if (node_at_pos2.param0 == CONTENT_IGNORE ) {
+	if (node_at_pos2 == PATHNODE_IGNORE) {
 			VERBOSE_TARGET << "Pathfinder: (1) area at pos: "
 					<< PP(pos2) << " not loaded";
 			return retval;
 	}
 
-	if (!m_ndef->get(node_at_pos2).walkable) {
-		MapNode node_below_pos2 =
-			m_map->getNode(pos2 + v3s16(0, -1, 0));
+	if (node_at_pos2 != PATHNODE_WALKABLE) {
+		PathNodeType node_below_pos2 =
+			m_node_cache->get(pos2 + v3s16(0, -1, 0));
 
 		//did we get information about node?
-		if (node_below_pos2.param0 == CONTENT_IGNORE ) {
+		if (node_below_pos2 == PATHNODE_IGNORE) {
 				VERBOSE_TARGET << "Pathfinder: (2) area at pos: "
 					<< PP((pos2 + v3s16(0, -1, 0))) << " not loaded";
 				return retval;
 		}
 
 		//test if the same-height neighbor is suitable
-		if (m_ndef->get(node_below_pos2).walkable) {
+		if (node_below_pos2 == PATHNODE_WALKABLE) {
 			//SUCCESS!
 			retval.valid = true;
 			retval.value = 1;
@@ -874,19 +948,17 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 		else {
 			//test if we can fall a couple of nodes (m_maxdrop)
 			v3s16 testpos = pos2 + v3s16(0, -1, 0);
-			MapNode node_at_pos = m_map->getNode(testpos);
+			PathNodeType node_at_pos = m_node_cache->get(testpos);
 
-			while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-					(!m_ndef->get(node_at_pos).walkable) &&
+			while ((node_at_pos == PATHNODE_FREE) &&
 					(testpos.Y > m_limits.MinEdge.Y)) {
 				testpos += v3s16(0, -1, 0);
-				node_at_pos = m_map->getNode(testpos);
+				node_at_pos = m_node_cache->get(testpos);
 			}
 
 			//did we find surface?
 			if ((testpos.Y >= m_limits.MinEdge.Y) &&
-					(node_at_pos.param0 != CONTENT_IGNORE) &&
-					(m_ndef->get(node_at_pos).walkable)) {
+					(node_at_pos == PATHNODE_WALKABLE)) {
 				if ((pos2.Y - testpos.Y - 1) <= m_maxdrop) {
 					//SUCCESS!
 					retval.valid = true;
@@ -912,34 +984,31 @@ PathCost Pathfinder::calcCost(v3s16 pos, v3s16 dir)
 
 		v3s16 targetpos = pos2; // position for jump target
 		v3s16 jumppos = pos; // position for checking if jumping space is free
-		MapNode node_target = m_map->getNode(targetpos);
-		MapNode node_jump = m_map->getNode(jumppos);
+		PathNodeType node_target = m_node_cache->get(targetpos);
+		PathNodeType node_jump = m_node_cache->get(jumppos);
 		bool headbanger = false; // true if anything blocks jumppath
 
-		while ((node_target.param0 != CONTENT_IGNORE) &&
-				(m_ndef->get(node_target).walkable) &&
+		while ((node_target == PATHNODE_WALKABLE) &&
 				(targetpos.Y < m_limits.MaxEdge.Y)) {
 			//if the jump would hit any solid node, discard
-			if ((node_jump.param0 == CONTENT_IGNORE) ||
-					(m_ndef->get(node_jump).walkable)) {
+			if (node_jump != PATHNODE_FREE) {
 					headbanger = true;
 				break;
 			}
 			targetpos += v3s16(0, 1, 0);
 			jumppos   += v3s16(0, 1, 0);
-			node_target = m_map->getNode(targetpos);
-			node_jump   = m_map->getNode(jumppos);
+			node_target = m_node_cache->get(targetpos);
+			node_jump   = m_node_cache->get(jumppos);
 
 		}
 		//check headbanger one last time
-		if ((node_jump.param0 == CONTENT_IGNORE) ||
-			(m_ndef->get(node_jump).walkable)) {
+		if (node_jump != PATHNODE_FREE) {
 			headbanger = true;
 		}
 
 		//did we find surface without banging our head?
 		if ((!headbanger) && (targetpos.Y <= m_limits.MaxEdge.Y) &&
-				(!m_ndef->get(node_target).walkable)) {
+				(node_target != PATHNODE_WALKABLE)) {
 
 			if (targetpos.Y - pos2.Y <= m_maxjump) {
 				//SUCCESS!
@@ -1005,94 +1074,6 @@ v3s16 Pathfinder::invert(v3s16 pos)
 	return retval;
 }
 
-/******************************************************************************/
-bool Pathfinder::updateAllCosts(v3s16 ipos,
-								v3s16 srcdir,
-								int current_cost,
-								int level)
-{
-	PathGridnode &g_pos = getIndexElement(ipos);
-	g_pos.totalcost = current_cost;
-	g_pos.sourcedir = srcdir;
-
-	level ++;
-
-	//check if target has been found
-	if (g_pos.target) {
-		m_min_target_distance = current_cost;
-		DEBUG_OUT(LVL " Pathfinder: target found!" << std::endl);
-		return true;
-	}
-
-	bool retval = false;
-
-	// the 4 cardinal directions
-	const static v3s16 directions[4] = {
-		v3s16(1,0, 0),
-		v3s16(-1,0, 0),
-		v3s16(0,0, 1),
-		v3s16(0,0,-1)
-	};
-
-	for (v3s16 direction : directions) {
-		if (direction != srcdir) {
-			PathCost cost = g_pos.getCost(direction);
-
-			if (cost.valid) {
-				direction.Y = cost.y_change;
-
-				v3s16 ipos2 = ipos + direction;
-
-				if (!isValidIndex(ipos2)) {
-					DEBUG_OUT(LVL " Pathfinder: " << PP(ipos2) <<
-						" out of range, max=" << PP(m_limits.MaxEdge) << std::endl);
-					continue;
-				}
-
-				PathGridnode &g_pos2 = getIndexElement(ipos2);
-
-				if (!g_pos2.valid) {
-					VERBOSE_TARGET << LVL "Pathfinder: no data for new position: "
-												<< PP(ipos2) << std::endl;
-					continue;
-				}
-
-				assert(cost.value > 0);
-
-				int new_cost = current_cost + cost.value;
-
-				// check if there already is a smaller path
-				if ((m_min_target_distance > 0) &&
-						(m_min_target_distance < new_cost)) {
-					return false;
-				}
-
-				if ((g_pos2.totalcost < 0) ||
-						(g_pos2.totalcost > new_cost)) {
-					DEBUG_OUT(LVL "Pathfinder: updating path at: "<<
-							PP(ipos2) << " from: " << g_pos2.totalcost << " to "<<
-							new_cost << std::endl);
-					if (updateAllCosts(ipos2, invert(direction),
-											new_cost, level)) {
-						retval = true;
-						}
-					}
-				else {
-					DEBUG_OUT(LVL "Pathfinder:"
-							" already found shorter path to: "
-							<< PP(ipos2) << std::endl);
-				}
-			}
-			else {
-				DEBUG_OUT(LVL "Pathfinder:"
-						" not moving to invalid direction: "
-						<< PP(directions[i]) << std::endl);
-			}
-		}
-	}
-	return retval;
-}
-
 /******************************************************************************/
 int Pathfinder::getXZManhattanDist(v3s16 pos)
 {
@@ -1107,21 +1088,16 @@ int Pathfinder::getXZManhattanDist(v3s16 pos)
 
 
 /******************************************************************************/
-bool Pathfinder::updateCostHeuristic(v3s16 isource, v3s16 idestination)
+bool Pathfinder::updateCostHeuristic(v3s16 isource, v3s16 idestination,
+		bool use_heuristic)
 {
 	// A* search algorithm.
 
 	// The open list contains the pathfinder nodes that still need to be
-	// checked. The priority queue sorts the pathfinder nodes by
-	// estimated cost, with lowest cost on the top.
-	std::priority_queue<v3s16, std::vector<v3s16>, PathfinderCompareHeuristic>
-			openList(PathfinderCompareHeuristic(this));
-
-	v3s16 source = getRealPos(isource);
-	v3s16 destination = getRealPos(idestination);
-
-	// initial position
-	openList.push(source);
+	// checked, as a binary heap with the lowest estimated cost on top.
+	// Nodes that are reached again on a cheaper path are added once more;
+	// the outdated entries are skipped when they come up.
+	std::priority_queue<PathOpenEntry> openList;
 
 	// the 4 cardinal directions
 	const static v3s16 directions[4] = {
@@ -1131,72 +1107,78 @@ bool Pathfinder::updateCostHeuristic(v3s16 isource, v3s16 idestination)
 		v3s16(0,0,-1)
 	};
 
-	v3s16 current_pos;
 	PathGridnode& s_pos = getIndexElement(isource);
 	s_pos.source = true;
 	s_pos.totalcost = 0;
 
 	// estimated cost from start to finish
-	int cur_manhattan = getXZManhattanDist(destination);
-	s_pos.estimated_cost = cur_manhattan;
+	s_pos.estimated_cost = use_heuristic ?
+			getXZManhattanDist(getRealPos(isource)) : 0;
+	s_pos.is_open = true;
+	openList.push({s_pos.estimated_cost, 0, isource});
+
+	unsigned int visited_nodes = 0;
 
 	while (!openList.empty()) {
 		// Pick node with lowest total cost estimate.
 		// The "cheapest" node is always on top.
-		current_pos = openList.top();
+		PathOpenEntry current = openList.top();
 		openList.pop();
-		v3s16 ipos = getIndexPos(current_pos);
 
-		// check if node is inside searchdistance and valid
-		if (!isValidIndex(ipos)) {
-			DEBUG_OUT(LVL " Pathfinder: " << PP(current_pos) <<
-				" out of search distance, max=" << PP(m_limits.MaxEdge) << std::endl);
+		PathGridnode& g_pos = getIndexElement(current.ipos);
+		if (g_pos.is_closed || current.totalcost != g_pos.totalcost)
 			continue;
-		}
-
-		PathGridnode& g_pos = getIndexElement(ipos);
 		g_pos.is_closed = true;
 		g_pos.is_open = false;
-		if (!g_pos.valid) {
-			continue;
-		}
 
-		if (current_pos == destination) {
+		if (current.ipos == idestination) {
 			// destination found, terminate
 			g_pos.target = true;
 			return true;
 		}
 
+		if (m_max_nodes > 0 && ++visited_nodes > m_max_nodes) {
+			VERBOSE_TARGET << "Node limit of " << m_max_nodes
+					<< " reached" << std::endl;
+			return false;
+		}
+
+		v3s16 current_pos = getRealPos(current.ipos);
+
 		// for this node, check the 4 cardinal directions
 		for (v3s16 direction_flat : directions) {
-			int current_totalcost = g_pos.totalcost;
-
 			// get cost from current node to currently checked direction
 			PathCost cost = g_pos.getCost(direction_flat);
 			if (!cost.updated) {
 				cost = calcCost(current_pos, direction_flat);
 				g_pos.setCost(direction_flat, cost);
 			}
+			if (!cost.valid)
+				continue;
+
 			// update Y component of direction if neighbor requires jump or fall
 			v3s16 direction_3d = v3s16(direction_flat);
 			direction_3d.Y = cost.y_change;
 
 			// get position of true neighbor
-			v3s16 neighbor = current_pos + direction_3d;
-			v3s16 ineighbor = getIndexPos(neighbor);
-			PathGridnode &n_pos = getIndexElement(ineighbor);
-
-			if (cost.valid && !n_pos.is_closed && !n_pos.is_open) {
-				// heuristic function; estimate cost from neighbor to destination
-				cur_manhattan = getXZManhattanDist(neighbor);
+			v3s16 ineighbor = current.ipos + direction_3d;
+			if (!isValidIndex(ineighbor))
+				continue;
 
-				// add neighbor to open list
-				n_pos.sourcedir = invert(direction_3d);
-				n_pos.totalcost = current_totalcost + cost.value;
-				n_pos.estimated_cost = current_totalcost + cost.value + cur_manhattan;
-				n_pos.is_open = true;
-				openList.push(neighbor);
-			}
+			PathGridnode &n_pos = getIndexElement(ineighbor);
+			int new_cost = g_pos.totalcost + cost.value;
+			if (!n_pos.valid || n_pos.is_closed ||
+					(n_pos.is_open && n_pos.totalcost <= new_cost))
+				continue;
+
+			// add neighbor to open list
+			n_pos.sourcedir = invert(direction_3d);
+			n_pos.totalcost = new_cost;
+			// heuristic function; estimate cost from neighbor to destination
+			n_pos.estimated_cost = new_cost + (use_heuristic ?
+					getXZManhattanDist(current_pos + direction_3d) : 0);
+			n_pos.is_open = true;
+			openList.push({n_pos.estimated_cost, new_cost, ineighbor});
 		}
 	}
 	// no path found; all possible nodes within searchdistance have been exhausted
@@ -1239,20 +1221,18 @@ v3s16 Pathfinder::walkDownwards(v3s16 pos, unsigned int max_down) {
 	if (max_down == 0)
 		return pos;
 	v3s16 testpos = v3s16(pos);
-	MapNode node_at_pos = m_map->getNode(testpos);
+	PathNodeType node_at_pos = m_node_cache->get(testpos);
 	unsigned int down = 0;
-	while ((node_at_pos.param0 != CONTENT_IGNORE) &&
-			(!m_ndef->get(node_at_pos).walkable) &&
+	while ((node_at_pos == PATHNODE_FREE) &&
 			(testpos.Y > m_limits.MinEdge.Y) &&
 			(down <= max_down)) {
 		testpos += v3s16(0, -1, 0);
 		down++;
-		node_at_pos = m_map->getNode(testpos);
+		node_at_pos = m_node_cache->get(testpos);
 	}
 	//did we find surface?
 	if ((testpos.Y >= m_limits.MinEdge.Y) &&
-			(node_at_pos.param0 != CONTENT_IGNORE) &&
-			(m_ndef->get(node_at_pos).walkable)) {
+			(node_at_pos == PATHNODE_WALKABLE)) {
 		if (down == 0) {
 			pos = testpos;
 		} else if ((down - 1) <= max_down) {
@@ -242,6 +242,38 @@ const RemotePlayerChatResult RemotePlayer::canSendChatMessage()
 void RemotePlayer::onSuccessfulSave()
 {
 	setModified(false);
+	inventory.setSaved();
 	if (m_sao)
 		m_sao->getMeta().setModified(false);
 }
+
+void RemotePlayer::makeSaveData(PlayerSaveData *data, bool all)
+{
+	sanity_check(m_sao);
+
+	data->name = m_name;
+	data->position = m_sao->getBasePosition();
+	data->pitch = m_sao->getLookPitch();
+	data->yaw = m_sao->getRotation().Y;
+	data->hp = m_sao->getHP();
+	data->breath = m_sao->getBreath();
+
+	data->inventory = inventory;
+	data->lists_unsaved = all || inventory.checkListsUnsaved();
+	data->unsaved_lists.clear();
+	for (const InventoryList *list : inventory.getLists())
+		data->unsaved_lists.push_back(all || list->checkUnsaved());
+
+	data->meta = m_sao->getMeta().getStrings();
+	data->meta_unsaved = all || m_sao->getMeta().isModified();
+
+	onSuccessfulSave();
+}
+
+void RemotePlayer::onFailedSave()
+{
+	setModified(true);
+	inventory.setUnsaved();
+	if (m_sao)
+		m_sao->getMeta().setModified(true);
+}
@@ -26,6 +26,32 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 class PlayerSAO;
 
+/*
+	A copy of the player state that is stored in the player database. It is
+	taken on the server thread, so that another thread can write it.
+*/
+struct PlayerSaveData
+{
+	PlayerSaveData() : inventory(nullptr) {}
+
+	std::string name;
+	v3f position;
+	f32 pitch = 0.0f;
+	f32 yaw = 0.0f;
+	u16 hp = 0;
+	u16 breath = 0;
+
+	// The whole inventory, for the backends that store it in one piece
+	Inventory inventory;
+	// If lists were added or removed, every list has to be written.
+	// Otherwise only the lists marked in unsaved_lists, by index.
+	bool lists_unsaved = true;
+	std::vector<bool> unsaved_lists;
+
+	StringMap meta;
+	bool meta_unsaved = true;
+};
+
 enum RemotePlayerChatResult
 {
 	RPLAYER_CHATRESULT_OK,
@@ -141,6 +167,12 @@ class RemotePlayer : public Player
 
 	void onSuccessfulSave();
 
+	// Copies the state for the player database and marks it as saved.
+	// With all = true, everything is marked as changed in the copy.
+	void makeSaveData(PlayerSaveData *data, bool all);
+	// Marks everything as changed again when such a copy wasn't written
+	void onFailedSave();
+
 private:
 	/*
 		serialize() writes a bunch of text that can contain
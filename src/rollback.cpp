@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "rollback.h"
+#include <algorithm>
 #include <fstream>
 #include <list>
 #include <sstream>
@@ -31,8 +32,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "inventorymanager.h" // deserializing InventoryLocations
 #include "sqlite3.h"
 #include "filesys.h"
+#include "settings.h"
+#include "threading/semaphore.h"
+#include "threading/mutex_auto_lock.h"
+#include "threading/thread.h"
 
 #define POINTS_PER_NODE (16.0)
+// Actions further away than this can never be suspects (100 points)
+#define SUSPECT_MAX_DISTANCE (7)
+#define SUSPECT_CELL_SIZE (8)
+#define SUSPECT_MAX_AGE (100)
+// Number of queued actions that wakes the write thread early
+#define WRITE_BATCH_SIZE (500)
 
 #define SQLRES(f, good) \
 	if ((f) != (good)) {\
@@ -82,11 +93,36 @@ struct ActionRow {
 };
 
 
-struct Entity {
-	int         id;
-	std::string name;
-};
+class RollbackWriteThread : public Thread
+{
+public:
+	RollbackWriteThread(RollbackManager *rollback, u32 interval_ms) :
+		Thread("RollbackWrite"),
+		m_rollback(rollback),
+		m_interval_ms(interval_ms)
+	{}
+
+	void wakeUp() { m_signal.post(); }
+
+protected:
+	void *run()
+	{
+		while (!stopRequested()) {
+			m_signal.wait(m_interval_ms);
+			try {
+				m_rollback->writePending();
+			} catch (FileNotGoodException &e) {
+				errorstream << e.what() << std::endl;
+			}
+		}
+		return nullptr;
+	}
 
+private:
+	RollbackManager *m_rollback;
+	u32 m_interval_ms;
+	Semaphore m_signal;
+};
 
 
 RollbackManager::RollbackManager(const std::string & world_path,
@@ -109,11 +145,25 @@ RollbackManager::RollbackManager(const std::string & world_path,
 		migrate(txt_filename);
 		fs::DeleteSingleFileOrEmptyDirectory(migrating_flag);
 	}
+
+	// Actions are written by a separate thread at most this long after
+	// being reported, or as soon as a batch has been collected
+	float interval = MYMAX(g_settings->getFloat("rollback_write_interval"), 0.1f);
+	m_queue_max = MYMAX(g_settings->getU32("rollback_queue_max"), WRITE_BATCH_SIZE);
+	action_todisk_buffer.reserve(WRITE_BATCH_SIZE);
+
+	m_write_thread = new RollbackWriteThread(this, interval * 1000);
+	m_write_thread->start();
 }
 
 
 RollbackManager::~RollbackManager()
 {
+	m_write_thread->stop();
+	m_write_thread->wakeUp();
+	m_write_thread->wait();
+	delete m_write_thread;
+
 	flush();
 
 	FINALIZE_STATEMENT(stmt_insert);
@@ -125,6 +175,8 @@ RollbackManager::~RollbackManager()
 	FINALIZE_STATEMENT(stmt_knownActor_insert);
 	FINALIZE_STATEMENT(stmt_knownNode_select);
 	FINALIZE_STATEMENT(stmt_knownNode_insert);
+	FINALIZE_STATEMENT(stmt_begin);
+	FINALIZE_STATEMENT(stmt_commit);
 
 	SQLOK_ERRSTREAM(sqlite3_close(db), "Could not close db");
 }
@@ -132,26 +184,23 @@ RollbackManager::~RollbackManager()
 
 void RollbackManager::registerNewActor(const int id, const std::string &name)
 {
-	Entity actor = {id, name};
-	knownActors.push_back(actor);
+	knownActorIds[name] = id;
+	knownActorNames[id] = name;
 }
 
 
 void RollbackManager::registerNewNode(const int id, const std::string &name)
 {
-	Entity node = {id, name};
-	knownNodes.push_back(node);
+	knownNodeIds[name] = id;
+	knownNodeNames[id] = name;
 }
 
 
 int RollbackManager::getActorId(const std::string &name)
 {
-	for (std::vector<Entity>::const_iterator iter = knownActors.begin();
-			iter != knownActors.end(); ++iter) {
-		if (iter->name == name) {
-			return iter->id;
-		}
-	}
+	auto it = knownActorIds.find(name);
+	if (it != knownActorIds.end())
+		return it->second;
 
 	SQLOK(sqlite3_bind_text(stmt_knownActor_insert, 1, name.c_str(), name.size(), NULL));
 	SQLRES(sqlite3_step(stmt_knownActor_insert), SQLITE_DONE);
@@ -166,12 +215,9 @@ int RollbackManager::getActorId(const std::string &name)
 
 int RollbackManager::getNodeId(const std::string &name)
 {
-	for (std::vector<Entity>::const_iterator iter = knownNodes.begin();
-			iter != knownNodes.end(); ++iter) {
-		if (iter->name == name) {
-			return iter->id;
-		}
-	}
+	auto it = knownNodeIds.find(name);
+	if (it != knownNodeIds.end())
+		return it->second;
 
 	SQLOK(sqlite3_bind_text(stmt_knownNode_insert, 1, name.c_str(), name.size(), NULL));
 	SQLRES(sqlite3_step(stmt_knownNode_insert), SQLITE_DONE);
@@ -186,12 +232,9 @@ int RollbackManager::getNodeId(const std::string &name)
 
 const char * RollbackManager::getActorName(const int id)
 {
-	for (std::vector<Entity>::const_iterator iter = knownActors.begin();
-			iter != knownActors.end(); ++iter) {
-		if (iter->id == id) {
-			return iter->name.c_str();
-		}
-	}
+	auto it = knownActorNames.find(id);
+	if (it != knownActorNames.end())
+		return it->second.c_str();
 
 	return "";
 }
@@ -199,12 +242,9 @@ const char * RollbackManager::getActorName(const int id)
 
 const char * RollbackManager::getNodeName(const int id)
 {
-	for (std::vector<Entity>::const_iterator iter = knownNodes.begin();
-			iter != knownNodes.end(); ++iter) {
-		if (iter->id == id) {
-			return iter->name.c_str();
-		}
-	}
+	auto it = knownNodeNames.find(id);
+	if (it != knownNodeNames.end())
+		return it->second.c_str();
 
 	return "";
 }
@@ -364,8 +404,25 @@ bool RollbackManager::initDatabase()
 	SQLOK(sqlite3_prepare_v2(db, "INSERT INTO `node` (`name`) VALUES (?)",
 			-1, &stmt_knownNode_insert, NULL));
 
+	SQLOK(sqlite3_prepare_v2(db, "BEGIN", -1, &stmt_begin, NULL));
+
+	SQLOK(sqlite3_prepare_v2(db, "COMMIT", -1, &stmt_commit, NULL));
+
 	verbosestream << "SQL prepared statements setup correctly" << std::endl;
 
+	loadKnownIds();
+
+	return needs_create;
+}
+
+
+void RollbackManager::loadKnownIds()
+{
+	knownActorIds.clear();
+	knownActorNames.clear();
+	knownNodeIds.clear();
+	knownNodeNames.clear();
+
 	while (sqlite3_step(stmt_knownActor_select) == SQLITE_ROW) {
 		registerNewActor(
 		        sqlite3_column_int(stmt_knownActor_select, 0),
@@ -381,8 +438,6 @@ bool RollbackManager::initDatabase()
 		);
 	}
 	SQLOK(sqlite3_reset(stmt_knownNode_select));
-
-	return needs_create;
 }
 
 
@@ -687,11 +742,6 @@ void RollbackManager::migrate(const std::string & file_path)
 
 	fh.seekg(0);
 
-	sqlite3_stmt *stmt_begin;
-	sqlite3_stmt *stmt_commit;
-	SQLOK(sqlite3_prepare_v2(db, "BEGIN", -1, &stmt_begin, NULL));
-	SQLOK(sqlite3_prepare_v2(db, "COMMIT", -1, &stmt_commit, NULL));
-
 	std::string bit;
 	int i = 0;
 	time_t start = time(0);
@@ -783,9 +833,6 @@ void RollbackManager::migrate(const std::string & file_path)
 	SQLRES(sqlite3_step(stmt_commit), SQLITE_DONE);
 	sqlite3_reset(stmt_commit);
 
-	SQLOK(sqlite3_finalize(stmt_begin));
-	SQLOK(sqlite3_finalize(stmt_commit));
-
 	std::cout
 		<< " Done: 100%                                  " << std::endl
 		<< "Now you can delete the old rollback.txt file." << std::endl;
@@ -874,76 +921,162 @@ std::string RollbackManager::getSuspect(v3s16 p, float nearness_shortcut,
 	}
 	int cur_time = time(0);
 	time_t first_time = cur_time - (100 - min_nearness);
-	RollbackAction likely_suspect;
-	float likely_suspect_nearness = 0;
-	for (std::list<RollbackAction>::const_reverse_iterator
-	     i = action_latest_buffer.rbegin();
-	     i != action_latest_buffer.rend(); ++i) {
-		if (i->unix_time < first_time) {
-			break;
-		}
-		if (i->actor.empty()) {
-			continue;
-		}
-		// Find position of suspect or continue
-		v3s16 suspect_p;
-		if (!i->getPosition(&suspect_p)) {
+
+	// Collect the recent actions in the cells around p, newest first
+	std::vector<const Suspect *> candidates;
+	v3s16 cell_min = getContainerPos(p - SUSPECT_MAX_DISTANCE, SUSPECT_CELL_SIZE);
+	v3s16 cell_max = getContainerPos(p + SUSPECT_MAX_DISTANCE, SUSPECT_CELL_SIZE);
+	v3s16 cell;
+	for (cell.Z = cell_min.Z; cell.Z <= cell_max.Z; cell.Z++)
+	for (cell.Y = cell_min.Y; cell.Y <= cell_max.Y; cell.Y++)
+	for (cell.X = cell_min.X; cell.X <= cell_max.X; cell.X++) {
+		auto it = m_suspect_cells.find(cell);
+		if (it == m_suspect_cells.end())
 			continue;
+		for (auto i = it->second.rbegin(); i != it->second.rend(); ++i) {
+			if (i->unix_time < first_time)
+				break;
+			candidates.push_back(&*i);
 		}
-		float f = getSuspectNearness(i->actor_is_guess, suspect_p,
-					     i->unix_time, p, cur_time);
+	}
+	std::sort(candidates.begin(), candidates.end(),
+		[] (const Suspect *a, const Suspect *b) { return a->seq > b->seq; });
+
+	const Suspect *likely_suspect = nullptr;
+	float likely_suspect_nearness = 0;
+	for (const Suspect *suspect : candidates) {
+		float f = getSuspectNearness(suspect->is_guess, suspect->p,
+					     suspect->unix_time, p, cur_time);
 		if (f >= min_nearness && f > likely_suspect_nearness) {
 			likely_suspect_nearness = f;
-			likely_suspect = *i;
+			likely_suspect = suspect;
 			if (likely_suspect_nearness >= nearness_shortcut) {
 				break;
 			}
 		}
 	}
 	// No likely suspect was found
-	if (likely_suspect_nearness == 0) {
+	if (!likely_suspect) {
 		return "";
 	}
 	// Likely suspect was found
-	return likely_suspect.actor;
+	return likely_suspect->actor;
 }
 
 
-void RollbackManager::flush()
+void RollbackManager::addSuspect(const RollbackAction &action)
 {
-	sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+	v3s16 p;
+	if (action.actor.empty() || !action.getPosition(&p))
+		return;
 
-	std::list<RollbackAction>::const_iterator iter;
+	pruneSuspects(action.unix_time - SUSPECT_MAX_AGE);
 
-	for (iter  = action_todisk_buffer.begin();
-			iter != action_todisk_buffer.end();
-			++iter) {
-		if (iter->actor.empty()) {
-			continue;
+	v3s16 cell = getContainerPos(p, SUSPECT_CELL_SIZE);
+	Suspect suspect = {m_suspect_seq++, action.unix_time, p,
+		action.actor_is_guess, action.actor};
+	m_suspect_cells[cell].push_back(suspect);
+	m_suspect_timeline.emplace_back(action.unix_time, cell);
+}
+
+
+void RollbackManager::pruneSuspects(time_t first_time)
+{
+	// Every cell is in chronological order, so the oldest action overall is
+	// always at the front of its cell
+	while (!m_suspect_timeline.empty() &&
+			m_suspect_timeline.front().first < first_time) {
+		auto it = m_suspect_cells.find(m_suspect_timeline.front().second);
+		it->second.pop_front();
+		if (it->second.empty())
+			m_suspect_cells.erase(it);
+		m_suspect_timeline.pop_front();
+	}
+}
+
+
+void RollbackManager::writePending()
+{
+	// Hold the database lock while taking the batch so that concurrent
+	// writers commit batches in the order they were queued
+	MutexAutoLock db_lock(m_db_mutex);
+
+	std::vector<RollbackAction> batch;
+	{
+		MutexAutoLock queue_lock(m_queue_mutex);
+		if (action_todisk_buffer.empty())
+			return;
+		batch.reserve(WRITE_BATCH_SIZE);
+		batch.swap(action_todisk_buffer);
+	}
+
+	try {
+		SQLRES(sqlite3_step(stmt_begin), SQLITE_DONE);
+		SQLOK(sqlite3_reset(stmt_begin));
+
+		for (const RollbackAction &action : batch) {
+			if (action.actor.empty()) {
+				continue;
+			}
+
+			registerRow(actionRowFromRollbackAction(action));
 		}
 
-		registerRow(actionRowFromRollbackAction(*iter));
+		SQLRES(sqlite3_step(stmt_commit), SQLITE_DONE);
+		SQLOK(sqlite3_reset(stmt_commit));
+	} catch (...) {
+		// Close the transaction so that the next write can begin a new one
+		if (!sqlite3_get_autocommit(db))
+			SQLOK_ERRSTREAM(sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL),
+				"Failed to roll back a batch of actions");
+		for (sqlite3_stmt *stmt : {stmt_begin, stmt_commit, stmt_insert,
+				stmt_replace, stmt_knownActor_insert, stmt_knownNode_insert})
+			sqlite3_reset(stmt);
+
+		// Requeue the batch in front of the actions queued meanwhile
+		{
+			MutexAutoLock queue_lock(m_queue_mutex);
+			batch.insert(batch.end(), action_todisk_buffer.begin(),
+				action_todisk_buffer.end());
+			action_todisk_buffer.swap(batch);
+		}
+
+		// Actors and nodes inserted by the transaction are gone as well
+		loadKnownIds();
+		throw;
 	}
+}
+
 
-	sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
-	action_todisk_buffer.clear();
+void RollbackManager::flush()
+{
+	writePending();
 }
 
 
 void RollbackManager::addAction(const RollbackAction & action)
 {
-	action_todisk_buffer.push_back(action);
-	action_latest_buffer.push_back(action);
+	addSuspect(action);
 
-	// Flush to disk sometimes
-	if (action_todisk_buffer.size() >= 500) {
+	size_t queued;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		action_todisk_buffer.push_back(action);
+		queued = action_todisk_buffer.size();
+	}
+
+	if (queued >= m_queue_max) {
+		// The write thread can't keep up, write on this thread instead
 		flush();
+	} else if (queued >= WRITE_BATCH_SIZE) {
+		m_write_thread->wakeUp();
 	}
 }
 
 std::list<RollbackAction> RollbackManager::getEntriesSince(time_t first_time)
 {
 	flush();
+	MutexAutoLock lock(m_db_mutex);
 	return getActionsSince(first_time);
 }
 
@@ -954,6 +1087,7 @@ std::list<RollbackAction> RollbackManager::getNodeActors(v3s16 pos, int range,
 	time_t cur_time = time(0);
 	time_t first_time = cur_time - seconds;
 
+	MutexAutoLock lock(m_db_mutex);
 	return getActionsSince_range(first_time, pos, range, limit);
 }
 
@@ -966,6 +1100,6 @@ std::list<RollbackAction> RollbackManager::getRevertActions(
 
 	flush();
 
+	MutexAutoLock lock(m_db_mutex);
 	return getActionsSince(first_time, actor_filter);
 }
-
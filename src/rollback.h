@@ -22,14 +22,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <string>
 #include "irr_v3d.h"
 #include "rollback_interface.h"
+#include <deque>
 #include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include "sqlite3.h"
 
 class IGameDef;
+class RollbackWriteThread;
 
 struct ActionRow;
-struct Entity;
 
 class RollbackManager: public IRollbackManager
 {
@@ -61,6 +65,7 @@ class RollbackManager: public IRollbackManager
 	const char * getNodeName(const int id);
 	bool createTables();
 	bool initDatabase();
+	void loadKnownIds();
 	bool registerRow(const ActionRow & row);
 	const std::list<ActionRow> actionRowsFromSelect(sqlite3_stmt * stmt);
 	ActionRow actionRowFromRollbackAction(const RollbackAction & action);
@@ -78,15 +83,43 @@ class RollbackManager: public IRollbackManager
 	static float getSuspectNearness(bool is_guess, v3s16 suspect_p,
 		time_t suspect_t, v3s16 action_p, time_t action_t);
 
+	// Writes the queued actions in a single transaction. Called by the
+	// write thread and by flush().
+	void writePending();
+	void addSuspect(const RollbackAction &action);
+	void pruneSuspects(time_t first_time);
+
+	friend class RollbackWriteThread;
+
+	struct Suspect {
+		u32 seq;
+		time_t unix_time;
+		v3s16 p;
+		bool is_guess;
+		std::string actor;
+	};
+
 
 	IGameDef *gamedef = nullptr;
 
 	std::string current_actor;
 	bool current_actor_is_guess = false;
 
-	std::list<RollbackAction> action_todisk_buffer;
-	std::list<RollbackAction> action_latest_buffer;
-
+	// Actions waiting to be written to disk, protected by m_queue_mutex
+	std::vector<RollbackAction> action_todisk_buffer;
+	std::mutex m_queue_mutex;
+	u32 m_queue_max;
+	RollbackWriteThread *m_write_thread = nullptr;
+
+	// Recent positioned actions used by getSuspect(), bucketed by cell
+	std::map<v3s16, std::deque<Suspect>> m_suspect_cells;
+	// Cells of all indexed actions in chronological order, for pruning
+	std::deque<std::pair<time_t, v3s16>> m_suspect_timeline;
+	u32 m_suspect_seq = 0;
+
+	// Serializes access to the database, the prepared statements and the
+	// actor/node id caches between the server and the write thread
+	std::mutex m_db_mutex;
 	std::string database_path;
 	sqlite3 * db;
 	sqlite3_stmt * stmt_insert;
@@ -98,7 +131,11 @@ class RollbackManager: public IRollbackManager
 	sqlite3_stmt * stmt_knownActor_insert;
 	sqlite3_stmt * stmt_knownNode_select;
 	sqlite3_stmt * stmt_knownNode_insert;
+	sqlite3_stmt * stmt_begin;
+	sqlite3_stmt * stmt_commit;
 
-	std::vector<Entity> knownActors;
-	std::vector<Entity> knownNodes;
+	std::unordered_map<std::string, int> knownActorIds;
+	std::unordered_map<int, std::string> knownActorNames;
+	std::unordered_map<std::string, int> knownNodeIds;
+	std::unordered_map<int, std::string> knownNodeNames;
 };
@@ -298,8 +298,9 @@ int ModApiEnvMod::l_bulk_set_node(lua_State *L)
 
 	MapNode n = readnode(L, 2, ndef);
 
-	// Do it
+	// Do it, updating the lighting once for all nodes
 	bool succeeded = true;
+	MapLightingBatch lighting(&env->getMap());
 	for (s32 i = 1; i <= len; i++) {
 		lua_rawgeti(L, 1, i);
 		if (!env->setNode(read_v3s16(L, -1), n))
@@ -1245,7 +1246,7 @@ int ModApiEnvMod::l_delete_area(lua_State *L)
 }
 
 // find_path(pos1, pos2, searchdistance,
-//     max_jump, max_drop, algorithm) -> table containing path
+//     max_jump, max_drop, algorithm, max_nodes) -> table containing path
 int ModApiEnvMod::l_find_path(lua_State *L)
 {
 	GET_ENV_PTR;
@@ -1265,9 +1266,12 @@ int ModApiEnvMod::l_find_path(lua_State *L)
 		if (algorithm == "Dijkstra")
 			algo = PA_DIJKSTRA;
 	}
+	unsigned int max_nodes = 0;
+	if (!lua_isnoneornil(L, 7))
+		max_nodes = luaL_checkint(L, 7);
 
 	std::vector<v3s16> path = get_path(&env->getServerMap(), env->getGameDef()->ndef(), pos1, pos2,
-		searchdistance, max_jump, max_drop, algo);
+		searchdistance, max_jump, max_drop, algo, max_nodes);
 
 	if (!path.empty()) {
 		lua_createtable(L, path.size(), 0);
@@ -32,15 +32,16 @@ int ModApiStorage::l_get_mod_storage(lua_State *L)
 
 	std::string mod_name = readParam<std::string>(L, -1);
 
-	ModMetadata *store = new ModMetadata(mod_name);
-	if (IGameDef *gamedef = getGameDef(L)) {
-		store->load(gamedef->getModStoragePath());
-		gamedef->registerModStorage(store);
-	} else {
-		delete store;
+	IGameDef *gamedef = getGameDef(L);
+	if (!gamedef) {
 		assert(false); // this should not happen
+		return 0;
 	}
 
+	// The entries are read on first use
+	ModMetadata *store = new ModMetadata(mod_name, gamedef->getModStorageDatabase());
+	gamedef->registerModStorage(store);
+
 	StorageRef::create(L, store);
 	int object = lua_gettop(L);
 
@@ -130,6 +131,7 @@ ModMetadata* StorageRef::getobject(StorageRef *ref)
 
 Metadata* StorageRef::getmeta(bool auto_create)
 {
+	m_object->load();
 	return m_object;
 }
 
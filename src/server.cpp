@@ -33,6 +33,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "config.h"
 #include "version.h"
 #include "filesys.h"
+#include "gameparams.h"
 #include "mapblock.h"
 #include "server/serveractiveobject.h"
 #include "settings.h"
@@ -60,6 +61,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/sha1.h"
 #include "util/hex.h"
 #include "database/database.h"
+#include "database/database-dummy.h"
+#include "database/database-files.h"
+#include "database/database-sqlite3.h"
+#if USE_POSTGRESQL
+#include "database/database-postgresql.h"
+#endif
+#if USE_LEVELDB
+#include "database/database-leveldb.h"
+#endif
+#if USE_REDIS
+#include "database/database-redis.h"
+#endif
 #include "chatmessage.h"
 #include "chat_interface.h"
 #include "remoteplayer.h"
@@ -263,6 +276,18 @@ Server::Server(
 			"minetest_core_aom_generated_count",
 			"Number of active object messages generated");
 
+	m_aom_deferred_counter = m_metrics_backend->addCounter(
+			"minetest_core_aom_deferred_count",
+			"Number of position updates deferred for distant clients");
+
+	m_liquid_queue_gauge = m_metrics_backend->addGauge(
+			"minetest_core_liquid_queue_length",
+			"Number of liquid nodes waiting to be processed");
+
+	m_liquid_processed_counter = m_metrics_backend->addCounter(
+			"minetest_core_liquid_processed",
+			"Number of liquid nodes processed");
+
 	m_packet_recv_counter = m_metrics_backend->addCounter(
 			"minetest_core_server_packet_recv",
 			"Processable packets received");
@@ -272,6 +297,10 @@ Server::Server(
 			"Valid received packets processed");
 
 	m_lag_gauge->set(g_settings->getFloat("dedicated_server_step"));
+
+	m_aom_fanout.setLod(
+		g_settings->getS16("active_object_send_range_blocks") * MAP_BLOCKSIZE * BS,
+		g_settings->getFloat("active_object_lod_interval"));
 }
 
 Server::~Server()
@@ -348,6 +377,10 @@ Server::~Server()
 	delete m_nodedef;
 	delete m_craftdef;
 
+	// Write the mod storages in one transaction before they are unregistered
+	if (m_mod_storage_database)
+		saveModStorages();
+
 	// Deinitialize scripting
 	infostream << "Server: Deinitializing scripting" << std::endl;
 	delete m_script;
@@ -391,6 +424,8 @@ void Server::init()
 		m_modmgr->printUnsatisfiedModsError();
 	}
 
+	m_mod_storage_database.reset(openModStorageDatabase(m_path_world));
+
 	//lock environment
 	MutexAutoLock envlock(m_env_mutex);
 
@@ -642,7 +677,10 @@ void Server::AsyncRunStep(bool initial_step)
 		ScopeProfiler sp(g_profiler, "Server: liquid transform");
 
 		std::map<v3s16, MapBlock*> modified_blocks;
-		m_env->getMap().transformLiquids(modified_blocks, m_env);
+		Map &map = m_env->getMap();
+		m_liquid_processed_counter->increment(
+			map.transformLiquids(modified_blocks, m_env));
+		m_liquid_queue_gauge->set(map.transforming_liquid_size());
 
 		/*
 			Set the modified blocks unsent for all the clients
@@ -716,14 +754,7 @@ void Server::AsyncRunStep(bool initial_step)
 		m_mod_storage_save_timer -= dtime;
 		if (m_mod_storage_save_timer <= 0.0f) {
 			m_mod_storage_save_timer = g_settings->getFloat("server_map_save_interval");
-			int n = 0;
-			for (std::unordered_map<std::string, ModMetadata *>::const_iterator
-				it = m_mod_storages.begin(); it != m_mod_storages.end(); ++it) {
-				if (it->second->isModified()) {
-					it->second->save(getModStoragePath());
-					n++;
-				}
-			}
+			u32 n = saveModStorages();
 			if (n > 0)
 				infostream << "Saved " << n << " modified mod storages." << std::endl;
 		}
@@ -736,93 +767,43 @@ void Server::AsyncRunStep(bool initial_step)
 		MutexAutoLock envlock(m_env_mutex);
 		ScopeProfiler sp(g_profiler, "Server: send SAO messages");
 
-		// Key = object id
-		// Value = data sent by object
-		std::unordered_map<u16, std::vector<ActiveObjectMessage>*> buffered_messages;
-
 		// Get active object messages from environment
 		ActiveObjectMessage aom(0);
-		u32 aom_count = 0;
-		for(;;) {
-			if (!m_env->getActiveObjectMessage(&aom))
-				break;
+		while (m_env->getActiveObjectMessage(&aom))
+			m_aom_fanout.push(std::move(aom));
 
-			std::vector<ActiveObjectMessage>* message_list = nullptr;
-			auto n = buffered_messages.find(aom.id);
-			if (n == buffered_messages.end()) {
-				message_list = new std::vector<ActiveObjectMessage>;
-				buffered_messages[aom.id] = message_list;
-			} else {
-				message_list = n->second;
-			}
-			message_list->push_back(std::move(aom));
-			aom_count++;
-		}
+		m_aom_buffer_counter->increment(m_aom_fanout.getMessageCount());
 
-		m_aom_buffer_counter->increment(aom_count);
+		m_aom_fanout.prepare([this] (u16 id, u16 *parent_id, v3f *pos) -> bool {
+			ServerActiveObject *sao = m_env->getActiveObject(id);
+			if (!sao)
+				return false;
+			ServerActiveObject *parent = sao->getParent();
+			*parent_id = parent ? parent->getId() : 0;
+			*pos = sao->getBasePosition();
+			return true;
+		}, dtime);
 
 		m_clients.lock();
 		const RemoteClientMap &clients = m_clients.getClientList();
-		// Route data to every client
-		std::string reliable_data, unreliable_data;
 		for (const auto &client_it : clients) {
-			reliable_data.clear();
-			unreliable_data.clear();
 			RemoteClient *client = client_it.second;
 			PlayerSAO *player = getPlayerSAO(client->peer_id);
-			// Go through all objects in message buffer
-			for (const auto &buffered_message : buffered_messages) {
-				// If object does not exist or is not known by client, skip it
-				u16 id = buffered_message.first;
-				ServerActiveObject *sao = m_env->getActiveObject(id);
-				if (!sao || client->m_known_objects.find(id) == client->m_known_objects.end())
-					continue;
-
-				// Get message list of object
-				std::vector<ActiveObjectMessage>* list = buffered_message.second;
-				// Go through every message
-				for (const ActiveObjectMessage &aom : *list) {
-					// Send position updates to players who do not see the attachment
-					if (aom.datastring[0] == AO_CMD_UPDATE_POSITION) {
-						if (sao->getId() == player->getId())
-							continue;
-
-						// Do not send position updates for attached players
-						// as long the parent is known to the client
-						ServerActiveObject *parent = sao->getParent();
-						if (parent && client->m_known_objects.find(parent->getId()) !=
-								client->m_known_objects.end())
-							continue;
-					}
-
-					// Add full new data to appropriate buffer
-					std::string &buffer = aom.reliable ? reliable_data : unreliable_data;
-					char idbuf[2];
-					writeU16((u8*) idbuf, aom.id);
-					// u16 id
-					// std::string data
-					buffer.append(idbuf, sizeof(idbuf));
-					buffer.append(serializeString16(aom.datastring));
-				}
-			}
-			/*
-				reliable_data and unreliable_data are now ready.
-				Send them.
-			*/
-			if (!reliable_data.empty()) {
-				SendActiveObjectMessages(client->peer_id, reliable_data);
-			}
-
-			if (!unreliable_data.empty()) {
-				SendActiveObjectMessages(client->peer_id, unreliable_data, false);
+			if (player) {
+				m_aom_fanout.addPeer(client->peer_id, player->getId(),
+					player->getBasePosition(), &client->m_known_objects);
+			} else {
+				m_aom_fanout.addPeer(client->peer_id, 0, v3f(),
+					&client->m_known_objects);
 			}
 		}
-		m_clients.unlock();
 
-		// Clear buffered_messages
-		for (auto &buffered_message : buffered_messages) {
-			delete buffered_message.second;
-		}
+		m_aom_fanout.route([this] (session_t peer_id, const std::string &data,
+				bool reliable) {
+			SendActiveObjectMessages(peer_id, data, reliable);
+		});
+		m_clients.unlock();
+		m_aom_deferred_counter->increment(m_aom_fanout.getDeferredCount());
 	}
 
 	/*
@@ -1474,7 +1455,8 @@ void Server::SendInventory(PlayerSAO *sao, bool incremental)
 	NetworkPacket pkt(TOCLIENT_INVENTORY, 0, sao->getPeerID());
 
 	std::ostringstream os(std::ios::binary);
-	sao->getInventory()->serialize(os, incremental);
+	sao->getInventory()->serialize(os, incremental,
+		player->protocol_version >= 40);
 	sao->getInventory()->setModified(false);
 	player->setModified(true);
 
@@ -2681,28 +2663,56 @@ void Server::SendMinimapModes(session_t peer_id,
 
 void Server::sendDetachedInventory(Inventory *inventory, const std::string &name, session_t peer_id)
 {
-	NetworkPacket pkt(TOCLIENT_DETACHED_INVENTORY, 0, peer_id);
-	pkt << name;
+	// Clients before protocol version 40 only read the text format
+	auto make_packet = [&] (NetworkPacket &pkt, bool binary) {
+		pkt << name;
+
+		if (!inventory) {
+			pkt << false; // Remove inventory
+			return;
+		}
 
-	if (!inventory) {
-		pkt << false; // Remove inventory
-	} else {
 		pkt << true; // Update inventory
 
 		// Serialization & NetworkPacket isn't a love story
 		std::ostringstream os(std::ios_base::binary);
-		inventory->serialize(os);
-		inventory->setModified(false);
+		inventory->serialize(os, false, binary);
 
 		const std::string &os_str = os.str();
 		pkt << static_cast<u16>(os_str.size()); // HACK: to keep compatibility with 5.0.0 clients
 		pkt.putRawString(os_str);
-	}
+	};
 
-	if (peer_id == PEER_ID_INEXISTENT)
-		m_clients.sendToAll(&pkt);
-	else
+	NetworkPacket pkt(TOCLIENT_DETACHED_INVENTORY, 0, peer_id);
+	if (peer_id != PEER_ID_INEXISTENT) {
+		make_packet(pkt, m_clients.getProtocolVersion(peer_id) >= 40);
 		Send(&pkt);
+	} else {
+		make_packet(pkt, true);
+
+		// Only build the legacy packet when a client needs it
+		m_clients.lock();
+		bool has_legacy_client = false;
+		for (const auto &client_it : m_clients.getClientList()) {
+			u16 version = client_it.second->net_proto_version;
+			if (version != 0 && version < 40) {
+				has_legacy_client = true;
+				break;
+			}
+		}
+
+		if (has_legacy_client) {
+			NetworkPacket legacy_pkt(TOCLIENT_DETACHED_INVENTORY, 0, peer_id);
+			make_packet(legacy_pkt, false);
+			m_clients.sendToAllCompat(&pkt, &legacy_pkt, 40);
+		} else {
+			m_clients.sendToAll(&pkt);
+		}
+		m_clients.unlock();
+	}
+
+	if (inventory)
+		inventory->setModified(false);
 }
 
 void Server::sendDetachedInventories(session_t peer_id, bool incremental)
@@ -3609,11 +3619,6 @@ std::string Server::getBuiltinLuaPath()
 	return porting::path_share + DIR_DELIM + "builtin";
 }
 
-std::string Server::getModStoragePath() const
-{
-	return m_path_world + DIR_DELIM + "mod_storage";
-}
-
 v3f Server::findSpawnPos()
 {
 	ServerMap &map = m_env->getServerMap();
@@ -3778,12 +3783,190 @@ void Server::unregisterModStorage(const std::string &name)
 {
 	std::unordered_map<std::string, ModMetadata *>::const_iterator it = m_mod_storages.find(name);
 	if (it != m_mod_storages.end()) {
-		// Save unconditionaly on unregistration
-		it->second->save(getModStoragePath());
+		if (it->second->isModified()) {
+			m_mod_storage_database->beginSave();
+			it->second->save();
+			m_mod_storage_database->endSave();
+		}
 		m_mod_storages.erase(name);
 	}
 }
 
+u32 Server::saveModStorages()
+{
+	u32 n = 0;
+	for (const auto &it : m_mod_storages) {
+		if (!it.second->isModified())
+			continue;
+		if (n++ == 0)
+			m_mod_storage_database->beginSave();
+		it.second->save();
+	}
+	if (n > 0)
+		m_mod_storage_database->endSave();
+	return n;
+}
+
+ModMetadataDatabase *Server::openModStorageDatabase(const std::string &world_path)
+{
+	std::string world_mt_path = world_path + DIR_DELIM + "world.mt";
+	Settings world_mt;
+	if (!world_mt.readConfigFile(world_mt_path.c_str()))
+		throw BaseException("Cannot read world.mt!");
+
+	std::string backend = "files";
+	if (world_mt.exists("mod_storage_backend")) {
+		backend = world_mt.get("mod_storage_backend");
+	} else {
+		// Worlds from before the mod storage database keep their files
+		world_mt.set("mod_storage_backend", backend);
+		if (!world_mt.updateConfigFile(world_mt_path.c_str())) {
+			errorstream << "Server::openModStorageDatabase(): "
+					<< "Failed to update world.mt!" << std::endl;
+		}
+	}
+
+	if (backend == "files") {
+		warningstream << "/!\\ You are using the old mod storage files backend. "
+				<< "This backend writes the whole storage of a mod on every "
+				<< "change /!\\" << std::endl << "Switching to SQLite3 is advised, "
+				<< "use --migrate-mod-storage sqlite3." << std::endl;
+	}
+
+	return openModStorageDatabase(backend, world_path, world_mt);
+}
+
+ModMetadataDatabase *Server::openModStorageDatabase(const std::string &backend,
+		const std::string &world_path, Settings &world_mt)
+{
+	if (backend == "sqlite3")
+		return new ModMetadataDatabaseSQLite3(world_path);
+
+	if (backend == "dummy")
+		return new Database_Dummy();
+
+#if USE_POSTGRESQL
+	if (backend == "postgresql") {
+		std::string connect_string;
+		world_mt.getNoEx("pgsql_mod_storage_connection", connect_string);
+		return new ModMetadataDatabasePostgreSQL(connect_string);
+	}
+#endif
+
+#if USE_LEVELDB
+	if (backend == "leveldb")
+		return new ModMetadataDatabaseLevelDB(world_path);
+#endif
+
+#if USE_REDIS
+	if (backend == "redis")
+		return new ModMetadataDatabaseRedis(world_mt);
+#endif
+
+	if (backend == "files")
+		return new ModMetadataDatabaseFiles(world_path + DIR_DELIM + "mod_storage");
+
+	throw BaseException(std::string("Database backend ") + backend + " not supported.");
+}
+
+bool Server::migrateModStorageDatabase(const GameParams &game_params,
+		const Settings &cmd_args)
+{
+	std::string migrate_to = cmd_args.get("migrate-mod-storage");
+	Settings world_mt;
+	std::string world_mt_path = game_params.world_path + DIR_DELIM + "world.mt";
+	if (!world_mt.readConfigFile(world_mt_path.c_str())) {
+		errorstream << "Cannot read world.mt!" << std::endl;
+		return false;
+	}
+
+	std::string backend = "files";
+	if (world_mt.exists("mod_storage_backend"))
+		backend = world_mt.get("mod_storage_backend");
+	else
+		warningstream << "No mod_storage_backend found in world.mt, "
+				"assuming \"files\"." << std::endl;
+
+	if (backend == migrate_to) {
+		errorstream << "Cannot migrate: new backend is same"
+				<< " as the old one" << std::endl;
+		return false;
+	}
+
+	try {
+		const std::unique_ptr<ModMetadataDatabase> srcdb(openModStorageDatabase(
+				backend, game_params.world_path, world_mt));
+		const std::unique_ptr<ModMetadataDatabase> dstdb(openModStorageDatabase(
+				migrate_to, game_params.world_path, world_mt));
+
+		std::vector<std::string> mod_list;
+		srcdb->listMods(&mod_list);
+		u32 failed = 0;
+		bool write_failed = false;
+		dstdb->beginSave();
+		for (const std::string &modname : mod_list) {
+			actionstream << "Migrating storage of mod " << modname << std::endl;
+			StringMap meta;
+			if (!srcdb->getModEntries(modname, &meta)) {
+				errorstream << "Failed to read storage of mod " << modname << std::endl;
+				failed++;
+				continue;
+			}
+			for (const auto &entry : meta) {
+				if (!dstdb->setModEntry(modname, entry.first, entry.second)) {
+					write_failed = true;
+					break;
+				}
+			}
+			if (write_failed) {
+				errorstream << "Failed to write storage of mod " << modname << std::endl;
+				break;
+			}
+		}
+		dstdb->endSave();
+
+		if (write_failed) {
+			// Keep using the old backend, nothing is lost
+			errorstream << "Migration aborted" << std::endl;
+			return false;
+		}
+
+		if (failed > 0) {
+			// Keep using the old backend, nothing is lost
+			errorstream << "Failed to migrate " << failed << " of "
+					<< mod_list.size() << " mod storages" << std::endl;
+			return false;
+		}
+
+		actionstream << "Successfully migrated " << mod_list.size()
+				<< " mod storages" << std::endl;
+		world_mt.set("mod_storage_backend", migrate_to);
+		if (!world_mt.updateConfigFile(world_mt_path.c_str()))
+			errorstream << "Failed to update world.mt!" << std::endl;
+		else
+			actionstream << "world.mt updated" << std::endl;
+
+		if (backend == "files") {
+			// Like auth.txt, keep the old files as a backup
+			std::string storage_path = game_params.world_path + DIR_DELIM + "mod_storage";
+			std::string backup_path = storage_path + ".bak";
+			if (fs::PathExists(storage_path) && !fs::PathExists(backup_path)) {
+				if (fs::Rename(storage_path, backup_path))
+					actionstream << "Renamed mod_storage to mod_storage.bak"
+							<< std::endl;
+				else
+					errorstream << "Could not rename mod_storage to "
+							"mod_storage.bak" << std::endl;
+			}
+		}
+
+	} catch (BaseException &e) {
+		errorstream << "An error occurred during migration: " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
 void dedicated_server_loop(Server &server, bool &kill)
 {
 	verbosestream<<"dedicated_server_loop()"<<std::endl;
@@ -38,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "serverenvironment.h"
 #include "clientiface.h"
 #include "chatmessage.h"
+#include "server/activeobjectfanout.h"
 #include "translation.h"
 #include <string>
 #include <list>
@@ -71,6 +72,8 @@ struct StarParams;
 class ServerThread;
 class ServerModManager;
 class ServerInventoryManager;
+class ModMetadataDatabase;
+struct GameParams;
 
 enum ClientDeletionReason {
 	CDR_LEAVE,
@@ -277,7 +280,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void getModNames(std::vector<std::string> &modlist);
 	std::string getBuiltinLuaPath();
 	virtual std::string getWorldPath() const { return m_path_world; }
-	virtual std::string getModStoragePath() const;
+	virtual ModMetadataDatabase *getModStorageDatabase()
+	{ return m_mod_storage_database.get(); }
 
 	inline bool isSingleplayer()
 			{ return m_simple_singleplayer_mode; }
@@ -348,6 +352,13 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	virtual bool registerModStorage(ModMetadata *storage);
 	virtual void unregisterModStorage(const std::string &name);
 
+	// Opens the backend configured in world.mt, "files" if there is none
+	static ModMetadataDatabase *openModStorageDatabase(const std::string &world_path);
+	static ModMetadataDatabase *openModStorageDatabase(const std::string &backend,
+			const std::string &world_path, Settings &world_mt);
+	static bool migrateModStorageDatabase(const GameParams &game_params,
+			const Settings &cmd_args);
+
 	bool joinModChannel(const std::string &channel);
 	bool leaveModChannel(const std::string &channel);
 	bool sendModChannelMessage(const std::string &channel, const std::string &message);
@@ -367,6 +378,7 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 
 private:
 	friend class EmergeThread;
+	friend class MapgenBenchmark;
 	friend class RemoteClient;
 	friend class TestServerShutdownState;
 
@@ -648,6 +660,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	s32 m_next_sound_id = 0; // positive values only
 	s32 nextSoundId();
 
+	// Writes the changed entries of all mod storages in one transaction.
+	// Returns the number of changed storages.
+	u32 saveModStorages();
+
+	std::unique_ptr<ModMetadataDatabase> m_mod_storage_database;
 	std::unordered_map<std::string, ModMetadata *> m_mod_storages;
 	float m_mod_storage_save_timer = 10.0f;
 
@@ -661,6 +678,9 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Inventory manager
 	std::unique_ptr<ServerInventoryManager> m_inventory_mgr;
 
+	// Routes active object messages to the clients, reused every step
+	ActiveObjectFanout m_aom_fanout;
+
 	// Global server metrics backend
 	std::unique_ptr<MetricsBackend> m_metrics_backend;
 
@@ -671,6 +691,9 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// current server step lag
 	MetricGaugePtr m_lag_gauge;
 	MetricCounterPtr m_aom_buffer_counter;
+	MetricCounterPtr m_aom_deferred_counter;
+	MetricGaugePtr m_liquid_queue_gauge;
+	MetricCounterPtr m_liquid_processed_counter;
 	MetricCounterPtr m_packet_recv_counter;
 	MetricCounterPtr m_packet_recv_processed_counter;
 };
@@ -0,0 +1,391 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "activeobjectfanout.h"
+#include "unit_sao.h"
+#include "util/serialize.h"
+
+// Deferred state of objects and peers that are gone is dropped this often
+#define LOD_PRUNE_INTERVAL 10.0f
+
+static inline bool is_position_update(const std::string &data)
+{
+	return !data.empty() && data[0] == AO_CMD_UPDATE_POSITION;
+}
+
+static void serialize_message(std::string &dst, u16 id, const std::string &data)
+{
+	char idbuf[2];
+	writeU16((u8 *)idbuf, id);
+	// u16 id
+	// std::string data
+	dst.append(idbuf, sizeof(idbuf));
+	dst.append(serializeString16(data));
+}
+
+ActiveObjectFanout::ActiveObjectFanout() :
+	m_object_index(U16_MAX + 1, -1)
+{
+}
+
+void ActiveObjectFanout::setLod(f32 send_range, f32 max_interval)
+{
+	m_lod_enabled = send_range > 0.0f && max_interval > 0.0f;
+	m_band_size = send_range / ACTIVEOBJECT_LOD_BANDS;
+	for (u8 band = 0; band < ACTIVEOBJECT_LOD_BANDS; band++) {
+		m_band_interval[band] = max_interval * 1000.0f * band /
+			(ACTIVEOBJECT_LOD_BANDS - 1);
+	}
+	if (!m_lod_enabled) {
+		m_positions.clear();
+		m_peer_lod.clear();
+	}
+}
+
+u8 ActiveObjectFanout::getBand(const v3f &a, const v3f &b) const
+{
+	f32 band = a.getDistanceFrom(b) / m_band_size;
+	if (band >= ACTIVEOBJECT_LOD_BANDS - 1)
+		return ACTIVEOBJECT_LOD_BANDS - 1;
+	return band;
+}
+
+void ActiveObjectFanout::cachePosition(const Object &obj, const std::string &data)
+{
+	CachedPosition &cached = m_positions[obj.id];
+	cached.pos = obj.pos;
+	cached.data[0].clear();
+	serialize_message(cached.data[0], obj.id, data);
+
+	// Distant bands get the update less often, so the client should take
+	// longer to interpolate to the new position
+	ObjectPositionUpdate update;
+	bool parsed = update.deSerialize(data);
+	f32 update_interval = update.update_interval;
+
+	for (u8 band = 1; band < ACTIVEOBJECT_LOD_BANDS; band++) {
+		cached.data[band].clear();
+		f32 interval = m_band_interval[band] / 1000.0f;
+		if (parsed && interval > update_interval) {
+			update.update_interval = interval;
+			serialize_message(cached.data[band], obj.id, update.serialize());
+		} else {
+			cached.data[band] = cached.data[0];
+		}
+	}
+}
+
+void ActiveObjectFanout::push(ActiveObjectMessage &&aom)
+{
+	s32 &index = m_object_index[aom.id];
+	if (index < 0) {
+		index = m_objects.size();
+		m_objects.emplace_back();
+		m_objects.back().id = aom.id;
+	}
+	Object &obj = m_objects[index];
+	u8 channel = aom.reliable ? 1 : 0;
+	s32 msg_index = m_messages.size();
+
+	// A newer position update on the same channel supersedes the last one
+	if (is_position_update(aom.datastring)) {
+		s32 &last = obj.last_position[channel];
+		if (last >= 0) {
+			m_messages[last].dropped = true;
+			m_coalesced_count++;
+		}
+		last = msg_index;
+	}
+
+	m_messages.emplace_back();
+	Message &msg = m_messages.back();
+	msg.data = std::move(aom.datastring);
+	msg.reliable = aom.reliable;
+
+	if (obj.last_message >= 0)
+		m_messages[obj.last_message].next = msg_index;
+	else
+		obj.first_message = msg_index;
+	obj.last_message = msg_index;
+	m_message_count++;
+}
+
+void ActiveObjectFanout::prepare(const ObjectLookup &lookup, f32 dtime)
+{
+	m_time += dtime * 1000.0f;
+	m_step++;
+
+	m_prune_timer += dtime;
+	if (m_prune_timer >= LOD_PRUNE_INTERVAL) {
+		m_prune_timer = 0.0f;
+		u16 parent_id;
+		v3f pos;
+		for (auto it = m_positions.begin(); it != m_positions.end();) {
+			if (lookup(it->first, &parent_id, &pos))
+				++it;
+			else
+				it = m_positions.erase(it);
+		}
+	}
+
+	for (Object &obj : m_objects) {
+		obj.alive = lookup(obj.id, &obj.parent_id, &obj.pos);
+		if (!obj.alive)
+			continue;
+
+		for (u8 channel = 0; channel < 2; channel++) {
+			std::string &buffer = m_buffers[channel];
+			Range &range = obj.ranges[channel];
+			range.begin = buffer.size();
+			range.pos_begin = range.pos_end = range.begin;
+
+			for (s32 i = obj.first_message; i >= 0; i = m_messages[i].next) {
+				const Message &msg = m_messages[i];
+				if (msg.dropped || msg.reliable != (channel == 1))
+					continue;
+
+				bool is_position = i == obj.last_position[channel];
+				if (is_position)
+					range.pos_begin = buffer.size();
+				serialize_message(buffer, obj.id, msg.data);
+				if (is_position)
+					range.pos_end = buffer.size();
+			}
+			range.end = buffer.size();
+		}
+
+		if (m_lod_enabled && obj.last_position[0] >= 0) {
+			cachePosition(obj, m_messages[obj.last_position[0]].data);
+			obj.cached = &m_positions[obj.id];
+		}
+	}
+}
+
+void ActiveObjectFanout::addPeer(session_t peer_id, u16 player_id,
+		const v3f &pos, const std::set<u16> *known_objects)
+{
+	if (m_peer_count == m_peers.size())
+		m_peers.emplace_back();
+
+	u32 peer_index = m_peer_count++;
+	Peer &peer = m_peers[peer_index];
+	peer.peer_id = peer_id;
+	peer.player_id = player_id;
+	peer.pos = pos;
+	peer.known_objects = known_objects;
+	peer.lod = nullptr;
+
+	// Peers without an object of their own have no position to measure from
+	if (m_lod_enabled && player_id != 0) {
+		peer.lod = &m_peer_lod[peer_id];
+		peer.lod->last_step = m_step;
+
+		// Forget objects the peer no longer knows
+		std::unordered_map<u16, ObjectLod> &objects = peer.lod->objects;
+		if (objects.size() > 2 * known_objects->size() + 64) {
+			for (auto it = objects.begin(); it != objects.end();) {
+				if (known_objects->find(it->first) == known_objects->end())
+					it = objects.erase(it);
+				else
+					++it;
+			}
+		}
+	}
+
+	// Walk whichever side is smaller
+	if (known_objects->size() < m_objects.size()) {
+		for (u16 id : *known_objects) {
+			s32 index = m_object_index[id];
+			if (index >= 0 && m_objects[index].alive)
+				m_pairs.emplace_back(index, peer_index);
+		}
+	} else {
+		for (u32 i = 0; i < m_objects.size(); i++) {
+			if (m_objects[i].alive &&
+					known_objects->find(m_objects[i].id) != known_objects->end())
+				m_pairs.emplace_back(i, peer_index);
+		}
+	}
+}
+
+void ActiveObjectFanout::appendRange(std::string &dst, const std::string &src,
+		const Range &range, bool skip_position)
+{
+	if (!skip_position) {
+		dst.append(src, range.begin, range.end - range.begin);
+		return;
+	}
+	dst.append(src, range.begin, range.pos_begin - range.begin);
+	dst.append(src, range.pos_end, range.end - range.pos_end);
+}
+
+void ActiveObjectFanout::sendPosition(Peer &peer, u16 id, const Object &obj)
+{
+	std::string &dst = peer.data[0];
+	u8 band = getBand(peer.pos, obj.pos);
+	if (band == 0) {
+		dst.append(obj.cached->data[0]);
+		auto it = peer.lod->objects.find(id);
+		if (it != peer.lod->objects.end()) {
+			it->second.last_sent = m_time;
+			it->second.pending = false;
+		}
+		return;
+	}
+
+	auto res = peer.lod->objects.emplace(id, ObjectLod());
+	ObjectLod &lod = res.first->second;
+	if (res.second || m_time - lod.last_sent >= m_band_interval[band]) {
+		dst.append(obj.cached->data[band]);
+		lod.last_sent = m_time;
+		lod.pending = false;
+		return;
+	}
+
+	m_deferred_count++;
+	if (!lod.pending) {
+		lod.pending = true;
+		peer.lod->pending.push_back(id);
+	}
+}
+
+void ActiveObjectFanout::sendPending(Peer &peer)
+{
+	std::vector<u16> &pending = peer.lod->pending;
+	size_t kept = 0;
+	for (u16 id : pending) {
+		auto it = peer.lod->objects.find(id);
+		if (it == peer.lod->objects.end() || !it->second.pending)
+			continue;
+
+		ObjectLod &lod = it->second;
+		auto cached = m_positions.find(id);
+		if (cached == m_positions.end() ||
+				peer.known_objects->find(id) == peer.known_objects->end()) {
+			lod.pending = false;
+			continue;
+		}
+
+		u8 band = getBand(peer.pos, cached->second.pos);
+		if (m_time - lod.last_sent < m_band_interval[band]) {
+			pending[kept++] = id;
+			continue;
+		}
+
+		peer.data[0].append(cached->second.data[band]);
+		lod.last_sent = m_time;
+		lod.pending = false;
+	}
+	pending.resize(kept);
+}
+
+void ActiveObjectFanout::route(const SendCallback &send)
+{
+	m_deferred_count = 0;
+
+	// Invert the (object, peer) pairs into object -> peers
+	m_interest_start.assign(m_objects.size() + 1, 0);
+	for (const auto &pair : m_pairs)
+		m_interest_start[pair.first + 1]++;
+	for (u32 i = 0; i < m_objects.size(); i++)
+		m_interest_start[i + 1] += m_interest_start[i];
+
+	m_interests.resize(m_pairs.size());
+	{
+		std::vector<u32> fill(m_interest_start.begin(), m_interest_start.end() - 1);
+		for (const auto &pair : m_pairs)
+			m_interests[fill[pair.first]++] = pair.second;
+	}
+
+	// Fan every object's serialized messages out to its peers
+	for (u32 i = 0; i < m_objects.size(); i++) {
+		const Object &obj = m_objects[i];
+		bool has_position[2] = {
+			obj.ranges[0].pos_end > obj.ranges[0].pos_begin,
+			obj.ranges[1].pos_end > obj.ranges[1].pos_begin
+		};
+
+		for (u32 k = m_interest_start[i]; k < m_interest_start[i + 1]; k++) {
+			Peer &peer = m_peers[m_interests[k]];
+
+			// Position updates are not sent to the player itself, nor for
+			// attached objects as long as the parent is known to the client
+			bool skip_position = false;
+			if (has_position[0] || has_position[1]) {
+				skip_position = obj.id == peer.player_id ||
+					(obj.parent_id != 0 && peer.known_objects->find(obj.parent_id) !=
+						peer.known_objects->end());
+			}
+
+			if (skip_position || !obj.cached || !peer.lod) {
+				for (u8 channel = 0; channel < 2; channel++) {
+					appendRange(peer.data[channel], m_buffers[channel],
+						obj.ranges[channel], skip_position);
+				}
+				continue;
+			}
+
+			appendRange(peer.data[1], m_buffers[1], obj.ranges[1], false);
+			appendRange(peer.data[0], m_buffers[0], obj.ranges[0], true);
+			sendPosition(peer, obj.id, obj);
+		}
+	}
+
+	for (u32 i = 0; i < m_peer_count; i++) {
+		Peer &peer = m_peers[i];
+		if (peer.lod)
+			sendPending(peer);
+		if (!peer.data[1].empty())
+			send(peer.peer_id, peer.data[1], true);
+		if (!peer.data[0].empty())
+			send(peer.peer_id, peer.data[0], false);
+	}
+
+	// Forget peers that are gone
+	for (auto it = m_peer_lod.begin(); it != m_peer_lod.end();) {
+		if (it->second.last_step != m_step)
+			it = m_peer_lod.erase(it);
+		else
+			++it;
+	}
+
+	reset();
+}
+
+void ActiveObjectFanout::reset()
+{
+	for (const Object &obj : m_objects)
+		m_object_index[obj.id] = -1;
+	m_objects.clear();
+	m_messages.clear();
+	m_buffers[0].clear();
+	m_buffers[1].clear();
+
+	// Keep the peers' buffers allocated for the next step
+	for (u32 i = 0; i < m_peer_count; i++) {
+		m_peers[i].data[0].clear();
+		m_peers[i].data[1].clear();
+		m_peers[i].known_objects = nullptr;
+	}
+	m_peer_count = 0;
+	m_pairs.clear();
+
+	m_message_count = 0;
+	m_coalesced_count = 0;
+}
@@ -0,0 +1,186 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "activeobject.h"
+#include "irr_v3d.h"
+#include "network/networkprotocol.h"
+
+/*
+	Routes the active object messages of one server step to the clients.
+
+	Every message is serialized only once into a shared buffer. Peers are then
+	matched with the objects they know through an inverted index (object ->
+	interested peers), and each peer's packet is assembled by copying the
+	preserialized byte ranges. Within a step only the last position update of
+	an object is sent, as it supersedes the earlier ones.
+
+	With level of detail enabled, unreliable position updates of distant
+	objects are sent less often. The distance to the peer selects one of
+	ACTIVEOBJECT_LOD_BANDS bands, each covering an equal part of the send
+	range, and an update is only sent once the band's interval has passed
+	since the last one. Deferred updates are sent later with the latest
+	position, and their interpolation interval is stretched to match, so
+	clients keep moving the object smoothly.
+
+	Usage per step: push() all messages, prepare(), addPeer() for every
+	client and finally route().
+*/
+#define ACTIVEOBJECT_LOD_BANDS 4
+
+class ActiveObjectFanout
+{
+public:
+	// Returns false if the object is gone, otherwise sets the parent ID
+	// (0 if the object isn't attached) and the position
+	typedef std::function<bool(u16 id, u16 *parent_id, v3f *pos)> ObjectLookup;
+	typedef std::function<void(session_t peer_id, const std::string &data,
+			bool reliable)> SendCallback;
+
+	ActiveObjectFanout();
+
+	// send_range is the distance up to which objects are sent to peers.
+	// A max_interval of 0 disables level of detail.
+	void setLod(f32 send_range, f32 max_interval);
+
+	void push(ActiveObjectMessage &&aom);
+
+	// Drops messages of objects that are gone and serializes the others
+	void prepare(const ObjectLookup &lookup, f32 dtime);
+
+	// known_objects must stay valid until route() returns.
+	// player_id is the ID of the peer's own object or 0.
+	void addPeer(session_t peer_id, u16 player_id, const v3f &pos,
+			const std::set<u16> *known_objects);
+
+	// Calls send for every peer with data, then resets for the next step
+	void route(const SendCallback &send);
+
+	u32 getMessageCount() const { return m_message_count; }
+	u32 getCoalescedCount() const { return m_coalesced_count; }
+	u32 getObjectCount() const { return m_objects.size(); }
+	// Position updates deferred by level of detail in the last route()
+	u32 getDeferredCount() const { return m_deferred_count; }
+
+private:
+	// Byte ranges of one object in one of the shared buffers. The position
+	// update, if any, is [pos_begin, pos_end) and can be skipped per peer.
+	struct Range {
+		u32 begin = 0;
+		u32 end = 0;
+		u32 pos_begin = 0;
+		u32 pos_end = 0;
+	};
+
+	// Latest unreliable position update of an object, serialized for every
+	// band. Kept across steps to send deferred updates.
+	struct CachedPosition {
+		v3f pos;
+		std::string data[ACTIVEOBJECT_LOD_BANDS];
+	};
+
+	struct Object {
+		u16 id;
+		u16 parent_id = 0;
+		v3f pos;
+		// Linked list of messages through Message::next
+		s32 first_message = -1;
+		s32 last_message = -1;
+		// Last position update per channel, for coalescing
+		s32 last_position[2] = {-1, -1};
+		Range ranges[2];
+		// Set if level of detail applies to the position update
+		CachedPosition *cached = nullptr;
+		bool alive = true;
+	};
+
+	struct Message {
+		std::string data;
+		s32 next = -1;
+		bool reliable;
+		bool dropped = false;
+	};
+
+	struct ObjectLod {
+		u64 last_sent = 0;
+		bool pending = false;
+	};
+
+	// Level of detail state of a peer, kept across steps
+	struct PeerLod {
+		std::unordered_map<u16, ObjectLod> objects;
+		// Objects with a deferred position update
+		std::vector<u16> pending;
+		u64 last_step = 0;
+	};
+
+	struct Peer {
+		session_t peer_id;
+		u16 player_id;
+		v3f pos;
+		const std::set<u16> *known_objects;
+		PeerLod *lod;
+		std::string data[2];
+	};
+
+	void appendRange(std::string &dst, const std::string &src,
+			const Range &range, bool skip_position);
+	u8 getBand(const v3f &a, const v3f &b) const;
+	void cachePosition(const Object &obj, const std::string &data);
+	void sendPosition(Peer &peer, u16 id, const Object &obj);
+	void sendPending(Peer &peer);
+	void reset();
+
+	// Object ID -> index in m_objects, or -1
+	std::vector<s32> m_object_index;
+	std::vector<Object> m_objects;
+	std::vector<Message> m_messages;
+	// Serialized messages, indexed by reliable
+	std::string m_buffers[2];
+
+	std::vector<Peer> m_peers;
+	u32 m_peer_count = 0;
+	// Inverted index in CSR layout: the peers interested in object i are
+	// m_interests[m_interest_start[i] .. m_interest_start[i + 1])
+	std::vector<u32> m_interest_start;
+	std::vector<u32> m_interests;
+	// (object, peer) pairs in peer order, before being inverted
+	std::vector<std::pair<u32, u32>> m_pairs;
+
+	bool m_lod_enabled = false;
+	f32 m_band_size = 0.0f;
+	// Minimum time between position updates per band, in milliseconds
+	u32 m_band_interval[ACTIVEOBJECT_LOD_BANDS] = {};
+	// Time since creation in milliseconds
+	u64 m_time = 0;
+	u64 m_step = 0;
+	f32 m_prune_timer = 0.0f;
+	std::unordered_map<u16, CachedPosition> m_positions;
+	std::unordered_map<session_t, PeerLod> m_peer_lod;
+
+	u32 m_message_count = 0;
+	u32 m_coalesced_count = 0;
+	u32 m_deferred_count = 0;
+};
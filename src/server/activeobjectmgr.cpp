@@ -50,6 +50,13 @@ void ActiveObjectMgr::step(
 	}
 }
 
+void ActiveObjectMgr::getAllObjects(std::vector<ServerActiveObject *> &result) const
+{
+	result.reserve(result.size() + m_active_objects.size());
+	for (const auto &ao_it : m_active_objects)
+		result.push_back(ao_it.second);
+}
+
 // clang-format off
 bool ActiveObjectMgr::registerObject(ServerActiveObject *obj)
 {
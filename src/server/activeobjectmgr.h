@@ -39,6 +39,8 @@ class ActiveObjectMgr : public ::ActiveObjectMgr<ServerActiveObject>
 			std::vector<ServerActiveObject *> &result,
 			std::function<bool(ServerActiveObject *obj)> include_obj_cb);
 
+	void getAllObjects(std::vector<ServerActiveObject *> &result) const;
+
 	void getAddedActiveObjectsAroundPos(const v3f &player_pos, f32 radius,
 			f32 player_radius, std::set<u16> &current_objects,
 			std::queue<u16> &added_objects);
@@ -133,63 +133,15 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 
 	m_last_sent_position_timer += dtime;
 
-	collisionMoveResult moveresult, *moveresult_p = nullptr;
-
-	// Each frame, parent position is copied if the object is attached, otherwise it's calculated normally
-	// If the object gets detached this comes into effect automatically from the last known origin
-	if(isAttached())
-	{
-		v3f pos = m_env->getActiveObject(m_attachment_parent_id)->getBasePosition();
-		m_base_position = pos;
-		m_velocity = v3f(0,0,0);
-		m_acceleration = v3f(0,0,0);
-	}
-	else
-	{
-		if(m_prop.physical){
-			aabb3f box = m_prop.collisionbox;
-			box.MinEdge *= BS;
-			box.MaxEdge *= BS;
-			f32 pos_max_d = BS*0.25; // Distance per iteration
-			v3f p_pos = m_base_position;
-			v3f p_velocity = m_velocity;
-			v3f p_acceleration = m_acceleration;
-			moveresult = collisionMoveSimple(m_env, m_env->getGameDef(),
-					pos_max_d, box, m_prop.stepheight, dtime,
-					&p_pos, &p_velocity, p_acceleration,
-					this, m_prop.collideWithObjects);
-			moveresult_p = &moveresult;
-
-			// Apply results
-			m_base_position = p_pos;
-			m_velocity = p_velocity;
-			m_acceleration = p_acceleration;
-		} else {
-			m_base_position += dtime * m_velocity + 0.5 * dtime
-					* dtime * m_acceleration;
-			m_velocity += dtime * m_acceleration;
-		}
-
-		if (m_prop.automatic_face_movement_dir &&
-				(fabs(m_velocity.Z) > 0.001 || fabs(m_velocity.X) > 0.001)) {
-			float target_yaw = atan2(m_velocity.Z, m_velocity.X) * 180 / M_PI
-				+ m_prop.automatic_face_movement_dir_offset;
-			float max_rotation_per_sec =
-					m_prop.automatic_face_movement_max_rotation_per_sec;
-
-			if (max_rotation_per_sec > 0) {
-				m_rotation.Y = wrapDegrees_0_360(m_rotation.Y);
-				wrappedApproachShortest(m_rotation.Y, target_yaw,
-					dtime * max_rotation_per_sec, 360.f);
-			} else {
-				// Negative values of max_rotation_per_sec mean disabled.
-				m_rotation.Y = target_yaw;
-			}
-		}
+	if (!m_physics_committed) {
+		stepPhysics(dtime, m_physics);
+		applyPhysics(m_physics);
 	}
+	m_physics_committed = false;
 
 	if(m_registered) {
-		m_env->getScriptIface()->luaentity_Step(m_id, dtime, moveresult_p);
+		m_env->getScriptIface()->luaentity_Step(m_id, dtime,
+			m_physics.has_moveresult ? &m_physics.moveresult : nullptr);
 	}
 
 	if (!send_recommended)
@@ -219,6 +171,77 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 	sendOutdatedData();
 }
 
+void LuaEntitySAO::preparePhysics(float dtime)
+{
+	stepPhysics(dtime, m_physics);
+}
+
+void LuaEntitySAO::commitPhysics()
+{
+	applyPhysics(m_physics);
+	m_physics_committed = true;
+}
+
+void LuaEntitySAO::stepPhysics(float dtime, PhysicsResult &result)
+{
+	result.position = m_base_position;
+	result.velocity = m_velocity;
+	result.acceleration = m_acceleration;
+	result.rotation = m_rotation;
+	result.has_moveresult = false;
+
+	// Each frame, parent position is copied if the object is attached, otherwise it's calculated normally
+	// If the object gets detached this comes into effect automatically from the last known origin
+	if(isAttached())
+	{
+		result.position = m_env->getActiveObject(m_attachment_parent_id)->getBasePosition();
+		result.velocity = v3f(0,0,0);
+		result.acceleration = v3f(0,0,0);
+		return;
+	}
+
+	if(m_prop.physical){
+		aabb3f box = m_prop.collisionbox;
+		box.MinEdge *= BS;
+		box.MaxEdge *= BS;
+		f32 pos_max_d = BS*0.25; // Distance per iteration
+		result.moveresult = collisionMoveSimple(m_env, m_env->getGameDef(),
+				pos_max_d, box, m_prop.stepheight, dtime,
+				&result.position, &result.velocity, result.acceleration,
+				this, m_prop.collideWithObjects);
+		result.has_moveresult = true;
+	} else {
+		result.position += dtime * result.velocity + 0.5 * dtime
+				* dtime * result.acceleration;
+		result.velocity += dtime * result.acceleration;
+	}
+
+	if (m_prop.automatic_face_movement_dir &&
+			(fabs(result.velocity.Z) > 0.001 || fabs(result.velocity.X) > 0.001)) {
+		float target_yaw = atan2(result.velocity.Z, result.velocity.X) * 180 / M_PI
+			+ m_prop.automatic_face_movement_dir_offset;
+		float max_rotation_per_sec =
+				m_prop.automatic_face_movement_max_rotation_per_sec;
+
+		if (max_rotation_per_sec > 0) {
+			result.rotation.Y = wrapDegrees_0_360(result.rotation.Y);
+			wrappedApproachShortest(result.rotation.Y, target_yaw,
+				dtime * max_rotation_per_sec, 360.f);
+		} else {
+			// Negative values of max_rotation_per_sec mean disabled.
+			result.rotation.Y = target_yaw;
+		}
+	}
+}
+
+void LuaEntitySAO::applyPhysics(const PhysicsResult &result)
+{
+	m_base_position = result.position;
+	m_velocity = result.velocity;
+	m_acceleration = result.acceleration;
+	m_rotation = result.rotation;
+}
+
 std::string LuaEntitySAO::getClientInitializationData(u16 protocol_version)
 {
 	std::ostringstream os(std::ios::binary);
@@ -20,6 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #pragma once
 
+#include "collision.h"
 #include "unit_sao.h"
 
 class LuaEntitySAO : public UnitSAO
@@ -40,6 +41,16 @@ class LuaEntitySAO : public UnitSAO
 	ActiveObjectType getSendType() const { return ACTIVEOBJECT_TYPE_GENERIC; }
 	virtual void addedToEnvironment(u32 dtime_s);
 	void step(float dtime, bool send_recommended);
+
+	/*
+		The movement of an object can be computed ahead of step():
+		preparePhysics() only reads the map and other objects, so it may run
+		for many objects at once. commitPhysics() applies the result, and the
+		following step() only runs on_step with it.
+	*/
+	void preparePhysics(float dtime);
+	void commitPhysics();
+
 	std::string getClientInitializationData(u16 protocol_version);
 	bool isStaticAllowed() const { return m_prop.static_save; }
 	bool shouldUnload() const { return true; }
@@ -72,6 +83,20 @@ class LuaEntitySAO : public UnitSAO
 	bool collideWithObjects() const;
 
 private:
+	struct PhysicsResult
+	{
+		v3f position;
+		v3f velocity;
+		v3f acceleration;
+		v3f rotation;
+		collisionMoveResult moveresult;
+		// Whether moveresult is passed to on_step
+		bool has_moveresult = false;
+	};
+
+	void stepPhysics(float dtime, PhysicsResult &result);
+	void applyPhysics(const PhysicsResult &result);
+
 	std::string getPropertyPacket();
 	void sendPosition(bool do_interpolate, bool is_movement_end);
 	std::string generateSetTextureModCommand() const;
@@ -82,6 +107,10 @@ class LuaEntitySAO : public UnitSAO
 	std::string m_init_state;
 	bool m_registered = false;
 
+	PhysicsResult m_physics;
+	// Whether m_physics was applied ahead of the next step()
+	bool m_physics_committed = false;
+
 	v3f m_velocity;
 	v3f m_acceleration;
 
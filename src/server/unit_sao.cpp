@@ -300,9 +300,7 @@ std::string UnitSAO::generateUpdateArmorGroupsCommand() const
 	return os.str();
 }
 
-std::string UnitSAO::generateUpdatePositionCommand(const v3f &position,
-		const v3f &velocity, const v3f &acceleration, const v3f &rotation,
-		bool do_interpolate, bool is_movement_end, f32 update_interval)
+std::string ObjectPositionUpdate::serialize() const
 {
 	std::ostringstream os(std::ios::binary);
 	// command
@@ -324,6 +322,37 @@ std::string UnitSAO::generateUpdatePositionCommand(const v3f &position,
 	return os.str();
 }
 
+bool ObjectPositionUpdate::deSerialize(const std::string &data)
+{
+	std::istringstream is(data, std::ios::binary);
+	if (readU8(is) != AO_CMD_UPDATE_POSITION)
+		return false;
+	position = readV3F32(is);
+	velocity = readV3F32(is);
+	acceleration = readV3F32(is);
+	rotation = readV3F32(is);
+	do_interpolate = readU8(is);
+	is_movement_end = readU8(is);
+	update_interval = readF32(is);
+	// Nothing may be missing or left over
+	return !is.fail() && is.peek() == std::istream::traits_type::eof();
+}
+
+std::string UnitSAO::generateUpdatePositionCommand(const v3f &position,
+		const v3f &velocity, const v3f &acceleration, const v3f &rotation,
+		bool do_interpolate, bool is_movement_end, f32 update_interval)
+{
+	ObjectPositionUpdate update;
+	update.position = position;
+	update.velocity = velocity;
+	update.acceleration = acceleration;
+	update.rotation = rotation;
+	update.do_interpolate = do_interpolate;
+	update.is_movement_end = is_movement_end;
+	update.update_interval = update_interval;
+	return update.serialize();
+}
+
 std::string UnitSAO::generateSetPropertiesCommand(const ObjectProperties &prop) const
 {
 	std::ostringstream os(std::ios::binary);
@@ -23,6 +23,23 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "object_properties.h"
 #include "serveractiveobject.h"
 
+// Contents of an AO_CMD_UPDATE_POSITION message
+struct ObjectPositionUpdate
+{
+	v3f position;
+	v3f velocity;
+	v3f acceleration;
+	v3f rotation;
+	bool do_interpolate = false;
+	bool is_movement_end = false;
+	// Time the client takes to interpolate to the new position
+	f32 update_interval = 0.0f;
+
+	std::string serialize() const;
+	// Returns false if data is not a position update
+	bool deSerialize(const std::string &data);
+};
+
 class UnitSAO : public ServerActiveObject
 {
 public:
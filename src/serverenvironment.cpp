@@ -35,12 +35,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/serialize.h"
 #include "util/basic_macros.h"
 #include "util/pointedthing.h"
+#include "util/workerpool.h"
 #include "threading/mutex_auto_lock.h"
 #include "filesys.h"
 #include "gameparams.h"
 #include "database/database-dummy.h"
 #include "database/database-files.h"
 #include "database/database-sqlite3.h"
+#include "database/database-writer.h"
 #if USE_POSTGRESQL
 #include "database/database-postgresql.h"
 #endif
@@ -104,6 +106,8 @@ void LBMContentMapping::addLBM(LoadingBlockModifierDef *lbm_def, IGameDef *gamed
 		}
 
 		for (content_t c_id : c_ids) {
+			if (c_id >= map.size())
+				map.resize(c_id + 1);
 			map[c_id].push_back(lbm_def);
 		}
 	}
@@ -112,13 +116,9 @@ void LBMContentMapping::addLBM(LoadingBlockModifierDef *lbm_def, IGameDef *gamed
 const std::vector<LoadingBlockModifierDef *> *
 LBMContentMapping::lookup(content_t c) const
 {
-	lbm_map::const_iterator it = map.find(c);
-	if (it == map.end())
+	if (c >= map.size() || map[c].empty())
 		return NULL;
-	// This first dereferences the iterator, returning
-	// a std::vector<LoadingBlockModifierDef *>
-	// reference, then we convert it to a pointer.
-	return &(it->second);
+	return &map[c];
 }
 
 LBMManager::~LBMManager()
@@ -384,6 +384,316 @@ void ActiveBlockList::update(std::vector<PlayerSAO*> &active_players,
 	}
 }
 
+/*
+	ABMHandler
+*/
+
+// Set of content IDs with constant time membership tests
+class ContentBitset
+{
+public:
+	void add(content_t c)
+	{
+		size_t word = c / 64;
+		if (word >= m_words.size())
+			m_words.resize(word + 1, 0);
+		m_words[word] |= (u64)1 << (c % 64);
+	}
+
+	void add(const ContentBitset &other)
+	{
+		if (other.m_words.size() > m_words.size())
+			m_words.resize(other.m_words.size(), 0);
+		for (size_t i = 0; i < other.m_words.size(); i++)
+			m_words[i] |= other.m_words[i];
+	}
+
+	bool contains(content_t c) const
+	{
+		size_t word = c / 64;
+		return word < m_words.size() && (m_words[word] >> (c % 64)) & 1;
+	}
+
+	bool empty() const { return m_words.empty(); }
+	void clear() { m_words.clear(); }
+
+private:
+	std::vector<u64> m_words;
+};
+
+/*
+	The trigger and neighbor contents of the registered ABMs are resolved
+	once and kept in flat tables. They are only rebuilt when ABMs are added
+	or node definitions change; each interval merely advances the timers.
+*/
+class ABMHandler
+{
+private:
+	struct CompiledABM
+	{
+		ActiveBlockModifier *abm;
+		ContentBitset trigger_contents;
+		ContentBitset required_neighbors;
+		// false if required_neighbors is known to be empty
+		bool check_required_neighbors;
+		// Whether the ABM runs in the current interval, and with what chance
+		bool active = false;
+		int chance = 1;
+	};
+
+	ServerEnvironment *m_env;
+	std::vector<CompiledABM> m_abms;
+	// The ABMs triggered by content c are, in registration order,
+	// m_triggers[m_trigger_start[c] .. m_trigger_start[c + 1])
+	std::vector<u32> m_trigger_start;
+	std::vector<u32> m_triggers;
+	// Contents that trigger any of the ABMs active in this interval
+	ContentBitset m_active_contents;
+	bool m_compiled = false;
+	u32 m_ndef_revision = 0;
+
+public:
+	ABMHandler(ServerEnvironment *env):
+		m_env(env)
+	{
+	}
+
+	// Rebuilds the trigger tables if ABMs were added or nodes changed
+	void compile(const std::vector<ABMWithState> &abms)
+	{
+		const NodeDefManager *ndef = m_env->getGameDef()->ndef();
+		if (m_compiled && abms.size() == m_abms.size() &&
+				ndef->getRevision() == m_ndef_revision)
+			return;
+
+		m_compiled = true;
+		m_ndef_revision = ndef->getRevision();
+		m_abms.clear();
+		m_abms.resize(abms.size());
+
+		// The same content may trigger an ABM more than once if it is
+		// listed more than once, e.g. by name and by group
+		std::vector<std::pair<content_t, u32>> triggers;
+		std::vector<content_t> ids;
+		for (u32 i = 0; i < abms.size(); i++) {
+			ActiveBlockModifier *abm = abms[i].abm;
+			CompiledABM &cabm = m_abms[i];
+			cabm.abm = abm;
+
+			// Trigger neighbors
+			const std::vector<std::string> &required_neighbors_s =
+				abm->getRequiredNeighbors();
+			for (const std::string &required_neighbor_s : required_neighbors_s) {
+				ids.clear();
+				ndef->getIds(required_neighbor_s, ids);
+				for (content_t c : ids)
+					cabm.required_neighbors.add(c);
+			}
+			cabm.check_required_neighbors = !required_neighbors_s.empty();
+
+			// Trigger contents
+			const std::vector<std::string> &contents_s = abm->getTriggerContents();
+			for (const std::string &content_s : contents_s) {
+				ids.clear();
+				ndef->getIds(content_s, ids);
+				for (content_t c : ids) {
+					cabm.trigger_contents.add(c);
+					triggers.emplace_back(c, i);
+				}
+			}
+		}
+
+		std::stable_sort(triggers.begin(), triggers.end(),
+			[] (const std::pair<content_t, u32> &a, const std::pair<content_t, u32> &b) {
+				return a.first < b.first;
+			});
+		size_t max_c = triggers.empty() ? 0 : triggers.back().first;
+		m_trigger_start.assign(max_c + 2, 0);
+		for (const auto &trigger : triggers)
+			m_trigger_start[trigger.first + 1]++;
+		for (size_t c = 0; c <= max_c; c++)
+			m_trigger_start[c + 1] += m_trigger_start[c];
+		m_triggers.resize(triggers.size());
+		for (size_t k = 0; k < triggers.size(); k++)
+			m_triggers[k] = triggers[k].second;
+
+		verbosestream << "ABMHandler: compiled " << m_abms.size() << " ABMs with "
+			<< m_triggers.size() << " trigger contents" << std::endl;
+	}
+
+	// Advances the ABM timers and selects the ABMs to run in this interval
+	void update(std::vector<ABMWithState> &abms, float dtime_s, bool use_timers)
+	{
+		m_active_contents.clear();
+		for (CompiledABM &cabm : m_abms)
+			cabm.active = false;
+
+		if(dtime_s < 0.001)
+			return;
+
+		for (u32 i = 0; i < abms.size(); i++) {
+			ABMWithState &abmws = abms[i];
+			ActiveBlockModifier *abm = abmws.abm;
+			float trigger_interval = abm->getTriggerInterval();
+			if(trigger_interval < 0.001)
+				trigger_interval = 0.001;
+			float actual_interval = dtime_s;
+			if(use_timers){
+				abmws.timer += dtime_s;
+				if(abmws.timer < trigger_interval)
+					continue;
+				abmws.timer -= trigger_interval;
+				actual_interval = trigger_interval;
+			}
+			float chance = abm->getTriggerChance();
+			if(chance == 0)
+				chance = 1;
+			CompiledABM &cabm = m_abms[i];
+			if (abm->getSimpleCatchUp()) {
+				float intervals = actual_interval / trigger_interval;
+				if(intervals == 0)
+					continue;
+				cabm.chance = chance / intervals;
+				if(cabm.chance == 0)
+					cabm.chance = 1;
+			} else {
+				cabm.chance = chance;
+			}
+			cabm.active = true;
+			m_active_contents.add(cabm.trigger_contents);
+		}
+	}
+
+	// Find out how many objects the given block and its neighbours contain.
+	// Returns the number of objects in the block, and also in 'wider' the
+	// number of objects in the block and all its neighbours. The latter
+	// may an estimate if any neighbours are unloaded.
+	u32 countObjects(MapBlock *block, ServerMap * map, u32 &wider)
+	{
+		wider = 0;
+		u32 wider_unknown_count = 0;
+		for(s16 x=-1; x<=1; x++)
+			for(s16 y=-1; y<=1; y++)
+				for(s16 z=-1; z<=1; z++)
+				{
+					MapBlock *block2 = map->getBlockNoCreateNoEx(
+						block->getPos() + v3s16(x,y,z));
+					if(block2==NULL){
+						wider_unknown_count++;
+						continue;
+					}
+					wider += block2->m_static_objects.m_active.size()
+						+ block2->m_static_objects.m_stored.size();
+				}
+		// Extrapolate
+		u32 active_object_count = block->m_static_objects.m_active.size();
+		u32 wider_known_count = 3*3*3 - wider_unknown_count;
+		wider += wider_unknown_count * wider / wider_known_count;
+		return active_object_count;
+
+	}
+	void apply(MapBlock *block, int &blocks_scanned, int &abms_run, int &blocks_cached)
+	{
+		if(m_active_contents.empty() || block->isDummy())
+			return;
+
+		// Check the content type cache first
+		// to see whether there are any ABMs
+		// to be run at all for this block.
+		if (block->contents_cached) {
+			blocks_cached++;
+			bool run_abms = false;
+			for (content_t c : block->contents) {
+				if (m_active_contents.contains(c)) {
+					run_abms = true;
+					break;
+				}
+			}
+			if (!run_abms)
+				return;
+		} else {
+			// Clear any caching
+			block->contents.clear();
+		}
+		blocks_scanned++;
+
+		ServerMap *map = &m_env->getServerMap();
+
+		u32 active_object_count_wider;
+		u32 active_object_count = this->countObjects(block, map, active_object_count_wider);
+		m_env->m_added_objects = 0;
+
+		v3s16 p0;
+		for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
+		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
+		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
+		{
+			MapNode n = block->getNodeUnsafe(p0);
+			content_t c = n.getContent();
+			// Cache content types as we go
+			if (!block->contents_cached && !block->do_not_cache_contents) {
+				block->contents.insert(c);
+				if (block->contents.size() > 64) {
+					// Too many different nodes... don't try to cache
+					block->do_not_cache_contents = true;
+					block->contents.clear();
+				}
+			}
+
+			if (!m_active_contents.contains(c))
+				continue;
+
+			v3s16 p = p0 + block->getPosRelative();
+			for (u32 k = m_trigger_start[c]; k < m_trigger_start[c + 1]; k++) {
+				CompiledABM &aabm = m_abms[m_triggers[k]];
+				if (!aabm.active || myrand() % aabm.chance != 0)
+					continue;
+
+				// Check neighbors
+				if (aabm.check_required_neighbors) {
+					v3s16 p1;
+					for(p1.X = p0.X-1; p1.X <= p0.X+1; p1.X++)
+					for(p1.Y = p0.Y-1; p1.Y <= p0.Y+1; p1.Y++)
+					for(p1.Z = p0.Z-1; p1.Z <= p0.Z+1; p1.Z++)
+					{
+						if(p1 == p0)
+							continue;
+						content_t c;
+						if (block->isValidPosition(p1)) {
+							// if the neighbor is found on the same map block
+							// get it straight from there
+							MapNode n = block->getNodeUnsafe(p1);
+							c = n.getContent();
+						} else {
+							// otherwise consult the map
+							MapNode n = map->getNode(p1 + block->getPosRelative());
+							c = n.getContent();
+						}
+						if (aabm.required_neighbors.contains(c))
+							goto neighbor_found;
+					}
+					// No required neighbor found
+					continue;
+				}
+				neighbor_found:
+
+				abms_run++;
+				// Call all the trigger variations
+				aabm.abm->trigger(m_env, p, n);
+				aabm.abm->trigger(m_env, p, n,
+					active_object_count, active_object_count_wider);
+
+				// Count surrounding objects again if the abms added any
+				if(m_env->m_added_objects > 0) {
+					active_object_count = countObjects(block, map, active_object_count_wider);
+					m_env->m_added_objects = 0;
+				}
+			}
+		}
+		block->contents_cached = !block->do_not_cache_contents;
+	}
+};
+
 /*
 	ServerEnvironment
 */
@@ -458,8 +768,13 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 				<< "please read http://wiki.minetest.net/Database_backends." << std::endl;
 	}
 
-	m_player_database = openPlayerDatabase(player_backend_name, path_world, conf);
+	m_player_database = new PlayerDatabaseWriter(
+		openPlayerDatabase(player_backend_name, path_world, conf));
 	m_auth_database = openAuthDatabase(auth_backend_name, path_world, conf);
+
+	u16 physics_threads = g_settings->getU16("entity_physics_threads");
+	if (physics_threads > 0)
+		m_physics_pool.reset(new WorkerPool("EntityPhysics", physics_threads));
 }
 
 ServerEnvironment::~ServerEnvironment()
@@ -560,31 +875,54 @@ void ServerEnvironment::kickAllPlayers(AccessDeniedCode reason,
 
 void ServerEnvironment::saveLoadedPlayers(bool force)
 {
+	// Only the changes are copied here, the database thread writes them
+	std::vector<PlayerSaveData> players;
+	players.reserve(m_players.size());
 	for (RemotePlayer *player : m_players) {
 		if (force || player->checkModified() || (player->getPlayerSAO() &&
 				player->getPlayerSAO()->getMeta().isModified())) {
-			try {
-				m_player_database->savePlayer(player);
-			} catch (DatabaseException &e) {
-				errorstream << "Failed to save player " << player->getName() << " exception: "
-					<< e.what() << std::endl;
-				throw;
-			}
+			players.emplace_back();
+			player->makeSaveData(&players.back(), force);
 		}
 	}
+
+	try {
+		if (!players.empty())
+			m_player_database->savePlayers(players);
+		// Forced saves happen at shutdown, so they have to be on disk
+		if (force)
+			m_player_database->flush();
+	} catch (DatabaseException &e) {
+		errorstream << "Failed to save players, exception: " << e.what() << std::endl;
+		restoreFailedPlayerSaves();
+		throw;
+	}
 }
 
 void ServerEnvironment::savePlayer(RemotePlayer *player)
 {
+	std::vector<PlayerSaveData> players(1);
+	player->makeSaveData(&players[0], false);
+
 	try {
-		m_player_database->savePlayer(player);
+		m_player_database->savePlayers(players);
 	} catch (DatabaseException &e) {
 		errorstream << "Failed to save player " << player->getName() << " exception: "
 			<< e.what() << std::endl;
+		restoreFailedPlayerSaves();
 		throw;
 	}
 }
 
+void ServerEnvironment::restoreFailedPlayerSaves()
+{
+	for (const std::string &name : m_player_database->takeFailedPlayers()) {
+		RemotePlayer *player = getPlayer(name.c_str());
+		if (player)
+			player->onFailedSave();
+	}
+}
+
 PlayerSAO *ServerEnvironment::loadPlayer(RemotePlayer *player, bool *new_player,
 	session_t peer_id, bool is_singleplayer)
 {
@@ -724,216 +1062,6 @@ void ServerEnvironment::loadDefaultMeta()
 	m_lbm_mgr.loadIntroductionTimes("", m_server, m_game_time);
 }
 
-struct ActiveABM
-{
-	ActiveBlockModifier *abm;
-	int chance;
-	std::vector<content_t> required_neighbors;
-	bool check_required_neighbors; // false if required_neighbors is known to be empty
-};
-
-class ABMHandler
-{
-private:
-	ServerEnvironment *m_env;
-	std::vector<std::vector<ActiveABM> *> m_aabms;
-public:
-	ABMHandler(std::vector<ABMWithState> &abms,
-		float dtime_s, ServerEnvironment *env,
-		bool use_timers):
-		m_env(env)
-	{
-		if(dtime_s < 0.001)
-			return;
-		const NodeDefManager *ndef = env->getGameDef()->ndef();
-		for (ABMWithState &abmws : abms) {
-			ActiveBlockModifier *abm = abmws.abm;
-			float trigger_interval = abm->getTriggerInterval();
-			if(trigger_interval < 0.001)
-				trigger_interval = 0.001;
-			float actual_interval = dtime_s;
-			if(use_timers){
-				abmws.timer += dtime_s;
-				if(abmws.timer < trigger_interval)
-					continue;
-				abmws.timer -= trigger_interval;
-				actual_interval = trigger_interval;
-			}
-			float chance = abm->getTriggerChance();
-			if(chance == 0)
-				chance = 1;
-			ActiveABM aabm;
-			aabm.abm = abm;
-			if (abm->getSimpleCatchUp()) {
-				float intervals = actual_interval / trigger_interval;
-				if(intervals == 0)
-					continue;
-				aabm.chance = chance / intervals;
-				if(aabm.chance == 0)
-					aabm.chance = 1;
-			} else {
-				aabm.chance = chance;
-			}
-
-			// Trigger neighbors
-			const std::vector<std::string> &required_neighbors_s =
-				abm->getRequiredNeighbors();
-			for (const std::string &required_neighbor_s : required_neighbors_s) {
-				ndef->getIds(required_neighbor_s, aabm.required_neighbors);
-			}
-			aabm.check_required_neighbors = !required_neighbors_s.empty();
-
-			// Trigger contents
-			const std::vector<std::string> &contents_s = abm->getTriggerContents();
-			for (const std::string &content_s : contents_s) {
-				std::vector<content_t> ids;
-				ndef->getIds(content_s, ids);
-				for (content_t c : ids) {
-					if (c >= m_aabms.size())
-						m_aabms.resize(c + 256, NULL);
-					if (!m_aabms[c])
-						m_aabms[c] = new std::vector<ActiveABM>;
-					m_aabms[c]->push_back(aabm);
-				}
-			}
-		}
-	}
-
-	~ABMHandler()
-	{
-		for (auto &aabms : m_aabms)
-			delete aabms;
-	}
-
-	// Find out how many objects the given block and its neighbours contain.
-	// Returns the number of objects in the block, and also in 'wider' the
-	// number of objects in the block and all its neighbours. The latter
-	// may an estimate if any neighbours are unloaded.
-	u32 countObjects(MapBlock *block, ServerMap * map, u32 &wider)
-	{
-		wider = 0;
-		u32 wider_unknown_count = 0;
-		for(s16 x=-1; x<=1; x++)
-			for(s16 y=-1; y<=1; y++)
-				for(s16 z=-1; z<=1; z++)
-				{
-					MapBlock *block2 = map->getBlockNoCreateNoEx(
-						block->getPos() + v3s16(x,y,z));
-					if(block2==NULL){
-						wider_unknown_count++;
-						continue;
-					}
-					wider += block2->m_static_objects.m_active.size()
-						+ block2->m_static_objects.m_stored.size();
-				}
-		// Extrapolate
-		u32 active_object_count = block->m_static_objects.m_active.size();
-		u32 wider_known_count = 3*3*3 - wider_unknown_count;
-		wider += wider_unknown_count * wider / wider_known_count;
-		return active_object_count;
-
-	}
-	void apply(MapBlock *block, int &blocks_scanned, int &abms_run, int &blocks_cached)
-	{
-		if(m_aabms.empty() || block->isDummy())
-			return;
-
-		// Check the content type cache first
-		// to see whether there are any ABMs
-		// to be run at all for this block.
-		if (block->contents_cached) {
-			blocks_cached++;
-			bool run_abms = false;
-			for (content_t c : block->contents) {
-				if (c < m_aabms.size() && m_aabms[c]) {
-					run_abms = true;
-					break;
-				}
-			}
-			if (!run_abms)
-				return;
-		} else {
-			// Clear any caching
-			block->contents.clear();
-		}
-		blocks_scanned++;
-
-		ServerMap *map = &m_env->getServerMap();
-
-		u32 active_object_count_wider;
-		u32 active_object_count = this->countObjects(block, map, active_object_count_wider);
-		m_env->m_added_objects = 0;
-
-		v3s16 p0;
-		for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
-		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
-		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
-		{
-			const MapNode &n = block->getNodeUnsafe(p0);
-			content_t c = n.getContent();
-			// Cache content types as we go
-			if (!block->contents_cached && !block->do_not_cache_contents) {
-				block->contents.insert(c);
-				if (block->contents.size() > 64) {
-					// Too many different nodes... don't try to cache
-					block->do_not_cache_contents = true;
-					block->contents.clear();
-				}
-			}
-
-			if (c >= m_aabms.size() || !m_aabms[c])
-				continue;
-
-			v3s16 p = p0 + block->getPosRelative();
-			for (ActiveABM &aabm : *m_aabms[c]) {
-				if (myrand() % aabm.chance != 0)
-					continue;
-
-				// Check neighbors
-				if (aabm.check_required_neighbors) {
-					v3s16 p1;
-					for(p1.X = p0.X-1; p1.X <= p0.X+1; p1.X++)
-					for(p1.Y = p0.Y-1; p1.Y <= p0.Y+1; p1.Y++)
-					for(p1.Z = p0.Z-1; p1.Z <= p0.Z+1; p1.Z++)
-					{
-						if(p1 == p0)
-							continue;
-						content_t c;
-						if (block->isValidPosition(p1)) {
-							// if the neighbor is found on the same map block
-							// get it straight from there
-							const MapNode &n = block->getNodeUnsafe(p1);
-							c = n.getContent();
-						} else {
-							// otherwise consult the map
-							MapNode n = map->getNode(p1 + block->getPosRelative());
-							c = n.getContent();
-						}
-						if (CONTAINS(aabm.required_neighbors, c))
-							goto neighbor_found;
-					}
-					// No required neighbor found
-					continue;
-				}
-				neighbor_found:
-
-				abms_run++;
-				// Call all the trigger variations
-				aabm.abm->trigger(m_env, p, n);
-				aabm.abm->trigger(m_env, p, n,
-					active_object_count, active_object_count_wider);
-
-				// Count surrounding objects again if the abms added any
-				if(m_env->m_added_objects > 0) {
-					active_object_count = countObjects(block, map, active_object_count_wider);
-					m_env->m_added_objects = 0;
-				}
-			}
-		}
-		block->contents_cached = !block->do_not_cache_contents;
-	}
-};
-
 void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 {
 	// Reset usage timer immediately, otherwise a block that becomes active
@@ -987,6 +1115,30 @@ void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 	}
 }
 
+void ServerEnvironment::stepEntityPhysics(float dtime)
+{
+	ScopeProfiler sp(g_profiler, "ServerEnv: entity physics", SPT_AVG);
+
+	m_physics_objects.clear();
+	m_physics_entities.clear();
+	m_ao_manager.getAllObjects(m_physics_objects);
+	for (ServerActiveObject *obj : m_physics_objects) {
+		if (!obj->isGone() && obj->getType() == ACTIVEOBJECT_TYPE_LUAENTITY)
+			m_physics_entities.push_back((LuaEntitySAO *)obj);
+	}
+
+	// The results are only applied once all objects were moved, so every
+	// object sees the same positions no matter which thread moves it
+	m_map->setConcurrentReads(true);
+	m_physics_pool->parallelFor(m_physics_entities.size(), [this, dtime] (u32 i) {
+		m_physics_entities[i]->preparePhysics(dtime);
+	});
+	m_map->setConcurrentReads(false);
+
+	for (LuaEntitySAO *entity : m_physics_entities)
+		entity->commitPhysics();
+}
+
 void ServerEnvironment::addActiveBlockModifier(ActiveBlockModifier *abm)
 {
 	m_abms.emplace_back(abm);
@@ -1425,7 +1577,10 @@ void ServerEnvironment::step(float dtime)
 		TimeTaker timer("modify in active blocks per interval");
 
 		// Initialize handling of ActiveBlockModifiers
-		ABMHandler abmhandler(m_abms, m_cache_abm_interval, this, true);
+		if (!m_abm_handler)
+			m_abm_handler.reset(new ABMHandler(this));
+		m_abm_handler->compile(m_abms);
+		m_abm_handler->update(m_abms, m_cache_abm_interval, true);
 
 		int blocks_scanned = 0;
 		int abms_run = 0;
@@ -1452,7 +1607,7 @@ void ServerEnvironment::step(float dtime)
 			block->setTimestampNoChangedFlag(m_game_time);
 
 			/* Handle ActiveBlockModifiers */
-			abmhandler.apply(block, blocks_scanned, abms_run, blocks_cached);
+			m_abm_handler->apply(block, blocks_scanned, abms_run, blocks_cached);
 
 			u32 time_ms = timer.getTimerTime();
 
@@ -1490,6 +1645,9 @@ void ServerEnvironment::step(float dtime)
 			send_recommended = true;
 		}
 
+		if (m_physics_pool)
+			stepEntityPhysics(dtime);
+
 		auto cb_state = [this, dtime, send_recommended] (ServerActiveObject *obj) {
 			if (obj->isGone())
 				return;
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "settings.h"
 #include "server/activeobjectmgr.h"
 #include "util/numeric.h"
+#include <memory>
 #include <set>
 #include <random>
 
@@ -34,10 +35,14 @@ struct GameParams;
 class MapBlock;
 class RemotePlayer;
 class PlayerDatabase;
+class PlayerDatabaseWriter;
 class AuthDatabase;
 class PlayerSAO;
 class ServerEnvironment;
 class ActiveBlockModifier;
+class ABMHandler;
+class LuaEntitySAO;
+class WorkerPool;
 struct StaticObject;
 class ServerActiveObject;
 class Server;
@@ -95,7 +100,8 @@ struct LoadingBlockModifierDef
 
 struct LBMContentMapping
 {
-	typedef std::unordered_map<content_t, std::vector<LoadingBlockModifierDef *>> lbm_map;
+	// Indexed by content ID
+	typedef std::vector<std::vector<LoadingBlockModifierDef *>> lbm_map;
 	lbm_map map;
 
 	std::vector<LoadingBlockModifierDef *> lbm_list;
@@ -410,6 +416,18 @@ class ServerEnvironment : public Environment
 	*/
 	void deactivateFarObjects(bool force_delete);
 
+	/*
+		Moves all Lua entities on the worker pool, before any on_step runs.
+		Objects only see the positions other objects had before the step.
+	*/
+	void stepEntityPhysics(float dtime);
+
+	/*
+		Marks the players whose saves the database thread failed to write
+		as unsaved, so that the next save writes them whole.
+	*/
+	void restoreFailedPlayerSaves();
+
 	/*
 		A few helpers used by the three above methods
 	*/
@@ -454,6 +472,12 @@ class ServerEnvironment : public Environment
 	u32 m_last_clear_objects_time = 0;
 	// Active block modifiers
 	std::vector<ABMWithState> m_abms;
+	// Trigger tables of m_abms, built on the first ABM interval
+	std::unique_ptr<ABMHandler> m_abm_handler;
+	// Moves the Lua entities ahead of their on_step, if enabled
+	std::unique_ptr<WorkerPool> m_physics_pool;
+	std::vector<ServerActiveObject *> m_physics_objects;
+	std::vector<LuaEntitySAO *> m_physics_entities;
 	LBMManager m_lbm_mgr;
 	// An interval for generally sending object positions and stuff
 	float m_recommended_send_interval = 0.1f;
@@ -464,7 +488,7 @@ class ServerEnvironment : public Environment
 	// peer_ids in here should be unique, except that there may be many 0s
 	std::vector<RemotePlayer*> m_players;
 
-	PlayerDatabase *m_player_database = nullptr;
+	PlayerDatabaseWriter *m_player_database = nullptr;
 	AuthDatabase *m_auth_database = nullptr;
 
 	// Pseudo random generator for shuffling, etc.
@@ -34,6 +34,7 @@ content_t t_CONTENT_TORCH;
 content_t t_CONTENT_WATER;
 content_t t_CONTENT_LAVA;
 content_t t_CONTENT_BRICK;
+content_t t_CONTENT_WATER_FLOWING;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -68,7 +69,7 @@ class TestGameDef : public IGameDef {
 		return testmodspec;
 	}
 	virtual const ModSpec* getModSpec(const std::string &modname) const { return NULL; }
-	virtual std::string getModStoragePath() const { return "."; }
+	virtual ModMetadataDatabase *getModStorageDatabase() { return nullptr; }
 	virtual bool registerModStorage(ModMetadata *meta) { return true; }
 	virtual void unregisterModStorage(const std::string &name) {}
 	bool joinModChannel(const std::string &channel);
@@ -230,6 +231,31 @@ void TestGameDef::defineSomeNodes()
 	f.is_ground_content = true;
 	idef->registerItem(itemdef);
 	t_CONTENT_BRICK = ndef->set(f.name, f);
+
+	//// Flowing water
+	itemdef = ItemDefinition();
+	itemdef.type = ITEM_NODE;
+	itemdef.name = "default:water_flowing";
+	itemdef.description = "Flowing water";
+	f = ContentFeatures();
+	f.name = itemdef.name;
+	f.alpha = 128;
+	f.liquid_type = LIQUID_FLOWING;
+	f.param_type_2 = CPT2_FLOWINGLIQUID;
+	for (TileDef &tiledef : f.tiledef)
+		tiledef.name = "default_water.png";
+	idef->registerItem(itemdef);
+	t_CONTENT_WATER_FLOWING = ndef->set(f.name, f);
+
+	// Link the water nodes, like resolving the names would
+	for (content_t c : {t_CONTENT_WATER, t_CONTENT_WATER_FLOWING}) {
+		f = ndef->get(c);
+		f.liquid_alternative_source = "default:water";
+		f.liquid_alternative_flowing = "default:water_flowing";
+		f.liquid_alternative_source_id = t_CONTENT_WATER;
+		f.liquid_alternative_flowing_id = t_CONTENT_WATER_FLOWING;
+		ndef->set(f.name, f);
+	}
 }
 
 bool TestGameDef::joinModChannel(const std::string &channel)
@@ -255,7 +281,7 @@ bool TestGameDef::sendModChannelMessage(const std::string &channel,
 //// run_tests
 ////
 
-bool run_tests()
+bool run_tests(bool benchmarks)
 {
 	u64 t1 = porting::getTimeMs();
 	TestGameDef gamedef;
@@ -265,9 +291,10 @@ bool run_tests()
 	u32 num_modules_failed     = 0;
 	u32 num_total_tests_failed = 0;
 	u32 num_total_tests_run    = 0;
-	std::vector<TestBase *> &testmods = TestManager::getTestModules();
+	std::vector<TestBase *> &testmods = benchmarks ?
+		TestManager::getBenchmarkModules() : TestManager::getTestModules();
 	for (size_t i = 0; i != testmods.size(); i++) {
-		if (!testmods[i]->testModule(&gamedef))
+		if (!testmods[i]->testModule(&gamedef, benchmarks))
 			num_modules_failed++;
 
 		num_total_tests_failed += testmods[i]->num_tests_failed;
@@ -283,7 +310,8 @@ bool run_tests()
 	rawstream
 		<< "++++++++++++++++++++++++++++++++++++++++"
 		<< "++++++++++++++++++++++++++++++++++++++++" << std::endl
-		<< "Unit Test Results: " << overall_status << std::endl
+		<< (benchmarks ? "Benchmark Results: " : "Unit Test Results: ")
+		<< overall_status << std::endl
 		<< "    " << num_modules_failed << " / " << testmods.size()
 		<< " failed modules (" << num_total_tests_failed << " / "
 		<< num_total_tests_run << " failed individual tests)." << std::endl
@@ -298,13 +326,16 @@ bool run_tests()
 //// TestBase
 ////
 
-bool TestBase::testModule(IGameDef *gamedef)
+bool TestBase::testModule(IGameDef *gamedef, bool benchmarks)
 {
-	rawstream << "======== Testing module " << getName() << std::endl;
+	rawstream << "======== " << (benchmarks ? "Benchmarking" : "Testing")
+		<< " module " << getName() << std::endl;
 	u64 t1 = porting::getTimeMs();
 
-
-	runTests(gamedef);
+	if (benchmarks)
+		runBenchmarks(gamedef);
+	else
+		runTests(gamedef);
 
 	u64 tdiff = porting::getTimeMs() - t1;
 	rawstream << "======== Module " << getName() << " "
@@ -103,11 +103,15 @@ class IGameDef;
 
 class TestBase {
 public:
-	bool testModule(IGameDef *gamedef);
+	// Runs runBenchmarks() instead of runTests() if benchmarks is true
+	bool testModule(IGameDef *gamedef, bool benchmarks = false);
 	std::string getTestTempDirectory();
 	std::string getTestTempFile();
 
 	virtual void runTests(IGameDef *gamedef) = 0;
+	// Only run by --run-benchmarks, for modules registered with
+	// TestManager::registerBenchmarkModule()
+	virtual void runBenchmarks(IGameDef *gamedef) {}
 	virtual const char *getName() = 0;
 
 	u32 num_tests_failed;
@@ -129,6 +133,17 @@ class TestManager {
 	{
 		getTestModules().push_back(module);
 	}
+
+	static std::vector<TestBase *> &getBenchmarkModules()
+	{
+		static std::vector<TestBase *> m_modules_to_benchmark;
+		return m_modules_to_benchmark;
+	}
+
+	static void registerBenchmarkModule(TestBase *module)
+	{
+		getBenchmarkModules().push_back(module);
+	}
 };
 
 // A few item and node definitions for those tests that need them
@@ -138,5 +153,7 @@ extern content_t t_CONTENT_TORCH;
 extern content_t t_CONTENT_WATER;
 extern content_t t_CONTENT_LAVA;
 extern content_t t_CONTENT_BRICK;
+extern content_t t_CONTENT_WATER_FLOWING;
 
-bool run_tests();
+// Runs the unit tests, or the benchmarks if benchmarks is true
+bool run_tests(bool benchmarks = false);
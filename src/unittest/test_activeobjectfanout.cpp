@@ -0,0 +1,449 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <map>
+#include <unordered_map>
+#include "server/activeobjectfanout.h"
+#include "server/unit_sao.h"
+#include "noise.h"
+#include "util/serialize.h"
+
+class TestActiveObjectFanout : public TestBase
+{
+public:
+	TestActiveObjectFanout()
+	{
+		TestManager::registerTestModule(this);
+		TestManager::registerBenchmarkModule(this);
+	}
+	const char *getName() { return "TestActiveObjectFanout"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testRouting();
+	void testCoalescePositions();
+	void testLod();
+	void testMatchesPerClient();
+	void testLodBandwidth();
+
+	void benchFanout();
+	void benchLodBandwidth();
+
+private:
+	void compareWithPerClient(u32 num_peers, u32 num_objects, u32 num_known,
+		u32 steps, bool print);
+};
+
+static TestActiveObjectFanout g_test_instance;
+
+void TestActiveObjectFanout::runTests(IGameDef *gamedef)
+{
+	TEST(testRouting);
+	TEST(testCoalescePositions);
+	TEST(testLod);
+	TEST(testMatchesPerClient);
+	TEST(testLodBandwidth);
+}
+
+void TestActiveObjectFanout::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchFanout);
+	TEST(benchLodBandwidth);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static std::string make_command(u8 cmd, const std::string &payload)
+{
+	return std::string(1, (char)cmd) + payload;
+}
+
+static std::string serialize_message(u16 id, const std::string &data)
+{
+	char idbuf[2];
+	writeU16((u8 *)idbuf, id);
+	return std::string(idbuf, 2) + serializeString16(data);
+}
+
+struct SentData {
+	std::string reliable;
+	std::string unreliable;
+};
+
+typedef std::map<session_t, SentData> SentMap;
+
+static ActiveObjectFanout::SendCallback collect(SentMap &sent)
+{
+	return [&sent] (session_t peer_id, const std::string &data, bool reliable) {
+		SentData &d = sent[peer_id];
+		(reliable ? d.reliable : d.unreliable) += data;
+	};
+}
+
+void TestActiveObjectFanout::testRouting()
+{
+	ActiveObjectFanout fanout;
+	std::string props = make_command(AO_CMD_SET_PROPERTIES, "props");
+	std::string pos1 = make_command(AO_CMD_UPDATE_POSITION, "pos1");
+	std::string pos2 = make_command(AO_CMD_UPDATE_POSITION, "pos2");
+	std::string pos3 = make_command(AO_CMD_UPDATE_POSITION, "pos3");
+
+	fanout.push(ActiveObjectMessage(1, true, props));
+	fanout.push(ActiveObjectMessage(1, false, pos1));
+	fanout.push(ActiveObjectMessage(2, false, pos2));
+	fanout.push(ActiveObjectMessage(3, false, pos3));
+	// Object 4 is gone
+	fanout.push(ActiveObjectMessage(4, true, props));
+	UASSERTEQ(u32, fanout.getMessageCount(), 5);
+	UASSERTEQ(u32, fanout.getObjectCount(), 4);
+
+	// Object 2 is attached to object 3
+	fanout.prepare([] (u16 id, u16 *parent_id, v3f *pos) {
+		*parent_id = id == 2 ? 3 : 0;
+		return id != 4;
+	}, 0.1f);
+
+	// Peer 10 is object 1 and knows objects 1 and 2
+	std::set<u16> known_a = {1, 2, 4};
+	// Peer 11 knows the attachment and its parent
+	std::set<u16> known_b = {1, 2, 3};
+	// Peer 12 knows nothing that changed
+	std::set<u16> known_c = {5, 6};
+	fanout.addPeer(10, 1, v3f(), &known_a);
+	fanout.addPeer(11, 0, v3f(), &known_b);
+	fanout.addPeer(12, 0, v3f(), &known_c);
+
+	SentMap sent;
+	fanout.route(collect(sent));
+
+	UASSERTEQ(size_t, sent.size(), 2);
+	UASSERT(sent.find(12) == sent.end());
+
+	// No own position, but the attachment's since its parent is unknown
+	UASSERTEQ(std::string, sent[10].reliable, serialize_message(1, props));
+	UASSERTEQ(std::string, sent[10].unreliable, serialize_message(2, pos2));
+
+	// No position of the attachment
+	UASSERTEQ(std::string, sent[11].reliable, serialize_message(1, props));
+	UASSERTEQ(std::string, sent[11].unreliable,
+		serialize_message(1, pos1) + serialize_message(3, pos3));
+
+	// Nothing is left over for the next step
+	UASSERTEQ(u32, fanout.getObjectCount(), 0);
+	fanout.prepare([] (u16 id, u16 *parent_id, v3f *pos) { return true; }, 0.1f);
+	fanout.addPeer(10, 1, v3f(), &known_a);
+	sent.clear();
+	fanout.route(collect(sent));
+	UASSERT(sent.empty());
+}
+
+void TestActiveObjectFanout::testCoalescePositions()
+{
+	ActiveObjectFanout fanout;
+	std::string anim = make_command(AO_CMD_SET_ANIMATION, "anim");
+	std::string pos1 = make_command(AO_CMD_UPDATE_POSITION, "pos1");
+	std::string pos2 = make_command(AO_CMD_UPDATE_POSITION, "pos2");
+	std::string pos3 = make_command(AO_CMD_UPDATE_POSITION, "pos3");
+
+	fanout.push(ActiveObjectMessage(7, false, pos1));
+	fanout.push(ActiveObjectMessage(7, true, anim));
+	fanout.push(ActiveObjectMessage(7, false, pos2));
+	// Reliable position updates are kept apart from the unreliable ones
+	fanout.push(ActiveObjectMessage(7, true, pos3));
+	fanout.push(ActiveObjectMessage(7, true, anim));
+	UASSERTEQ(u32, fanout.getCoalescedCount(), 1);
+
+	fanout.prepare([] (u16 id, u16 *parent_id, v3f *pos) {
+		*parent_id = 0;
+		return true;
+	}, 0.1f);
+	std::set<u16> known = {7};
+	fanout.addPeer(1, 0, v3f(), &known);
+	// The object itself still gets everything but its position
+	fanout.addPeer(2, 7, v3f(), &known);
+
+	SentMap sent;
+	fanout.route(collect(sent));
+
+	UASSERTEQ(std::string, sent[1].unreliable, serialize_message(7, pos2));
+	UASSERTEQ(std::string, sent[1].reliable, serialize_message(7, anim) +
+		serialize_message(7, pos3) + serialize_message(7, anim));
+	UASSERT(sent[2].unreliable.empty());
+	UASSERTEQ(std::string, sent[2].reliable,
+		serialize_message(7, anim) + serialize_message(7, anim));
+}
+
+static std::string make_position(const v3f &pos, f32 update_interval)
+{
+	return UnitSAO::generateUpdatePositionCommand(pos, v3f(), v3f(), v3f(),
+		true, false, update_interval);
+}
+
+void TestActiveObjectFanout::testLod()
+{
+	ActiveObjectFanout fanout;
+	// Bands of 100 units, updated at most every 0, 200, 400 and 600ms
+	fanout.setLod(400.0f, 0.6f);
+
+	std::map<u16, v3f> positions = {
+		{1, v3f(0, 0, 0)},
+		{2, v3f(50, 0, 0)},
+		{3, v3f(0, 0, 350)},
+	};
+	auto lookup = [&positions] (u16 id, u16 *parent_id, v3f *pos) {
+		*parent_id = 0;
+		*pos = positions[id];
+		return true;
+	};
+	std::set<u16> known = {1, 2, 3};
+
+	// Object 1 is the player, 2 is close and 3 is far away. Both move for
+	// the first three steps, then stop.
+	std::vector<SentMap> steps;
+	for (int step = 0; step < 8; step++) {
+		if (step < 3) {
+			fanout.push(ActiveObjectMessage(2, false,
+				make_position(positions[2], 0.1f)));
+			fanout.push(ActiveObjectMessage(3, false,
+				make_position(positions[3] + v3f(step, 0, 0), 0.1f)));
+		}
+		fanout.prepare(lookup, 0.1f);
+		fanout.addPeer(10, 1, positions[1], &known);
+		// A peer without object of its own gets everything
+		fanout.addPeer(11, 0, v3f(), &known);
+		steps.emplace_back();
+		fanout.route(collect(steps.back()));
+		UASSERTEQ(u32, fanout.getDeferredCount(), step == 1 || step == 2 ? 1 : 0);
+	}
+
+	std::string near = serialize_message(2, make_position(positions[2], 0.1f));
+	// Distant objects are interpolated over the band's interval
+	std::string far_first = serialize_message(3, make_position(positions[3], 0.6f));
+	// The deferred update has the latest position
+	std::string far_last = serialize_message(3,
+		make_position(positions[3] + v3f(2, 0, 0), 0.6f));
+
+	// The first update of an object is never deferred
+	UASSERTEQ(std::string, steps[0][10].unreliable, near + far_first);
+	UASSERTEQ(std::string, steps[1][10].unreliable, near);
+	UASSERTEQ(std::string, steps[2][10].unreliable, near);
+	for (int step = 3; step < 8; step++) {
+		if (step == 6) {
+			UASSERTEQ(std::string, steps[step][10].unreliable, far_last);
+		} else {
+			UASSERT(steps[step][10].unreliable.empty());
+		}
+	}
+
+	for (int step = 0; step < 3; step++) {
+		UASSERTEQ(std::string, steps[step][11].unreliable, near +
+			serialize_message(3, make_position(positions[3] + v3f(step, 0, 0), 0.1f)));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The per-client loop the fan-out replaces, kept for comparison
+static size_t route_per_client(const std::vector<ActiveObjectMessage> &messages,
+		const std::vector<std::set<u16>> &known)
+{
+	std::unordered_map<u16, std::vector<ActiveObjectMessage> *> buffered;
+	for (const ActiveObjectMessage &aom : messages) {
+		auto it = buffered.find(aom.id);
+		if (it == buffered.end())
+			it = buffered.emplace(aom.id, new std::vector<ActiveObjectMessage>).first;
+		it->second->push_back(aom);
+	}
+
+	size_t bytes = 0;
+	std::string reliable_data, unreliable_data;
+	for (const std::set<u16> &known_objects : known) {
+		reliable_data.clear();
+		unreliable_data.clear();
+		for (const auto &it : buffered) {
+			if (known_objects.find(it.first) == known_objects.end())
+				continue;
+			for (const ActiveObjectMessage &aom : *it.second) {
+				std::string &buffer = aom.reliable ? reliable_data : unreliable_data;
+				char idbuf[2];
+				writeU16((u8 *)idbuf, aom.id);
+				buffer.append(idbuf, sizeof(idbuf));
+				buffer.append(serializeString16(aom.datastring));
+			}
+		}
+		bytes += reliable_data.size() + unreliable_data.size();
+	}
+
+	for (auto &it : buffered)
+		delete it.second;
+	return bytes;
+}
+
+void TestActiveObjectFanout::compareWithPerClient(u32 num_peers,
+		u32 num_objects, u32 num_known, u32 steps, bool print)
+{
+	// Every object moves; a few of them twice in a step or change animation
+	std::string pos = make_command(AO_CMD_UPDATE_POSITION, std::string(40, 'p'));
+	std::string anim = make_command(AO_CMD_SET_ANIMATION, std::string(20, 'a'));
+	std::vector<ActiveObjectMessage> messages;
+	for (u16 id = 1; id <= num_objects; id++) {
+		messages.emplace_back(id, false, pos);
+		if (id % 5 == 0)
+			messages.emplace_back(id, false, pos);
+		if (id % 10 == 0)
+			messages.emplace_back(id, true, anim);
+	}
+
+	// Every peer sees a different window of the objects
+	std::vector<std::set<u16>> known(num_peers);
+	for (u32 p = 0; p < num_peers; p++) {
+		for (u32 i = 0; i < num_known; i++)
+			known[p].insert(1 + (p * 37 + i) % num_objects);
+	}
+
+	u64 t = porting::getTimeUs();
+	size_t legacy_bytes = 0;
+	for (u32 step = 0; step < steps; step++)
+		legacy_bytes = route_per_client(messages, known);
+	u64 legacy_time = (porting::getTimeUs() - t) / steps;
+
+	ActiveObjectFanout fanout;
+	size_t bytes = 0;
+	u32 coalesced = 0;
+	auto send = [&bytes] (session_t peer_id, const std::string &data, bool reliable) {
+		bytes += data.size();
+	};
+	t = porting::getTimeUs();
+	for (u32 step = 0; step < steps; step++) {
+		bytes = 0;
+		for (const ActiveObjectMessage &aom : messages)
+			fanout.push(ActiveObjectMessage(aom));
+		coalesced = fanout.getCoalescedCount();
+		fanout.prepare([] (u16 id, u16 *parent_id, v3f *pos) {
+			*parent_id = 0;
+			return true;
+		}, 0.1f);
+		for (u32 p = 0; p < num_peers; p++)
+			fanout.addPeer(p + 1, 0, v3f(), &known[p]);
+		fanout.route(send);
+	}
+	u64 fanout_time = (porting::getTimeUs() - t) / steps;
+
+	UASSERTEQ(u32, coalesced, num_objects / 5);
+	// Exactly the coalesced position updates are saved
+	size_t pos_size = serialize_message(0, pos).size();
+	UASSERTEQ(size_t, legacy_bytes - bytes,
+		(size_t)num_peers * num_known / 5 * pos_size);
+
+	if (print) {
+		rawstream << "    " << num_peers << " peers x " << num_objects
+			<< " objects: per-client loop " << legacy_time << "us, fan-out "
+			<< fanout_time << "us per step, " << bytes / 1024 << " KiB sent ("
+			<< legacy_bytes / 1024 << " KiB without coalescing)" << std::endl;
+	}
+}
+
+void TestActiveObjectFanout::testMatchesPerClient()
+{
+	compareWithPerClient(10, 500, 200, 1, false);
+}
+
+#define CROWD_PEERS 20
+#define CROWD_AREA 4000.0f
+#define CROWD_SEND_RANGE 1280.0f
+#define CROWD_DTIME 0.09f
+
+// Average bytes sent per peer and second to a crowd of moving objects
+static u64 crowd_bandwidth(f32 lod_interval, u16 num_objects, u32 steps)
+{
+	PcgRandom rand(42);
+	auto random_pos = [&rand] () {
+		return v3f(rand.range(0, CROWD_AREA), 0, rand.range(0, CROWD_AREA));
+	};
+
+	std::vector<v3f> peers(CROWD_PEERS);
+	for (v3f &pos : peers)
+		pos = random_pos();
+	std::vector<v3f> objects(num_objects + 1);
+	for (v3f &pos : objects)
+		pos = random_pos();
+
+	// Peers know the objects within the send range
+	std::vector<std::set<u16>> known(CROWD_PEERS);
+	for (u32 p = 0; p < CROWD_PEERS; p++) {
+		for (u16 id = 1; id <= num_objects; id++) {
+			if (peers[p].getDistanceFrom(objects[id]) < CROWD_SEND_RANGE)
+				known[p].insert(id);
+		}
+	}
+
+	ActiveObjectFanout fanout;
+	fanout.setLod(CROWD_SEND_RANGE, lod_interval);
+	u64 bytes = 0;
+	auto send = [&bytes] (session_t peer_id, const std::string &data, bool reliable) {
+		bytes += data.size();
+	};
+	auto lookup = [&objects] (u16 id, u16 *parent_id, v3f *pos) {
+		*parent_id = 0;
+		*pos = objects[id];
+		return true;
+	};
+
+	// Every object walks and sends its position every step
+	for (u32 step = 0; step < steps; step++) {
+		for (u16 id = 1; id <= num_objects; id++) {
+			objects[id].X += 1.0f;
+			fanout.push(ActiveObjectMessage(id, false,
+				make_position(objects[id], CROWD_DTIME)));
+		}
+		fanout.prepare(lookup, CROWD_DTIME);
+		for (u32 p = 0; p < CROWD_PEERS; p++)
+			fanout.addPeer(p + 1, num_objects + 1 + p, peers[p], &known[p]);
+		fanout.route(send);
+	}
+
+	return bytes / CROWD_PEERS / (steps * CROWD_DTIME);
+}
+
+void TestActiveObjectFanout::testLodBandwidth()
+{
+	u64 full = crowd_bandwidth(0.0f, 300, 30);
+	u64 lod = crowd_bandwidth(0.5f, 300, 30);
+	UASSERT(lod < full);
+}
+
+void TestActiveObjectFanout::benchFanout()
+{
+	compareWithPerClient(100, 5000, 2000, 5, true);
+}
+
+void TestActiveObjectFanout::benchLodBandwidth()
+{
+	const u16 num_objects = 2000;
+	u64 full = crowd_bandwidth(0.0f, num_objects, 100);
+	u64 lod = crowd_bandwidth(0.5f, num_objects, 100);
+	UASSERT(lod < full);
+
+	rawstream << "    " << num_objects << " moving objects, " << CROWD_PEERS
+		<< " peers: " << full / 1024 << " KiB/s per peer, "
+		<< lod / 1024 << " KiB/s with level of detail" << std::endl;
+}
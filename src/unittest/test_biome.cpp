@@ -0,0 +1,175 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "mapgen/mg_biome.h"
+
+class TestBiome : public TestBase {
+public:
+	TestBiome() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestBiome"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBands();
+	void testIndexMatchesLinear();
+};
+
+static TestBiome g_test_instance;
+
+void TestBiome::runTests(IGameDef *gamedef)
+{
+	TEST(testBands);
+	TEST(testIndexMatchesLinear);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static Biome *create_biome(float heat, float humidity, s16 y_min, s16 y_max,
+	s16 vertical_blend = 0)
+{
+	Biome *b = new Biome();
+	b->min_pos = v3s16(-31000, y_min, -31000);
+	b->max_pos = v3s16(31000, y_max, 31000);
+	b->heat_point = heat;
+	b->humidity_point = humidity;
+	b->vertical_blend = vertical_blend;
+	return b;
+}
+
+
+// Layered biomes like in biome-heavy games: every climate has an ocean,
+// a shore, the surface and an underground variant. Some only exist in
+// parts of the world.
+static void create_biomes(std::vector<Biome *> &biomes, u32 climates)
+{
+	PcgRandom pr(17);
+	static const s16 layers[][3] = {
+		// y_min, y_max, vertical_blend
+		{-31000, -256, 0},
+		{-255, -2, 0},
+		{-1, 3, 0},
+		{4, 90, 6},
+		{91, 31000, 0},
+	};
+
+	for (u32 i = 0; i != climates; i++) {
+		// Coarse points, so that some biomes are equally close
+		float heat = pr.range(0, 20) * 5;
+		float humidity = pr.range(0, 20) * 5;
+		for (const s16 *layer : layers) {
+			Biome *b = create_biome(heat, humidity, layer[0], layer[1], layer[2]);
+			if (i % 8 == 7) {
+				b->min_pos.X = pr.range(-1000, 0);
+				b->max_pos.Z = pr.range(0, 1000);
+			}
+			biomes.push_back(b);
+		}
+	}
+}
+
+
+static bool same_result(const BiomeIndex::Result &a_res,
+	const BiomeIndex::Result &e_res)
+{
+	return a_res.closest == e_res.closest && a_res.dist == e_res.dist &&
+		a_res.closest_blend == e_res.closest_blend &&
+		a_res.dist_blend == e_res.dist_blend;
+}
+
+
+void TestBiome::testBands()
+{
+	std::vector<Biome *> biomes;
+	biomes.push_back(create_biome(50, 50, -10, 10, 4));
+	biomes.push_back(create_biome(0, 0, 11, 20));
+	biomes.push_back(create_biome(50, 50, -10, 10));
+	BiomeIndex index(biomes);
+
+	// Closest biome within the y limits
+	BiomeIndex::Result res;
+	index.findClosest(40, 40, v3s16(0, 10, 0), res);
+	UASSERT(res.closest == biomes[0]);
+	UASSERT(res.dist == 200);
+	UASSERT(res.closest_blend == nullptr);
+
+	// The blend area of the first one is above it
+	res = BiomeIndex::Result();
+	index.findClosest(40, 40, v3s16(0, 14, 0), res);
+	UASSERT(res.closest == biomes[1]);
+	UASSERT(res.closest_blend == biomes[0]);
+
+	res = BiomeIndex::Result();
+	index.findClosest(40, 40, v3s16(0, 15, 0), res);
+	UASSERT(res.closest == biomes[1]);
+	UASSERT(res.closest_blend == nullptr);
+
+	res = BiomeIndex::Result();
+	index.findClosest(40, 40, v3s16(0, -11, 0), res);
+	UASSERT(res.closest == nullptr);
+	UASSERT(res.closest_blend == nullptr);
+
+	// Limits in x and z direction
+	biomes[0]->max_pos.X = 100;
+	BiomeIndex limited(biomes);
+	res = BiomeIndex::Result();
+	limited.findClosest(40, 40, v3s16(101, 0, 0), res);
+	UASSERT(res.closest == biomes[2]);
+
+	for (Biome *b : biomes)
+		delete b;
+}
+
+
+void TestBiome::testIndexMatchesLinear()
+{
+	std::vector<Biome *> biomes;
+	create_biomes(biomes, 40);
+	BiomeIndex index(biomes);
+
+	PcgRandom pr(4);
+	u32 mismatches = 0;
+	for (u32 i = 0; i != 200000; i++) {
+		// Half of the points are on the grid of the biome points or
+		// halfway between them
+		float heat, humidity;
+		if (i % 2) {
+			heat = pr.range(-200, 1200) / 10.0f;
+			humidity = pr.range(-200, 1200) / 10.0f;
+		} else {
+			heat = pr.range(-10, 50) * 2.5f;
+			humidity = pr.range(-10, 50) * 2.5f;
+		}
+		v3s16 pos(pr.range(-32768, 32767), pr.range(-300, 300),
+			pr.range(-1500, 1500));
+		if (i % 16 == 0)
+			pos.Y = pr.range(-32768, 32767);
+
+		BiomeIndex::Result res, expected;
+		index.findClosest(heat, humidity, pos, res);
+		index.findClosestLinear(heat, humidity, pos, expected);
+		if (!same_result(res, expected))
+			mismatches++;
+	}
+	UASSERTEQ(u32, mismatches, 0);
+
+	for (Biome *b : biomes)
+		delete b;
+}
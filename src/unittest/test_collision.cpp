@@ -19,7 +19,65 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "test.h"
 
+#include <cstring>
 #include "collision.h"
+#include "environment.h"
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "util/workerpool.h"
+
+// Stone terrain with an uneven surface a few nodes below y = 0
+class TestCollisionMap : public Map
+{
+public:
+	TestCollisionMap(IGameDef *gamedef) : Map(gamedef)
+	{
+		for (s16 z = -2; z <= 1; z++)
+		for (s16 y = -1; y <= 0; y++)
+		for (s16 x = -2; x <= 1; x++)
+			createBlock(v3s16(x, y, z));
+	}
+
+	void createBlock(v3s16 bp)
+	{
+		v2s16 p2d(bp.X, bp.Z);
+		MapSector *sector = getSectorNoGenerate(p2d);
+		if (!sector) {
+			sector = new MapSector(this, p2d, m_gamedef);
+			m_sectors[p2d] = sector;
+		}
+		MapBlock *block = sector->createBlankBlock(bp.Y);
+		MapNode *data = block->getData();
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+			v3s16 p = bp * MAP_BLOCKSIZE + v3s16(x, y, z);
+			s16 surface = ((p.X * 7 + p.Z * 13) % 5 + 5) % 5 - 3;
+			data[z * MapBlock::zstride + y * MapBlock::ystride + x] =
+				MapNode(p.Y < surface ? t_CONTENT_STONE : CONTENT_AIR);
+		}
+	}
+};
+
+class TestCollisionEnvironment : public Environment
+{
+public:
+	TestCollisionEnvironment(IGameDef *gamedef) :
+		Environment(gamedef),
+		m_map(gamedef)
+	{
+	}
+
+	void step(f32 dtime) {}
+	Map &getMap() { return m_map; }
+	void getSelectedActiveObjects(const core::line3d<f32> &shootline_on_map,
+			std::vector<PointedThing> &objects) {}
+
+private:
+	TestCollisionMap m_map;
+};
 
 class TestCollision : public TestBase {
 public:
@@ -29,6 +87,7 @@ class TestCollision : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testAxisAlignedCollision();
+	void testParallelDeterminism(IGameDef *gamedef);
 };
 
 static TestCollision g_test_instance;
@@ -36,6 +95,7 @@ static TestCollision g_test_instance;
 void TestCollision::runTests(IGameDef *gamedef)
 {
 	TEST(testAxisAlignedCollision);
+	TEST(testParallelDeterminism, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -178,3 +238,72 @@ void TestCollision::testAxisAlignedCollision()
 		}
 	}
 }
+
+struct TestBody {
+	v3f pos;
+	v3f speed;
+	collisionMoveResult result;
+};
+
+static void move_bodies(Environment *env, IGameDef *gamedef,
+	std::vector<TestBody> &bodies, WorkerPool *pool)
+{
+	static const aabb3f box(-0.3f * BS, -0.5f * BS, -0.3f * BS,
+		0.3f * BS, 0.5f * BS, 0.3f * BS);
+	static const v3f gravity(0, -9.81f * BS, 0);
+
+	env->getMap().setConcurrentReads(pool != nullptr);
+	auto move = [&] (u32 i) {
+		TestBody &b = bodies[i];
+		b.result = collisionMoveSimple(env, gamedef, 0.25f * BS, box,
+			0.6f * BS, 0.05f, &b.pos, &b.speed, gravity, nullptr, false);
+	};
+	if (pool) {
+		pool->parallelFor(bodies.size(), move);
+	} else {
+		for (u32 i = 0; i < bodies.size(); i++)
+			move(i);
+	}
+	env->getMap().setConcurrentReads(false);
+}
+
+static bool same_bits(const v3f &a, const v3f &b)
+{
+	return memcmp(&a, &b, sizeof(v3f)) == 0;
+}
+
+void TestCollision::testParallelDeterminism(IGameDef *gamedef)
+{
+	TestCollisionEnvironment env(gamedef);
+	WorkerPool pool("TestCollision", 4);
+
+	// Bodies falling onto and sliding over the terrain
+	std::vector<TestBody> serial;
+	for (u32 i = 0; i < 500; i++) {
+		TestBody b;
+		b.pos = v3f((s32)(i % 25) - 12, 2 + (i % 7) * 0.3f,
+			(s32)(i / 25) - 10) * BS;
+		b.speed = v3f((s32)(i % 11) - 5, 0, (s32)(i % 13) - 6) * BS;
+		serial.push_back(b);
+	}
+	std::vector<TestBody> parallel = serial;
+
+	for (int step = 0; step < 40; step++) {
+		move_bodies(&env, gamedef, serial, nullptr);
+		move_bodies(&env, gamedef, parallel, &pool);
+	}
+
+	u32 touching = 0;
+	for (size_t i = 0; i < serial.size(); i++) {
+		UASSERT(same_bits(serial[i].pos, parallel[i].pos));
+		UASSERT(same_bits(serial[i].speed, parallel[i].speed));
+		UASSERTEQ(bool, serial[i].result.touching_ground,
+			parallel[i].result.touching_ground);
+		UASSERTEQ(size_t, serial[i].result.collisions.size(),
+			parallel[i].result.collisions.size());
+		if (serial[i].result.touching_ground)
+			touching++;
+	}
+	// Make sure the bodies actually hit the terrain
+	UASSERT(touching > serial.size() / 2);
+}
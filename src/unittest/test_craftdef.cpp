@@ -0,0 +1,544 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "craftdef.h"
+#include "itemdef.h"
+#include "noise.h"
+#include "util/string.h"
+
+class TestCraftDef : public TestBase {
+public:
+	TestCraftDef()
+	{
+		TestManager::registerTestModule(this);
+		TestManager::registerBenchmarkModule(this);
+	}
+	const char *getName() { return "TestCraftDef"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testGroupIndex(IGameDef *gamedef);
+	void testCachedResults(IGameDef *gamedef);
+	void testInvalidation(IGameDef *gamedef);
+
+	void benchCraftResults(IGameDef *gamedef);
+};
+
+static TestCraftDef g_test_instance;
+
+#define NUM_NODES 250
+
+static const char *materials[][2] = {
+	{"wood", "group:wood"},
+	{"stone", "group:stone"},
+	{"steel", "craft_test:steel_ingot"},
+	{"bronze", "craft_test:bronze_ingot"},
+	{"mese", "craft_test:mese_crystal"},
+	{"diamond", "craft_test:diamond"},
+};
+
+static const char *tools[] = {"pick", "shovel", "axe", "sword"};
+
+static const char *colors[] = {"white", "grey", "black", "red", "yellow",
+	"green", "cyan", "blue", "magenta", "orange", "violet", "brown", "pink"};
+
+static const char *ores[][2] = {
+	{"iron_lump", "steel_ingot"},
+	{"copper_lump", "copper_ingot"},
+	{"tin_lump", "tin_ingot"},
+	{"cobble", "stone"},
+};
+
+static void register_item(IWritableItemDefManager *idef, const std::string &name,
+	const ItemGroupList &groups = ItemGroupList(), ItemType type = ITEM_CRAFT)
+{
+	ItemDefinition def;
+	def.type = type;
+	def.name = "craft_test:" + name;
+	def.groups = groups;
+	if (type == ITEM_TOOL)
+		def.stack_max = 1;
+	idef->registerItem(def);
+}
+
+// Items like those of the default game
+static void register_items(IGameDef *gamedef)
+{
+	IWritableItemDefManager *idef = (IWritableItemDefManager *)gamedef->idef();
+	if (idef->isKnown("craft_test:stick"))
+		return;
+
+	for (int i = 0; i < 4; i++) {
+		register_item(idef, "tree_" + itos(i), {{"tree", 1}, {"flammable", 2}});
+		register_item(idef, "wood_" + itos(i), {{"wood", 1}, {"flammable", 2}});
+	}
+	register_item(idef, "stick", {{"stick", 1}, {"flammable", 2}});
+	register_item(idef, "stone", {{"stone", 1}});
+	register_item(idef, "cobble", {{"stone", 2}});
+	register_item(idef, "mossycobble", {{"stone", 1}});
+	for (const char *item : {"steel_ingot", "bronze_ingot", "copper_ingot",
+			"tin_ingot", "mese_crystal", "diamond", "iron_lump", "copper_lump",
+			"tin_lump"})
+		register_item(idef, item);
+	for (auto &material : materials)
+	for (const char *tool : tools)
+		register_item(idef, std::string(tool) + "_" + material[0],
+			ItemGroupList(), ITEM_TOOL);
+	for (const char *color : colors) {
+		std::string color_group = std::string("color_") + color;
+		register_item(idef, std::string("flower_") + color,
+			{{"flower", 1}, {color_group, 1}});
+		register_item(idef, std::string("dye_") + color,
+			{{"dye", 1}, {color_group, 1}});
+		register_item(idef, std::string("wool_") + color,
+			{{"wool", 1}, {color_group, 1}, {"flammable", 3}});
+	}
+	for (int i = 0; i < NUM_NODES; i++) {
+		register_item(idef, "node_" + itos(i), {{"cracky", 3}});
+		register_item(idef, "stair_" + itos(i), {{"cracky", 3}, {"stair", 1}});
+		register_item(idef, "slab_" + itos(i), {{"cracky", 3}, {"slab", 1}});
+	}
+
+	// More groups than fit into one word of the group bitsets
+	ItemGroupList many_groups;
+	for (int i = 0; i < 100; i += 3)
+		many_groups["test_group_" + itos(i)] = 1;
+	register_item(idef, "many_groups", many_groups);
+}
+
+// Replaces the group recipe items by an item of the group
+static std::string group_member(const std::string &rec_name, PcgRandom &pr)
+{
+	if (rec_name == "group:wood")
+		return "craft_test:wood_" + itos(pr.range(0, 3));
+	if (rec_name == "group:tree")
+		return "craft_test:tree_" + itos(pr.range(0, 3));
+	if (rec_name == "group:stone")
+		return pr.range(0, 1) ? "craft_test:cobble" : "craft_test:mossycobble";
+	if (rec_name == "group:stick")
+		return "craft_test:stick";
+	if (str_starts_with(rec_name, "group:flower,color_"))
+		return "craft_test:flower_" + rec_name.substr(19);
+	if (str_starts_with(rec_name, "group:dye,color_"))
+		return "craft_test:dye_" + rec_name.substr(16);
+	if (rec_name == "group:wool")
+		return "craft_test:wool_" + std::string(colors[pr.range(0, 12)]);
+	return rec_name;
+}
+
+struct CraftGrid
+{
+	CraftMethod method;
+	unsigned int width;
+	std::vector<std::string> names;
+};
+
+static void add_shaped(IWritableCraftDefManager *cdef, IGameDef *gamedef,
+	const std::string &output, unsigned int width,
+	const std::vector<std::string> &recipe, std::vector<CraftGrid> *grids,
+	PcgRandom &pr)
+{
+	cdef->registerCraft(new CraftDefinitionShaped(output, width, recipe,
+		CraftReplacements()), gamedef);
+
+	// At a random position in the 3x3 grid
+	unsigned int height = recipe.size() / width;
+	unsigned int off_x = pr.range(0, 3 - width);
+	unsigned int off_y = pr.range(0, 3 - height);
+	CraftGrid grid{CRAFT_METHOD_NORMAL, 3, std::vector<std::string>(9)};
+	for (unsigned int i = 0; i < recipe.size(); i++)
+		grid.names[(off_y + i / width) * 3 + off_x + i % width] =
+			group_member(recipe[i], pr);
+	grids->push_back(grid);
+}
+
+static void add_shapeless(IWritableCraftDefManager *cdef, IGameDef *gamedef,
+	const std::string &output, const std::vector<std::string> &recipe,
+	std::vector<CraftGrid> *grids, PcgRandom &pr)
+{
+	cdef->registerCraft(new CraftDefinitionShapeless(output, recipe,
+		CraftReplacements()), gamedef);
+
+	// In random slots
+	CraftGrid grid{CRAFT_METHOD_NORMAL, 3, std::vector<std::string>(9)};
+	for (const std::string &rec_name : recipe) {
+		u32 i;
+		do {
+			i = pr.range(0, 8);
+		} while (!grid.names[i].empty());
+		grid.names[i] = group_member(rec_name, pr);
+	}
+	grids->push_back(grid);
+}
+
+// Registers recipes like those of the default game and returns matching grids
+static void register_recipes(IWritableCraftDefManager *cdef, IGameDef *gamedef,
+	std::vector<CraftGrid> *grids)
+{
+	PcgRandom pr(42);
+	const std::string stick = "group:stick";
+
+	for (int i = 0; i < 4; i++) {
+		add_shapeless(cdef, gamedef, "craft_test:wood_" + itos(i) + " 4",
+			{"craft_test:tree_" + itos(i)}, grids, pr);
+	}
+	add_shaped(cdef, gamedef, "craft_test:stick 4", 1, {"group:wood"}, grids, pr);
+
+	for (auto &material : materials) {
+		std::string m = material[1];
+		std::string suffix = std::string("_") + material[0];
+		add_shaped(cdef, gamedef, "craft_test:pick" + suffix, 3,
+			{m, m, m, "", stick, "", "", stick, ""}, grids, pr);
+		add_shaped(cdef, gamedef, "craft_test:shovel" + suffix, 1,
+			{m, stick, stick}, grids, pr);
+		add_shaped(cdef, gamedef, "craft_test:axe" + suffix, 2,
+			{m, m, m, stick, "", stick}, grids, pr);
+		add_shaped(cdef, gamedef, "craft_test:sword" + suffix, 1,
+			{m, m, stick}, grids, pr);
+	}
+	const std::string copper = "craft_test:copper_ingot";
+	add_shaped(cdef, gamedef, "craft_test:bronze_ingot 9", 3,
+		{copper, copper, copper, copper, "craft_test:tin_ingot", copper,
+		copper, copper, copper}, grids, pr);
+
+	for (const char *color : colors) {
+		add_shapeless(cdef, gamedef, std::string("craft_test:dye_") + color + " 4",
+			{std::string("group:flower,color_") + color}, grids, pr);
+		add_shapeless(cdef, gamedef, std::string("craft_test:wool_") + color,
+			{std::string("group:dye,color_") + color, "group:wool"}, grids, pr);
+	}
+
+	for (int i = 0; i < NUM_NODES; i++) {
+		std::string node = "craft_test:node_" + itos(i);
+		std::string slab = "craft_test:slab_" + itos(i);
+		add_shaped(cdef, gamedef, "craft_test:stair_" + itos(i) + " 8", 3,
+			{node, "", "", node, node, "", node, node, node}, grids, pr);
+		add_shaped(cdef, gamedef, slab + " 6", 3, {node, node, node}, grids, pr);
+		add_shaped(cdef, gamedef, node, 1, {slab, slab}, grids, pr);
+	}
+
+	for (auto &ore : ores) {
+		std::string input = std::string("craft_test:") + ore[0];
+		cdef->registerCraft(new CraftDefinitionCooking(
+			std::string("craft_test:") + ore[1], input, 3, CraftReplacements()),
+			gamedef);
+		grids->push_back(CraftGrid{CRAFT_METHOD_COOKING, 1, {input}});
+	}
+	for (const char *fuel : {"group:tree", "group:wood", "craft_test:stick"}) {
+		cdef->registerCraft(new CraftDefinitionFuel(fuel, 7, CraftReplacements()),
+			gamedef);
+		grids->push_back(CraftGrid{CRAFT_METHOD_FUEL, 1, {group_member(fuel, pr)}});
+	}
+
+	cdef->registerCraft(new CraftDefinitionToolRepair(0.02), gamedef);
+}
+
+// Returns a crafting input from a grid, with random counts and wear
+static CraftInput make_input(const CraftGrid &grid, IGameDef *gamedef,
+	PcgRandom &pr)
+{
+	CraftInput input;
+	input.method = grid.method;
+	input.width = grid.width;
+	for (const std::string &name : grid.names) {
+		if (name.empty()) {
+			input.items.emplace_back();
+			continue;
+		}
+		const ItemDefinition &def = gamedef->idef()->get(name);
+		if (def.type == ITEM_TOOL)
+			input.items.emplace_back(name, pr.range(1, 4) == 1 ? 2 : 1,
+				pr.range(0, 65535), gamedef->idef());
+		else
+			input.items.emplace_back(name, pr.range(1, 3), 0, gamedef->idef());
+	}
+	return input;
+}
+
+struct CraftResult
+{
+	bool found;
+	std::string output;
+	std::vector<std::string> items;
+	std::vector<std::string> replacements;
+
+	bool operator==(const CraftResult &other) const
+	{
+		return found == other.found && output == other.output &&
+			items == other.items && replacements == other.replacements;
+	}
+};
+
+static CraftResult get_result(IWritableCraftDefManager *cdef, CraftInput input,
+	bool decrement, IGameDef *gamedef)
+{
+	CraftResult res;
+	CraftOutput output;
+	std::vector<ItemStack> replacements;
+	res.found = cdef->getCraftResult(input, output, replacements, decrement, gamedef);
+	if (res.found)
+		res.output = output.item + " " + ftos(output.time);
+	for (const ItemStack &item : input.items)
+		res.items.push_back(item.getItemString());
+	for (const ItemStack &item : replacements)
+		res.replacements.push_back(item.getItemString());
+	return res;
+}
+
+// Grids that match a recipe, and variations of them that mostly don't
+static void make_grids(const std::vector<CraftGrid> &recipe_grids,
+	std::vector<CraftGrid> *grids, u32 count, PcgRandom &pr)
+{
+	std::vector<std::string> names;
+	for (const CraftGrid &grid : recipe_grids)
+	for (const std::string &name : grid.names)
+		if (!name.empty())
+			names.push_back(name);
+
+	while (grids->size() < count) {
+		CraftGrid grid = recipe_grids[pr.range(0, recipe_grids.size() - 1)];
+		switch (pr.range(0, 3)) {
+		case 0:
+			// Another item in a slot
+			grid.names[pr.range(0, grid.names.size() - 1)] =
+				names[pr.range(0, names.size() - 1)];
+			break;
+		case 1: {
+			// Two tools to repair
+			std::string tool = names[pr.range(0, names.size() - 1)];
+			if (pr.range(0, 1))
+				tool = std::string("craft_test:") + tools[pr.range(0, 3)] +
+					"_" + materials[pr.range(0, 5)][0];
+			grid = CraftGrid{CRAFT_METHOD_NORMAL, 3, std::vector<std::string>(9)};
+			grid.names[pr.range(0, 4)] = tool;
+			grid.names[pr.range(5, 8)] = tool;
+			break;
+		}
+		default:
+			break;
+		}
+		grids->push_back(grid);
+	}
+}
+
+void TestCraftDef::runTests(IGameDef *gamedef)
+{
+	register_items(gamedef);
+
+	TEST(testGroupIndex, gamedef);
+	TEST(testCachedResults, gamedef);
+	TEST(testInvalidation, gamedef);
+}
+
+void TestCraftDef::runBenchmarks(IGameDef *gamedef)
+{
+	register_items(gamedef);
+
+	TEST(benchCraftResults, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestCraftDef::testGroupIndex(IGameDef *gamedef)
+{
+	CraftGroupIndex index;
+	index.addRecipeItem("group:wood");
+	index.addRecipeItem("group:wood,flammable");
+	index.addRecipeItem("group:stone");
+	index.addRecipeItem("group:test_group_99");
+	index.addRecipeItem("group:test_group_3,test_group_96");
+	index.addRecipeItem("group:test_group_3,test_group_97");
+	index.addItems(gamedef->idef());
+
+	UASSERT(index.matches("craft_test:wood_0", "group:wood"));
+	UASSERT(index.matches("craft_test:wood_0", "group:wood,flammable"));
+	UASSERT(!index.matches("craft_test:tree_0", "group:wood,flammable"));
+	UASSERT(!index.matches("craft_test:stick", "group:wood"));
+	UASSERT(index.matches("craft_test:cobble", "group:stone"));
+	UASSERT(!index.matches("craft_test:unknown", "group:stone"));
+	UASSERT(index.matches("craft_test:many_groups", "group:test_group_99"));
+	UASSERT(index.matches("craft_test:many_groups",
+		"group:test_group_3,test_group_96"));
+	UASSERT(!index.matches("craft_test:many_groups",
+		"group:test_group_3,test_group_97"));
+	UASSERT(!index.matches("craft_test:wood_0", "group:test_group_99"));
+
+	// Recipes match the same with and without the index
+	CraftDefinitionShapeless def("craft_test:wool_red",
+		{"group:dye,color_red", "group:wool"}, CraftReplacements());
+	CraftInput input(CRAFT_METHOD_NORMAL, 2, {
+		ItemStack("craft_test:wool_blue", 1, 0, gamedef->idef()),
+		ItemStack("craft_test:dye_red", 1, 0, gamedef->idef())});
+	UASSERT(def.check(input, gamedef));
+	input.items[1].name = "craft_test:dye_blue";
+	UASSERT(!def.check(input, gamedef));
+
+	def.initHash(gamedef, &index);
+	index.addItems(gamedef->idef());
+	UASSERT(!def.check(input, gamedef));
+	input.items[1].name = "craft_test:dye_red";
+	UASSERT(def.check(input, gamedef));
+}
+
+void TestCraftDef::testCachedResults(IGameDef *gamedef)
+{
+	// The reference doesn't cache results. The recipes of the unhashed one
+	// are matched by parsing the groups.
+	IWritableCraftDefManager *cached = createCraftDefManager(256);
+	IWritableCraftDefManager *reference = createCraftDefManager(0);
+	IWritableCraftDefManager *unhashed = createCraftDefManager(0);
+	std::vector<CraftGrid> recipe_grids;
+	register_recipes(cached, gamedef, &recipe_grids);
+	recipe_grids.clear();
+	register_recipes(reference, gamedef, &recipe_grids);
+	recipe_grids.clear();
+	register_recipes(unhashed, gamedef, &recipe_grids);
+	cached->initHashes(gamedef);
+	reference->initHashes(gamedef);
+
+	// More grids than the cache holds
+	PcgRandom pr(7);
+	std::vector<CraftGrid> grids;
+	make_grids(recipe_grids, &grids, 1000, pr);
+
+	u32 found = 0;
+	u32 mismatches = 0;
+	for (u32 i = 0; i < 4000; i++) {
+		CraftInput input = make_input(grids[pr.range(0, grids.size() - 1)],
+			gamedef, pr);
+		bool decrement = i % 2;
+		CraftResult expected = get_result(reference, input, decrement, gamedef);
+		if (!(get_result(cached, input, decrement, gamedef) == expected))
+			mismatches++;
+		if (i % 20 == 0 &&
+				!(get_result(unhashed, input, decrement, gamedef) == expected))
+			mismatches++;
+		if (expected.found)
+			found++;
+	}
+	UASSERTEQ(u32, mismatches, 0);
+	// Most of the grids match a recipe
+	UASSERT(found > 2000);
+
+	delete cached;
+	delete reference;
+	delete unhashed;
+}
+
+void TestCraftDef::testInvalidation(IGameDef *gamedef)
+{
+	IWritableCraftDefManager *cdef = createCraftDefManager();
+	std::vector<CraftGrid> recipe_grids;
+	register_recipes(cdef, gamedef, &recipe_grids);
+	cdef->initHashes(gamedef);
+
+	PcgRandom pr(3);
+	CraftGrid grid{CRAFT_METHOD_NORMAL, 3, std::vector<std::string>(9)};
+	grid.names[4] = "craft_test:stick";
+	grid.names[7] = "craft_test:stone";
+	CraftInput input = make_input(grid, gamedef, pr);
+	UASSERT(!get_result(cdef, input, false, gamedef).found);
+
+	// A new recipe
+	cdef->registerCraft(new CraftDefinitionShapeless("craft_test:node_1",
+		{"craft_test:stone", "group:stick"}, CraftReplacements()), gamedef);
+	UASSERT(get_result(cdef, input, false, gamedef).found);
+	cdef->initHashes(gamedef);
+	CraftResult res = get_result(cdef, input, false, gamedef);
+	UASSERT(res.found);
+	UASSERT(res.output == "craft_test:node_1 0");
+
+	// Cleared recipes
+	cdef->clear();
+	UASSERT(!get_result(cdef, input, false, gamedef).found);
+
+	delete cdef;
+}
+
+void TestCraftDef::benchCraftResults(IGameDef *gamedef)
+{
+	IWritableCraftDefManager *cached = createCraftDefManager();
+	IWritableCraftDefManager *uncached = createCraftDefManager(0);
+	std::vector<CraftGrid> recipe_grids;
+	register_recipes(cached, gamedef, &recipe_grids);
+	recipe_grids.clear();
+	register_recipes(uncached, gamedef, &recipe_grids);
+	cached->initHashes(gamedef);
+	uncached->initHashes(gamedef);
+
+	// The grids of a few players that move items around
+	PcgRandom pr(11);
+	std::vector<CraftGrid> grids;
+	make_grids(recipe_grids, &grids, 100, pr);
+	std::vector<CraftInput> inputs;
+	for (u32 i = 0; i < 1000; i++)
+		inputs.push_back(make_input(grids[i % grids.size()], gamedef, pr));
+
+	u64 time_uncached = 0;
+	u64 time_cached = 0;
+	u32 found = 0;
+	for (int round = 0; round < 20; round++) {
+		CraftOutput output;
+		std::vector<ItemStack> replacements;
+		u64 t = porting::getTimeUs();
+		for (CraftInput &input : inputs)
+			found += uncached->getCraftResult(input, output, replacements, false,
+				gamedef);
+		time_uncached += porting::getTimeUs() - t;
+
+		t = porting::getTimeUs();
+		for (CraftInput &input : inputs)
+			found -= cached->getCraftResult(input, output, replacements, false,
+				gamedef);
+		time_cached += porting::getTimeUs() - t;
+	}
+	UASSERTEQ(u32, found, 0);
+
+	// Group matching by itself
+	CraftGroupIndex index;
+	CraftDefinitionShapeless def("craft_test:wool_red",
+		{"group:dye,color_red", "group:wool"}, CraftReplacements());
+	CraftInput input(CRAFT_METHOD_NORMAL, 2, {
+		ItemStack("craft_test:wool_blue", 1, 0, gamedef->idef()),
+		ItemStack("craft_test:dye_red", 1, 0, gamedef->idef())});
+	u64 t = porting::getTimeUs();
+	for (int i = 0; i < 20000; i++)
+		found += def.check(input, gamedef);
+	u64 time_parsed = porting::getTimeUs() - t;
+
+	def.initHash(gamedef, &index);
+	index.addItems(gamedef->idef());
+	t = porting::getTimeUs();
+	for (int i = 0; i < 20000; i++)
+		found -= def.check(input, gamedef);
+	u64 time_indexed = porting::getTimeUs() - t;
+	UASSERTEQ(u32, found, 0);
+
+	rawstream << "    " << inputs.size() * 20 << " craft grids: "
+		<< time_uncached << "us uncached, " << time_cached << "us cached"
+		<< std::endl;
+	rawstream << "    20000 group recipe checks: " << time_parsed
+		<< "us parsing groups, " << time_indexed << "us indexed" << std::endl;
+
+	delete cached;
+	delete uncached;
+}
@@ -0,0 +1,297 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "map.h"
+#include "nodedef.h"
+#include "mapgen/mapgen.h"
+#include "mapgen/mg_decoration.h"
+#include "mapgen/mg_schematic.h"
+
+class TestDecoration : public TestBase {
+public:
+	TestDecoration() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestDecoration"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testFusedPlacement(IGameDef *gamedef, bool use_heightmap);
+	void testSkipUnplaceable(IGameDef *gamedef);
+};
+
+static TestDecoration g_test_instance;
+
+#define CHUNK_SIZE 80
+#define WATER_LEVEL 32
+// One of them doesn't occur in the test area
+#define BIOME_COUNT 5
+
+// Non-walkable decoration, registered for this module only
+static content_t c_plant;
+
+static const v3s16 chunk_min(0, 0, 0);
+static const v3s16 chunk_max = chunk_min + v3s16(1, 1, 1) * (CHUNK_SIZE - 1);
+
+// Mapchunk with hills, lakes and a cave layer, including the usual
+// one block of overgeneration
+class TestDecoArea {
+public:
+	TestDecoArea(const NodeDefManager *ndef, bool use_heightmap) :
+		vm(nullptr)
+	{
+		vm.addArea(VoxelArea(chunk_min - v3s16(1, 1, 1) * MAP_BLOCKSIZE,
+			chunk_max + v3s16(1, 1, 1) * MAP_BLOCKSIZE));
+
+		for (s32 i = 0; i != vm.m_area.getVolume(); i++)
+			vm.m_data[i] = MapNode(CONTENT_AIR);
+
+		for (s16 z = vm.m_area.MinEdge.Z; z <= vm.m_area.MaxEdge.Z; z++)
+		for (s16 x = vm.m_area.MinEdge.X; x <= vm.m_area.MaxEdge.X; x++) {
+			s16 ground = 26 + ((x * 3 + z * 5) & 15);
+			bool cave = ((x + z * 2) % 23 + 23) % 23 < 15;
+			for (s16 y = vm.m_area.MinEdge.Y; y <= ground; y++) {
+				if (cave && y >= 8 && y <= 14)
+					continue;
+				vm.setNode(v3s16(x, y, z), MapNode(y == ground ?
+					t_CONTENT_GRASS : t_CONTENT_STONE));
+			}
+			for (s16 y = ground + 1; y <= WATER_LEVEL; y++)
+				vm.setNode(v3s16(x, y, z), MapNode(t_CONTENT_WATER));
+		}
+
+		mg.vm = &vm;
+		mg.ndef = ndef;
+		mg.seed = 42;
+		mg.biomemap = biomemap;
+		for (s16 z = 0; z < CHUNK_SIZE; z++)
+		for (s16 x = 0; x < CHUNK_SIZE; x++)
+			biomemap[z * CHUNK_SIZE + x] = x / 40 + z / 40 * 2;
+
+		if (use_heightmap) {
+			mg.heightmap = heightmap;
+			mg.updateHeightmap(chunk_min, chunk_max);
+		}
+	}
+
+	MMVManip vm;
+	Mapgen mg;
+	s16 heightmap[CHUNK_SIZE * CHUNK_SIZE];
+	biome_t biomemap[CHUNK_SIZE * CHUNK_SIZE];
+};
+
+
+static Schematic *create_tree(const NodeDefManager *ndef)
+{
+	// Brick trunk with a stone crown, 3x4x3
+	Schematic *schem = new Schematic();
+	schem->size = v3s16(3, 4, 3);
+	schem->schemdata = new MapNode[3 * 4 * 3];
+	schem->slice_probs = new u8[4];
+	for (u32 i = 0; i != 4; i++)
+		schem->slice_probs[i] = MTSCHEM_PROB_ALWAYS;
+
+	schem->m_nodenames.emplace_back("ignore");
+	schem->m_nodenames.emplace_back("default:brick");
+	schem->m_nodenames.emplace_back("default:stone");
+	schem->m_nnlistsizes.push_back(3);
+	for (s16 z = 0; z < 3; z++)
+	for (s16 y = 0; y < 4; y++)
+	for (s16 x = 0; x < 3; x++) {
+		content_t c = 0;
+		if (y == 3)
+			c = 2;
+		else if (x == 1 && z == 1)
+			c = 1;
+		schem->schemdata[z * 12 + y * 3 + x] =
+			MapNode(c, MTSCHEM_PROB_ALWAYS, 0);
+	}
+	ndef->pendNodeResolve(schem);
+	return schem;
+}
+
+
+// Registers count decorations of all kinds, mostly plants restricted to
+// some biome like in a game
+static void add_decorations(DecorationManager *decomgr, Schematic *tree,
+	u32 count)
+{
+	static const s16 sidelens[] = {1, 8, 16, 80};
+
+	for (u32 i = 0; i != count; i++) {
+		Decoration *deco;
+		if (i % 10 == 6) {
+			DecoSchematic *schem_deco = new DecoSchematic();
+			schem_deco->schematic = tree;
+			schem_deco->rotation = ROTATE_RAND;
+			schem_deco->flags = DECO_PLACE_CENTER_X | DECO_PLACE_CENTER_Z;
+			deco = schem_deco;
+		} else {
+			DecoSimple *simple = new DecoSimple();
+			// Walkable decorations change the surfaces found by later ones
+			simple->c_decos.push_back(i % 10 == 4 || i % 10 == 8 ?
+				t_CONTENT_BRICK : c_plant);
+			simple->deco_height = 1;
+			simple->deco_height_max = i % 3;
+			simple->deco_param2 = 0;
+			simple->deco_param2_max = 0;
+			deco = simple;
+		}
+
+		deco->mapseed = 42;
+		deco->nspawnby = -1;
+		deco->y_min = -100;
+		deco->y_max = 100;
+		deco->fill_ratio = 0.02f;
+		deco->sidelen = sidelens[i % 4];
+		deco->c_place_on.push_back(t_CONTENT_GRASS);
+
+		switch (i % 10) {
+		case 4:
+		case 5:
+			// Decorations often share the noise parameters
+			deco->flags |= DECO_USE_NOISE;
+			deco->np = NoiseParams(0.01f, 0.03f, v3f(50, 50, 50), i % 3, 2,
+				0.5f, 2.0f);
+			break;
+		case 7:
+			deco->flags |= DECO_ALL_FLOORS;
+			deco->c_place_on[0] = t_CONTENT_STONE;
+			break;
+		case 8:
+			deco->flags |= DECO_ALL_CEILINGS;
+			deco->c_place_on[0] = t_CONTENT_STONE;
+			break;
+		case 9:
+			deco->flags |= DECO_LIQUID_SURFACE;
+			deco->c_place_on[0] = t_CONTENT_WATER;
+			break;
+		}
+
+		if (i % 3 != 0)
+			deco->biomes.insert(i / 10 % BIOME_COUNT);
+
+		decomgr->add(deco);
+	}
+}
+
+
+void TestDecoration::runTests(IGameDef *gamedef)
+{
+	NodeDefManager *ndef =
+		(NodeDefManager *)gamedef->getNodeDefManager();
+
+	ContentFeatures f;
+	f.name = "test:plant";
+	f.drawtype = NDT_PLANTLIKE;
+	f.walkable = false;
+	c_plant = ndef->set(f.name, f);
+
+	ndef->setNodeRegistrationStatus(true);
+	TEST(testFusedPlacement, gamedef, true);
+	TEST(testFusedPlacement, gamedef, false);
+	TEST(testSkipUnplaceable, gamedef);
+	ndef->resetNodeResolveState();
+	ndef->removeNode(f.name);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestDecoration::testFusedPlacement(IGameDef *gamedef, bool use_heightmap)
+{
+	const NodeDefManager *ndef = gamedef->getNodeDefManager();
+	Schematic *tree = create_tree(ndef);
+	DecorationManager decomgr(gamedef);
+	add_decorations(&decomgr, tree, 60);
+
+	TestDecoArea fused(ndef, use_heightmap);
+	TestDecoArea separate(ndef, use_heightmap);
+	TestDecoArea terrain(ndef, use_heightmap);
+	u32 blockseed = Mapgen::getBlockSeed(chunk_min, 42);
+
+	decomgr.placeAllDecos(&fused.mg, blockseed, chunk_min, chunk_max);
+
+	// Every decoration on its own sees all the nodes placed before it
+	for (u32 i = 0; i != decomgr.getNumObjects(); i++) {
+		Decoration *deco = (Decoration *)decomgr.getRaw(i);
+		deco->placeDeco(&separate.mg, blockseed + i, chunk_min, chunk_max);
+	}
+
+	u32 differences = 0;
+	u32 changed = 0;
+	for (s32 i = 0; i != fused.vm.m_area.getVolume(); i++) {
+		const MapNode &n = fused.vm.m_data[i];
+		const MapNode &expected = separate.vm.m_data[i];
+		if (n.getContent() != expected.getContent() ||
+				n.param1 != expected.param1 || n.param2 != expected.param2)
+			differences++;
+		if (n.getContent() != terrain.vm.m_data[i].getContent())
+			changed++;
+	}
+	UASSERTEQ(u32, differences, 0);
+	UASSERT(changed > 1000);
+
+	delete tree;
+}
+
+
+void TestDecoration::testSkipUnplaceable(IGameDef *gamedef)
+{
+	const NodeDefManager *ndef = gamedef->getNodeDefManager();
+	TestDecoArea area(ndef, true);
+	TestDecoArea terrain(ndef, true);
+	u32 blockseed = Mapgen::getBlockSeed(chunk_min, 42);
+
+	DecoSimple deco;
+	deco.c_decos.push_back(t_CONTENT_BRICK);
+	deco.c_place_on.push_back(t_CONTENT_GRASS);
+	deco.deco_height = 1;
+	deco.deco_height_max = 0;
+	deco.deco_param2 = 0;
+	deco.deco_param2_max = 0;
+	deco.nspawnby = -1;
+	deco.fill_ratio = 1.0f;
+	deco.sidelen = 16;
+
+	// Above the ground
+	deco.y_min = 50;
+	deco.y_max = 60;
+	deco.placeDeco(&area.mg, blockseed, chunk_min, chunk_max);
+	// Above the mapchunk
+	deco.y_min = 100;
+	deco.y_max = 200;
+	deco.placeDeco(&area.mg, blockseed, chunk_min, chunk_max);
+	// Biome that doesn't exist here
+	deco.y_min = -100;
+	deco.y_max = 100;
+	deco.biomes.insert(BIOME_COUNT + 1);
+	deco.placeDeco(&area.mg, blockseed, chunk_min, chunk_max);
+
+	for (s32 i = 0; i != area.vm.m_area.getVolume(); i++)
+		UASSERT(area.vm.m_data[i].getContent() == terrain.vm.m_data[i].getContent());
+
+	// Found once the biome exists
+	deco.biomes.insert(0);
+	deco.placeDeco(&area.mg, blockseed, chunk_min, chunk_max);
+	u32 placed = 0;
+	for (s32 i = 0; i != area.vm.m_area.getVolume(); i++)
+		placed += area.vm.m_data[i].getContent() == t_CONTENT_BRICK;
+	UASSERT(placed > 0);
+}
@@ -0,0 +1,281 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <functional>
+#include <irrlicht.h> // createDevice
+#include "client/imagekernels.h"
+#include "noise.h"
+#include "porting.h"
+
+class TestImageKernels : public TestBase
+{
+public:
+	TestImageKernels()
+	{
+		TestManager::registerTestModule(this);
+		TestManager::registerBenchmarkModule(this);
+	}
+	const char *getName() { return "TestImageKernels"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testBlit();
+	void testColorize();
+	void testMultiplication();
+	void testMask();
+	void testBrighten();
+	void testTransform();
+
+	void benchKernels();
+
+private:
+	video::IImage *createImage(u32 width, u32 height, u64 seed);
+	video::IImage *copyImage(video::IImage *image);
+	static bool equal(video::IImage *a, video::IImage *b);
+
+	video::IVideoDriver *m_driver;
+};
+
+static TestImageKernels g_test_instance;
+
+void TestImageKernels::runTests(IGameDef *gamedef)
+{
+	IrrlichtDevice *device = createDevice(video::EDT_NULL);
+	m_driver = device->getVideoDriver();
+
+	TEST(testBlit);
+	TEST(testColorize);
+	TEST(testMultiplication);
+	TEST(testMask);
+	TEST(testBrighten);
+	TEST(testTransform);
+
+	device->drop();
+}
+
+void TestImageKernels::runBenchmarks(IGameDef *gamedef)
+{
+	IrrlichtDevice *device = createDevice(video::EDT_NULL);
+	m_driver = device->getVideoDriver();
+
+	TEST(benchKernels);
+
+	device->drop();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Every kernel must give the same pixels as its generic variant, so the images
+// mix the fully transparent and fully opaque pixels the fast paths skip with
+// random ones
+video::IImage *TestImageKernels::createImage(u32 width, u32 height, u64 seed)
+{
+	video::IImage *image = m_driver->createImage(video::ECF_A8R8G8B8,
+		core::dimension2d<u32>(width, height));
+	PcgRandom pr(seed);
+	for (u32 y = 0; y < height; y++)
+	for (u32 x = 0; x < width; x++) {
+		u32 alpha = pr.range(0, 3);
+		if (alpha == 1)
+			alpha = 255;
+		else if (alpha > 1)
+			alpha = pr.range(0, 255);
+		image->setPixel(x, y, (alpha << 24) | (pr.next() & 0xffffff));
+	}
+	return image;
+}
+
+video::IImage *TestImageKernels::copyImage(video::IImage *image)
+{
+	video::IImage *copy = m_driver->createImage(image->getColorFormat(),
+		image->getDimension());
+	image->copyTo(copy);
+	return copy;
+}
+
+bool TestImageKernels::equal(video::IImage *a, video::IImage *b)
+{
+	core::dimension2d<u32> dim = a->getDimension();
+	if (dim != b->getDimension())
+		return false;
+	for (u32 y = 0; y < dim.Height; y++)
+	for (u32 x = 0; x < dim.Width; x++) {
+		if (a->getPixel(x, y) != b->getPixel(x, y))
+			return false;
+	}
+	return true;
+}
+
+void TestImageKernels::testBlit()
+{
+	for (u64 seed = 0; seed < 8; seed++) {
+		video::IImage *src = createImage(37, 23, seed);
+		video::IImage *dst = createImage(41, 29, seed + 100);
+		video::IImage *ref = copyImage(dst);
+
+		blit_with_alpha(src, dst, v2s32(2, 3), v2s32(5, 1), v2u32(30, 19));
+		blit_with_alpha_generic(src, ref, v2s32(2, 3), v2s32(5, 1), v2u32(30, 19));
+		UASSERT(equal(dst, ref));
+
+		blit_with_alpha_overlay(src, dst, v2s32(1, 0), v2s32(0, 4), v2u32(30, 19));
+		blit_with_alpha_overlay_generic(src, ref, v2s32(1, 0), v2s32(0, 4),
+			v2u32(30, 19));
+		UASSERT(equal(dst, ref));
+
+		src->drop();
+		dst->drop();
+		ref->drop();
+	}
+}
+
+void TestImageKernels::testColorize()
+{
+	video::IImage *dst = createImage(41, 29, 1);
+	video::IImage *ref = copyImage(dst);
+
+	for (int ratio : {-1, 0, 77, 255})
+	for (bool keep_alpha : {false, true})
+	for (u32 alpha : {0, 100, 255}) {
+		video::SColor color(alpha, 200, 120, 40);
+		apply_colorize(dst, v2u32(3, 2), v2u32(20, 20), color, ratio, keep_alpha);
+		apply_colorize_generic(ref, v2u32(3, 2), v2u32(20, 20), color, ratio,
+			keep_alpha);
+		UASSERT(equal(dst, ref));
+	}
+
+	dst->drop();
+	ref->drop();
+}
+
+void TestImageKernels::testMultiplication()
+{
+	video::IImage *dst = createImage(41, 29, 2);
+	video::IImage *ref = copyImage(dst);
+
+	for (video::SColor color : {video::SColor(255, 255, 255, 255),
+			video::SColor(128, 0, 100, 255), video::SColor(0, 17, 230, 99)}) {
+		apply_multiplication(dst, v2u32(1, 1), v2u32(40, 28), color);
+		apply_multiplication_generic(ref, v2u32(1, 1), v2u32(40, 28), color);
+		UASSERT(equal(dst, ref));
+	}
+
+	dst->drop();
+	ref->drop();
+}
+
+void TestImageKernels::testMask()
+{
+	video::IImage *mask = createImage(37, 23, 3);
+	video::IImage *dst = createImage(41, 29, 4);
+	video::IImage *ref = copyImage(dst);
+
+	apply_mask(mask, dst, v2s32(1, 2), v2s32(2, 2), v2u32(35, 20));
+	apply_mask_generic(mask, ref, v2s32(1, 2), v2s32(2, 2), v2u32(35, 20));
+	UASSERT(equal(dst, ref));
+
+	mask->drop();
+	dst->drop();
+	ref->drop();
+}
+
+void TestImageKernels::testBrighten()
+{
+	video::IImage *image = createImage(41, 29, 5);
+	// Check the extremes of every channel
+	image->setPixel(0, 0, video::SColor(0, 0, 0, 0));
+	image->setPixel(1, 0, video::SColor(255, 255, 255, 255));
+	image->setPixel(2, 0, video::SColor(7, 1, 254, 128));
+	video::IImage *ref = copyImage(image);
+
+	brighten(image);
+	brighten_generic(ref);
+	UASSERT(equal(image, ref));
+	UASSERT(image->getPixel(0, 0) == video::SColor(0, 127, 127, 127));
+	UASSERT(image->getPixel(1, 0) == video::SColor(255, 255, 255, 255));
+
+	image->drop();
+	ref->drop();
+}
+
+void TestImageKernels::testTransform()
+{
+	video::IImage *src = createImage(37, 23, 6);
+
+	for (u32 transform = 0; transform < 8; transform++) {
+		core::dimension2d<u32> dim = imageTransformDimension(transform,
+			src->getDimension());
+		video::IImage *dst = m_driver->createImage(video::ECF_A8R8G8B8, dim);
+		video::IImage *ref = m_driver->createImage(video::ECF_A8R8G8B8, dim);
+
+		imageTransform(transform, src, dst);
+		imageTransform_generic(transform, src, ref);
+		UASSERT(equal(dst, ref));
+
+		dst->drop();
+		ref->drop();
+	}
+
+	src->drop();
+}
+
+void TestImageKernels::benchKernels()
+{
+	// Like the modifiers of a 512px texture pack
+	video::IImage *src = createImage(512, 512, 7);
+	video::IImage *dst = createImage(512, 512, 8);
+	v2u32 size(512, 512);
+
+	auto run = [] (const char *name, const std::function<void()> &fast,
+			const std::function<void()> &generic) {
+		u64 t[2];
+		for (int i = 0; i < 2; i++) {
+			u64 start = porting::getTimeUs();
+			for (int j = 0; j < 10; j++)
+				(i == 0 ? fast : generic)();
+			t[i] = porting::getTimeUs() - start;
+		}
+		rawstream << "    " << name << ": " << t[0] / 10 << "us, generic "
+			<< t[1] / 10 << "us" << std::endl;
+	};
+
+	run("blit_with_alpha",
+		[&] { blit_with_alpha(src, dst, v2s32(0, 0), v2s32(0, 0), size); },
+		[&] { blit_with_alpha_generic(src, dst, v2s32(0, 0), v2s32(0, 0), size); });
+	run("apply_colorize",
+		[&] { apply_colorize(dst, v2u32(0, 0), size, 0xff806040, 255, true); },
+		[&] { apply_colorize_generic(dst, v2u32(0, 0), size, 0xff806040, 255, true); });
+	run("apply_multiplication",
+		[&] { apply_multiplication(dst, v2u32(0, 0), size, 0xff806040); },
+		[&] { apply_multiplication_generic(dst, v2u32(0, 0), size, 0xff806040); });
+	run("apply_mask",
+		[&] { apply_mask(src, dst, v2s32(0, 0), v2s32(0, 0), size); },
+		[&] { apply_mask_generic(src, dst, v2s32(0, 0), v2s32(0, 0), size); });
+	run("brighten",
+		[&] { brighten(dst); },
+		[&] { brighten_generic(dst); });
+	run("imageTransform",
+		[&] { imageTransform(1, src, dst); },
+		[&] { imageTransform_generic(1, src, dst); });
+
+	src->drop();
+	dst->drop();
+}
@@ -32,6 +32,8 @@ class TestInventory : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testSerializeDeserialize(IItemDefManager *idef);
+	void testItemIds(IItemDefManager *idef);
+	void testSerializeDeserializeBinary(IItemDefManager *idef);
 
 	static const char *serialized_inventory_in;
 	static const char *serialized_inventory_out;
@@ -43,6 +45,8 @@ static TestInventory g_test_instance;
 void TestInventory::runTests(IGameDef *gamedef)
 {
 	TEST(testSerializeDeserialize, gamedef->getItemDefManager());
+	TEST(testItemIds, gamedef->getItemDefManager());
+	TEST(testSerializeDeserializeBinary, gamedef->getItemDefManager());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -80,6 +84,90 @@ void TestInventory::testSerializeDeserialize(IItemDefManager *idef)
 	UASSERT(leftover == wanted);
 }
 
+void TestInventory::testItemIds(IItemDefManager *idef)
+{
+	u16 id = idef->getItemId("default:stone");
+	UASSERT(id != ITEM_ID_INVALID);
+	UASSERT(idef->getItemName(id) && *idef->getItemName(id) == "default:stone");
+	UASSERT(idef->getItemId("default:cobble") == ITEM_ID_INVALID);
+	UASSERT(!idef->getItemName(ITEM_ID_INVALID - 1));
+
+	// Clients get the same ids with the item definitions
+	std::ostringstream os(std::ios::binary);
+	idef->serialize(os, 40);
+	IWritableItemDefManager *client_idef = createItemDefManager();
+	std::istringstream is(os.str(), std::ios::binary);
+	client_idef->deSerialize(is);
+
+	std::set<std::string> names;
+	idef->getAll(names);
+	for (const std::string &name : names)
+		UASSERT(client_idef->getItemId(name) == idef->getItemId(name));
+
+	delete client_idef;
+}
+
+static void make_binary_test_inventory(Inventory &inv, IItemDefManager *idef)
+{
+	std::istringstream is(TestInventory::serialized_inventory_in,
+		std::ios::binary);
+	inv.deSerialize(is);
+
+	InventoryList *list = inv.addList("tools", 4);
+	list->setWidth(2);
+	list->changeItem(0, ItemStack("default:stone", 99, 0, idef));
+	ItemStack torch("default:torch", 1, 0, idef);
+	torch.wear = 100;
+	torch.metadata.setString("description", "A torch\nwith\x01 binary");
+	torch.metadata.setString("", "empty key");
+	list->changeItem(1, torch);
+	// Items that are not defined are sent by name
+	list->changeItem(3, ItemStack("unknown:item", 5, 0, idef));
+}
+
+void TestInventory::testSerializeDeserializeBinary(IItemDefManager *idef)
+{
+	Inventory inv(idef);
+	make_binary_test_inventory(inv, idef);
+
+	std::ostringstream os(std::ios::binary);
+	inv.serialize(os, false, true);
+
+	Inventory received(idef);
+	received.addList("removed", 1);
+	std::istringstream is(os.str(), std::ios::binary);
+	received.deSerialize(is);
+	UASSERT(received == inv);
+	UASSERT(!received.getList("removed"));
+	UASSERT(received.getList("tools")->getItem(1).metadata.getString(
+		"description") == "A torch\nwith\x01 binary");
+
+	UASSERT(received.getList("tools")->getItem(3).name == "unknown:item");
+
+	// Incremental
+	inv.setModified(false);
+	inv.getList("abc")->changeItem(0, ItemStack("default:dirt", 3, 0, idef));
+	inv.deleteList("0");
+	os.str("");
+	os.clear();
+	inv.serialize(os, true, true);
+	is.str(os.str());
+	is.clear();
+	received.deSerialize(is);
+	UASSERT(received == inv);
+
+	// Truncated data
+	is.str(os.str().substr(0, os.str().size() - 2));
+	is.clear();
+	bool threw = false;
+	try {
+		received.deSerialize(is);
+	} catch (SerializationError &e) {
+		threw = true;
+	}
+	UASSERT(threw);
+}
+
 const char *TestInventory::serialized_inventory_in =
 	"List 0 10\n"
 	"Width 3\n"
@@ -0,0 +1,215 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "nodedef.h"
+#include "settings.h"
+
+// Flat stone terrain with its surface at y = 0
+class TestLiquidMap : public Map
+{
+public:
+	TestLiquidMap(IGameDef *gamedef) : Map(gamedef)
+	{
+		for (s16 z = -2; z <= 1; z++)
+		for (s16 y = -1; y <= 0; y++)
+		for (s16 x = -2; x <= 1; x++)
+			createBlock(v3s16(x, y, z));
+	}
+
+	void createBlock(v3s16 bp)
+	{
+		v2s16 p2d(bp.X, bp.Z);
+		MapSector *sector = getSectorNoGenerate(p2d);
+		if (!sector) {
+			sector = new MapSector(this, p2d, m_gamedef);
+			m_sectors[p2d] = sector;
+		}
+		MapBlock *block = sector->createBlankBlock(bp.Y);
+		MapNode *data = block->getData();
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+			s16 world_y = bp.Y * MAP_BLOCKSIZE + y;
+			data[z * MapBlock::zstride + y * MapBlock::ystride + x] =
+				MapNode(world_y < 0 ? t_CONTENT_STONE : CONTENT_AIR);
+		}
+	}
+
+	void addSource(v3s16 p)
+	{
+		MapNode n(t_CONTENT_WATER);
+		setNode(p, n);
+		transforming_liquid_add(p);
+	}
+
+	// Transforms liquids until nothing changes anymore
+	u32 settle()
+	{
+		u32 calls = 0;
+		while (transforming_liquid_size() > 0 && calls < 100) {
+			std::map<v3s16, MapBlock *> modified_blocks;
+			transformLiquids(modified_blocks, nullptr);
+			calls++;
+		}
+		return calls;
+	}
+};
+
+class TestLiquid : public TestBase
+{
+public:
+	TestLiquid() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestLiquid"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testSpread(IGameDef *gamedef);
+	void testThreadCount(IGameDef *gamedef);
+	void testLoopMax(IGameDef *gamedef);
+	void testTimeBudget(IGameDef *gamedef);
+};
+
+static TestLiquid g_test_instance;
+
+void TestLiquid::runTests(IGameDef *gamedef)
+{
+	std::string old_threads = g_settings->get("liquid_threads");
+	std::string old_budget = g_settings->get("liquid_time_budget");
+	std::string old_loop_max = g_settings->get("liquid_loop_max");
+	g_settings->set("liquid_time_budget", "0");
+
+	TEST(testSpread, gamedef);
+	TEST(testThreadCount, gamedef);
+	TEST(testLoopMax, gamedef);
+	TEST(testTimeBudget, gamedef);
+
+	g_settings->set("liquid_threads", old_threads);
+	g_settings->set("liquid_time_budget", old_budget);
+	g_settings->set("liquid_loop_max", old_loop_max);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static u8 flowing_level(Map *map, v3s16 p)
+{
+	MapNode n = map->getNode(p);
+	if (n.getContent() != t_CONTENT_WATER_FLOWING)
+		return 0xff;
+	return n.param2 & LIQUID_LEVEL_MASK;
+}
+
+void TestLiquid::testSpread(IGameDef *gamedef)
+{
+	g_settings->set("liquid_threads", "1");
+	TestLiquidMap map(gamedef);
+	map.addSource(v3s16(0, 0, 0));
+	map.settle();
+
+	// The level drops by one per node
+	UASSERTEQ(u8, flowing_level(&map, v3s16(1, 0, 0)), LIQUID_LEVEL_MAX);
+	UASSERTEQ(u8, flowing_level(&map, v3s16(-3, 0, 0)), LIQUID_LEVEL_MAX - 2);
+	UASSERTEQ(u8, flowing_level(&map, v3s16(2, 0, 2)), LIQUID_LEVEL_MAX - 3);
+	UASSERTEQ(u8, flowing_level(&map, v3s16(0, 0, 8)), 0);
+	UASSERT(map.getNode(v3s16(0, 0, 9)).getContent() == CONTENT_AIR);
+	UASSERT(map.getNode(v3s16(0, 1, 0)).getContent() == CONTENT_AIR);
+
+	// Removing the source makes the water flow away
+	MapNode air(CONTENT_AIR);
+	map.setNode(v3s16(0, 0, 0), air);
+	map.transforming_liquid_add(v3s16(1, 0, 0));
+	map.settle();
+	for (s16 x = -8; x <= 8; x++)
+		UASSERT(map.getNode(v3s16(x, 0, 0)).getContent() == CONTENT_AIR);
+}
+
+void TestLiquid::testThreadCount(IGameDef *gamedef)
+{
+	// A lake spilling over block borders, stepped with one and four threads
+	TestLiquidMap serial(gamedef);
+	TestLiquidMap parallel(gamedef);
+
+	for (s16 z = -20; z <= -10; z++)
+	for (s16 x = -20; x <= -10; x++) {
+		serial.addSource(v3s16(x, 0, z));
+		parallel.addSource(v3s16(x, 0, z));
+	}
+
+	for (int step = 0; step < 15; step++) {
+		// The map reads liquid_threads on the first call
+		std::map<v3s16, MapBlock *> modified_blocks;
+		g_settings->set("liquid_threads", "1");
+		u32 serial_count = serial.transformLiquids(modified_blocks, nullptr);
+		g_settings->set("liquid_threads", "4");
+		u32 parallel_count = parallel.transformLiquids(modified_blocks, nullptr);
+		UASSERTEQ(u32, serial_count, parallel_count);
+		UASSERTEQ(u32, serial.transforming_liquid_size(),
+			parallel.transforming_liquid_size());
+	}
+
+	u32 flowing = 0;
+	for (s16 z = -32; z < 32; z++)
+	for (s16 x = -32; x < 32; x++) {
+		v3s16 p(x, 0, z);
+		UASSERT(serial.getNode(p) == parallel.getNode(p));
+		if (serial.getNode(p).getContent() == t_CONTENT_WATER_FLOWING)
+			flowing++;
+	}
+	UASSERT(flowing > 100);
+}
+
+void TestLiquid::testLoopMax(IGameDef *gamedef)
+{
+	g_settings->set("liquid_threads", "1");
+	g_settings->set("liquid_loop_max", "10");
+	TestLiquidMap map(gamedef);
+	for (s16 x = 0; x < 30; x++)
+		map.transforming_liquid_add(v3s16(x, 0, 0));
+
+	// Air without water around stays as it is, so nothing else is queued
+	std::map<v3s16, MapBlock *> modified_blocks;
+	UASSERTEQ(u32, map.transformLiquids(modified_blocks, nullptr), 10);
+	UASSERTEQ(u32, map.transforming_liquid_size(), 20);
+	UASSERT(modified_blocks.empty());
+	g_settings->set("liquid_loop_max", "100000");
+}
+
+void TestLiquid::testTimeBudget(IGameDef *gamedef)
+{
+	g_settings->set("liquid_threads", "1");
+	g_settings->set("liquid_time_budget", "1");
+	TestLiquidMap map(gamedef);
+	for (s16 z = -32; z < 32; z++)
+	for (s16 y = 0; y < 16; y++)
+	for (s16 x = -32; x < 32; x++)
+		map.transforming_liquid_add(v3s16(x, y, z));
+
+	// Stops after the first batch that exceeds the budget; the rest is kept
+	u32 queued = map.transforming_liquid_size();
+	std::map<v3s16, MapBlock *> modified_blocks;
+	u32 processed = map.transformLiquids(modified_blocks, nullptr);
+	UASSERT(processed > 0 && processed < queued);
+	UASSERTEQ(u32, map.transforming_liquid_size(), queued - processed);
+	g_settings->set("liquid_time_budget", "0");
+}
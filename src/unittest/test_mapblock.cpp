@@ -0,0 +1,213 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "mapblock.h"
+#include "serialization.h"
+#include "voxel.h"
+
+class TestMapBlock : public TestBase
+{
+public:
+	TestMapBlock() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlock"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testCompactUniform(IGameDef *gamedef);
+	void testCompactPalette(IGameDef *gamedef);
+	void testCompactTooManyNodes(IGameDef *gamedef);
+	void testCompactWrite(IGameDef *gamedef);
+	void testCompactSerialize(IGameDef *gamedef);
+	void testCompactIdle(IGameDef *gamedef);
+};
+
+static TestMapBlock g_test_instance;
+
+void TestMapBlock::runTests(IGameDef *gamedef)
+{
+	TEST(testCompactUniform, gamedef);
+	TEST(testCompactPalette, gamedef);
+	TEST(testCompactTooManyNodes, gamedef);
+	TEST(testCompactWrite, gamedef);
+	TEST(testCompactSerialize, gamedef);
+	TEST(testCompactIdle, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Fills the block with `distinct` different nodes
+static void fill_block(MapBlock &block, u32 distinct)
+{
+	MapNode *data = block.getData();
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		data[i] = MapNode(i % distinct, (i % distinct) * 3, 3);
+}
+
+static bool blocks_equal(MapBlock &a, MapBlock &b)
+{
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+		if (!(a.getNodeUnsafe(x, y, z) == b.getNodeUnsafe(x, y, z)))
+			return false;
+	}
+	return true;
+}
+
+void TestMapBlock::testCompactUniform(IGameDef *gamedef)
+{
+	MapBlock block(nullptr, v3s16(0, 0, 0), gamedef);
+	MapNode stone(CONTENT_AIR + 1, 0xf0, 0);
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		block.getData()[i] = stone;
+
+	UASSERT(block.compact());
+	UASSERT(block.isCompact());
+	UASSERT(!block.isDummy());
+	UASSERT(block.getNodeDataSize() < 16);
+
+	bool valid;
+	UASSERT(block.getNode(v3s16(15, 0, 7), &valid) == stone);
+	UASSERT(valid);
+	UASSERT(block.getNode(v3s16(16, 0, 7), &valid).getContent() == CONTENT_IGNORE);
+	UASSERT(!valid);
+}
+
+void TestMapBlock::testCompactPalette(IGameDef *gamedef)
+{
+	// Palettes of 2, 4, 16 and 200 entries use 1, 2, 4 and 8 bits per node
+	const u32 distinct[] = {2, 4, 16, 200};
+	const size_t index_bytes[] = {512, 1024, 2048, 4096};
+	for (size_t i = 0; i < ARRLEN(distinct); i++) {
+		MapBlock full(nullptr, v3s16(0, 0, 0), gamedef);
+		MapBlock block(nullptr, v3s16(0, 0, 0), gamedef);
+		fill_block(full, distinct[i]);
+		fill_block(block, distinct[i]);
+
+		UASSERT(block.compact());
+		UASSERT(block.getNodeDataSize() >= index_bytes[i]);
+		UASSERT(block.getNodeDataSize() < 2 * index_bytes[i]);
+		UASSERT(blocks_equal(block, full));
+
+		MapNode copy[MapBlock::nodecount];
+		block.copyNodesTo(copy);
+		UASSERT(memcmp(copy, full.getData(), sizeof(copy)) == 0);
+	}
+}
+
+void TestMapBlock::testCompactTooManyNodes(IGameDef *gamedef)
+{
+	MapBlock block(nullptr, v3s16(0, 0, 0), gamedef);
+	MapNode *data = block.getData();
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		data[i] = MapNode(i);
+
+	UASSERT(!block.compact());
+	UASSERT(!block.isCompact());
+	UASSERTEQ(size_t, block.getNodeDataSize(),
+		MapBlock::nodecount * sizeof(MapNode));
+	UASSERT(block.getNodeNoEx(v3s16(1, 2, 3)).getContent() ==
+		3 * MapBlock::zstride + 2 * MapBlock::ystride + 1);
+}
+
+void TestMapBlock::testCompactWrite(IGameDef *gamedef)
+{
+	MapBlock full(nullptr, v3s16(0, 0, 0), gamedef);
+	MapBlock block(nullptr, v3s16(0, 0, 0), gamedef);
+	fill_block(full, 5);
+	fill_block(block, 5);
+	UASSERT(block.compact());
+
+	// Writing expands the block
+	MapNode n(200);
+	block.setNode(v3s16(1, 2, 3), n);
+	full.setNode(v3s16(1, 2, 3), n);
+	UASSERT(!block.isCompact());
+	UASSERT(blocks_equal(block, full));
+
+	// Blitting from a VoxelManipulator, too
+	UASSERT(block.compact());
+	VoxelArea area(v3s16(0, 0, 0), v3s16(MAP_BLOCKSIZE - 1,
+		MAP_BLOCKSIZE - 1, MAP_BLOCKSIZE - 1));
+	VoxelManipulator vm;
+	vm.addArea(area);
+	full.copyTo(vm);
+	vm.setNode(v3s16(4, 5, 6), n);
+	block.copyFrom(vm);
+	full.copyFrom(vm);
+	UASSERT(!block.isCompact());
+	UASSERT(blocks_equal(block, full));
+
+	// Blitting into a VoxelManipulator doesn't
+	UASSERT(block.compact());
+	VoxelManipulator vm2;
+	vm2.addArea(area);
+	block.copyTo(vm2);
+	UASSERT(block.isCompact());
+	UASSERT(vm2.getNodeNoEx(v3s16(4, 5, 6)) == n);
+}
+
+void TestMapBlock::testCompactSerialize(IGameDef *gamedef)
+{
+	MapBlock full(nullptr, v3s16(0, 0, 0), gamedef);
+	MapBlock block(nullptr, v3s16(0, 0, 0), gamedef);
+	fill_block(full, 3);
+	fill_block(block, 3);
+	UASSERT(block.compact());
+
+	std::ostringstream os_full(std::ios_base::binary);
+	std::ostringstream os_block(std::ios_base::binary);
+	full.serialize(os_full, SER_FMT_VER_HIGHEST_WRITE, false);
+	block.serialize(os_block, SER_FMT_VER_HIGHEST_WRITE, false);
+	UASSERT(os_full.str() == os_block.str());
+
+	// Deserializing into a compact block replaces its nodes
+	MapBlock other(nullptr, v3s16(0, 0, 0), gamedef);
+	fill_block(other, 2);
+	UASSERT(other.compact());
+	std::istringstream is(os_full.str(), std::ios_base::binary);
+	other.deSerialize(is, SER_FMT_VER_HIGHEST_WRITE, false);
+	UASSERT(blocks_equal(other, full));
+}
+
+void TestMapBlock::testCompactIdle(IGameDef *gamedef)
+{
+	MapBlock block(nullptr, v3s16(0, 0, 0), gamedef);
+	fill_block(block, 2);
+
+	block.compactIfIdle(1.0f, 2.0f);
+	UASSERT(!block.isCompact());
+	block.compactIfIdle(1.0f, 2.0f);
+	UASSERT(block.isCompact());
+
+	// Writes reset the idle time
+	MapNode n(100);
+	block.setNode(v3s16(0, 0, 0), n);
+	block.compactIfIdle(1.5f, 2.0f);
+	block.setNode(v3s16(0, 0, 1), n);
+	block.compactIfIdle(1.5f, 2.0f);
+	UASSERT(!block.isCompact());
+
+	// Negative delays disable compaction
+	block.compactIfIdle(100.0f, -1.0f);
+	UASSERT(!block.isCompact());
+}
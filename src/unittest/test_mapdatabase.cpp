@@ -0,0 +1,316 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <atomic>
+#include <thread>
+#include "database/database-cache.h"
+#include "database/database-dummy.h"
+#include "database/database-sqlite3.h"
+#include "settings.h"
+
+class TestMapDatabase : public TestBase
+{
+public:
+	TestMapDatabase()
+	{
+		TestManager::registerTestModule(this);
+		TestManager::registerBenchmarkModule(this);
+	}
+	const char *getName() { return "TestMapDatabase"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testSaveLoad(const std::string &dir);
+	void testConcurrentRead(const std::string &dir);
+	void testCacheLoad();
+	void testCacheCoalesceSaves();
+	void testCacheEviction();
+
+	void benchLoadLatencyDuringSave(const std::string &dir, bool wal);
+};
+
+// Counts the accesses that reach the backend
+class CountingDatabase : public Database_Dummy
+{
+public:
+	bool saveBlock(const v3s16 &pos, const std::string &data)
+	{
+		saves++;
+		return Database_Dummy::saveBlock(pos, data);
+	}
+
+	void loadBlock(const v3s16 &pos, std::string *block)
+	{
+		loads++;
+		Database_Dummy::loadBlock(pos, block);
+	}
+
+	u32 saves = 0;
+	u32 loads = 0;
+};
+
+static TestMapDatabase g_test_instance;
+
+#define BENCH_BLOCK_COUNT 1000
+
+void TestMapDatabase::runTests(IGameDef *gamedef)
+{
+	std::string old_mode = g_settings->get("sqlite_high_throughput");
+	std::string test_dir = getTestTempDirectory();
+
+	g_settings->setBool("sqlite_high_throughput", false);
+	TEST(testSaveLoad, test_dir + DIR_DELIM "plain");
+
+	g_settings->setBool("sqlite_high_throughput", true);
+	TEST(testSaveLoad, test_dir + DIR_DELIM "wal");
+	TEST(testConcurrentRead, test_dir + DIR_DELIM "wal");
+
+	g_settings->set("sqlite_high_throughput", old_mode);
+
+	TEST(testCacheLoad);
+	TEST(testCacheCoalesceSaves);
+	TEST(testCacheEviction);
+}
+
+void TestMapDatabase::runBenchmarks(IGameDef *gamedef)
+{
+	std::string old_mode = g_settings->get("sqlite_high_throughput");
+	std::string test_dir = getTestTempDirectory();
+
+	g_settings->setBool("sqlite_high_throughput", false);
+	TEST(benchLoadLatencyDuringSave, test_dir + DIR_DELIM "plain", false);
+
+	g_settings->setBool("sqlite_high_throughput", true);
+	TEST(benchLoadLatencyDuringSave, test_dir + DIR_DELIM "wal", true);
+
+	g_settings->set("sqlite_high_throughput", old_mode);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMapDatabase::testSaveLoad(const std::string &dir)
+{
+	MapDatabaseSQLite3 db(dir);
+	std::string data;
+
+	db.loadBlock(v3s16(1, 2, 3), &data);
+	UASSERT(data.empty());
+
+	UASSERT(db.saveBlock(v3s16(1, 2, 3), "block data"));
+	db.loadBlock(v3s16(1, 2, 3), &data);
+	UASSERTEQ(std::string, data, "block data");
+
+	UASSERT(db.deleteBlock(v3s16(1, 2, 3)));
+	data.clear();
+	db.loadBlock(v3s16(1, 2, 3), &data);
+	UASSERT(data.empty());
+}
+
+
+void TestMapDatabase::testConcurrentRead(const std::string &dir)
+{
+	MapDatabaseSQLite3 db(dir);
+	UASSERT(db.canLoadConcurrently());
+
+	v3s16 pos(-4, 5, 6);
+	UASSERT(db.saveBlock(pos, "old"));
+
+	// Only committed data is visible to concurrent readers
+	std::string data;
+	db.beginSave();
+	UASSERT(db.saveBlock(pos, "new"));
+	UASSERT(db.loadBlockConcurrent(pos, &data));
+	UASSERTEQ(std::string, data, "old");
+	db.endSave();
+
+	UASSERT(db.loadBlockConcurrent(pos, &data));
+	UASSERTEQ(std::string, data, "new");
+
+	// Every thread gets its own connection
+	bool ok = false;
+	std::thread reader([&] () {
+		ok = db.loadBlockConcurrent(pos, &data) && data == "new";
+	});
+	reader.join();
+	UASSERT(ok);
+}
+
+
+void TestMapDatabase::testCacheLoad()
+{
+	CountingDatabase *backend = new CountingDatabase();
+	MapDatabaseCache cache(backend, 1024 * 1024, 0);
+	std::string data;
+
+	backend->saveBlock(v3s16(1, 2, 3), "stored");
+
+	// The first load reaches the backend, the second one doesn't
+	cache.loadBlock(v3s16(1, 2, 3), &data);
+	UASSERTEQ(std::string, data, "stored");
+	cache.loadBlock(v3s16(1, 2, 3), &data);
+	UASSERTEQ(std::string, data, "stored");
+	UASSERTEQ(u32, backend->loads, 1);
+	UASSERTEQ(u64, cache.getHits(), 1);
+	UASSERTEQ(u64, cache.getMisses(), 1);
+
+	// Missing blocks are not cached
+	data.clear();
+	cache.loadBlock(v3s16(0, 0, 0), &data);
+	cache.loadBlock(v3s16(0, 0, 0), &data);
+	UASSERT(data.empty());
+	UASSERTEQ(u32, backend->loads, 3);
+
+	// Saved blocks are served from memory and written through
+	UASSERT(cache.saveBlock(v3s16(4, 5, 6), "saved"));
+	UASSERTEQ(u32, backend->saves, 2);
+	UASSERT(cache.loadBlockConcurrent(v3s16(4, 5, 6), &data));
+	UASSERTEQ(std::string, data, "saved");
+
+	// Deleted blocks are gone from both
+	UASSERT(cache.deleteBlock(v3s16(4, 5, 6)));
+	data.clear();
+	cache.loadBlock(v3s16(4, 5, 6), &data);
+	UASSERT(data.empty());
+}
+
+
+void TestMapDatabase::testCacheCoalesceSaves()
+{
+	CountingDatabase *backend = new CountingDatabase();
+	{
+		MapDatabaseCache cache(backend, 1024 * 1024, 0);
+
+		cache.beginSave();
+		UASSERT(cache.saveBlock(v3s16(1, 1, 1), "first"));
+		UASSERT(cache.saveBlock(v3s16(1, 1, 1), "second"));
+		UASSERTEQ(u32, cache.getDirtyCount(), 1);
+		UASSERTEQ(u32, backend->saves, 0);
+		cache.endSave();
+
+		UASSERTEQ(u32, cache.getDirtyCount(), 0);
+		UASSERTEQ(u32, backend->saves, 1);
+		std::string data;
+		backend->loadBlock(v3s16(1, 1, 1), &data);
+		UASSERTEQ(std::string, data, "second");
+	}
+
+	backend = new CountingDatabase();
+	MapDatabaseCache *cache = new MapDatabaseCache(backend, 1024 * 1024, 60000);
+	for (int i = 0; i < 10; i++) {
+		cache->beginSave();
+		UASSERT(cache->saveBlock(v3s16(2, 2, 2), std::to_string(i)));
+		cache->endSave();
+	}
+	UASSERTEQ(u32, backend->saves, 0);
+
+	// Listing blocks has to include the unwritten ones
+	std::vector<v3s16> blocks;
+	cache->listAllLoadableBlocks(blocks);
+	UASSERTEQ(size_t, blocks.size(), 1);
+	UASSERTEQ(u32, backend->saves, 1);
+
+	UASSERT(cache->saveBlock(v3s16(2, 2, 2), "last"));
+	UASSERTEQ(u32, backend->saves, 1);
+
+	cache->flush();
+	UASSERTEQ(u32, backend->saves, 2);
+	delete cache;
+}
+
+
+void TestMapDatabase::testCacheEviction()
+{
+	CountingDatabase *backend = new CountingDatabase();
+	std::string blob(1000, 'x');
+	// Room for about four blocks
+	MapDatabaseCache cache(backend, 4500, 60000);
+
+	cache.beginSave();
+	for (s16 i = 0; i < 8; i++)
+		UASSERT(cache.saveBlock(v3s16(i, 0, 0), blob));
+	cache.endSave();
+
+	UASSERT(cache.getMemoryUsage() <= 4500);
+	// Evicted blocks were written, the others are still waiting
+	UASSERTEQ(u32, backend->saves + cache.getDirtyCount(), 8);
+	UASSERT(backend->saves >= 4);
+
+	// The oldest blocks come from the backend, the newest from memory
+	std::string data;
+	cache.loadBlock(v3s16(0, 0, 0), &data);
+	UASSERTEQ(std::string, data, blob);
+	UASSERTEQ(u32, backend->loads, 1);
+	cache.loadBlock(v3s16(7, 0, 0), &data);
+	UASSERTEQ(std::string, data, blob);
+	UASSERTEQ(u32, backend->loads, 1);
+}
+
+
+void TestMapDatabase::benchLoadLatencyDuringSave(const std::string &dir, bool wal)
+{
+	MapDatabaseSQLite3 db(dir);
+	std::string blob(4096, 'x');
+
+	db.beginSave();
+	for (s16 i = 0; i < BENCH_BLOCK_COUNT; i++)
+		UASSERT(db.saveBlock(v3s16(i, 0, 0), blob));
+	db.endSave();
+
+	// Rewrite all blocks in one transaction, like ServerMap::save(), while
+	// another thread loads blocks. Without concurrent reads the emerge
+	// threads have to wait for the whole save.
+	std::atomic<bool> saving(true);
+	u64 save_start = porting::getTimeUs();
+	u64 save_time = 0;
+	std::thread saver([&] () {
+		db.beginSave();
+		for (s16 i = 0; i < BENCH_BLOCK_COUNT; i++)
+			db.saveBlock(v3s16(i, 1, 0), blob);
+		db.endSave();
+		save_time = porting::getTimeUs() - save_start;
+		saving = false;
+	});
+
+	u64 max_latency = 0;
+	u32 loads = 0;
+	bool loads_ok = true;
+	if (wal) {
+		std::string data;
+		while (saving && loads_ok) {
+			u64 t = porting::getTimeUs();
+			loads_ok = db.loadBlockConcurrent(
+				v3s16(loads % BENCH_BLOCK_COUNT, 0, 0), &data) &&
+				data.size() == blob.size();
+			max_latency = MYMAX(max_latency, porting::getTimeUs() - t);
+			loads++;
+		}
+	}
+	saver.join();
+	UASSERT(loads_ok);
+	if (!wal)
+		max_latency = save_time;
+
+	rawstream << "    " << (wal ? "WAL" : "plain") << ": saved "
+		<< BENCH_BLOCK_COUNT << " blocks in " << save_time << "us, "
+		<< loads << " concurrent loads, max load latency "
+		<< max_latency << "us" << std::endl;
+}
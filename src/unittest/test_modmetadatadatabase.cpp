@@ -0,0 +1,400 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "content/mods.h"
+#include "database/database-dummy.h"
+#include "database/database-files.h"
+#include "database/database-sqlite3.h"
+#include "filesys.h"
+
+namespace
+{
+// Like in TestAuthDatabase, these run the same tests once on a database
+// object that is kept and once on new objects for every step.
+
+class ModMetadataDatabaseProvider
+{
+public:
+	virtual ~ModMetadataDatabaseProvider() = default;
+	virtual ModMetadataDatabase *getModMetadataDatabase() = 0;
+};
+
+class FixedProvider : public ModMetadataDatabaseProvider
+{
+public:
+	FixedProvider(ModMetadataDatabase *mod_meta_db) : mod_meta_db(mod_meta_db) {}
+	virtual ~FixedProvider() = default;
+	virtual ModMetadataDatabase *getModMetadataDatabase() { return mod_meta_db; }
+
+private:
+	ModMetadataDatabase *mod_meta_db;
+};
+
+class FilesProvider : public ModMetadataDatabaseProvider
+{
+public:
+	FilesProvider(const std::string &dir) : dir(dir) {}
+	virtual ~FilesProvider() { delete mod_meta_db; }
+	virtual ModMetadataDatabase *getModMetadataDatabase()
+	{
+		delete mod_meta_db;
+		mod_meta_db = new ModMetadataDatabaseFiles(dir);
+		return mod_meta_db;
+	}
+
+private:
+	std::string dir;
+	ModMetadataDatabase *mod_meta_db = nullptr;
+};
+
+class SQLite3Provider : public ModMetadataDatabaseProvider
+{
+public:
+	SQLite3Provider(const std::string &dir) : dir(dir) {}
+	virtual ~SQLite3Provider() { delete mod_meta_db; }
+	virtual ModMetadataDatabase *getModMetadataDatabase()
+	{
+		delete mod_meta_db;
+		mod_meta_db = new ModMetadataDatabaseSQLite3(dir);
+		return mod_meta_db;
+	}
+
+private:
+	std::string dir;
+	ModMetadataDatabase *mod_meta_db = nullptr;
+};
+
+// Counts the writes of ModMetadata::save()
+class CountingDatabase : public Database_Dummy
+{
+public:
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value)
+	{
+		sets++;
+		return !fail && Database_Dummy::setModEntry(modname, key, value);
+	}
+
+	bool removeModEntry(const std::string &modname, const std::string &key)
+	{
+		removes++;
+		return !fail && Database_Dummy::removeModEntry(modname, key);
+	}
+
+	bool removeModEntries(const std::string &modname)
+	{
+		clears++;
+		return !fail && Database_Dummy::removeModEntries(modname);
+	}
+
+	u32 sets = 0;
+	u32 removes = 0;
+	u32 clears = 0;
+	bool fail = false;
+};
+}
+
+class TestModMetadataDatabase : public TestBase
+{
+public:
+	TestModMetadataDatabase() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestModMetadataDatabase"; }
+
+	void runTests(IGameDef *gamedef);
+	void runTestsForCurrentDB();
+
+	void testRecallFail();
+	void testCreate();
+	void testRecall();
+	void testChange();
+	void testRecallChanged();
+	void testListMods();
+	void testRemove();
+	void testRecallRemoved();
+
+	void testIncrementalSave();
+
+private:
+	ModMetadataDatabaseProvider *mod_meta_provider;
+	// The files backend stores JSON strings, which can't hold every byte
+	bool binary_safe;
+
+	const std::string &getKey() const;
+	const std::string &getValue() const;
+};
+
+static TestModMetadataDatabase g_test_instance;
+
+void TestModMetadataDatabase::runTests(IGameDef *gamedef)
+{
+	// fixed directory, for persistence
+	thread_local const std::string test_dir = getTestTempDirectory();
+	const std::string files_dir = test_dir + DIR_DELIM + "mod_storage";
+
+	rawstream << "-------- Files database (same object)" << std::endl;
+
+	binary_safe = false;
+
+	ModMetadataDatabase *mod_meta_db = new ModMetadataDatabaseFiles(files_dir);
+	mod_meta_provider = new FixedProvider(mod_meta_db);
+
+	runTestsForCurrentDB();
+
+	delete mod_meta_db;
+	delete mod_meta_provider;
+
+	// reset database
+	fs::RecursiveDelete(files_dir);
+
+	rawstream << "-------- Files database (new objects)" << std::endl;
+
+	mod_meta_provider = new FilesProvider(files_dir);
+
+	runTestsForCurrentDB();
+
+	delete mod_meta_provider;
+
+	rawstream << "-------- SQLite3 database (same object)" << std::endl;
+
+	binary_safe = true;
+
+	mod_meta_db = new ModMetadataDatabaseSQLite3(test_dir);
+	mod_meta_provider = new FixedProvider(mod_meta_db);
+
+	runTestsForCurrentDB();
+
+	delete mod_meta_db;
+	delete mod_meta_provider;
+
+	// reset database
+	fs::DeleteSingleFileOrEmptyDirectory(test_dir + DIR_DELIM + "mod_storage.sqlite");
+
+	rawstream << "-------- SQLite3 database (new objects)" << std::endl;
+
+	mod_meta_provider = new SQLite3Provider(test_dir);
+
+	runTestsForCurrentDB();
+
+	delete mod_meta_provider;
+
+	rawstream << "-------- ModMetadata" << std::endl;
+
+	TEST(testIncrementalSave);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestModMetadataDatabase::runTestsForCurrentDB()
+{
+	TEST(testRecallFail);
+	TEST(testCreate);
+	TEST(testRecall);
+	TEST(testChange);
+	TEST(testRecallChanged);
+	TEST(testListMods);
+	TEST(testRemove);
+	TEST(testRecallRemoved);
+}
+
+// Lua strings may contain any byte
+static const std::string binary_key("bin\0key", 7);
+static const std::string binary_value("\0\x01\xff value", 9);
+static const std::string text_key("key2");
+static const std::string text_value("value");
+
+const std::string &TestModMetadataDatabase::getKey() const
+{
+	return binary_safe ? binary_key : text_key;
+}
+
+const std::string &TestModMetadataDatabase::getValue() const
+{
+	return binary_safe ? binary_value : text_value;
+}
+
+void TestModMetadataDatabase::testRecallFail()
+{
+	ModMetadataDatabase *mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	StringMap recalled;
+	UASSERT(mod_meta_db->getModEntries("mod1", &recalled));
+	UASSERT(recalled.empty());
+}
+
+void TestModMetadataDatabase::testCreate()
+{
+	ModMetadataDatabase *mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	mod_meta_db->beginSave();
+	UASSERT(mod_meta_db->setModEntry("mod1", "key1", "value1"));
+	UASSERT(mod_meta_db->setModEntry("mod1", getKey(), getValue()));
+	mod_meta_db->endSave();
+}
+
+void TestModMetadataDatabase::testRecall()
+{
+	ModMetadataDatabase *mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	StringMap recalled;
+	UASSERT(mod_meta_db->getModEntries("mod1", &recalled));
+	UASSERTEQ(size_t, recalled.size(), 2);
+	UASSERT(recalled["key1"] == "value1");
+	UASSERT(recalled[getKey()] == getValue());
+}
+
+void TestModMetadataDatabase::testChange()
+{
+	ModMetadataDatabase *mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	mod_meta_db->beginSave();
+	UASSERT(mod_meta_db->setModEntry("mod1", "key1", "value2"));
+	mod_meta_db->endSave();
+}
+
+void TestModMetadataDatabase::testRecallChanged()
+{
+	ModMetadataDatabase *mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	StringMap recalled;
+	UASSERT(mod_meta_db->getModEntries("mod1", &recalled));
+	UASSERTEQ(size_t, recalled.size(), 2);
+	UASSERT(recalled["key1"] == "value2");
+}
+
+void TestModMetadataDatabase::testListMods()
+{
+	ModMetadataDatabase *mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	mod_meta_db->beginSave();
+	UASSERT(mod_meta_db->setModEntry("mod2", "key1", "value1"));
+	mod_meta_db->endSave();
+
+	mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	std::vector<std::string> mod_list;
+	mod_meta_db->listMods(&mod_list);
+	std::sort(mod_list.begin(), mod_list.end());
+	UASSERTEQ(size_t, mod_list.size(), 2);
+	UASSERT(mod_list[0] == "mod1");
+	UASSERT(mod_list[1] == "mod2");
+}
+
+void TestModMetadataDatabase::testRemove()
+{
+	ModMetadataDatabase *mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	mod_meta_db->beginSave();
+	UASSERT(mod_meta_db->removeModEntry("mod1", "key1"));
+	// Nothing to remove is not an error
+	UASSERT(mod_meta_db->removeModEntry("mod1", "nonexistent"));
+	UASSERT(mod_meta_db->removeModEntries("mod2"));
+	mod_meta_db->endSave();
+}
+
+void TestModMetadataDatabase::testRecallRemoved()
+{
+	ModMetadataDatabase *mod_meta_db = mod_meta_provider->getModMetadataDatabase();
+	StringMap recalled;
+	UASSERT(mod_meta_db->getModEntries("mod1", &recalled));
+	UASSERTEQ(size_t, recalled.size(), 1);
+	UASSERT(recalled[getKey()] == getValue());
+
+	recalled.clear();
+	UASSERT(mod_meta_db->getModEntries("mod2", &recalled));
+	UASSERT(recalled.empty());
+
+	std::vector<std::string> mod_list;
+	mod_meta_db->listMods(&mod_list);
+	UASSERTEQ(size_t, mod_list.size(), 1);
+	UASSERT(mod_list[0] == "mod1");
+
+	// Leave an empty database for the next run
+	mod_meta_db->beginSave();
+	mod_meta_db->removeModEntries("mod1");
+	mod_meta_db->endSave();
+}
+
+void TestModMetadataDatabase::testIncrementalSave()
+{
+	CountingDatabase db;
+	for (int i = 0; i < 1000; i++)
+		db.setModEntry("mod", "key" + itos(i), itos(i));
+	db.sets = 0;
+
+	ModMetadata meta("mod", &db);
+	meta.load();
+	UASSERTEQ(size_t, meta.size(), 1000);
+	UASSERT(!meta.isModified());
+
+	// Only the changed entries are written
+	meta.setString("key1", "changed");
+	meta.setString("key2", "2");
+	meta.setString("new", "value");
+	meta.removeString("key3");
+	UASSERT(meta.isModified());
+	UASSERT(meta.save());
+	UASSERTEQ(u32, db.sets, 2);
+	UASSERTEQ(u32, db.removes, 1);
+	UASSERTEQ(u32, db.clears, 0);
+	UASSERT(!meta.isModified());
+
+	StringMap stored;
+	db.getModEntries("mod", &stored);
+	UASSERT(stored == meta.getStrings());
+
+	// A cleared storage is removed once and only the new entries are written
+	db.sets = db.removes = 0;
+	meta.clear();
+	meta.setString("a", "b");
+	UASSERT(meta.save());
+	UASSERTEQ(u32, db.sets, 1);
+	UASSERTEQ(u32, db.removes, 0);
+	UASSERTEQ(u32, db.clears, 1);
+
+	stored.clear();
+	db.getModEntries("mod", &stored);
+	UASSERT(stored == meta.getStrings());
+
+	// Unsetting a key that was never stored, or one that was set and unset
+	// between two saves, is saved like any other change
+	meta.setString("never_stored", "");
+	meta.setString("short_lived", "x");
+	meta.setString("short_lived", "");
+	UASSERT(meta.isModified());
+	UASSERT(meta.save());
+	UASSERT(!meta.isModified());
+
+	// Failed writes are kept and retried by the next save
+	db.fail = true;
+	meta.setString("a", "c");
+	meta.setString("d", "e");
+	UASSERT(!meta.save());
+	UASSERT(meta.isModified());
+	meta.clear();
+	meta.setString("f", "g");
+	UASSERT(!meta.save());
+	UASSERT(meta.isModified());
+
+	db.fail = false;
+	db.sets = db.removes = db.clears = 0;
+	UASSERT(meta.save());
+	UASSERTEQ(u32, db.sets, 1);
+	UASSERTEQ(u32, db.removes, 0);
+	UASSERTEQ(u32, db.clears, 1);
+	UASSERT(!meta.isModified());
+
+	stored.clear();
+	db.getModEntries("mod", &stored);
+	UASSERT(stored == meta.getStrings());
+}
@@ -20,8 +20,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include <cmath>
+#include <cstring>
+#include <vector>
 #include "exceptions.h"
 #include "noise.h"
+#include "util/workerpool.h"
 
 class TestNoise : public TestBase {
 public:
@@ -34,6 +37,7 @@ class TestNoise : public TestBase {
 	void testNoise2dBulk();
 	void testNoise3dPoint();
 	void testNoise3dBulk();
+	void testNoise3dParallel();
 	void testNoiseInvalidParams();
 
 	static const float expected_2d_results[10 * 10];
@@ -48,6 +52,7 @@ void TestNoise::runTests(IGameDef *gamedef)
 	TEST(testNoise2dBulk);
 	TEST(testNoise3dPoint);
 	TEST(testNoise3dBulk);
+	TEST(testNoise3dParallel);
 	TEST(testNoiseInvalidParams);
 }
 
@@ -106,6 +111,36 @@ void TestNoise::testNoise3dBulk()
 	}
 }
 
+void TestNoise::testNoise3dParallel()
+{
+	// Like mapgen noise: chunk sized, eased, with a persistence map and
+	// absolute values
+	NoiseParams np_list[] = {
+		NoiseParams(0, 12, v3f(100, 60, 100), 5333, 5, 0.63, 2.0),
+		NoiseParams(0, 1, v3f(250, 350, 250), 5333, 5, 0.63, 2.0,
+			NOISE_FLAG_EASED),
+		NoiseParams(0.5, 1, v3f(61, 61, 61), 52534, 3, 0.5, 2.0,
+			NOISE_FLAG_EASED | NOISE_FLAG_ABSVALUE),
+	};
+	WorkerPool pool("TestNoise", 4);
+	const u32 size = 80 * 82 * 80;
+	std::vector<float> persist(size);
+	for (u32 i = 0; i != size; i++)
+		persist[i] = 0.3f + (i % 97) / 200.0f;
+
+	for (NoiseParams &np : np_list) {
+		Noise serial(&np, 42, 80, 82, 80);
+		Noise parallel(&np, 42, 80, 82, 80);
+		parallel.pool = &pool;
+
+		for (float *persistence_map : {(float *)nullptr, persist.data()}) {
+			float *expected = serial.perlinMap3D(-32, -33, 48, persistence_map);
+			float *result = parallel.perlinMap3D(-32, -33, 48, persistence_map);
+			UASSERT(memcmp(expected, result, size * sizeof(float)) == 0);
+		}
+	}
+}
+
 void TestNoise::testNoiseInvalidParams()
 {
 	bool exception_thrown = false;
@@ -0,0 +1,254 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "pathfinder.h"
+
+// Flat stone terrain with its surface at y = 0
+class TestPathMap : public Map
+{
+public:
+	TestPathMap(IGameDef *gamedef) : Map(gamedef)
+	{
+		for (s16 z = -1; z <= 1; z++)
+		for (s16 y = -1; y <= 1; y++)
+		for (s16 x = -1; x <= 10; x++)
+			createBlock(v3s16(x, y, z));
+	}
+
+	void createBlock(v3s16 bp)
+	{
+		v2s16 p2d(bp.X, bp.Z);
+		MapSector *sector = getSectorNoGenerate(p2d);
+		if (!sector) {
+			sector = new MapSector(this, p2d, m_gamedef);
+			m_sectors[p2d] = sector;
+		}
+		MapBlock *block = sector->createBlankBlock(bp.Y);
+		MapNode *data = block->getData();
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+			s16 world_y = bp.Y * MAP_BLOCKSIZE + y;
+			data[z * MapBlock::zstride + y * MapBlock::ystride + x] =
+				MapNode(world_y < 0 ? t_CONTENT_STONE : CONTENT_AIR);
+		}
+	}
+};
+
+class TestPathfinder : public TestBase
+{
+public:
+	TestPathfinder()
+	{
+		TestManager::registerTestModule(this);
+		TestManager::registerBenchmarkModule(this);
+	}
+	const char *getName() { return "TestPathfinder"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testStraightPath(Map *map, const NodeDefManager *ndef);
+	void testWall(Map *map, const NodeDefManager *ndef);
+	void testStep(Map *map, const NodeDefManager *ndef);
+	void testUnreachable(Map *map, const NodeDefManager *ndef);
+	void testNodeLimit(Map *map, const NodeDefManager *ndef);
+	void testWindingPath(Map *map, const NodeDefManager *ndef);
+
+	void benchWindingPath(Map *map, const NodeDefManager *ndef);
+};
+
+static TestPathfinder g_test_instance;
+
+void TestPathfinder::runTests(IGameDef *gamedef)
+{
+	const NodeDefManager *ndef = gamedef->getNodeDefManager();
+	TestPathMap map(gamedef);
+
+	TEST(testStraightPath, &map, ndef);
+	TEST(testWall, &map, ndef);
+	TEST(testStep, &map, ndef);
+	TEST(testUnreachable, &map, ndef);
+	TEST(testNodeLimit, &map, ndef);
+	TEST(testWindingPath, &map, ndef);
+}
+
+void TestPathfinder::runBenchmarks(IGameDef *gamedef)
+{
+	const NodeDefManager *ndef = gamedef->getNodeDefManager();
+	TestPathMap map(gamedef);
+
+	TEST(benchWindingPath, &map, ndef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static const PathAlgorithm algorithms[] = {PA_PLAIN_NP, PA_PLAIN, PA_DIJKSTRA};
+
+static void set_node(Map *map, v3s16 p, content_t c)
+{
+	MapNode n(c);
+	map->getBlockNoCreateNoEx(getNodeBlockPos(p))->setNode(
+		p - getNodeBlockPos(p) * MAP_BLOCKSIZE, n);
+}
+
+void TestPathfinder::testStraightPath(Map *map, const NodeDefManager *ndef)
+{
+	for (PathAlgorithm algo : algorithms) {
+		std::vector<v3s16> path = get_path(map, ndef,
+			v3s16(0, 0, 0), v3s16(10, 0, 0), 4, 1, 1, algo);
+		UASSERTEQ(size_t, path.size(), 11);
+		UASSERT(path.front() == v3s16(0, 0, 0));
+		UASSERT(path.back() == v3s16(10, 0, 0));
+	}
+}
+
+void TestPathfinder::testWall(Map *map, const NodeDefManager *ndef)
+{
+	// A wall from z = -3 to z = 3 that is too high to jump over
+	for (s16 z = -3; z <= 3; z++)
+	for (s16 y = 0; y <= 2; y++)
+		set_node(map, v3s16(5, y, z), t_CONTENT_STONE);
+
+	for (PathAlgorithm algo : algorithms) {
+		std::vector<v3s16> path = get_path(map, ndef,
+			v3s16(0, 0, 0), v3s16(10, 0, 0), 5, 1, 1, algo);
+		// 10 steps along x and 2 * 4 steps around the wall
+		UASSERTEQ(size_t, path.size(), 19);
+		for (v3s16 p : path)
+			UASSERT(p.X != 5 || p.Z < -3 || p.Z > 3);
+	}
+
+	for (s16 z = -3; z <= 3; z++)
+	for (s16 y = 0; y <= 2; y++)
+		set_node(map, v3s16(5, y, z), CONTENT_AIR);
+}
+
+void TestPathfinder::testStep(Map *map, const NodeDefManager *ndef)
+{
+	// A one node high step is climbed rather than walked around
+	for (s16 z = -8; z <= 8; z++)
+		set_node(map, v3s16(5, 0, z), t_CONTENT_STONE);
+
+	for (PathAlgorithm algo : algorithms) {
+		std::vector<v3s16> path = get_path(map, ndef,
+			v3s16(0, 0, 0), v3s16(10, 0, 0), 3, 1, 1, algo);
+		UASSERTEQ(size_t, path.size(), 11);
+		UASSERT(path[5] == v3s16(5, 1, 0));
+	}
+
+	for (s16 z = -8; z <= 8; z++)
+		set_node(map, v3s16(5, 0, z), CONTENT_AIR);
+}
+
+void TestPathfinder::testUnreachable(Map *map, const NodeDefManager *ndef)
+{
+	// Destination buried in stone
+	UASSERT(get_path(map, ndef, v3s16(0, 0, 0), v3s16(10, -1, 0),
+		4, 1, 1, PA_PLAIN).empty());
+
+	// Destination enclosed by walls
+	for (s16 d = -1; d <= 1; d++) {
+		set_node(map, v3s16(9, 1, d), t_CONTENT_STONE);
+		set_node(map, v3s16(11, 1, d), t_CONTENT_STONE);
+		set_node(map, v3s16(d + 10, 1, -1), t_CONTENT_STONE);
+		set_node(map, v3s16(d + 10, 1, 1), t_CONTENT_STONE);
+		set_node(map, v3s16(9, 0, d), t_CONTENT_STONE);
+		set_node(map, v3s16(11, 0, d), t_CONTENT_STONE);
+		set_node(map, v3s16(d + 10, 0, -1), t_CONTENT_STONE);
+		set_node(map, v3s16(d + 10, 0, 1), t_CONTENT_STONE);
+	}
+	for (PathAlgorithm algo : algorithms) {
+		UASSERT(get_path(map, ndef, v3s16(0, 0, 0), v3s16(10, 0, 0),
+			4, 1, 1, algo).empty());
+	}
+	for (s16 d = -1; d <= 1; d++)
+	for (s16 y = 0; y <= 1; y++) {
+		set_node(map, v3s16(9, y, d), CONTENT_AIR);
+		set_node(map, v3s16(11, y, d), CONTENT_AIR);
+		set_node(map, v3s16(d + 10, y, -1), CONTENT_AIR);
+		set_node(map, v3s16(d + 10, y, 1), CONTENT_AIR);
+	}
+}
+
+void TestPathfinder::testNodeLimit(Map *map, const NodeDefManager *ndef)
+{
+	// A straight path visits one node per step
+	UASSERT(get_path(map, ndef, v3s16(0, 0, 0), v3s16(20, 0, 0),
+		4, 1, 1, PA_PLAIN, 10).empty());
+	UASSERT(!get_path(map, ndef, v3s16(0, 0, 0), v3s16(20, 0, 0),
+		4, 1, 1, PA_PLAIN, 100).empty());
+}
+
+// Rows of walls with alternating gaps force the search to wind around
+static void set_winding_walls(Map *map)
+{
+	for (s16 x = 4; x < 150; x += 8)
+	for (s16 z = -12; z <= 12; z++) {
+		if ((x / 8) % 2 == 0 ? z > 10 : z < -10)
+			continue;
+		set_node(map, v3s16(x, 0, z), t_CONTENT_STONE);
+		set_node(map, v3s16(x, 1, z), t_CONTENT_STONE);
+	}
+}
+
+static const s16 winding_lengths[] = {16, 64, 150};
+
+void TestPathfinder::testWindingPath(Map *map, const NodeDefManager *ndef)
+{
+	set_winding_walls(map);
+
+	for (s16 length : winding_lengths)
+	for (PathAlgorithm algo : algorithms) {
+		size_t path_size = get_path(map, ndef, v3s16(0, 0, 0),
+			v3s16(length, 0, 0), 12, 1, 1, algo).size();
+		UASSERT(path_size > (size_t)length);
+	}
+}
+
+void TestPathfinder::benchWindingPath(Map *map, const NodeDefManager *ndef)
+{
+	set_winding_walls(map);
+
+	const u32 runs = 20;
+	for (s16 length : winding_lengths) {
+		rawstream << "    length " << length << ":";
+		for (PathAlgorithm algo : algorithms) {
+			size_t path_size = 0;
+			u64 t = porting::getTimeUs();
+			for (u32 i = 0; i < runs; i++) {
+				path_size = get_path(map, ndef, v3s16(0, 0, 0),
+					v3s16(length, 0, 0), 12, 1, 1, algo).size();
+			}
+			t = porting::getTimeUs() - t;
+			UASSERT(path_size > (size_t)length);
+
+			const char *name = algo == PA_PLAIN_NP ? "A*_noprefetch" :
+				algo == PA_PLAIN ? "A*" : "Dijkstra";
+			rawstream << " " << name << " " << (t / runs) << "us";
+		}
+		rawstream << std::endl;
+	}
+}
@@ -19,9 +19,39 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "test.h"
 
+#include <algorithm>
 #include "exceptions.h"
+#include "filesys.h"
 #include "remoteplayer.h"
 #include "server.h"
+#include "database/database-dummy.h"
+#include "database/database-files.h"
+#include "database/database-sqlite3.h"
+#include "database/database-writer.h"
+#include "server/player_sao.h"
+
+namespace
+{
+// Fails the first failures saves and records the players of the others
+class FailingDatabase : public Database_Dummy
+{
+public:
+	FailingDatabase(u32 failures = U32_MAX) : failures(failures) {}
+
+	void savePlayers(const std::vector<PlayerSaveData> &players)
+	{
+		if (failures > 0) {
+			failures--;
+			throw DatabaseException("test failure");
+		}
+		for (const PlayerSaveData &player : players)
+			saved.push_back(player.name);
+	}
+
+	u32 failures;
+	std::vector<std::string> saved;
+};
+}
 
 class TestPlayer : public TestBase
 {
@@ -30,10 +60,204 @@ class TestPlayer : public TestBase
 	const char *getName() { return "TestPlayer"; }
 
 	void runTests(IGameDef *gamedef);
+
+	void testSaveFlags(IGameDef *gamedef);
+	void testIncrementalSave(IGameDef *gamedef);
+	void testWriterError(IGameDef *gamedef);
+	void testWriterErrorKeepsBatch();
+
+private:
+	void checkIncrementalSave(IGameDef *gamedef, PlayerDatabase *backend);
 };
 
 static TestPlayer g_test_instance;
 
 void TestPlayer::runTests(IGameDef *gamedef)
 {
+	TEST(testSaveFlags, gamedef);
+	TEST(testIncrementalSave, gamedef);
+	TEST(testWriterError, gamedef);
+	TEST(testWriterErrorKeepsBatch);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestPlayer::testSaveFlags(IGameDef *gamedef)
+{
+	IItemDefManager *idef = gamedef->idef();
+	RemotePlayer player("flags", idef);
+	PlayerSAO sao(nullptr, &player, 15000, false);
+	sao.finalize(&player, std::set<std::string>());
+	player.setPlayerSAO(&sao);
+
+	// A new player is written whole
+	PlayerSaveData data;
+	player.makeSaveData(&data, false);
+	UASSERT(data.name == "flags");
+	UASSERT(data.lists_unsaved);
+
+	player.makeSaveData(&data, false);
+	UASSERT(!data.lists_unsaved);
+	UASSERT(!data.meta_unsaved);
+	UASSERTEQ(size_t, data.unsaved_lists.size(), 4);
+	for (bool unsaved : data.unsaved_lists)
+		UASSERT(!unsaved);
+
+	// Sending the inventory to the client doesn't count as saving it
+	player.inventory.getList("craft")->changeItem(0,
+		ItemStack("default:stone", 1, 0, idef));
+	player.inventory.setModified(false);
+	sao.getMeta().setString("key", "value");
+	player.makeSaveData(&data, false);
+	UASSERT(!data.lists_unsaved);
+	UASSERT(!data.unsaved_lists[0]);
+	UASSERT(data.unsaved_lists[1]);
+	UASSERT(!data.unsaved_lists[2]);
+	UASSERT(data.meta_unsaved);
+	UASSERT(data.meta["key"] == "value");
+	UASSERT(data.inventory == player.inventory);
+
+	// Adding lists and forced saves write everything
+	player.inventory.addList("bag", 4);
+	player.makeSaveData(&data, false);
+	UASSERT(data.lists_unsaved);
+	UASSERT(!data.meta_unsaved);
+
+	player.makeSaveData(&data, true);
+	UASSERT(data.lists_unsaved);
+	UASSERT(data.meta_unsaved);
+
+	player.setPlayerSAO(nullptr);
+}
+
+void TestPlayer::testIncrementalSave(IGameDef *gamedef)
+{
+	std::string test_dir = getTestTempDirectory();
+
+	fs::DeleteSingleFileOrEmptyDirectory(test_dir + DIR_DELIM "players.sqlite");
+	checkIncrementalSave(gamedef, new PlayerDatabaseSQLite3(test_dir));
+
+	fs::RecursiveDelete(test_dir + DIR_DELIM "players");
+	checkIncrementalSave(gamedef, new PlayerDatabaseFiles(test_dir + DIR_DELIM "players"));
+}
+
+void TestPlayer::checkIncrementalSave(IGameDef *gamedef, PlayerDatabase *backend)
+{
+	IItemDefManager *idef = gamedef->idef();
+	PlayerDatabaseWriter db(backend);
+
+	RemotePlayer player("saved", idef);
+	PlayerSAO sao(nullptr, &player, 15000, false);
+	sao.finalize(&player, std::set<std::string>());
+	player.setPlayerSAO(&sao);
+
+	sao.setBasePosition(v3f(1.0f, 2.0f, 3.0f));
+	player.inventory.getList("main")->changeItem(3,
+		ItemStack("default:dirt_with_grass", 12, 0, idef));
+	sao.getMeta().setString("a", "1");
+
+	std::vector<PlayerSaveData> players(1);
+	player.makeSaveData(&players[0], false);
+	db.savePlayers(players);
+
+	// Only the changed list is written
+	player.inventory.getList("main")->changeItem(5,
+		ItemStack("default:torch", 99, 0, idef));
+	players[0] = PlayerSaveData();
+	player.makeSaveData(&players[0], false);
+	UASSERT(!players[0].lists_unsaved);
+	UASSERT(players[0].unsaved_lists[0]);
+	UASSERT(!players[0].unsaved_lists[1]);
+	UASSERT(!players[0].meta_unsaved);
+	db.savePlayers(players);
+
+	// Only the metadata is written
+	sao.getMeta().setString("b", "2");
+	players[0] = PlayerSaveData();
+	player.makeSaveData(&players[0], false);
+	db.savePlayers(players);
+
+	// Loading waits for the queued saves
+	RemotePlayer loaded("saved", idef);
+	PlayerSAO loaded_sao(nullptr, &loaded, 15000, false);
+	loaded_sao.finalize(&loaded, std::set<std::string>());
+	UASSERT(db.loadPlayer(&loaded, &loaded_sao));
+	UASSERT(loaded.inventory == player.inventory);
+	UASSERT(loaded_sao.getMeta().getStrings() == sao.getMeta().getStrings());
+	UASSERT(loaded_sao.getBasePosition() == sao.getBasePosition());
+
+	std::vector<std::string> names;
+	db.listPlayers(names);
+	UASSERTEQ(size_t, names.size(), 1);
+	UASSERT(db.removePlayer("saved"));
+
+	player.setPlayerSAO(nullptr);
+}
+
+void TestPlayer::testWriterError(IGameDef *gamedef)
+{
+	RemotePlayer player("failing", gamedef->idef());
+	PlayerSAO sao(nullptr, &player, 15000, false);
+	sao.finalize(&player, std::set<std::string>());
+	player.setPlayerSAO(&sao);
+
+	PlayerDatabaseWriter db(new FailingDatabase());
+	std::vector<PlayerSaveData> players(1);
+	player.makeSaveData(&players[0], false);
+	UASSERT(!player.checkModified());
+
+	// The error is thrown on this thread, once
+	db.savePlayers(players);
+	EXCEPTION_CHECK(DatabaseException, db.flush());
+	db.flush();
+
+	// The failed player is written whole by the next save
+	std::vector<std::string> failed = db.takeFailedPlayers();
+	UASSERTEQ(size_t, failed.size(), 1);
+	UASSERT(failed[0] == "failing");
+	UASSERT(db.takeFailedPlayers().empty());
+	player.onFailedSave();
+	UASSERT(player.checkModified());
+	players[0] = PlayerSaveData();
+	player.makeSaveData(&players[0], false);
+	UASSERT(players[0].lists_unsaved);
+	UASSERT(players[0].meta_unsaved);
+
+	player.setPlayerSAO(nullptr);
+}
+
+void TestPlayer::testWriterErrorKeepsBatch()
+{
+	FailingDatabase *backend = new FailingDatabase(1);
+	PlayerDatabaseWriter db(backend);
+	std::vector<PlayerSaveData> first(1), second(1);
+	first[0].name = "first";
+	second[0].name = "second";
+
+	db.savePlayers(first);
+	// Give the thread time to fail the first batch
+	sleep_ms(50);
+
+	// The error is thrown once, by either call
+	u32 errors = 0;
+	try {
+		db.savePlayers(second);
+	} catch (DatabaseException &e) {
+		errors++;
+	}
+	try {
+		db.flush();
+	} catch (DatabaseException &e) {
+		errors++;
+	}
+	UASSERTEQ(u32, errors, 1);
+
+	// The second batch is either written or reported as failed
+	auto contains = [] (const std::vector<std::string> &names,
+			const std::string &name) {
+		return std::find(names.begin(), names.end(), name) != names.end();
+	};
+	std::vector<std::string> failed = db.takeFailedPlayers();
+	UASSERT(contains(failed, "first"));
+	UASSERT(contains(backend->saved, "second") || contains(failed, "second"));
 }
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <cmath>
 #include "util/enriched_string.h"
 #include "util/numeric.h"
+#include "util/rectmerge.h"
 #include "util/string.h"
 
 class TestUtilities : public TestBase {
@@ -56,6 +57,7 @@ class TestUtilities : public TestBase {
 	void testMyround();
 	void testStringJoin();
 	void testEulerConversion();
+	void testMergeRectangles();
 };
 
 static TestUtilities g_test_instance;
@@ -87,6 +89,7 @@ void TestUtilities::runTests(IGameDef *gamedef)
 	TEST(testMyround);
 	TEST(testStringJoin);
 	TEST(testEulerConversion);
+	TEST(testMergeRectangles);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -528,3 +531,37 @@ void TestUtilities::testEulerConversion()
 	setPitchYawRoll(m2, v2);
 	UASSERT(within(m1, m2, tolL));
 }
+
+void TestUtilities::testMergeRectangles()
+{
+	// 0 is empty, other cells merge with equal cells
+	const u8 grid[] = {
+		1, 1, 1, 0,
+		1, 1, 1, 2,
+		1, 1, 3, 2,
+		0, 1, 1, 2,
+	};
+	std::vector<u8> covered(16, 0);
+	std::vector<v3s16> rects;
+	mergeRectangles(4, 4,
+		[&grid] (u32 first, u32 cell) {
+			return grid[cell] != 0 && grid[cell] == grid[first];
+		},
+		[&] (u16 x, u16 y, u16 w, u16 h) {
+			for (u16 j = y; j < y + h; j++)
+			for (u16 i = x; i < x + w; i++)
+				covered[j * 4 + i]++;
+			rects.emplace_back(x, y, w * 10 + h);
+		});
+
+	// Every non-empty cell is covered exactly once
+	for (u32 i = 0; i < 16; i++)
+		UASSERTEQ(int, covered[i], grid[i] ? 1 : 0);
+
+	UASSERTEQ(size_t, rects.size(), 5);
+	UASSERT(rects[0] == v3s16(0, 0, 32)); // 3 wide, 2 high
+	UASSERT(rects[1] == v3s16(3, 1, 13)); // 1 wide, 3 high
+	UASSERT(rects[2] == v3s16(0, 2, 21));
+	UASSERT(rects[3] == v3s16(2, 2, 11));
+	UASSERT(rects[4] == v3s16(1, 3, 21));
+}
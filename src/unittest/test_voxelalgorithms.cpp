@@ -20,17 +20,62 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "nodedef.h"
 #include "voxelalgorithms.h"
 #include "util/numeric.h"
 
+// Sunlit air above flat stone terrain with its surface at y = 0
+class TestLightMap : public Map
+{
+public:
+	TestLightMap(IGameDef *gamedef) : Map(gamedef)
+	{
+		for (s16 z = -2; z <= 1; z++)
+		for (s16 y = -1; y <= 1; y++)
+		for (s16 x = -2; x <= 1; x++)
+			createBlock(v3s16(x, y, z));
+	}
+
+	void createBlock(v3s16 bp)
+	{
+		v2s16 p2d(bp.X, bp.Z);
+		MapSector *sector = getSectorNoGenerate(p2d);
+		if (!sector) {
+			sector = new MapSector(this, p2d, m_gamedef);
+			m_sectors[p2d] = sector;
+		}
+		MapBlock *block = sector->createBlankBlock(bp.Y);
+		MapNode *data = block->getData();
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+			s16 world_y = bp.Y * MAP_BLOCKSIZE + y;
+			MapNode n(world_y < 0 ? t_CONTENT_STONE : CONTENT_AIR);
+			n.setLight(LIGHTBANK_DAY, world_y < 0 ? 0 : LIGHT_SUN, m_nodedef);
+			data[z * MapBlock::zstride + y * MapBlock::ystride + x] = n;
+		}
+	}
+};
+
 class TestVoxelAlgorithms : public TestBase {
 public:
-	TestVoxelAlgorithms() { TestManager::registerTestModule(this); }
+	TestVoxelAlgorithms()
+	{
+		TestManager::registerTestModule(this);
+		TestManager::registerBenchmarkModule(this);
+	}
 	const char *getName() { return "TestVoxelAlgorithms"; }
 
 	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
 
 	void testVoxelLineIterator(const NodeDefManager *ndef);
+	void testLightingBatch(IGameDef *gamedef);
+
+	void benchLightingBatch(IGameDef *gamedef);
 };
 
 static TestVoxelAlgorithms g_test_instance;
@@ -40,6 +85,12 @@ void TestVoxelAlgorithms::runTests(IGameDef *gamedef)
 	const NodeDefManager *ndef = gamedef->getNodeDefManager();
 
 	TEST(testVoxelLineIterator, ndef);
+	TEST(testLightingBatch, gamedef);
+}
+
+void TestVoxelAlgorithms::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchLightingBatch, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -99,3 +150,71 @@ void TestVoxelAlgorithms::testVoxelLineIterator(const NodeDefManager *ndef)
 		UASSERTEQ(int, actual_nodecount, nodecount);
 	}
 }
+
+// A stone roof with a torch below it
+static void build_shelter(Map *map)
+{
+	std::map<v3s16, MapBlock *> modified_blocks;
+	for (s16 z = -6; z <= 6; z++)
+	for (s16 x = -6; x <= 6; x++)
+		map->addNodeAndUpdate(v3s16(x, 4, z), MapNode(t_CONTENT_STONE),
+			modified_blocks);
+	map->addNodeAndUpdate(v3s16(0, 0, 0), MapNode(t_CONTENT_TORCH),
+		modified_blocks);
+	map->removeNodeAndUpdate(v3s16(6, 4, 6), modified_blocks);
+}
+
+void TestVoxelAlgorithms::testLightingBatch(IGameDef *gamedef)
+{
+	const NodeDefManager *ndef = gamedef->getNodeDefManager();
+	TestLightMap single(gamedef);
+	TestLightMap batched(gamedef);
+
+	build_shelter(&single);
+	{
+		MapLightingBatch lighting(&batched);
+		build_shelter(&batched);
+		// The light is updated when the batch ends
+		UASSERTEQ(u8, batched.getNode(v3s16(0, 3, 0)).getLight(LIGHTBANK_DAY, ndef),
+			LIGHT_SUN);
+	}
+
+	// Shade below the roof, sunlight through the hole in its corner
+	UASSERT(single.getNode(v3s16(0, 3, 0)).getLight(LIGHTBANK_DAY, ndef) < LIGHT_SUN);
+	UASSERTEQ(u8, single.getNode(v3s16(6, 3, 6)).getLight(LIGHTBANK_DAY, ndef),
+		LIGHT_SUN);
+	UASSERTEQ(u8, single.getNode(v3s16(1, 0, 0)).getLight(LIGHTBANK_NIGHT, ndef),
+		ndef->get(t_CONTENT_TORCH).light_source - 1);
+
+	for (s16 z = -32; z < 32; z++)
+	for (s16 y = -16; y < 32; y++)
+	for (s16 x = -32; x < 32; x++) {
+		v3s16 p(x, y, z);
+		UASSERT(single.getNode(p) == batched.getNode(p));
+	}
+}
+
+void TestVoxelAlgorithms::benchLightingBatch(IGameDef *gamedef)
+{
+	// Build a 64x64x3 roof (12288 nodes) over the sunlit terrain and
+	// remove it again
+	for (bool batch : {false, true}) {
+		TestLightMap map(gamedef);
+		std::map<v3s16, MapBlock *> modified_blocks;
+		u64 t = porting::getTimeUs();
+		for (content_t c : {t_CONTENT_STONE, (content_t)CONTENT_AIR}) {
+			if (batch)
+				map.beginLightingBatch();
+			for (s16 z = -32; z < 32; z++)
+			for (s16 y = 20; y < 23; y++)
+			for (s16 x = -32; x < 32; x++)
+				map.addNodeAndUpdate(v3s16(x, y, z), MapNode(c), modified_blocks);
+			if (batch)
+				map.endLightingBatch();
+		}
+		t = porting::getTimeUs() - t;
+
+		rawstream << "    " << (batch ? "batched" : "node by node") << ": "
+			<< t / 1000 << "ms for 2 x 12288 nodes" << std::endl;
+	}
+}
@@ -0,0 +1,146 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <atomic>
+#include <thread>
+#include "util/workerpool.h"
+
+class TestWorkerPool : public TestBase
+{
+public:
+	TestWorkerPool() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestWorkerPool"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testParallelFor(u32 thread_count);
+	void testRepeatedLoops();
+	void testSharedPool();
+	void testException();
+};
+
+static TestWorkerPool g_test_instance;
+
+void TestWorkerPool::runTests(IGameDef *gamedef)
+{
+	TEST(testParallelFor, 1);
+	TEST(testParallelFor, 4);
+	TEST(testRepeatedLoops);
+	TEST(testSharedPool);
+	TEST(testException);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestWorkerPool::testParallelFor(u32 thread_count)
+{
+	WorkerPool pool("TestPool", thread_count);
+	UASSERTEQ(u32, pool.getThreadCount(), thread_count);
+
+	for (u32 count : {0, 1, 7, 1000}) {
+		std::vector<std::atomic<u32>> visits(count);
+		for (auto &v : visits)
+			v = 0;
+		pool.parallelFor(count, [&visits] (u32 i) {
+			visits[i]++;
+		});
+		for (auto &v : visits)
+			UASSERTEQ(u32, v, 1);
+	}
+}
+
+void TestWorkerPool::testRepeatedLoops()
+{
+	// Every loop has to be finished before parallelFor returns
+	WorkerPool pool("TestPool", 3);
+	std::vector<u32> values(100, 0);
+	for (u32 n = 1; n <= 50; n++) {
+		pool.parallelFor(values.size(), [&values] (u32 i) {
+			values[i]++;
+		});
+		for (u32 v : values)
+			UASSERTEQ(u32, v, n);
+	}
+}
+
+void TestWorkerPool::testSharedPool()
+{
+	// Loops of other threads and nested loops run while the pool is busy
+	WorkerPool pool("TestPool", 3);
+	std::vector<u32> values_a(100, 0), values_b(100, 0);
+	std::vector<std::atomic<u32>> nested(100);
+	for (auto &v : nested)
+		v = 0;
+
+	std::thread other([&pool, &values_b] () {
+		for (u32 n = 0; n < 50; n++) {
+			pool.parallelFor(values_b.size(), [&values_b] (u32 i) {
+				values_b[i]++;
+			});
+		}
+	});
+	for (u32 n = 0; n < 50; n++) {
+		pool.parallelFor(values_a.size(), [&] (u32 i) {
+			values_a[i]++;
+			if (n == 0) {
+				pool.parallelFor(10, [&nested, i] (u32 j) {
+					nested[i]++;
+				});
+			}
+		});
+	}
+	other.join();
+
+	for (u32 v : values_a)
+		UASSERTEQ(u32, v, 50);
+	for (u32 v : values_b)
+		UASSERTEQ(u32, v, 50);
+	for (auto &v : nested)
+		UASSERTEQ(u32, v, 10);
+}
+
+void TestWorkerPool::testException()
+{
+	// Throw on every thread, including the calling one
+	WorkerPool pool("TestPool", 4);
+	for (int n = 0; n < 10; n++) {
+		bool caught = false;
+		try {
+			pool.parallelFor(1000, [] (u32 i) {
+				if (i % 100 == 0)
+					throw BaseException("thrown by the loop");
+			});
+		} catch (BaseException &e) {
+			caught = true;
+		}
+		UASSERT(caught);
+	}
+
+	// The pool is free for the next loop
+	std::vector<std::atomic<u32>> visits(1000);
+	for (auto &v : visits)
+		v = 0;
+	pool.parallelFor(visits.size(), [&visits] (u32 i) {
+		visits[i]++;
+	});
+	for (auto &v : visits)
+		UASSERTEQ(u32, v, 1);
+}
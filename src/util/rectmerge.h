@@ -0,0 +1,68 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <vector>
+#include "irrlichttypes.h"
+
+/*
+	Covers the cells of a width x height grid, stored row by row, with
+	rectangles of cells that can be merged. This is greedy: a rectangle
+	starts at the first uncovered cell in row order, grows along its row and
+	then over the following rows for as long as its whole width fits.
+
+	mergeable(first, cell) tells whether the cell can join the rectangle
+	starting at the cell first. If mergeable(cell, cell) is false, the cell
+	is empty and not covered at all.
+	emit(x, y, w, h) is called for every rectangle.
+*/
+template <typename Mergeable, typename Emit>
+void mergeRectangles(u16 width, u16 height, Mergeable mergeable, Emit emit)
+{
+	std::vector<bool> covered(width * height, false);
+
+	for (u16 y = 0; y < height; y++)
+	for (u16 x = 0; x < width; x++) {
+		u32 first = y * width + x;
+		if (covered[first] || !mergeable(first, first))
+			continue;
+
+		u16 w = 1;
+		while (x + w < width && !covered[first + w] &&
+				mergeable(first, first + w))
+			w++;
+
+		u16 h = 1;
+		for (; y + h < height; h++) {
+			u32 row = first + h * width;
+			u16 i = 0;
+			while (i < w && !covered[row + i] && mergeable(first, row + i))
+				i++;
+			if (i < w)
+				break;
+		}
+
+		for (u16 j = 0; j < h; j++)
+		for (u16 i = 0; i < w; i++)
+			covered[first + j * width + i] = true;
+
+		emit(x, y, w, h);
+	}
+}
@@ -0,0 +1,137 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "workerpool.h"
+#include "threading/mutex_auto_lock.h"
+#include "threading/thread.h"
+#include "log.h"
+#include "porting.h"
+
+// Every thread takes about this many chunks of a loop, to balance uneven work
+#define CHUNKS_PER_THREAD 8
+
+class WorkerPoolThread : public Thread
+{
+public:
+	WorkerPoolThread(WorkerPool *pool, const std::string &name) :
+		Thread(name),
+		m_pool(pool)
+	{
+	}
+
+	void *run()
+	{
+		BEGIN_DEBUG_EXCEPTION_HANDLER
+
+		while (true) {
+			m_pool->m_start.wait();
+			if (stopRequested())
+				break;
+			m_pool->work();
+			m_pool->m_done.post();
+		}
+
+		END_DEBUG_EXCEPTION_HANDLER
+
+		return nullptr;
+	}
+
+private:
+	WorkerPool *m_pool;
+};
+
+WorkerPool::WorkerPool(const std::string &name, u32 thread_count) :
+	m_next(0),
+	m_busy(false)
+{
+	for (u32 i = 1; i < thread_count; i++) {
+		WorkerPoolThread *thread = new WorkerPoolThread(this,
+			name + std::to_string(i));
+		if (!thread->start()) {
+			errorstream << "WorkerPool: Failed to start thread " << name << i
+				<< std::endl;
+			delete thread;
+			break;
+		}
+		m_threads.push_back(thread);
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	for (WorkerPoolThread *thread : m_threads)
+		thread->stop();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_start.post();
+	for (WorkerPoolThread *thread : m_threads) {
+		thread->wait();
+		delete thread;
+	}
+}
+
+void WorkerPool::parallelFor(u32 count, const std::function<void(u32)> &f)
+{
+	if (m_threads.empty() || count < 2 || m_busy.exchange(true)) {
+		for (u32 i = 0; i < count; i++)
+			f(i);
+		return;
+	}
+
+	m_job = &f;
+	m_count = count;
+	m_chunk_size = MYMAX(1, count / (getThreadCount() * CHUNKS_PER_THREAD));
+	m_next = 0;
+	m_exception = nullptr;
+
+	// work() catches the exceptions of every thread, so the job stays valid
+	// until all threads are done with it
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_start.post();
+	work();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_done.wait();
+
+	m_job = nullptr;
+	std::exception_ptr exception = m_exception;
+	m_exception = nullptr;
+	m_busy = false;
+
+	if (exception)
+		std::rethrow_exception(exception);
+}
+
+void WorkerPool::work()
+{
+	try {
+		while (true) {
+			u32 begin = m_next.fetch_add(m_chunk_size);
+			if (begin >= m_count)
+				break;
+			u32 end = MYMIN(begin + m_chunk_size, m_count);
+			for (u32 i = begin; i < end; i++)
+				(*m_job)(i);
+		}
+	} catch (...) {
+		// Skip the indices nobody took yet
+		m_next = m_count;
+		MutexAutoLock lock(m_exception_mutex);
+		if (!m_exception)
+			m_exception = std::current_exception();
+	}
+}
@@ -0,0 +1,82 @@
+/*
+Minetest
+Copyright (C) 2020 Minetest core developers
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "irrlichttypes.h"
+#include "threading/semaphore.h"
+#include "util/basic_macros.h"
+
+class WorkerPoolThread;
+
+/*
+	A fixed set of threads for running loops in parallel.
+
+	parallelFor() splits the index range over the worker threads and the
+	calling thread and returns once every index was processed. Which thread
+	processes an index is unspecified, so the loop body must only write
+	data belonging to its own index. If the loop body throws, the remaining
+	indices are skipped and the first exception is rethrown by parallelFor()
+	once every thread has stopped.
+
+	Several threads may share a pool. A loop started while the pool is busy
+	with another one, including from within a loop body, runs on the calling
+	thread only.
+*/
+class WorkerPool
+{
+public:
+	// Starts thread_count - 1 threads; the calling thread is the last one
+	WorkerPool(const std::string &name, u32 thread_count);
+	~WorkerPool();
+
+	DISABLE_CLASS_COPY(WorkerPool)
+
+	u32 getThreadCount() const { return m_threads.size() + 1; }
+
+	// Calls f(i) for every i in [0, count)
+	void parallelFor(u32 count, const std::function<void(u32)> &f);
+
+private:
+	friend class WorkerPoolThread;
+
+	// Processes indices of the current loop until none are left or the loop
+	// body threw
+	void work();
+
+	std::vector<WorkerPoolThread *> m_threads;
+	Semaphore m_start;
+	Semaphore m_done;
+
+	// The current loop
+	const std::function<void(u32)> *m_job = nullptr;
+	u32 m_count = 0;
+	u32 m_chunk_size = 1;
+	std::atomic<u32> m_next;
+	std::atomic<bool> m_busy;
+	// First exception thrown by the current loop
+	std::exception_ptr m_exception;
+	std::mutex m_exception_mutex;
+};
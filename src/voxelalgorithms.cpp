@@ -97,6 +97,18 @@ struct LightQueue {
 		}
 	}
 
+	/*!
+	 * Empties the queue, but keeps the memory of the buckets
+	 * for the next use.
+	 */
+	void clear()
+	{
+		max_light = LIGHT_SUN;
+		for (u8 i = 0; i <= LIGHT_SUN; i++) {
+			lights[i].clear();
+		}
+	}
+
 	/*!
 	 * Returns the next brightest ChangingLight and
 	 * removes it from the queue.
@@ -473,11 +485,15 @@ void update_lighting_nodes(Map *map,
 	const NodeDefManager *ndef = map->getNodeDefManager();
 	// For node getter functions
 	bool is_valid_position;
+	// Allocating the buckets costs more than updating a few nodes,
+	// so every thread keeps its queues
+	static thread_local UnlightQueue disappearing_lights(256);
+	static thread_local ReLightQueue light_sources(256);
 
 	// Process each light bank separately
 	for (LightBank bank : banks) {
-		UnlightQueue disappearing_lights(256);
-		ReLightQueue light_sources(256);
+		disappearing_lights.clear();
+		light_sources.clear();
 		// Nodes that are brighter than the brightest modified node was
 		// won't change, since they didn't get their light from a
 		// modified node.
@@ -38,6 +38,9 @@ namespace voxalgo
  * Before calling this procedure make sure that all new nodes on
  * the map have zero light level!
  *
+ * All nodes are updated in one pass per light bank, so a batch of
+ * changes is much cheaper than updating them one by one.
+ *
  * \param oldnodes contains the MapNodes that were replaced by the new
  * MapNodes and their positions
  * \param modified_blocks output, contains all map blocks that